@@ -67,6 +67,9 @@ public:
     iter = parsed_options.find("cob_style");
     gen_cob_style_ = (iter != parsed_options.end());
 
+    iter = parsed_options.find("futures");
+    gen_futures_ = (iter != parsed_options.end());
+
     iter = parsed_options.find("no_client_completion");
     gen_no_client_completion_ = (iter != parsed_options.end());
 
@@ -137,6 +140,7 @@ public:
   void generate_struct_writer(std::ofstream& out, t_struct* tstruct, bool pointers = false);
   void generate_struct_result_writer(std::ofstream& out, t_struct* tstruct, bool pointers = false);
   void generate_struct_swap(std::ofstream& out, t_struct* tstruct);
+  void generate_lazy_field_helpers(std::ofstream& out, t_struct* tstruct);
   void generate_struct_ostream_operator(std::ofstream& out, t_struct* tstruct);
 
   /**
@@ -149,6 +153,7 @@ public:
   void generate_service_multiface(t_service* tservice);
   void generate_service_helpers(t_service* tservice);
   void generate_service_client(t_service* tservice, string style);
+  void generate_service_future_client(t_service* tservice);
   void generate_service_processor(t_service* tservice, string style);
   void generate_service_skeleton(t_service* tservice);
   void generate_process_function(t_service* tservice,
@@ -202,6 +207,8 @@ public:
 
   void generate_serialize_list_element(std::ofstream& out, t_list* tlist, std::string iter);
 
+  std::string list_array_type(t_list* tlist);
+
   void generate_function_call(ostream& out,
                               t_function* tfunction,
                               string target,
@@ -228,6 +235,8 @@ public:
   std::string cob_function_signature(t_function* tfunction,
                                      std::string prefix = "",
                                      bool name_params = true);
+  std::string future_function_signature(t_function* tfunction, std::string prefix = "");
+  std::string future_decoder_signature(t_function* tfunction, std::string prefix = "");
   std::string argument_list(t_struct* tstruct, bool name_params = true, bool start_comma = false);
   std::string type_to_enum(t_type* ttype);
   std::string local_reflection_name(const char*, t_type* ttype, bool external = false);
@@ -246,6 +255,19 @@ public:
 
   bool is_reference(t_field* tfield) { return tfield->get_reference(); }
 
+  /**
+   * True iff the field is a struct or container annotated with cpp.lazy,
+   * which is declared as apache::thrift::TLazy<T>. Dense structs are laid
+   * out for TDenseProtocol's reflection and never lazy.
+   */
+  bool is_lazy(t_field* tfield) {
+    if (gen_dense_ || is_reference(tfield) || tfield->annotations_.count("cpp.lazy") == 0) {
+      return false;
+    }
+    t_type* ttype = get_true_type(tfield->get_type());
+    return ttype->is_struct() || ttype->is_xception() || ttype->is_container();
+  }
+
   bool is_complex_type(t_type* ttype) {
     ttype = get_true_type(ttype);
 
@@ -300,6 +322,11 @@ private:
    */
   bool gen_cob_style_;
 
+  /**
+   * True if we should generate clients returning futures as well.
+   */
+  bool gen_futures_;
+
   /**
    * True if we should omit calls to completion__() in CobClient class.
    */
@@ -384,6 +411,21 @@ void t_cpp_generator::init_generator() {
   // Include C++xx compatibility header
   f_types_ << "#include <thrift/cxxfunctional.h>" << endl;
 
+  // Include TLazy if any field is deserialized on first access
+  vector<t_struct*> structs = program_->get_structs();
+  const vector<t_struct*>& xceptions = program_->get_xceptions();
+  structs.insert(structs.end(), xceptions.begin(), xceptions.end());
+  bool has_lazy = false;
+  for (size_t i = 0; i < structs.size() && !has_lazy; ++i) {
+    const vector<t_field*>& members = structs[i]->get_members();
+    for (size_t j = 0; j < members.size() && !has_lazy; ++j) {
+      has_lazy = is_lazy(members[j]);
+    }
+  }
+  if (has_lazy) {
+    f_types_ << "#include <thrift/TLazy.h>" << endl;
+  }
+
   // Include other Thrift includes
   const vector<t_program*>& includes = program_->get_includes();
   for (size_t i = 0; i < includes.size(); ++i) {
@@ -747,6 +789,18 @@ void t_cpp_generator::generate_forward_declaration(t_struct* tstruct) {
  * @param tstruct The struct definition
  */
 void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception) {
+  const vector<t_field*>& members = tstruct->get_members();
+  for (vector<t_field*>::const_iterator m_iter = members.begin(); m_iter != members.end();
+       ++m_iter) {
+    if ((*m_iter)->annotations_.count("cpp.lazy") && !is_lazy(*m_iter)) {
+      pwarning(1,
+               "cpp.lazy is ignored on %s.%s, it applies to struct and container fields"
+               " without cpp.ref in non-dense structs",
+               tstruct->get_name().c_str(),
+               (*m_iter)->get_name().c_str());
+    }
+  }
+
   generate_struct_declaration(f_types_, tstruct, is_exception, false, true, true, true);
   generate_struct_definition(f_types_impl_, f_types_impl_, tstruct);
   generate_struct_fingerprint(f_types_impl_, tstruct, true);
@@ -757,6 +811,7 @@ void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception)
   std::ofstream& out = (gen_templates_ ? f_types_tcc_ : f_types_impl_);
   generate_struct_reader(out, tstruct);
   generate_struct_writer(out, tstruct);
+  generate_lazy_field_helpers(out, tstruct);
   generate_struct_swap(f_types_impl_, tstruct);
   generate_copy_constructor(f_types_impl_, tstruct, is_exception);
   if (gen_moveable_) {
@@ -1007,7 +1062,11 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
       if (!t->is_base_type()) {
         t_const_value* cv = (*m_iter)->get_value();
         if (cv != NULL) {
-          print_const_value(out, (*m_iter)->get_name(), t, cv);
+          string name = (*m_iter)->get_name();
+          if (is_lazy(*m_iter)) {
+            name += ".getMutable()";
+          }
+          print_const_value(out, name, t, cv);
         }
       }
     }
@@ -1054,6 +1113,24 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
   }
   out << endl;
 
+  // (De)serializers handed to TLazy for each lazy field
+  bool has_lazy = false;
+  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    if (pointers || !is_lazy(*m_iter)) {
+      continue;
+    }
+    has_lazy = true;
+    indent(out) << "static uint32_t __read_" << (*m_iter)->get_name()
+                << "(::apache::thrift::protocol::TProtocol* iprot, "
+                << type_name((*m_iter)->get_type()) << "& value);" << endl;
+    indent(out) << "static uint32_t __write_" << (*m_iter)->get_name()
+                << "(::apache::thrift::protocol::TProtocol* oprot, "
+                << type_name((*m_iter)->get_type(), false, true) << " value);" << endl;
+  }
+  if (has_lazy) {
+    out << endl;
+  }
+
   if (!pointers) {
     // Should we generate default operators?
     if (!gen_no_default_operators_) {
@@ -1404,7 +1481,11 @@ void t_cpp_generator::generate_struct_reader(ofstream& out, t_struct* tstruct, b
             indent() << "  throw TProtocolException(TProtocolException::INVALID_DATA);" << endl;
 #endif
 
-      if (pointers && !(*f_iter)->get_type()->is_xception()) {
+      if (is_lazy(*f_iter)) {
+        indent(out) << "xfer += this->" << (*f_iter)->get_name() << ".read(iprot, ftype, &"
+                    << tstruct->get_name() << "::__read_" << (*f_iter)->get_name() << ");"
+                    << endl;
+      } else if (pointers && !(*f_iter)->get_type()->is_xception()) {
         generate_deserialize_field(out, *f_iter, "(*(this->", "))");
       } else {
         generate_deserialize_field(out, *f_iter, "this->");
@@ -1489,7 +1570,10 @@ void t_cpp_generator::generate_struct_writer(ofstream& out, t_struct* tstruct, b
         << "\"" << (*f_iter)->get_name() << "\", " << type_to_enum((*f_iter)->get_type()) << ", "
         << (*f_iter)->get_key() << ");" << endl;
     // Write field contents
-    if (pointers && !(*f_iter)->get_type()->is_xception()) {
+    if (is_lazy(*f_iter)) {
+      indent(out) << "xfer += this->" << (*f_iter)->get_name() << ".write(oprot, &"
+                  << tstruct->get_name() << "::__write_" << (*f_iter)->get_name() << ");" << endl;
+    } else if (pointers && !(*f_iter)->get_type()->is_xception()) {
       generate_serialize_field(out, *f_iter, "(*(this->", "))");
     } else {
       generate_serialize_field(out, *f_iter, "this->");
@@ -1579,6 +1663,47 @@ void t_cpp_generator::generate_struct_result_writer(ofstream& out,
   indent(out) << "}" << endl << endl;
 }
 
+/**
+ * Generates the functions that read and write the value of each lazy field,
+ * which TLazy calls when the value cannot be skipped or copied.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_lazy_field_helpers(ofstream& out, t_struct* tstruct) {
+  // These are no templates, so the .tcc needs them inline
+  string decl = gen_templates_ ? "inline uint32_t " : "uint32_t ";
+
+  const vector<t_field*>& fields = tstruct->get_members();
+  for (vector<t_field*>::const_iterator f_iter = fields.begin(); f_iter != fields.end();
+       ++f_iter) {
+    if (!is_lazy(*f_iter)) {
+      continue;
+    }
+    t_field value((*f_iter)->get_type(), "value");
+
+    indent(out) << decl << tstruct->get_name() << "::__read_" << (*f_iter)->get_name()
+                << "(::apache::thrift::protocol::TProtocol* iprot, "
+                << type_name((*f_iter)->get_type()) << "& value) {" << endl;
+    indent_up();
+    indent(out) << "uint32_t xfer = 0;" << endl;
+    generate_deserialize_field(out, &value);
+    indent(out) << "return xfer;" << endl;
+    scope_down(out);
+    out << endl;
+
+    indent(out) << decl << tstruct->get_name() << "::__write_" << (*f_iter)->get_name()
+                << "(::apache::thrift::protocol::TProtocol* oprot, "
+                << type_name((*f_iter)->get_type(), false, true) << " value) {" << endl;
+    indent_up();
+    indent(out) << "uint32_t xfer = 0;" << endl;
+    generate_serialize_field(out, &value);
+    indent(out) << "return xfer;" << endl;
+    scope_down(out);
+    out << endl;
+  }
+}
+
 /**
  * Generates the swap function.
  *
@@ -1710,6 +1835,24 @@ void t_cpp_generator::generate_struct_ostream_operator(std::ofstream& out, t_str
 void t_cpp_generator::generate_service(t_service* tservice) {
   string svcname = tservice->get_name();
 
+  // Arguments and exceptions are handed around as plain values, so they
+  // are never lazy
+  const vector<t_function*>& functions = tservice->get_functions();
+  for (size_t i = 0; i < functions.size(); ++i) {
+    vector<t_field*> fields = functions[i]->get_arglist()->get_members();
+    const vector<t_field*>& xceptions = functions[i]->get_xceptions()->get_members();
+    fields.insert(fields.end(), xceptions.begin(), xceptions.end());
+    for (size_t j = 0; j < fields.size(); ++j) {
+      if (fields[j]->annotations_.erase("cpp.lazy")) {
+        pwarning(1,
+                 "cpp.lazy is ignored on %s of %s.%s",
+                 fields[j]->get_name().c_str(),
+                 svcname.c_str(),
+                 functions[i]->get_name().c_str());
+      }
+    }
+  }
+
   // Make output files
   string f_header_name = get_out_dir() + svcname + ".h";
   f_header_.open(f_header_name.c_str());
@@ -1728,6 +1871,9 @@ void t_cpp_generator::generate_service(t_service* tservice) {
   if (gen_cob_style_) {
     f_header_ << "#include <thrift/async/TAsyncDispatchProcessor.h>" << endl;
   }
+  if (gen_futures_) {
+    f_header_ << "#include <thrift/async/TFutureChannel.h>" << endl;
+  }
   f_header_ << "#include \"" << get_include_prefix(*get_program()) << program_name_ << "_types.h\""
             << endl;
 
@@ -1789,6 +1935,10 @@ void t_cpp_generator::generate_service(t_service* tservice) {
     generate_service_async_skeleton(tservice);
   }
 
+  if (gen_futures_) {
+    generate_service_future_client(tservice);
+  }
+
   // Close the namespace
   f_service_ << ns_close_ << endl << endl;
   f_service_tcc_ << ns_close_ << endl << endl;
@@ -2634,6 +2784,174 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
   }
 }
 
+/**
+ * Generates a client whose methods send the call and return a future of
+ * its result. All calls share one TFutureChannel, which matches replies to
+ * calls by sequence id. The replies are decoded by static decode_ methods
+ * when the caller asks the future for the result.
+ *
+ * @param tservice The service to generate a client for.
+ */
+void t_cpp_generator::generate_service_future_client(t_service* tservice) {
+  string channel_ptr = "boost::shared_ptr< ::apache::thrift::async::TFutureChannel>";
+  string classname = service_name_ + "FutureClient";
+
+  string extends = "";
+  string extends_client = "";
+  if (tservice->get_extends() != NULL) {
+    extends = type_name(tservice->get_extends()) + "FutureClient";
+    extends_client = " : public " + extends;
+  }
+
+  // Generate the header portion
+  f_header_ << "class " << classname << extends_client << " {" << endl << " public:" << endl;
+  indent_up();
+  if (extends.empty()) {
+    f_header_ << indent() << classname << "(" << channel_ptr << " channel) : channel_(channel) {}"
+              << endl << indent() << "virtual ~" << classname << "() {}" << endl << indent()
+              << channel_ptr << " getChannel() {" << endl << indent() << "  return channel_;"
+              << endl << indent() << "}" << endl;
+  } else {
+    f_header_ << indent() << classname << "(" << channel_ptr << " channel) : " << extends
+              << "(channel) {}" << endl;
+  }
+
+  vector<t_function*> functions = tservice->get_functions();
+  vector<t_function*>::const_iterator f_iter;
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    indent(f_header_) << future_function_signature(*f_iter) << ";" << endl;
+  }
+  indent_down();
+
+  f_header_ << " protected:" << endl;
+  indent_up();
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    if (!(*f_iter)->is_oneway()) {
+      indent(f_header_) << "static " << future_decoder_signature(*f_iter) << ";" << endl;
+    }
+  }
+  if (extends.empty()) {
+    f_header_ << endl << indent() << channel_ptr << " channel_;" << endl;
+  }
+  indent_down();
+  f_header_ << "};" << endl << endl;
+
+  string scope = classname + "::";
+
+  // Generate method implementations
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    string funname = (*f_iter)->get_name();
+    string argsname = tservice->get_name() + "_" + funname + "_pargs";
+    string resultname = tservice->get_name() + "_" + funname + "_presult";
+    t_type* ttype = (*f_iter)->get_returntype();
+    string future_type = "::apache::thrift::async::TFuture< " + type_name(ttype) + " >";
+
+    indent(f_service_) << future_function_signature(*f_iter, scope) << endl;
+    scope_up(f_service_);
+
+    // Serialize the request
+    f_service_ << indent() << "::apache::thrift::async::TFutureChannel::Request request(*channel_);"
+               << endl << indent() << "request.oprot->writeMessageBegin(\"" << funname
+               << "\", ::apache::thrift::protocol::"
+               << ((*f_iter)->is_oneway() ? "T_ONEWAY" : "T_CALL") << ", request.seqid);" << endl
+               << endl << indent() << argsname << " args;" << endl;
+
+    const vector<t_field*>& fields = (*f_iter)->get_arglist()->get_members();
+    vector<t_field*>::const_iterator fld_iter;
+    for (fld_iter = fields.begin(); fld_iter != fields.end(); ++fld_iter) {
+      f_service_ << indent() << "args." << (*fld_iter)->get_name() << " = &"
+                 << (*fld_iter)->get_name() << ";" << endl;
+    }
+
+    f_service_ << indent() << "args.write(request.oprot);" << endl << endl << indent()
+               << "request.oprot->writeMessageEnd();" << endl << indent()
+               << "request.oprot->getTransport()->writeEnd();" << endl;
+    if ((*f_iter)->is_oneway()) {
+      f_service_ << indent() << "channel_->sendOneway(request);" << endl;
+    } else {
+      f_service_ << indent() << "return " << future_type << "(channel_->send(request), &decode_"
+                 << funname << ");" << endl;
+    }
+    scope_down(f_service_);
+    f_service_ << endl;
+
+    if ((*f_iter)->is_oneway()) {
+      continue;
+    }
+
+    // The decoder reads the reply from a buffer of its own, so there is no
+    // other message to skip past when it is not the expected one
+    indent(f_service_) << future_decoder_signature(*f_iter, scope) << endl;
+    scope_up(f_service_);
+    f_service_ << indent() << "int32_t rseqid = 0;" << endl << indent() << "std::string fname;"
+               << endl << indent() << "::apache::thrift::protocol::TMessageType mtype;" << endl
+               << endl << indent() << "iprot->readMessageBegin(fname, mtype, rseqid);" << endl
+               << indent() << "if (mtype == ::apache::thrift::protocol::T_EXCEPTION) {" << endl
+               << indent() << "  ::apache::thrift::TApplicationException x;" << endl << indent()
+               << "  x.read(iprot);" << endl << indent() << "  iprot->readMessageEnd();" << endl
+               << indent() << "  throw x;" << endl << indent() << "}" << endl << indent()
+               << "if (mtype != ::apache::thrift::protocol::T_REPLY) {" << endl << indent()
+               << "  throw ::apache::thrift::TApplicationException("
+               << "::apache::thrift::TApplicationException::INVALID_MESSAGE_TYPE);" << endl
+               << indent() << "}" << endl << indent() << "if (fname.compare(\"" << funname
+               << "\") != 0) {" << endl << indent()
+               << "  throw ::apache::thrift::TApplicationException("
+               << "::apache::thrift::TApplicationException::WRONG_METHOD_NAME);" << endl
+               << indent() << "}" << endl << indent() << resultname << " result;" << endl;
+    if (!ttype->is_void()) {
+      f_service_ << indent() << "result.success = &_return;" << endl;
+    }
+    f_service_ << indent() << "result.read(iprot);" << endl << indent()
+               << "iprot->readMessageEnd();" << endl << endl;
+
+    if (!ttype->is_void()) {
+      f_service_ << indent() << "if (result.__isset.success) {" << endl << indent()
+                 << "  return;" << endl << indent() << "}" << endl;
+    }
+
+    const std::vector<t_field*>& xceptions = (*f_iter)->get_xceptions()->get_members();
+    vector<t_field*>::const_iterator x_iter;
+    for (x_iter = xceptions.begin(); x_iter != xceptions.end(); ++x_iter) {
+      f_service_ << indent() << "if (result.__isset." << (*x_iter)->get_name() << ") {" << endl
+                 << indent() << "  throw result." << (*x_iter)->get_name() << ";" << endl
+                 << indent() << "}" << endl;
+    }
+
+    if (!ttype->is_void()) {
+      f_service_ << indent() << "throw ::apache::thrift::TApplicationException("
+                 << "::apache::thrift::TApplicationException::MISSING_RESULT, \"" << funname
+                 << " failed: unknown result\");" << endl;
+    }
+    scope_down(f_service_);
+    f_service_ << endl;
+  }
+}
+
+/**
+ * Renders the signature of a futures-style client method.
+ */
+string t_cpp_generator::future_function_signature(t_function* tfunction, string prefix) {
+  string result;
+  if (tfunction->is_oneway()) {
+    result = "void";
+  } else {
+    result = "::apache::thrift::async::TFuture< " + type_name(tfunction->get_returntype()) + " >";
+  }
+  return result + " " + prefix + tfunction->get_name() + "("
+         + argument_list(tfunction->get_arglist()) + ")";
+}
+
+/**
+ * Renders the signature of the function decoding the reply to a call made
+ * by a futures-style client.
+ */
+string t_cpp_generator::future_decoder_signature(t_function* tfunction, string prefix) {
+  t_type* ttype = tfunction->get_returntype();
+  return "void " + prefix + "decode_" + tfunction->get_name()
+         + "(::apache::thrift::protocol::TProtocol* iprot"
+         + (ttype->is_void() ? "" : ", " + type_name(ttype) + "& _return") + ")";
+}
+
 class ProcessorGenerator {
 public:
   ProcessorGenerator(t_cpp_generator* generator, t_service* service, const string& style);
@@ -2875,6 +3193,36 @@ void ProcessorGenerator::generate_class_definition() {
   indent_down();
   f_header_ << indent() << "}" << endl << endl << indent() << "virtual ~" << class_name_ << "() {}"
             << endl;
+
+  // Functions annotated cpp.inline_safe may be run on a server's IO thread
+  if (style_ != "Cob") {
+    vector<string> inline_safe;
+    for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+      std::map<string, string>::const_iterator it = (*f_iter)->annotations_.find("cpp.inline_safe");
+      if (it != (*f_iter)->annotations_.end() && it->second != "false") {
+        inline_safe.push_back((*f_iter)->get_name());
+      }
+    }
+    if (!inline_safe.empty()) {
+      f_header_ << indent() << "virtual bool isInlineSafe(const std::string& fname) const {" << endl;
+      indent_up();
+      indent(f_header_) << "return ";
+      for (vector<string>::iterator n_iter = inline_safe.begin(); n_iter != inline_safe.end();
+           ++n_iter) {
+        if (n_iter != inline_safe.begin()) {
+          f_header_ << " || ";
+        }
+        f_header_ << "fname == \"" << *n_iter << "\"";
+      }
+      if (!extends_.empty()) {
+        f_header_ << " || " << extends_ << "::isInlineSafe(fname)";
+      }
+      f_header_ << ";" << endl;
+      indent_down();
+      f_header_ << indent() << "}" << endl;
+      f_header_ << indent() << "virtual bool hasInlineSafeCalls() const { return true; }" << endl;
+    }
+  }
   indent_down();
   f_header_ << "};" << endl << endl;
 
@@ -3688,6 +4036,19 @@ void t_cpp_generator::generate_deserialize_container(ofstream& out, t_type* ttyp
     if (!use_push) {
       indent(out) << prefix << ".resize(" << size << ");" << endl;
     }
+
+    // Lists of fixed-width numbers are read in one call
+    string array_type = list_array_type((t_list*)ttype);
+    if (!array_type.empty()) {
+      indent(out) << "if (" << size << " > 0)" << endl;
+      scope_up(out);
+      indent(out) << "xfer += iprot->read" << array_type << "Array(&" << prefix << "[0], " << size
+                  << ");" << endl;
+      scope_down(out);
+      indent(out) << "xfer += iprot->readListEnd();" << endl;
+      scope_down(out);
+      return;
+    }
   }
 
   // For loop iterates over elements
@@ -3876,6 +4237,19 @@ void t_cpp_generator::generate_serialize_container(ofstream& out, t_type* ttype,
     indent(out) << "xfer += oprot->writeListBegin("
                 << type_to_enum(((t_list*)ttype)->get_elem_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << endl;
+
+    // Lists of fixed-width numbers are written in one call
+    string array_type = list_array_type((t_list*)ttype);
+    if (!array_type.empty()) {
+      indent(out) << "if (!" << prefix << ".empty())" << endl;
+      scope_up(out);
+      indent(out) << "xfer += oprot->write" << array_type << "Array(&" << prefix
+                  << "[0], static_cast<uint32_t>(" << prefix << ".size()));" << endl;
+      scope_down(out);
+      indent(out) << "xfer += oprot->writeListEnd();" << endl;
+      scope_down(out);
+      return;
+    }
   }
 
   string iter = tmp("_iter");
@@ -3931,6 +4305,33 @@ void t_cpp_generator::generate_serialize_list_element(ofstream& out, t_list* tli
   generate_serialize_field(out, &efield, "");
 }
 
+/**
+ * Returns the element type name of the TProtocol array methods that can
+ * read and write a list at once, e.g. "I32" for readI32Array(), or "" if
+ * the list is not a std::vector of plain i32, i64 or double.
+ */
+string t_cpp_generator::list_array_type(t_list* tlist) {
+  if (tlist->has_cpp_name()) {
+    return "";
+  }
+  t_type* elem_type = tlist->get_elem_type();
+  t_type* true_type = get_true_type(elem_type);
+  if (!true_type->is_base_type() || elem_type->annotations_.count("cpp.type")
+      || true_type->annotations_.count("cpp.type")) {
+    return "";
+  }
+  switch (((t_base_type*)true_type)->get_base()) {
+  case t_base_type::TYPE_I32:
+    return "I32";
+  case t_base_type::TYPE_I64:
+    return "I64";
+  case t_base_type::TYPE_DOUBLE:
+    return "Double";
+  default:
+    return "";
+  }
+}
+
 /**
  * Makes a :: prefix for a namespace
  *
@@ -4136,6 +4537,8 @@ string t_cpp_generator::declare_field(t_field* tfield,
   result += type_name(tfield->get_type());
   if (is_reference(tfield)) {
     result = "boost::shared_ptr<" + result + ">";
+  } else if (is_lazy(tfield)) {
+    result = "::apache::thrift::TLazy<" + result + " >";
   }
   if (pointer) {
     result += "*";
@@ -4358,6 +4761,7 @@ THRIFT_REGISTER_GENERATOR(
     cpp,
     "C++",
     "    cob_style:       Generate \"Continuation OBject\"-style classes.\n"
+    "    futures:         Generate clients returning futures that share one connection.\n"
     "    no_client_completion:\n"
     "                     Omit calls to completion__() in CobClient class.\n"
     "    no_default_operators:\n"
@@ -0,0 +1,139 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TBUFFERSLICE_H_
+#define _THRIFT_TBUFFERSLICE_H_ 1
+
+#include <thrift/Thrift.h>
+
+#include <boost/shared_array.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * A read-only, reference counted range of bytes.
+ *
+ * Slices handed out by TTransport::readSlice() point straight into the
+ * frame the transport received and keep that frame alive for as long as
+ * any slice refers to it, so binary fields read this way are not copied.
+ * Generated structs use it through the cpp.type annotation:
+ *
+ *   typedef binary (cpp.type = "apache::thrift::TBufferSlice") Blob
+ *
+ * TBinaryProtocol and TCompactProtocol read such fields without copying
+ * when the transport supports it (TFramedTransport, or TMemoryBuffer when
+ * given a shared frame); all other combinations fall back to a copy.
+ */
+class TBufferSlice {
+public:
+  TBufferSlice() : data_(NULL), size_(0) {}
+
+  /**
+   * Aliases size bytes at data, which must lie within owner's allocation.
+   * With an empty owner the slice merely borrows the bytes, and the caller
+   * has to keep them alive for as long as the slice is used.
+   */
+  TBufferSlice(const boost::shared_array<uint8_t>& owner, const uint8_t* data, uint32_t size)
+    : owner_(owner), data_(data), size_(size) {}
+
+  /// Copies the given bytes into a new allocation
+  TBufferSlice(const uint8_t* data, uint32_t size) : data_(NULL), size_(0) { assign(data, size); }
+
+  /// Copies the contents of str into a new allocation
+  explicit TBufferSlice(const std::string& str) : data_(NULL), size_(0) { assign(str); }
+
+  void assign(const uint8_t* data, uint32_t size) {
+    if (size == 0) {
+      clear();
+      return;
+    }
+    boost::shared_array<uint8_t> copy(new uint8_t[size]);
+    std::memcpy(copy.get(), data, size);
+    owner_.swap(copy);
+    data_ = owner_.get();
+    size_ = size;
+  }
+
+  void assign(const std::string& str) {
+    assign(reinterpret_cast<const uint8_t*>(str.data()), static_cast<uint32_t>(str.size()));
+  }
+
+  void clear() {
+    owner_.reset();
+    data_ = NULL;
+    size_ = 0;
+  }
+
+  const uint8_t* data() const { return data_; }
+
+  uint32_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const uint8_t* begin() const { return data_; }
+
+  const uint8_t* end() const { return data_ + size_; }
+
+  /// Copies the bytes out into a std::string
+  std::string str() const { return std::string(reinterpret_cast<const char*>(data_), size_); }
+
+  /// The buffer kept alive by this slice
+  const boost::shared_array<uint8_t>& owner() const { return owner_; }
+
+  void swap(TBufferSlice& that) {
+    using std::swap;
+    owner_.swap(that.owner_);
+    swap(data_, that.data_);
+    swap(size_, that.size_);
+  }
+
+  bool operator==(const TBufferSlice& rhs) const {
+    return size_ == rhs.size_ && (size_ == 0 || std::memcmp(data_, rhs.data_, size_) == 0);
+  }
+
+  bool operator!=(const TBufferSlice& rhs) const { return !(*this == rhs); }
+
+  bool operator<(const TBufferSlice& rhs) const {
+    int cmp = std::memcmp(data_, rhs.data_, (std::min)(size_, rhs.size_));
+    return cmp < 0 || (cmp == 0 && size_ < rhs.size_);
+  }
+
+private:
+  boost::shared_array<uint8_t> owner_;
+  const uint8_t* data_;
+  uint32_t size_;
+};
+
+inline void swap(TBufferSlice& a, TBufferSlice& b) {
+  a.swap(b);
+}
+
+inline std::ostream& operator<<(std::ostream& out, const TBufferSlice& slice) {
+  return out.write(reinterpret_cast<const char*>(slice.data()), slice.size());
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TBUFFERSLICE_H_
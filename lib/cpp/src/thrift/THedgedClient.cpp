@@ -0,0 +1,314 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <algorithm>
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+
+#include <thrift/THedgedClient.h>
+#include <thrift/concurrency/Util.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+namespace apache {
+namespace thrift {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Util;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::transport::TConnectionPool;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TSocketPoolServer;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TTransportFactory;
+using boost::shared_ptr;
+
+namespace {
+
+// how many recent calls the percentile is taken over
+const size_t LATENCY_WINDOW = 1000;
+
+// the percentile is recomputed after this many calls
+const uint64_t PERCENTILE_INTERVAL = 100;
+
+/**
+ * Sets the socket timeouts to the time left until the deadline before
+ * every read and write, so that a response arriving in many small reads
+ * cannot outlast the deadline either.
+ */
+class TDeadlineTransport : public transport::TVirtualTransport<TDeadlineTransport> {
+public:
+  TDeadlineTransport(shared_ptr<TSocket> socket, int64_t deadline)
+    : socket_(socket), deadline_(deadline) {}
+
+  bool isOpen() { return socket_->isOpen(); }
+
+  bool peek() {
+    socket_->setRecvTimeout(left());
+    return socket_->peek();
+  }
+
+  void open() { socket_->open(); }
+
+  void close() { socket_->close(); }
+
+  uint32_t read(uint8_t* buf, uint32_t len) {
+    socket_->setRecvTimeout(left());
+    return socket_->read(buf, len);
+  }
+
+  void write(const uint8_t* buf, uint32_t len) {
+    socket_->setSendTimeout(left());
+    socket_->write(buf, len);
+  }
+
+  void flush() { socket_->flush(); }
+
+  const std::string getOrigin() { return socket_->getOrigin(); }
+
+private:
+  int left() {
+    int64_t left = deadline_ - Util::currentTime();
+    if (left <= 0) {
+      throw TTransportException(TTransportException::TIMED_OUT,
+                                "THedgedClient: deadline exceeded");
+    }
+    return static_cast<int>(left);
+  }
+
+  shared_ptr<TSocket> socket_;
+  int64_t deadline_;
+};
+}
+
+THedgedClientBase::Call::Call(THedgedClientBase& client)
+  : client(client), count(0), winner(-1), start(Util::currentTimeUsec()), deadline(0) {
+  Guard g(client.mutex_);
+  if (client.deadline_ > 0) {
+    deadline = start / 1000 + client.deadline_;
+  }
+}
+
+THedgedClientBase::Call::~Call() {
+  for (int i = 0; i < count; ++i) {
+    client.end(attempts[i], i == winner);
+  }
+  if (winner >= 0) {
+    client.recordCall(*this);
+  }
+}
+
+THedgedClientBase::THedgedClientBase(shared_ptr<TConnectionPool> pool,
+                                     shared_ptr<TTransportFactory> transportFactory,
+                                     shared_ptr<TProtocolFactory> protocolFactory)
+  : pool_(pool),
+    transportFactory_(transportFactory),
+    protocolFactory_(protocolFactory),
+    deadline_(0),
+    hedgeDelay_(10),
+    percentile_(0.95),
+    nextLatency_(0),
+    numCalls_(0),
+    percentileDelay_(0),
+    numHedged_(0),
+    numHedgeWins_(0) {
+}
+
+void THedgedClientBase::setDeadline(int ms) {
+  Guard g(mutex_);
+  deadline_ = ms;
+}
+
+void THedgedClientBase::setHedgeDelay(int ms) {
+  Guard g(mutex_);
+  hedgeDelay_ = ms;
+}
+
+void THedgedClientBase::setHedgePercentile(double percentile) {
+  Guard g(mutex_);
+  percentile_ = percentile;
+  percentileDelay_ = 0;
+  if (latencies_.size() >= PERCENTILE_INTERVAL) {
+    takePercentile();
+  }
+}
+
+int THedgedClientBase::getHedgeDelay() {
+  return static_cast<int>(hedgeDelayUsec() / 1000);
+}
+
+uint64_t THedgedClientBase::getNumHedged() {
+  Guard g(mutex_);
+  return numHedged_;
+}
+
+uint64_t THedgedClientBase::getNumHedgeWins() {
+  Guard g(mutex_);
+  return numHedgeWins_;
+}
+
+shared_ptr<TProtocol> THedgedClientBase::attempt(Call& call) {
+  shared_ptr<TSocketPoolServer> exclude;
+  if (call.count > 0) {
+    exclude = call.attempts[0].lease.getServer();
+  }
+  Attempt& attempt = call.attempts[call.count];
+  attempt.lease = pool_->checkout(call.deadline, exclude);
+  ++call.count;
+
+  shared_ptr<TSocket> socket = attempt.lease.getSocket();
+  shared_ptr<transport::TTransport> transport = socket;
+  if (call.deadline > 0) {
+    if (call.deadline <= Util::currentTime()) {
+      throw TTransportException(TTransportException::TIMED_OUT,
+                                "THedgedClient: deadline exceeded");
+    }
+    attempt.sendTimeout = socket->getSendTimeout();
+    attempt.recvTimeout = socket->getRecvTimeout();
+    attempt.timeoutsChanged = true;
+    transport.reset(new TDeadlineTransport(socket, call.deadline));
+  }
+  attempt.protocol = protocolFactory_->getProtocol(transportFactory_->getTransport(transport));
+  return attempt.protocol;
+}
+
+void THedgedClientBase::abandon(Call& call) {
+  if (call.count > 1) {
+    --call.count;
+    end(call.attempts[call.count], false);
+  }
+}
+
+bool THedgedClientBase::awaitFirst(Call& call) {
+  int64_t until = (call.start + hedgeDelayUsec()) / 1000;
+  if (call.deadline > 0) {
+    until = (std::min)(until, call.deadline);
+  }
+  return firstReadable(call, until) == 0;
+}
+
+shared_ptr<TProtocol> THedgedClientBase::awaitWinner(Call& call) {
+  if (call.count == 1) {
+    // a lone attempt needs no poll; its transport enforces the deadline
+    call.winner = 0;
+    return call.attempts[0].protocol;
+  }
+
+  call.winner = firstReadable(call, call.deadline);
+  if (call.winner < 0) {
+    throw TTransportException(TTransportException::TIMED_OUT, "THedgedClient: deadline exceeded");
+  }
+  for (int i = 0; i < call.count; ++i) {
+    if (i != call.winner) {
+      end(call.attempts[i], false);
+    }
+  }
+  return call.attempts[call.winner].protocol;
+}
+
+int THedgedClientBase::firstReadable(Call& call, int64_t until) {
+  THRIFT_POLLFD fds[2];
+  for (int i = 0; i < call.count; ++i) {
+    fds[i].fd = call.attempts[i].lease.getSocket()->getSocketFD();
+    fds[i].events = THRIFT_POLLIN;
+    fds[i].revents = 0;
+  }
+  for (;;) {
+    int timeout = -1;
+    if (until > 0) {
+      timeout = static_cast<int>((std::max)(until - Util::currentTime(), static_cast<int64_t>(0)));
+    }
+    int ret = THRIFT_POLL(fds, call.count, timeout);
+    if (ret > 0) {
+      for (int i = 0; i < call.count; ++i) {
+        if (fds[i].revents != 0) {
+          return i;
+        }
+      }
+    } else if (ret == 0) {
+      return -1;
+    } else if (THRIFT_GET_SOCKET_ERROR != THRIFT_EINTR) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("THedgedClient poll() ", errno_copy);
+      throw TTransportException(TTransportException::UNKNOWN, "poll() failed", errno_copy);
+    }
+  }
+}
+
+void THedgedClientBase::end(Attempt& attempt, bool complete) {
+  if (!attempt.lease.valid()) {
+    return;
+  }
+  attempt.protocol.reset();
+  if (complete) {
+    if (attempt.timeoutsChanged) {
+      shared_ptr<TSocket> socket = attempt.lease.getSocket();
+      socket->setSendTimeout(attempt.sendTimeout);
+      socket->setRecvTimeout(attempt.recvTimeout);
+    }
+    attempt.lease.release();
+  } else {
+    attempt.lease.invalidate();
+  }
+}
+
+void THedgedClientBase::recordCall(const Call& call) {
+  int64_t latency = Util::currentTimeUsec() - call.start;
+
+  Guard g(mutex_);
+  if (call.count > 1) {
+    ++numHedged_;
+    if (call.winner == 1) {
+      ++numHedgeWins_;
+    }
+  }
+  if (latencies_.size() < LATENCY_WINDOW) {
+    latencies_.push_back(latency);
+  } else {
+    latencies_[nextLatency_] = latency;
+    nextLatency_ = (nextLatency_ + 1) % LATENCY_WINDOW;
+  }
+  if (++numCalls_ % PERCENTILE_INTERVAL == 0) {
+    takePercentile();
+  }
+}
+
+void THedgedClientBase::takePercentile() {
+  if (percentile_ <= 0 || latencies_.empty()) {
+    return;
+  }
+  std::vector<int64_t> sorted(latencies_);
+  size_t n = static_cast<size_t>((std::min)(percentile_, 1.0) * (sorted.size() - 1));
+  std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+  percentileDelay_ = sorted[n];
+}
+
+int64_t THedgedClientBase::hedgeDelayUsec() {
+  Guard g(mutex_);
+  if (percentile_ > 0 && percentileDelay_ > 0) {
+    return percentileDelay_;
+  }
+  return static_cast<int64_t>(hedgeDelay_) * 1000;
+}
+}
+} // apache::thrift
@@ -0,0 +1,226 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_THEDGEDCLIENT_H_
+#define _THRIFT_THEDGEDCLIENT_H_ 1
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/transport/TConnectionPool.h>
+#include <thrift/transport/TTransport.h>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * Non-template part of THedgedClient.
+ */
+class THedgedClientBase {
+public:
+  virtual ~THedgedClientBase() {}
+
+  /**
+   * Sets the time in milliseconds a call may take in total, from checking
+   * out a connection to the end of the response. 0 means no deadline.
+   */
+  void setDeadline(int ms);
+
+  /**
+   * Sets the delay in milliseconds after which a hedged call sends a
+   * second copy. It applies until enough calls have been timed to take
+   * the percentile, or always if the percentile is 0.
+   */
+  void setHedgeDelay(int ms);
+
+  /**
+   * Sets which percentile of recent call latencies a hedged call waits
+   * before sending a second copy, e.g. 0.95. 0 uses the fixed delay.
+   */
+  void setHedgePercentile(double percentile);
+
+  /// The delay in milliseconds hedged calls currently wait
+  int getHedgeDelay();
+
+  /// Number of calls that sent a second copy
+  uint64_t getNumHedged();
+
+  /// Number of calls the second copy answered first
+  uint64_t getNumHedgeWins();
+
+protected:
+  THedgedClientBase(boost::shared_ptr<transport::TConnectionPool> pool,
+                    boost::shared_ptr<transport::TTransportFactory> transportFactory,
+                    boost::shared_ptr<protocol::TProtocolFactory> protocolFactory);
+
+  struct Attempt {
+    Attempt() : sendTimeout(0), recvTimeout(0), timeoutsChanged(false) {}
+
+    transport::TConnectionLease lease;
+    boost::shared_ptr<protocol::TProtocol> protocol;
+    int sendTimeout;
+    int recvTimeout;
+    bool timeoutsChanged;
+  };
+
+  /**
+   * State of one call. Its destructor hands back the connection of the
+   * winning attempt, if any, and closes all others.
+   */
+  struct Call {
+    Call(THedgedClientBase& client);
+    ~Call();
+
+    THedgedClientBase& client;
+    Attempt attempts[2];
+    int count;
+    int winner;
+    int64_t start;
+    int64_t deadline;
+  };
+
+  /**
+   * Opens the next attempt of the call, on another server than the first,
+   * and returns the protocol to send it on.
+   */
+  boost::shared_ptr<protocol::TProtocol> attempt(Call& call);
+
+  /**
+   * Closes the last attempt, after sending it failed.
+   */
+  void abandon(Call& call);
+
+  /**
+   * Waits until the first attempt has a response, at most until the hedge
+   * delay has passed; returns whether it has one.
+   */
+  bool awaitFirst(Call& call);
+
+  /**
+   * Picks the attempt whose response comes first and closes the others.
+   *
+   * @throws TTransportException TIMED_OUT if the deadline passes first
+   */
+  boost::shared_ptr<protocol::TProtocol> awaitWinner(Call& call);
+
+private:
+  int firstReadable(Call& call, int64_t until);
+  void end(Attempt& attempt, bool complete);
+  void recordCall(const Call& call);
+  void takePercentile();
+  int64_t hedgeDelayUsec();
+
+  boost::shared_ptr<transport::TConnectionPool> pool_;
+  boost::shared_ptr<transport::TTransportFactory> transportFactory_;
+  boost::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+
+  concurrency::Mutex mutex_;
+  int deadline_;
+  int hedgeDelay_;
+  double percentile_;
+  // latencies of recent calls in microseconds, a ring buffer
+  std::vector<int64_t> latencies_;
+  size_t nextLatency_;
+  uint64_t numCalls_;
+  int64_t percentileDelay_;
+  uint64_t numHedged_;
+  uint64_t numHedgeWins_;
+};
+
+/**
+ * Makes calls through a generated synchronous client on connections from
+ * a TConnectionPool, within a deadline, and optionally hedged: when an
+ * idempotent call has not been answered after the hedge delay, a second
+ * copy goes to another server and whichever answers first wins. The
+ * other connection is closed.
+ *
+ * The deadline covers connecting, sending and receiving. Calls take the
+ * send_ and recv_ halves of a method as functors, e.g.
+ *
+ *   THedgedClient<CalculatorClient> client(pool, transportFactory, protocolFactory);
+ *   int32_t sum = client.hedgedCall(boost::bind(&CalculatorClient::send_add, _1, 1, 2),
+ *                                   boost::bind(&CalculatorClient::recv_add, _1));
+ *
+ * The response counts as arrived when its connection becomes readable. A
+ * connection that fails before answering therefore also ends the race.
+ */
+template <class Client_>
+class THedgedClient : public THedgedClientBase {
+public:
+  THedgedClient(boost::shared_ptr<transport::TConnectionPool> pool,
+                boost::shared_ptr<transport::TTransportFactory> transportFactory,
+                boost::shared_ptr<protocol::TProtocolFactory> protocolFactory)
+    : THedgedClientBase(pool, transportFactory, protocolFactory) {}
+
+  /**
+   * Makes a call within the deadline, without hedging.
+   */
+  template <class Send_, class Recv_>
+  typename Recv_::result_type call(Send_ send, Recv_ recv) {
+    Call call(*this);
+    {
+      Client_ client(attempt(call));
+      send(client);
+    }
+    return receive(call, recv);
+  }
+
+  /**
+   * Makes a call within the deadline, sending a second copy to another
+   * server after the hedge delay. Only for idempotent methods.
+   */
+  template <class Send_, class Recv_>
+  typename Recv_::result_type hedgedCall(Send_ send, Recv_ recv) {
+    Call call(*this);
+    {
+      Client_ client(attempt(call));
+      send(client);
+    }
+    if (!awaitFirst(call)) {
+      try {
+        Client_ client(attempt(call));
+        send(client);
+      } catch (const transport::TTransportException&) {
+        // no other server to ask, or it failed; keep waiting for the first
+        abandon(call);
+      }
+    }
+    return receive(call, recv);
+  }
+
+private:
+  template <class Recv_>
+  typename Recv_::result_type receive(Call& call, Recv_& recv) {
+    Client_ client(awaitWinner(call));
+    try {
+      return recv(client);
+    } catch (...) {
+      // the connection may be anywhere in the response
+      call.winner = -1;
+      throw;
+    }
+  }
+};
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_THEDGEDCLIENT_H_
@@ -0,0 +1,122 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TLazy.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+namespace apache {
+namespace thrift {
+
+using protocol::TBinaryProtocolT;
+using protocol::TCompactProtocolT;
+using protocol::TProtocol;
+using protocol::TProtocolException;
+using protocol::TType;
+using protocol::TValueEncoding;
+using transport::TBufferBase;
+using transport::TMemoryBuffer;
+using transport::TTransport;
+using transport::TTransportException;
+
+namespace {
+
+// Skips a value on a protocol of the given type reading the buffer, and
+// returns how many bytes the value takes up. Throws TTransportException
+// if the value does not end within the buffer.
+template <class Protocol_>
+uint32_t measure(const boost::shared_ptr<TMemoryBuffer>& buffer, TType type) {
+  Protocol_ prot(buffer);
+  uint32_t size = buffer->available_read();
+  protocol::skip(prot, type);
+  return size - buffer->available_read();
+}
+
+boost::shared_ptr<TMemoryBuffer> observe(const uint8_t* data, uint32_t size) {
+  return boost::shared_ptr<TMemoryBuffer>(new TMemoryBuffer(const_cast<uint8_t*>(data), size));
+}
+
+// Decoding is rare enough for TLazy instances to share a few mutexes
+const size_t NUM_DECODE_MUTEXES = 64;
+concurrency::Mutex decodeMutexes[NUM_DECODE_MUTEXES];
+}
+
+concurrency::Mutex& TLazyBase::decodeMutex(const TLazyBase* lazy) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(lazy);
+  return decodeMutexes[(address / sizeof(void*)) % NUM_DECODE_MUTEXES];
+}
+
+bool TLazyBase::capture(TProtocol* iprot, TType type, uint32_t& xfer) {
+  TValueEncoding encoding = iprot->getValueEncoding();
+  if (encoding == protocol::T_ENCODING_UNKNOWN) {
+    return false;
+  }
+  TTransport* trans = iprot->getTransport().get();
+  uint32_t len = 0;
+  const uint8_t* data = trans->borrow(NULL, &len);
+  if (data == NULL || len == 0) {
+    return false;
+  }
+
+  // Find the end of the value without consuming it, so that the value can
+  // still be read eagerly if it continues beyond the buffered bytes.
+  uint32_t size;
+  try {
+    if (encoding == protocol::T_ENCODING_BINARY) {
+      size = measure<TBinaryProtocolT<TBufferBase> >(observe(data, len), type);
+    } else {
+      size = measure<TCompactProtocolT<TBufferBase> >(observe(data, len), type);
+    }
+  } catch (const TTransportException&) {
+    return false;
+  }
+
+  xfer = trans->readSlice(serialized_, size);
+  encoding_ = encoding;
+  stringLimit_ = iprot->getStringSizeLimit();
+  containerLimit_ = iprot->getContainerSizeLimit();
+  return true;
+}
+
+bool TLazyBase::writeSerialized(TProtocol* oprot, uint32_t& xfer) const {
+  if (serialized_.empty() || encoding_ != oprot->getValueEncoding()) {
+    return false;
+  }
+  oprot->getTransport()->writeSlice(serialized_);
+  xfer = serialized_.size();
+  return true;
+}
+
+boost::shared_ptr<TProtocol> TLazyBase::getSerializedProtocol() const {
+  boost::shared_ptr<TMemoryBuffer> buffer = observe(serialized_.data(), serialized_.size());
+  switch (encoding_) {
+  case protocol::T_ENCODING_BINARY:
+    return boost::shared_ptr<TProtocol>(
+        new TBinaryProtocolT<TBufferBase>(buffer, stringLimit_, containerLimit_, false, true));
+  case protocol::T_ENCODING_COMPACT:
+    return boost::shared_ptr<TProtocol>(
+        new TCompactProtocolT<TBufferBase>(buffer, stringLimit_, containerLimit_));
+  default:
+    throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                             "no serialized form kept for lazy field");
+  }
+}
+}
+} // apache::thrift
@@ -0,0 +1,258 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TLAZY_H_
+#define _THRIFT_TLAZY_H_ 1
+
+#include <thrift/TBufferSlice.h>
+#include <thrift/TToString.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/protocol/TProtocol.h>
+
+#include <boost/atomic.hpp>
+
+#include <string>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * The parts of TLazy that do not depend on the value type.
+ */
+class TLazyBase {
+public:
+  /**
+   * The serialized form of the value as it was read, or an empty slice if
+   * the value was not read lazily or has been changed since.
+   */
+  const TBufferSlice& getSerialized() const { return serialized_; }
+
+  /// The encoding of getSerialized()
+  protocol::TValueEncoding getEncoding() const { return encoding_; }
+
+protected:
+  TLazyBase() : encoding_(protocol::T_ENCODING_UNKNOWN), stringLimit_(0), containerLimit_(0) {}
+
+  /**
+   * Consumes a value of the given type from iprot's transport and keeps its
+   * serialized form, along with iprot's size limits. This only succeeds if the protocol's encoding is known
+   * and the transport has the whole value buffered, as TMemoryBuffer and
+   * TFramedTransport do; otherwise nothing is consumed and false returned.
+   */
+  bool capture(protocol::TProtocol* iprot, protocol::TType type, uint32_t& xfer);
+
+  /**
+   * Copies the kept serialized form to oprot's transport if oprot uses the
+   * same encoding, returns false if it does not or nothing is kept.
+   */
+  bool writeSerialized(protocol::TProtocol* oprot, uint32_t& xfer) const;
+
+  /// A protocol reading the kept serialized form, within the kept limits
+  boost::shared_ptr<protocol::TProtocol> getSerializedProtocol() const;
+
+  /// The mutex the first get() of the given TLazy decodes under
+  static concurrency::Mutex& decodeMutex(const TLazyBase* lazy);
+
+  /// Drops the kept serialized form
+  void forget() {
+    serialized_.clear();
+    encoding_ = protocol::T_ENCODING_UNKNOWN;
+  }
+
+  void swap(TLazyBase& that) {
+    using std::swap;
+    serialized_.swap(that.serialized_);
+    swap(encoding_, that.encoding_);
+    swap(stringLimit_, that.stringLimit_);
+    swap(containerLimit_, that.containerLimit_);
+  }
+
+private:
+  TBufferSlice serialized_;
+  protocol::TValueEncoding encoding_;
+  int32_t stringLimit_;
+  int32_t containerLimit_;
+};
+
+/**
+ * A field of a generated struct that is deserialized on first access.
+ *
+ * Struct and container fields annotated with cpp.lazy are declared as
+ * TLazy<T>:
+ *
+ *   struct Request {
+ *     1: i64 id
+ *     2: Profile profile (cpp.lazy)
+ *     3: list<Item> items (cpp.lazy)
+ *   }
+ *
+ * Reading such a field with TBinaryProtocol or TCompactProtocol merely
+ * skips over it and keeps its bytes (without copying them when the
+ * transport hands out slices, see TTransport::readSlice()); get()
+ * deserializes them the first time it is called. A value that was never
+ * changed is written back by copying those bytes, provided the output
+ * protocol uses the same encoding. With other protocols, or transports
+ * which do not buffer the whole value, fields are read eagerly.
+ *
+ * Errors in the serialized form of a lazy field are only reported by
+ * get(). Like the rest of a generated struct, a TLazy may be read from
+ * several threads at once, including through get() and copies, whose
+ * first decode is done under a lock; changing it is not thread safe.
+ */
+template <typename T>
+class TLazy : public TLazyBase {
+public:
+  typedef uint32_t (*Reader)(protocol::TProtocol* iprot, T& value);
+  typedef uint32_t (*Writer)(protocol::TProtocol* oprot, const T& value);
+
+  TLazy() : value_(), pending_(false), reader_(NULL) {}
+
+  TLazy(const T& value) : value_(value), pending_(false), reader_(NULL) {}
+
+  TLazy(const TLazy& that) : TLazyBase(that), value_(), pending_(false), reader_(that.reader_) {
+    copyValue(that);
+  }
+
+  TLazy& operator=(const TLazy& that) {
+    if (this != &that) {
+      TLazyBase::operator=(that);
+      reader_ = that.reader_;
+      copyValue(that);
+    }
+    return *this;
+  }
+
+  TLazy& operator=(const T& value) {
+    set(value);
+    return *this;
+  }
+
+  /// The value, deserialized from the kept bytes on the first call
+  const T& get() const {
+    if (pending_.load(boost::memory_order_acquire)) {
+      concurrency::Guard g(decodeMutex(this));
+      if (pending_.load(boost::memory_order_relaxed)) {
+        boost::shared_ptr<protocol::TProtocol> iprot = getSerializedProtocol();
+        reader_(iprot.get(), value_);
+        pending_.store(false, boost::memory_order_release);
+      }
+    }
+    return value_;
+  }
+
+  /**
+   * The value for modification. The kept bytes are dropped, so from now on
+   * the value is serialized from scratch.
+   */
+  T& getMutable() {
+    get();
+    forget();
+    return value_;
+  }
+
+  void set(const T& value) {
+    value_ = value;
+    pending_.store(false, boost::memory_order_relaxed);
+    forget();
+  }
+
+  /// Whether get() still has to deserialize the value
+  bool isPending() const { return pending_.load(boost::memory_order_acquire); }
+
+  /**
+   * Reads a value of the given type, lazily if possible. The reader
+   * deserializes a value and is kept for get().
+   */
+  uint32_t read(protocol::TProtocol* iprot, protocol::TType type, Reader reader) {
+    uint32_t xfer = 0;
+    reader_ = reader;
+    if (capture(iprot, type, xfer)) {
+      value_ = T();
+      pending_.store(true, boost::memory_order_relaxed);
+    } else {
+      pending_.store(false, boost::memory_order_relaxed);
+      forget();
+      xfer = reader(iprot, value_);
+    }
+    return xfer;
+  }
+
+  /// Writes the value, copying the kept bytes if possible
+  uint32_t write(protocol::TProtocol* oprot, Writer writer) const {
+    uint32_t xfer = 0;
+    if (!writeSerialized(oprot, xfer)) {
+      xfer = writer(oprot, get());
+    }
+    return xfer;
+  }
+
+  void swap(TLazy& that) {
+    using std::swap;
+    TLazyBase::swap(that);
+    swap(value_, that.value_);
+    bool pending = pending_.load(boost::memory_order_relaxed);
+    pending_.store(that.pending_.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+    that.pending_.store(pending, boost::memory_order_relaxed);
+    swap(reader_, that.reader_);
+  }
+
+  bool operator==(const TLazy& rhs) const {
+    if (!getSerialized().empty() && getEncoding() == rhs.getEncoding()
+        && getSerialized() == rhs.getSerialized()) {
+      return true;
+    }
+    return get() == rhs.get();
+  }
+
+  bool operator!=(const TLazy& rhs) const { return !(*this == rhs); }
+
+private:
+  void copyValue(const TLazy& that) {
+    if (that.pending_.load(boost::memory_order_acquire)) {
+      // that may be decoding on another thread; as long as it is pending
+      // its value is the default one, so only the bytes need copying
+      concurrency::Guard g(decodeMutex(&that));
+      if (that.pending_.load(boost::memory_order_relaxed)) {
+        value_ = T();
+        pending_.store(true, boost::memory_order_relaxed);
+        return;
+      }
+    }
+    value_ = that.value_;
+    pending_.store(false, boost::memory_order_relaxed);
+  }
+
+  mutable T value_;
+  mutable boost::atomic<bool> pending_;
+  Reader reader_;
+};
+
+template <typename T>
+void swap(TLazy<T>& a, TLazy<T>& b) {
+  a.swap(b);
+}
+
+template <typename T>
+std::string to_string(const TLazy<T>& lazy) {
+  return to_string(lazy.get());
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TLAZY_H_
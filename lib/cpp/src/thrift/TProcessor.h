@@ -150,6 +150,25 @@ public:
     return process(io, io, connectionContext);
   }
 
+  /**
+   * Whether calls to the named function are cheap and never block, so that
+   * a server may run them directly on its IO thread instead of handing them
+   * to a worker thread.  Generated processors return true for functions
+   * annotated with (cpp.inline_safe = "true").
+   *
+   * @param fname the function name of the incoming message.
+   */
+  virtual bool isInlineSafe(const std::string& fname) const {
+    (void)fname;
+    return false;
+  }
+
+  /**
+   * Whether isInlineSafe() may return true at all, so that servers only look
+   * at method names for processors that have inline safe functions.
+   */
+  virtual bool hasInlineSafeCalls() const { return false; }
+
   boost::shared_ptr<TProcessorEventHandler> getEventHandler() { return eventHandler_; }
 
   void setEventHandler(boost::shared_ptr<TProcessorEventHandler> eventHandler) {
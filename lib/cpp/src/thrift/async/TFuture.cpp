@@ -0,0 +1,107 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/async/TFuture.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TBufferTransports.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransportException;
+using boost::shared_ptr;
+
+TFutureState::TFutureState(shared_ptr<TProtocolFactory> protocolFactory)
+  : protocolFactory_(protocolFactory), done_(false), failed_(false) {
+}
+
+void TFutureState::complete(std::string& reply) {
+  std::vector<VoidCallback> callbacks;
+  {
+    Synchronized s(monitor_);
+    reply_.swap(reply);
+    done_ = true;
+    callbacks.swap(callbacks_);
+    monitor_.notifyAll();
+  }
+  for (size_t i = 0; i < callbacks.size(); ++i) {
+    callbacks[i]();
+  }
+}
+
+void TFutureState::fail(const TTransportException& error) {
+  std::vector<VoidCallback> callbacks;
+  {
+    Synchronized s(monitor_);
+    error_ = error;
+    failed_ = true;
+    done_ = true;
+    callbacks.swap(callbacks_);
+    monitor_.notifyAll();
+  }
+  for (size_t i = 0; i < callbacks.size(); ++i) {
+    callbacks[i]();
+  }
+}
+
+bool TFutureState::ready() const {
+  Synchronized s(monitor_);
+  return done_;
+}
+
+bool TFutureState::wait(int64_t timeout_ms) const {
+  Synchronized s(monitor_);
+  while (!done_) {
+    if (monitor_.waitForTimeRelative(timeout_ms) == THRIFT_ETIMEDOUT) {
+      return done_;
+    }
+  }
+  return true;
+}
+
+void TFutureState::then(const VoidCallback& cob) {
+  {
+    Synchronized s(monitor_);
+    if (!done_) {
+      callbacks_.push_back(cob);
+      return;
+    }
+  }
+  cob();
+}
+
+shared_ptr<TProtocol> TFutureState::reply() const {
+  wait();
+  // done_ no longer changes, so the reply can be read without the lock
+  if (failed_) {
+    throw error_;
+  }
+  shared_ptr<TMemoryBuffer> buffer(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(reply_.data())),
+                        static_cast<uint32_t>(reply_.size())));
+  return protocolFactory_->getProtocol(buffer);
+}
+}
+}
+} // apache::thrift::async
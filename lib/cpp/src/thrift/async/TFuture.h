@@ -0,0 +1,172 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_TFUTURE_H_
+#define _THRIFT_ASYNC_TFUTURE_H_ 1
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <thrift/cxxfunctional.h>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/transport/TTransportException.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+/**
+ * The shared state behind a TFuture: the raw reply to one call, or the
+ * transport error that ended it.
+ */
+class TFutureState {
+public:
+  typedef apache::thrift::stdcxx::function<void()> VoidCallback;
+
+  TFutureState(boost::shared_ptr<protocol::TProtocolFactory> protocolFactory);
+
+  /**
+   * Completes the call with the reply message; takes the contents of reply.
+   */
+  void complete(std::string& reply);
+
+  /**
+   * Completes the call with an error.
+   */
+  void fail(const transport::TTransportException& error);
+
+  bool ready() const;
+
+  /**
+   * Waits until the call completes, at most timeout_ms milliseconds or
+   * forever if 0; returns whether it completed.
+   */
+  bool wait(int64_t timeout_ms = 0) const;
+
+  /**
+   * Runs cob once the call completes, on the thread that completes it, or
+   * right away if it already has.
+   */
+  void then(const VoidCallback& cob);
+
+  /**
+   * Waits for the call and returns a protocol positioned at the start of
+   * the reply message.
+   *
+   * @throws TTransportException if the call failed
+   */
+  boost::shared_ptr<protocol::TProtocol> reply() const;
+
+private:
+  boost::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+  concurrency::Monitor monitor_;
+  bool done_;
+  std::string reply_;
+  bool failed_;
+  transport::TTransportException error_;
+  std::vector<VoidCallback> callbacks_;
+};
+
+/**
+ * What TFuture does independently of the result type.
+ */
+class TFutureBase {
+public:
+  /**
+   * Whether the future belongs to a call; a default constructed one does
+   * not, and everything else throws TException on it.
+   */
+  bool valid() const { return state_.get() != NULL; }
+
+  bool ready() const { return state().ready(); }
+
+  bool wait(int64_t timeout_ms = 0) const { return state().wait(timeout_ms); }
+
+  void then(const TFutureState::VoidCallback& cob) { state().then(cob); }
+
+protected:
+  TFutureBase() {}
+
+  TFutureBase(boost::shared_ptr<TFutureState> state) : state_(state) {}
+
+  TFutureState& state() const {
+    if (!state_) {
+      throw TException("TFuture: not the result of a call");
+    }
+    return *state_;
+  }
+
+private:
+  boost::shared_ptr<TFutureState> state_;
+};
+
+/**
+ * The result of a call made through a futures-style client. get() waits
+ * for the reply and decodes it, returning the result or throwing the
+ * exception the server sent. Copies share the same call.
+ */
+template <class T>
+class TFuture : public TFutureBase {
+public:
+  typedef void (*Decoder)(protocol::TProtocol* iprot, T& _return);
+
+  TFuture() : decoder_(NULL) {}
+
+  TFuture(boost::shared_ptr<TFutureState> state, Decoder decoder)
+    : TFutureBase(state), decoder_(decoder) {}
+
+  /**
+   * Waits for the reply and decodes it; each call decodes it again.
+   */
+  T get() const {
+    T _return;
+    decoder_(state().reply().get(), _return);
+    return _return;
+  }
+
+private:
+  Decoder decoder_;
+};
+
+template <>
+class TFuture<void> : public TFutureBase {
+public:
+  typedef void (*Decoder)(protocol::TProtocol* iprot);
+
+  TFuture() : decoder_(NULL) {}
+
+  TFuture(boost::shared_ptr<TFutureState> state, Decoder decoder)
+    : TFutureBase(state), decoder_(decoder) {}
+
+  /**
+   * Waits for the reply and throws the exception in it, if any.
+   */
+  void get() const { decoder_(state().reply().get()); }
+
+private:
+  Decoder decoder_;
+};
+}
+}
+} // apache::thrift::async
+
+#endif // #ifndef _THRIFT_ASYNC_TFUTURE_H_
@@ -0,0 +1,258 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/async/TFutureChannel.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TSocket.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransportException;
+using boost::shared_ptr;
+
+namespace {
+
+const uint32_t DEFAULT_MAX_FRAME_SIZE = 256 * 1024 * 1024;
+}
+
+class TFutureChannel::Reader : public concurrency::Runnable {
+public:
+  Reader(TFutureChannel* channel) : channel_(channel) {}
+
+  virtual void run() { channel_->readLoop(); }
+
+private:
+  TFutureChannel* channel_;
+};
+
+TFutureChannel::Request::Request(TFutureChannel& channel)
+  : buffer_(new TMemoryBuffer()), protocol_(channel.protocolFactory_->getProtocol(buffer_)) {
+  {
+    Guard g(channel.mutex_);
+    seqid = static_cast<int32_t>(channel.nextSeqid_++);
+  }
+  oprot = protocol_.get();
+  // room for the frame size, filled in by write()
+  uint8_t size[4] = {0, 0, 0, 0};
+  buffer_->write(size, sizeof(size));
+}
+
+TFutureChannel::TFutureChannel(shared_ptr<TSocket> socket,
+                               shared_ptr<TProtocolFactory> protocolFactory)
+  : socket_(socket),
+    protocolFactory_(protocolFactory),
+    maxFrameSize_(DEFAULT_MAX_FRAME_SIZE),
+    nextSeqid_(0),
+    failed_(false),
+    closing_(false) {
+  reader_ = PlatformThreadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+                PlatformThreadFactory::OTHER,
+                PlatformThreadFactory::NORMAL,
+                1,
+#endif
+                false).newThread(shared_ptr<Reader>(new Reader(this)));
+  reader_->start();
+}
+
+TFutureChannel::~TFutureChannel() {
+  try {
+    close();
+  } catch (const TException& e) {
+    GlobalOutput.printf("TFutureChannel::~TFutureChannel(): %s", e.what());
+  }
+}
+
+shared_ptr<TFutureState> TFutureChannel::send(Request& request) {
+  shared_ptr<TFutureState> state(new TFutureState(protocolFactory_));
+  {
+    Guard g(mutex_);
+    if (failed_) {
+      throw error_;
+    }
+    // registered before writing, the reply cannot overtake it
+    outstanding_[request.seqid] = state;
+  }
+  // a failed write fails the whole channel, this call included
+  write(request);
+  return state;
+}
+
+void TFutureChannel::sendOneway(Request& request) {
+  {
+    Guard g(mutex_);
+    if (failed_) {
+      throw error_;
+    }
+  }
+  write(request);
+}
+
+void TFutureChannel::write(Request& request) {
+  uint8_t* buf;
+  uint32_t len;
+  request.buffer_->getBuffer(&buf, &len);
+  uint32_t size = len - 4;
+  buf[0] = static_cast<uint8_t>(size >> 24);
+  buf[1] = static_cast<uint8_t>(size >> 16);
+  buf[2] = static_cast<uint8_t>(size >> 8);
+  buf[3] = static_cast<uint8_t>(size);
+
+  Guard g(writeMutex_);
+  {
+    Guard g2(mutex_);
+    if (failed_) {
+      throw error_;
+    }
+  }
+  try {
+    socket_->write(buf, len);
+    socket_->flush();
+  } catch (const TTransportException& e) {
+    // part of the frame may be on the wire already, so nothing can follow
+    // it on this connection; fail the channel before anyone else writes
+    if (socket_->isOpen()) {
+      shutdown(socket_->getSocketFD(), THRIFT_SHUT_RDWR);
+    }
+    failAll(e);
+    throw;
+  }
+}
+
+void TFutureChannel::close() {
+  {
+    Guard g(mutex_);
+    if (closing_) {
+      return;
+    }
+    closing_ = true;
+  }
+  // wake up the reader; the socket stays valid until it has stopped
+  if (socket_->isOpen()) {
+    shutdown(socket_->getSocketFD(), THRIFT_SHUT_RDWR);
+  }
+  reader_->join();
+  socket_->close();
+}
+
+bool TFutureChannel::good() {
+  Guard g(mutex_);
+  return !failed_;
+}
+
+size_t TFutureChannel::getNumOutstanding() {
+  Guard g(mutex_);
+  return outstanding_.size();
+}
+
+void TFutureChannel::readLoop() {
+  try {
+    for (;;) {
+      uint8_t header[4];
+      socket_->readAll(header, sizeof(header));
+      uint32_t size = (static_cast<uint32_t>(header[0]) << 24)
+                      | (static_cast<uint32_t>(header[1]) << 16)
+                      | (static_cast<uint32_t>(header[2]) << 8) | static_cast<uint32_t>(header[3]);
+      if (size > maxFrameSize_) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "TFutureChannel: frame size exceeds maximum");
+      }
+      std::string frame(size, '\0');
+      if (size > 0) {
+        socket_->readAll(reinterpret_cast<uint8_t*>(&frame[0]), size);
+      }
+
+      // only the header is read here; the caller decodes the rest
+      std::string fname;
+      TMessageType mtype;
+      int32_t seqid;
+      {
+        shared_ptr<TMemoryBuffer> buffer(
+            new TMemoryBuffer(reinterpret_cast<uint8_t*>(&frame[0]), size));
+        protocolFactory_->getProtocol(buffer)->readMessageBegin(fname, mtype, seqid);
+      }
+
+      shared_ptr<TFutureState> state;
+      {
+        Guard g(mutex_);
+        std::map<int32_t, shared_ptr<TFutureState> >::iterator it = outstanding_.find(seqid);
+        if (it != outstanding_.end()) {
+          state = it->second;
+          outstanding_.erase(it);
+        }
+      }
+      if (state) {
+        state->complete(frame);
+      } else {
+        GlobalOutput.printf("TFutureChannel: reply to %s with unknown seqid %d",
+                            fname.c_str(),
+                            seqid);
+      }
+    }
+  } catch (const TTransportException& e) {
+    bool closing;
+    {
+      Guard g(mutex_);
+      closing = closing_;
+    }
+    if (closing) {
+      failAll(TTransportException(TTransportException::NOT_OPEN, "TFutureChannel: closed"));
+    } else {
+      GlobalOutput.printf("TFutureChannel: %s", e.what());
+      failAll(e);
+    }
+  } catch (const TException& e) {
+    GlobalOutput.printf("TFutureChannel: %s", e.what());
+    failAll(TTransportException(TTransportException::CORRUPTED_DATA, e.what()));
+  }
+}
+
+void TFutureChannel::failAll(const TTransportException& error) {
+  std::map<int32_t, shared_ptr<TFutureState> > outstanding;
+  {
+    Guard g(mutex_);
+    // later calls fail with the first error, not with the reader noticing
+    // the shutdown that followed it
+    if (!failed_) {
+      failed_ = true;
+      error_ = error;
+    }
+    outstanding.swap(outstanding_);
+  }
+  for (std::map<int32_t, shared_ptr<TFutureState> >::iterator it = outstanding.begin();
+       it != outstanding.end();
+       ++it) {
+    it->second->fail(error);
+  }
+}
+}
+}
+} // apache::thrift::async
@@ -0,0 +1,138 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_TFUTURECHANNEL_H_
+#define _THRIFT_ASYNC_TFUTURECHANNEL_H_ 1
+
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+#include <thrift/async/TFuture.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+/**
+ * A framed connection shared by any number of outstanding calls, which
+ * is what clients generated with the futures option run on.
+ *
+ * Each call is tagged with its own sequence id. A reader thread matches
+ * the replies to the calls by that id, so the server may answer in any
+ * order. Messages are framed as with TFramedTransport directly on the
+ * socket, which the reader reads while callers write. close() shuts the
+ * socket down to stop the reader before closing it.
+ *
+ * If the connection fails, all outstanding calls fail with the error, and
+ * so does every call after that. A failed write counts as a failed
+ * connection, since it may have left part of a frame on the wire.
+ */
+class TFutureChannel {
+public:
+  /**
+   * A request being written. Write the message to oprot, with seqid as
+   * its sequence id, then pass the request to send() or sendOneway().
+   */
+  class Request {
+  public:
+    Request(TFutureChannel& channel);
+
+    int32_t seqid;
+    protocol::TProtocol* oprot;
+
+  private:
+    friend class TFutureChannel;
+
+    boost::shared_ptr<transport::TMemoryBuffer> buffer_;
+    boost::shared_ptr<protocol::TProtocol> protocol_;
+  };
+
+  /**
+   * @param socket          opened socket to the server
+   * @param protocolFactory protocol for requests and replies
+   */
+  TFutureChannel(boost::shared_ptr<transport::TSocket> socket,
+                 boost::shared_ptr<protocol::TProtocolFactory> protocolFactory);
+
+  /**
+   * Closes the channel, failing all outstanding calls.
+   */
+  virtual ~TFutureChannel();
+
+  /**
+   * Sends the request and returns the state its reply will arrive in.
+   *
+   * @throws TTransportException if the channel has failed
+   */
+  boost::shared_ptr<TFutureState> send(Request& request);
+
+  /**
+   * Sends a request that gets no reply.
+   */
+  void sendOneway(Request& request);
+
+  /**
+   * Stops the reader and closes the transport; outstanding calls fail.
+   */
+  void close();
+
+  bool good();
+
+  /// Number of calls awaiting a reply
+  size_t getNumOutstanding();
+
+  /**
+   * Sets the largest reply frame accepted, see TFramedTransport.
+   */
+  void setMaxFrameSize(uint32_t maxFrameSize) { maxFrameSize_ = maxFrameSize; }
+
+private:
+  class Reader;
+  friend class Reader;
+
+  void write(Request& request);
+  void readLoop();
+  void failAll(const transport::TTransportException& error);
+
+  boost::shared_ptr<transport::TSocket> socket_;
+  boost::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+  uint32_t maxFrameSize_;
+
+  concurrency::Mutex writeMutex_;
+
+  concurrency::Mutex mutex_;
+  // wraps around, which the int32_t seqids on the wire do as well
+  uint32_t nextSeqid_;
+  std::map<int32_t, boost::shared_ptr<TFutureState> > outstanding_;
+  bool failed_;
+  transport::TTransportException error_;
+  bool closing_;
+
+  boost::shared_ptr<concurrency::Thread> reader_;
+};
+}
+}
+} // apache::thrift::async
+
+#endif // #ifndef _THRIFT_ASYNC_TFUTURECHANNEL_H_
@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/concurrency/CpuAffinity.h>
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+
+namespace {
+
+std::string readSysFile(const std::string& path) {
+  std::ifstream in(path.c_str());
+  std::string line;
+  if (in) {
+    std::getline(in, line);
+  }
+  return line;
+}
+
+std::string nodePath(int node) {
+  std::ostringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+  return path.str();
+}
+}
+
+std::vector<int> CpuAffinity::parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::istringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    char* end = NULL;
+    long first = strtol(range.c_str(), &end, 10);
+    long last = first;
+    if (end == range.c_str() || first < 0) {
+      continue;
+    }
+    if (*end == '-') {
+      last = strtol(end + 1, NULL, 10);
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+  }
+  return cpus;
+}
+
+std::vector<int> CpuAffinity::getOnlineCpus() {
+  std::vector<int> cpus = parseCpuList(readSysFile("/sys/devices/system/cpu/online"));
+#ifdef _SC_NPROCESSORS_ONLN
+  if (cpus.empty()) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long cpu = 0; cpu < count; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    cpus.push_back(0);
+  }
+  return cpus;
+}
+
+int CpuAffinity::getNumaNodeCount() {
+  std::vector<int> nodes = parseCpuList(readSysFile("/sys/devices/system/node/online"));
+  return nodes.empty() ? 1 : nodes.back() + 1;
+}
+
+std::vector<int> CpuAffinity::getNumaNodeCpus(int node) {
+  std::vector<int> cpus = parseCpuList(readSysFile(nodePath(node)));
+  if (cpus.empty() && node == 0 && getNumaNodeCount() == 1) {
+    cpus = getOnlineCpus();
+  }
+  return cpus;
+}
+
+bool CpuAffinity::setCurrentThreadAffinity(const std::vector<int>& cpus) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  if (cpus.empty()) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (std::vector<int>::const_iterator it = cpus.begin(); it != cpus.end(); ++it) {
+    if (*it >= 0 && *it < CPU_SETSIZE) {
+      CPU_SET(*it, &set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+}
+}
+} // apache::thrift::concurrency
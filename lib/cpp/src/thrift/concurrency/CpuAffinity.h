@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_CONCURRENCY_CPUAFFINITY_H_
+#define _THRIFT_CONCURRENCY_CPUAFFINITY_H_ 1
+
+#include <string>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+
+/**
+ * CPU topology and affinity helpers
+ *
+ * The topology is read from sysfs (/sys/devices/system), so on platforms
+ * without it every CPU is reported as belonging to NUMA node 0 and pinning
+ * is a no-op that reports failure.
+ */
+class CpuAffinity {
+
+public:
+  /**
+   * Returns the ids of the online CPUs.
+   */
+  static std::vector<int> getOnlineCpus();
+
+  /**
+   * Returns the number of NUMA nodes, at least 1.
+   */
+  static int getNumaNodeCount();
+
+  /**
+   * Returns the ids of the CPUs belonging to a NUMA node. If the machine
+   * reports no NUMA topology node 0 holds all online CPUs.
+   */
+  static std::vector<int> getNumaNodeCpus(int node);
+
+  /**
+   * Restricts the calling thread to the given CPUs.
+   *
+   * @return true on success, false if the CPU set is empty, invalid or
+   *         affinity is not supported on this platform
+   */
+  static bool setCurrentThreadAffinity(const std::vector<int>& cpus);
+
+  /**
+   * Parses a kernel cpu list such as "0-3,8,10-11".
+   */
+  static std::vector<int> parseCpuList(const std::string& list);
+};
+}
+}
+} // apache::thrift::concurrency
+
+#endif // #ifndef _THRIFT_CONCURRENCY_CPUAFFINITY_H_
@@ -20,7 +20,9 @@
 #include <thrift/thrift-config.h>
 
 #include <thrift/concurrency/PosixThreadFactory.h>
+#include <thrift/concurrency/CpuAffinity.h>
 #include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Mutex.h>
 
 #if GOOGLE_PERFTOOLS_REGISTER_THREAD
 #include <google/profiler.h>
@@ -61,12 +63,14 @@ private:
   int stackSize_;
   weak_ptr<PthreadThread> self_;
   bool detached_;
+  std::vector<int> cpus_;
 
 public:
   PthreadThread(int policy,
                 int priority,
                 int stackSize,
                 bool detached,
+                const std::vector<int>& cpus,
                 shared_ptr<Runnable> runnable)
     :
 
@@ -78,7 +82,8 @@ public:
       policy_(policy),
       priority_(priority),
       stackSize_(stackSize),
-      detached_(detached) {
+      detached_(detached),
+      cpus_(cpus) {
 
     this->Thread::runnable(runnable);
   }
@@ -202,6 +207,11 @@ void* PthreadThread::threadMain(void* arg) {
   ProfilerRegisterThread();
 #endif
 
+  // Affinity is a placement hint, a thread that cannot be pinned still runs
+  if (!thread->cpus_.empty() && !CpuAffinity::setCurrentThreadAffinity(thread->cpus_)) {
+    GlobalOutput.printf("PthreadThread::threadMain(): unable to set CPU affinity");
+  }
+
   thread->state_ = started;
   thread->runnable()->run();
   if (thread->state_ != stopping && thread->state_ != stopped) {
@@ -221,6 +231,10 @@ private:
   PRIORITY priority_;
   int stackSize_;
   bool detached_;
+  AFFINITY affinity_;
+  std::vector<int> cpus_;
+  mutable size_t nextCpu_;
+  Mutex affinityMutex_;
 
   /**
    * Converts generic posix thread schedule policy enums into pthread
@@ -270,7 +284,12 @@ private:
 
 public:
   Impl(POLICY policy, PRIORITY priority, int stackSize, bool detached)
-    : policy_(policy), priority_(priority), stackSize_(stackSize), detached_(detached) {}
+    : policy_(policy),
+      priority_(priority),
+      stackSize_(stackSize),
+      detached_(detached),
+      affinity_(NO_AFFINITY),
+      nextCpu_(0) {}
 
   /**
    * Creates a new POSIX thread to run the runnable object
@@ -283,6 +302,7 @@ public:
                                                       toPthreadPriority(policy_, priority_),
                                                       stackSize_,
                                                       detached_,
+                                                      nextThreadCpus(),
                                                       runnable));
     result->weakRef(result);
     runnable->thread(result);
@@ -307,6 +327,34 @@ public:
 
   void setDetached(bool value) { detached_ = value; }
 
+  /**
+   * Picks the CPUs the next thread is pinned to, empty for no affinity.
+   */
+  std::vector<int> nextThreadCpus() const {
+    Guard g(affinityMutex_);
+    if (affinity_ != ROUND_ROBIN_CPUS || cpus_.empty()) {
+      return cpus_;
+    }
+    return std::vector<int>(1, cpus_[nextCpu_++ % cpus_.size()]);
+  }
+
+  void setAffinity(AFFINITY affinity, const std::vector<int>& cpus) {
+    Guard g(affinityMutex_);
+    affinity_ = cpus.empty() ? NO_AFFINITY : affinity;
+    cpus_ = cpus;
+    nextCpu_ = 0;
+  }
+
+  AFFINITY getAffinity() const {
+    Guard g(affinityMutex_);
+    return affinity_;
+  }
+
+  std::vector<int> getAffinityCpus() const {
+    Guard g(affinityMutex_);
+    return cpus_;
+  }
+
   Thread::id_t getCurrentThreadId() const {
 
 #ifndef _WIN32
@@ -352,6 +400,30 @@ void PosixThreadFactory::setDetached(bool value) {
   impl_->setDetached(value);
 }
 
+void PosixThreadFactory::setCpuAffinity(const std::vector<int>& cpus) {
+  impl_->setAffinity(FIXED_CPUS, cpus);
+}
+
+void PosixThreadFactory::setRoundRobinAffinity(const std::vector<int>& cpus) {
+  impl_->setAffinity(ROUND_ROBIN_CPUS, cpus.empty() ? CpuAffinity::getOnlineCpus() : cpus);
+}
+
+void PosixThreadFactory::setNumaNodeAffinity(int node) {
+  impl_->setAffinity(NUMA_NODE, CpuAffinity::getNumaNodeCpus(node));
+}
+
+void PosixThreadFactory::clearAffinity() {
+  impl_->setAffinity(NO_AFFINITY, std::vector<int>());
+}
+
+PosixThreadFactory::AFFINITY PosixThreadFactory::getAffinity() const {
+  return impl_->getAffinity();
+}
+
+std::vector<int> PosixThreadFactory::getAffinityCpus() const {
+  return impl_->getAffinityCpus();
+}
+
 Thread::id_t PosixThreadFactory::getCurrentThreadId() const {
   return impl_->getCurrentThreadId();
 }
@@ -24,6 +24,8 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include <vector>
+
 namespace apache {
 namespace thrift {
 namespace concurrency {
@@ -61,6 +63,16 @@ public:
     DECREMENT = 8
   };
 
+  /**
+   * CPU affinity of created threads
+   *
+   * NO_AFFINITY leaves placement to the OS scheduler, FIXED_CPUS pins every
+   * thread to the same set of CPUs, ROUND_ROBIN_CPUS pins each new thread
+   * to the next single CPU of a list and NUMA_NODE pins every thread to the
+   * CPUs of one NUMA node.
+   */
+  enum AFFINITY { NO_AFFINITY, FIXED_CPUS, ROUND_ROBIN_CPUS, NUMA_NODE };
+
   /**
    * Posix thread (pthread) factory.  All threads created by a factory are reference-counted
    * via boost::shared_ptr and boost::weak_ptr.  The factory guarantees that threads and
@@ -120,6 +132,37 @@ public:
    */
   virtual bool isDetached() const;
 
+  /**
+   * Pins threads created from now on to the given CPUs
+   */
+  virtual void setCpuAffinity(const std::vector<int>& cpus);
+
+  /**
+   * Pins each thread created from now on to one CPU, cycling through the
+   * given list, or through all online CPUs if the list is empty
+   */
+  virtual void setRoundRobinAffinity(const std::vector<int>& cpus = std::vector<int>());
+
+  /**
+   * Pins threads created from now on to the CPUs of a NUMA node
+   */
+  virtual void setNumaNodeAffinity(int node);
+
+  /**
+   * Lets the OS place threads created from now on
+   */
+  virtual void clearAffinity();
+
+  /**
+   * Gets the current affinity policy
+   */
+  virtual AFFINITY getAffinity() const;
+
+  /**
+   * Gets the CPUs used by the current affinity policy
+   */
+  virtual std::vector<int> getAffinityCpus() const;
+
 private:
   class Impl;
   boost::shared_ptr<Impl> impl_;
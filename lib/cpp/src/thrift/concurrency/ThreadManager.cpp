@@ -282,7 +282,6 @@ public:
         } else {
           idle_ = true;
           manager_->workerCount_--;
-          notifyManager = (manager_->workerCount_ == manager_->workerMaxCount_);
         }
       }
 
@@ -302,9 +301,7 @@ public:
     {
       Synchronized s(manager_->workerMonitor_);
       manager_->deadWorkers_.insert(this->thread());
-      if (notifyManager) {
-        manager_->workerMonitor_.notify();
-      }
+      manager_->workerMonitor_.notify();
     }
 
     return;
@@ -421,7 +418,9 @@ void ThreadManager::Impl::removeWorker(size_t value) {
   {
     Synchronized s(workerMonitor_);
 
-    while (workerCount_ != workerMaxCount_) {
+    // Also wait for the removed workers to report themselves dead, they
+    // still touch workerMonitor_ after giving up their worker count.
+    while (workerCount_ != workerMaxCount_ || deadWorkers_.size() < value) {
       workerMonitor_.wait();
     }
 
@@ -191,6 +191,28 @@ public:
     return false;
   }
 
+  /**
+   * Ask the processor registered for the service named in the message
+   * whether the call may run inline.
+   */
+  bool isInlineSafe(const std::string& fname) const {
+    std::string::size_type sep = fname.find(':');
+    if (sep == std::string::npos) {
+      return false;
+    }
+    services_t::const_iterator it = services.find(fname.substr(0, sep));
+    return it != services.end() && it->second->isInlineSafe(fname.substr(sep + 1));
+  }
+
+  bool hasInlineSafeCalls() const {
+    for (services_t::const_iterator it = services.begin(); it != services.end(); ++it) {
+      if (it->second->hasInlineSafeCalls()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
 private:
   /** Map of service processor objects, indexed by service names. */
   services_t services;
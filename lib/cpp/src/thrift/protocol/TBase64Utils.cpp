@@ -19,6 +19,8 @@
 
 #include <thrift/protocol/TBase64Utils.h>
 
+#include <cstring>
+
 #include <boost/static_assert.hpp>
 
 using std::string;
@@ -44,6 +46,26 @@ void base64_encode(const uint8_t* in, uint32_t len, uint8_t* buf) {
   }
 }
 
+uint32_t base64_encode_block(const uint8_t* in, uint32_t len, uint8_t* buf) {
+  uint8_t* out = buf;
+  // whole groups are encoded inline rather than through base64_encode()
+  while (len >= 3) {
+    uint32_t group = (in[0] << 16) | (in[1] << 8) | in[2];
+    out[0] = kBase64EncodeTable[group >> 18];
+    out[1] = kBase64EncodeTable[(group >> 12) & 0x3f];
+    out[2] = kBase64EncodeTable[(group >> 6) & 0x3f];
+    out[3] = kBase64EncodeTable[group & 0x3f];
+    in += 3;
+    out += 4;
+    len -= 3;
+  }
+  if (len) {
+    base64_encode(in, len, out);
+    out += len + 1;
+  }
+  return static_cast<uint32_t>(out - buf);
+}
+
 static const uint8_t kBase64DecodeTable[256] = {
     0xff,
     0xff,
@@ -312,6 +334,32 @@ void base64_decode(uint8_t* buf, uint32_t len) {
     }
   }
 }
+
+uint32_t base64_decode_block(const uint8_t* in, uint32_t len, uint8_t* buf) {
+  uint8_t* out = buf;
+  // each group is read before its bytes are written, which keeps decoding
+  // in place safe
+  while (len >= 4) {
+    uint32_t group = ((kBase64DecodeTable[in[0]] & 0x3f) << 18)
+                     | ((kBase64DecodeTable[in[1]] & 0x3f) << 12)
+                     | ((kBase64DecodeTable[in[2]] & 0x3f) << 6)
+                     | (kBase64DecodeTable[in[3]] & 0x3f);
+    out[0] = static_cast<uint8_t>(group >> 16);
+    out[1] = static_cast<uint8_t>(group >> 8);
+    out[2] = static_cast<uint8_t>(group);
+    in += 4;
+    out += 3;
+    len -= 4;
+  }
+  if (len > 1) {
+    uint8_t tail[4];
+    std::memcpy(tail, in, len);
+    base64_decode(tail, len);
+    std::memcpy(out, tail, len - 1);
+    out += len - 1;
+  }
+  return static_cast<uint32_t>(out - buf);
+}
 }
 }
 } // apache::thrift::protocol
@@ -38,6 +38,17 @@ void base64_encode(const uint8_t* in, uint32_t len, uint8_t* buf);
 // len is number of bytes to consume from input (must be 2, 3, or 4)
 // no '=' padding should be included in the input
 void base64_decode(uint8_t* buf, uint32_t len);
+
+// encodes all len bytes of in to buf, without '=' padding, and returns
+// the number of characters written, which is len * 4 / 3 rounded up
+// buf must hold that many characters and may not overlap in
+uint32_t base64_encode_block(const uint8_t* in, uint32_t len, uint8_t* buf);
+
+// decodes the len base64 characters at in to buf and returns the number
+// of bytes written, which is at most len * 3 / 4
+// a single character left over after the last group of 4 is ignored
+// buf may be the same as in, so a buffer can be decoded in place
+uint32_t base64_decode_block(const uint8_t* in, uint32_t len, uint8_t* buf);
 }
 }
 } // apache::thrift::protocol
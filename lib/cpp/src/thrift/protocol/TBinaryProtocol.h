@@ -66,11 +66,17 @@ public:
 
   void setContainerSizeLimit(int32_t container_limit) { container_limit_ = container_limit; }
 
+  int32_t getStringSizeLimit() const { return string_limit_; }
+
+  int32_t getContainerSizeLimit() const { return container_limit_; }
+
   void setStrict(bool strict_read, bool strict_write) {
     strict_read_ = strict_read;
     strict_write_ = strict_write;
   }
 
+  TValueEncoding getValueEncoding() const { return T_ENCODING_BINARY; }
+
   /**
    * Writing functions.
    */
@@ -120,6 +126,19 @@ public:
 
   inline uint32_t writeBinary(const std::string& str);
 
+  inline uint32_t writeBinary(const TBufferSlice& slice);
+
+  /**
+   * Write the elements of a list in one go: they are converted to network
+   * byte order a chunk at a time and each chunk goes to the transport in a
+   * single write.
+   */
+  inline uint32_t writeI32Array(const int32_t* values, const uint32_t size);
+
+  inline uint32_t writeI64Array(const int64_t* values, const uint32_t size);
+
+  inline uint32_t writeDoubleArray(const double* values, const uint32_t size);
+
   /**
    * Reading functions
    */
@@ -167,10 +186,42 @@ public:
 
   inline uint32_t readBinary(std::string& str);
 
+  /**
+   * Reads a binary field as a slice of the transport's buffer, which avoids
+   * copying it when the transport supports TTransport::readSlice().
+   */
+  inline uint32_t readBinary(TBufferSlice& slice);
+
+  /**
+   * Read the elements of a list in one go, converting them straight out of
+   * the transport's buffer when it can lend it.
+   */
+  inline uint32_t readI32Array(int32_t* values, const uint32_t size);
+
+  inline uint32_t readI64Array(int64_t* values, const uint32_t size);
+
+  inline uint32_t readDoubleArray(double* values, const uint32_t size);
+
+  virtual uint32_t readBinary_virt(TBufferSlice& slice) { return readBinary(slice); }
+  virtual uint32_t writeBinary_virt(const TBufferSlice& slice) { return writeBinary(slice); }
+  using TVirtualProtocol<TBinaryProtocolT<Transport_> >::readBinary_virt;
+  using TVirtualProtocol<TBinaryProtocolT<Transport_> >::writeBinary_virt;
+
 protected:
   template <typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
 
+  // Array bodies for 4 and 8 byte elements, which Word_ is one of
+  template <typename Word_>
+  uint32_t writeWords(const uint8_t* values, const uint32_t size);
+
+  template <typename Word_>
+  uint32_t readWords(uint8_t* values, const uint32_t size);
+
+  // Converts between host and network byte order, which is the same swap
+  static uint32_t swapWord(uint32_t word) { return htonl(word); }
+  static uint64_t swapWord(uint64_t word) { return htonll(word); }
+
   Transport_* trans_;
 
   int32_t string_limit_;
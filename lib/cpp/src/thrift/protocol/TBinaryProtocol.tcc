@@ -22,6 +22,8 @@
 
 #include <thrift/protocol/TBinaryProtocol.h>
 
+#include <algorithm>
+#include <cstring>
 #include <limits>
 
 namespace apache {
@@ -172,6 +174,42 @@ uint32_t TBinaryProtocolT<Transport_>::writeDouble(const double dub) {
   return 8;
 }
 
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::writeI32Array(const int32_t* values, const uint32_t size) {
+  return writeWords<uint32_t>(reinterpret_cast<const uint8_t*>(values), size);
+}
+
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::writeI64Array(const int64_t* values, const uint32_t size) {
+  return writeWords<uint64_t>(reinterpret_cast<const uint8_t*>(values), size);
+}
+
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::writeDoubleArray(const double* values, const uint32_t size) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+  return writeWords<uint64_t>(reinterpret_cast<const uint8_t*>(values), size);
+}
+
+template <class Transport_>
+template <typename Word_>
+uint32_t TBinaryProtocolT<Transport_>::writeWords(const uint8_t* values, const uint32_t size) {
+  // The swap loop has no dependencies between words, so the compiler
+  // vectorizes it
+  Word_ chunk[4096 / sizeof(Word_)];
+  const uint32_t chunkSize = sizeof(chunk) / sizeof(Word_);
+  for (uint32_t done = 0; done < size;) {
+    uint32_t n = (std::min)(size - done, chunkSize);
+    std::memcpy(chunk, values + done * sizeof(Word_), n * sizeof(Word_));
+    for (uint32_t i = 0; i < n; ++i) {
+      chunk[i] = swapWord(chunk[i]);
+    }
+    this->trans_->write(reinterpret_cast<uint8_t*>(chunk), n * sizeof(Word_));
+    done += n;
+  }
+  return size * static_cast<uint32_t>(sizeof(Word_));
+}
+
 template <class Transport_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_>::writeString(const StrType& str) {
@@ -190,6 +228,16 @@ uint32_t TBinaryProtocolT<Transport_>::writeBinary(const std::string& str) {
   return TBinaryProtocolT<Transport_>::writeString(str);
 }
 
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::writeBinary(const TBufferSlice& slice) {
+  if (slice.size() > static_cast<uint32_t>((std::numeric_limits<int32_t>::max)()))
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  uint32_t result = writeI32(static_cast<int32_t>(slice.size()));
+  // lets transports that buffer writes link large slices instead of copying
+  this->trans_->writeSlice(slice);
+  return result + slice.size();
+}
+
 /**
  * Reading functions
  */
@@ -399,6 +447,62 @@ uint32_t TBinaryProtocolT<Transport_>::readDouble(double& dub) {
   return 8;
 }
 
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::readI32Array(int32_t* values, const uint32_t size) {
+  return readWords<uint32_t>(reinterpret_cast<uint8_t*>(values), size);
+}
+
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::readI64Array(int64_t* values, const uint32_t size) {
+  return readWords<uint64_t>(reinterpret_cast<uint8_t*>(values), size);
+}
+
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::readDoubleArray(double* values, const uint32_t size) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+  return readWords<uint64_t>(reinterpret_cast<uint8_t*>(values), size);
+}
+
+template <class Transport_>
+template <typename Word_>
+uint32_t TBinaryProtocolT<Transport_>::readWords(uint8_t* values, const uint32_t size) {
+  uint32_t done = 0;
+  while (done < size) {
+    // Swap straight out of the transport's buffer, as many whole words as
+    // it holds
+    uint32_t got = sizeof(Word_);
+    const uint8_t* borrow_buf = this->trans_->borrow(NULL, &got);
+    if (borrow_buf == NULL) {
+      break;
+    }
+    uint32_t n = (std::min)(size - done, got / static_cast<uint32_t>(sizeof(Word_)));
+    uint8_t* out = values + done * sizeof(Word_);
+    for (uint32_t i = 0; i < n; ++i) {
+      Word_ word;
+      std::memcpy(&word, borrow_buf + i * sizeof(Word_), sizeof(Word_));
+      word = swapWord(word);
+      std::memcpy(out + i * sizeof(Word_), &word, sizeof(Word_));
+    }
+    this->trans_->consume(n * sizeof(Word_));
+    done += n;
+  }
+
+  if (done < size) {
+    // No buffer to borrow; read the rest and swap it in place
+    uint8_t* out = values + done * sizeof(Word_);
+    uint32_t n = size - done;
+    this->trans_->readAll(out, n * sizeof(Word_));
+    for (uint32_t i = 0; i < n; ++i) {
+      Word_ word;
+      std::memcpy(&word, out + i * sizeof(Word_), sizeof(Word_));
+      word = swapWord(word);
+      std::memcpy(out + i * sizeof(Word_), &word, sizeof(Word_));
+    }
+  }
+  return size * static_cast<uint32_t>(sizeof(Word_));
+}
+
 template <class Transport_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_>::readString(StrType& str) {
@@ -413,6 +517,22 @@ uint32_t TBinaryProtocolT<Transport_>::readBinary(std::string& str) {
   return TBinaryProtocolT<Transport_>::readString(str);
 }
 
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::readBinary(TBufferSlice& slice) {
+  int32_t size;
+  uint32_t result = readI32(size);
+
+  // Catch error cases
+  if (size < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  }
+  if (this->string_limit_ > 0 && size > this->string_limit_) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+
+  return result + this->trans_->readSlice(slice, static_cast<uint32_t>(size));
+}
+
 template <class Transport_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_>::readStringBody(StrType& str, int32_t size) {
@@ -101,6 +101,12 @@ public:
 
   ~TCompactProtocolT() { free(string_buf_); }
 
+  TValueEncoding getValueEncoding() const { return T_ENCODING_COMPACT; }
+
+  int32_t getStringSizeLimit() const { return string_limit_; }
+
+  int32_t getContainerSizeLimit() const { return container_limit_; }
+
   /**
    * Writing functions
    */
@@ -139,6 +145,17 @@ public:
 
   uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeBinary(const TBufferSlice& slice);
+
+  /**
+   * Write the elements of a list in one go. The varints are encoded into a
+   * local buffer, eight at a time while they fit in a byte each, and the
+   * buffer goes to the transport in a single write.
+   */
+  uint32_t writeI32Array(const int32_t* values, const uint32_t size);
+
+  uint32_t writeI64Array(const int64_t* values, const uint32_t size);
+
   /**
   * These methods are called by structs, but don't actually have any wired
   * output or purpose
@@ -159,6 +176,9 @@ protected:
   uint32_t writeVarint64(uint64_t n);
   uint64_t i64ToZigzag(const int64_t l);
   uint32_t i32ToZigzag(const int32_t n);
+  template <typename Int_>
+  uint32_t writeVarintArray(const Int_* values, const uint32_t size);
+  static uint32_t encodeVarint(uint64_t n, uint8_t* buf);
   inline int8_t getCompactType(const TType ttype);
 
 public:
@@ -194,6 +214,26 @@ public:
 
   uint32_t readBinary(std::string& str);
 
+  /**
+   * Reads a binary field as a slice of the transport's buffer, which avoids
+   * copying it when the transport supports TTransport::readSlice().
+   */
+  uint32_t readBinary(TBufferSlice& slice);
+
+  /**
+   * Read the elements of a list in one go. While the transport can lend
+   * its buffer the varints are decoded out of it a word at a time, eight
+   * per word when they are one byte each.
+   */
+  uint32_t readI32Array(int32_t* values, const uint32_t size);
+
+  uint32_t readI64Array(int64_t* values, const uint32_t size);
+
+  virtual uint32_t readBinary_virt(TBufferSlice& slice) { return readBinary(slice); }
+  virtual uint32_t writeBinary_virt(const TBufferSlice& slice) { return writeBinary(slice); }
+  using TVirtualProtocol<TCompactProtocolT<Transport_> >::readBinary_virt;
+  using TVirtualProtocol<TCompactProtocolT<Transport_> >::writeBinary_virt;
+
   /*
    *These methods are here for the struct to call, but don't have any wire
    * encoding.
@@ -210,6 +250,14 @@ protected:
   int32_t zigzagToI32(uint32_t n);
   int64_t zigzagToI64(uint64_t n);
   TType getTType(int8_t type);
+  template <typename Int_>
+  uint32_t readVarintArray(Int_* values, const uint32_t size);
+
+  // Zigzag conversions for the array bodies, picked by element type
+  uint64_t toZigzag(int32_t n) { return i32ToZigzag(n); }
+  uint64_t toZigzag(int64_t n) { return i64ToZigzag(n); }
+  void fromZigzag(uint64_t n, int32_t& value) { value = zigzagToI32(static_cast<uint32_t>(n)); }
+  void fromZigzag(uint64_t n, int64_t& value) { value = zigzagToI64(n); }
 
   // Buffer for reading strings, save for the lifetime of the protocol to
   // avoid memory churn allocating memory on every string read
@@ -19,6 +19,8 @@
 #ifndef _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_
 #define _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_ 1
 
+#include <algorithm>
+#include <cstring>
 #include <limits>
 
 /*
@@ -80,6 +82,39 @@ const int8_t TTypeToCType[16] = {
   CT_LIST, // T_LIST
 };
 
+// High bits of the bytes of a word, which mark varint continuations
+const uint64_t CONTINUATION_BITS = 0x8080808080808080ULL;
+
+/**
+ * Index of the lowest set bit of a non-zero word.
+ */
+inline int lowestBit(uint64_t word) {
+#ifdef __GNUC__
+  return __builtin_ctzll(word);
+#else
+  int bit = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+/**
+ * Joins the 7 bit groups of a varint of at most 8 bytes, loaded little
+ * endian into word with the bytes after it cleared, without a loop over
+ * the bytes: neighbouring groups are merged pairwise, then the pairs, then
+ * the halves.
+ */
+inline uint64_t packVarint(uint64_t word) {
+  word &= 0x7F7F7F7F7F7F7F7FULL;
+  word = ((word & 0x7F007F007F007F00ULL) >> 1) | (word & 0x007F007F007F007FULL);
+  word = ((word & 0x3FFF00003FFF0000ULL) >> 2) | (word & 0x00003FFF00003FFFULL);
+  word = ((word & 0x0FFFFFFF00000000ULL) >> 4) | (word & 0x000000000FFFFFFFULL);
+  return word;
+}
+
 }} // end detail::compact namespace
 
 
@@ -246,6 +281,16 @@ uint32_t TCompactProtocolT<Transport_>::writeI64(const int64_t i64) {
   return writeVarint64(i64ToZigzag(i64));
 }
 
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI32Array(const int32_t* values, const uint32_t size) {
+  return writeVarintArray(values, size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI64Array(const int64_t* values, const uint32_t size) {
+  return writeVarintArray(values, size);
+}
+
 /**
  * Write a double to the wire as 8 bytes.
  */
@@ -283,6 +328,20 @@ uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
   return wsize;
 }
 
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinary(const TBufferSlice& slice) {
+  uint32_t ssize = slice.size();
+  uint32_t wsize = writeVarint32(ssize);
+  // checking ssize + wsize > uint_max, but we don't want to overflow while checking for overflows.
+  // transforming the check to ssize > uint_max - wsize
+  if (ssize > (std::numeric_limits<uint32_t>::max)() - wsize)
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  wsize += ssize;
+  // lets transports that buffer writes link large slices instead of copying
+  trans_->writeSlice(slice);
+  return wsize;
+}
+
 //
 // Internal Writing methods
 //
@@ -379,6 +438,66 @@ uint32_t TCompactProtocolT<Transport_>::writeVarint64(uint64_t n) {
   return wsize;
 }
 
+/**
+ * Encode n as a varint into buf, which must have room for 10 bytes.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::encodeVarint(uint64_t n, uint8_t* buf) {
+  uint32_t wsize = 0;
+  while (n & ~static_cast<uint64_t>(0x7F)) {
+    buf[wsize++] = static_cast<uint8_t>((n & 0x7F) | 0x80);
+    n >>= 7;
+  }
+  buf[wsize++] = static_cast<uint8_t>(n);
+  return wsize;
+}
+
+/**
+ * Write the zigzag varints of a list of i32 or i64.
+ */
+template <class Transport_>
+template <typename Int_>
+uint32_t TCompactProtocolT<Transport_>::writeVarintArray(const Int_* values,
+                                                         const uint32_t size) {
+  uint8_t buf[4096];
+  // room for a group of eight of the longest varints
+  const uint32_t limit = sizeof(buf) - 8 * 10;
+  uint32_t pos = 0;
+  uint32_t wsize = 0;
+  uint32_t i = 0;
+  while (i < size) {
+    if (pos > limit) {
+      trans_->write(buf, pos);
+      wsize += pos;
+      pos = 0;
+    }
+    uint32_t n = (std::min)(size - i, 8u);
+    uint64_t zigzag[8];
+    uint64_t bits = 0;
+    for (uint32_t j = 0; j < n; ++j) {
+      zigzag[j] = toZigzag(values[i + j]);
+      bits |= zigzag[j];
+    }
+    if ((bits & ~static_cast<uint64_t>(0x7F)) == 0) {
+      // one byte each, the usual case for small ids and counts
+      for (uint32_t j = 0; j < n; ++j) {
+        buf[pos + j] = static_cast<uint8_t>(zigzag[j]);
+      }
+      pos += n;
+    } else {
+      for (uint32_t j = 0; j < n; ++j) {
+        pos += encodeVarint(zigzag[j], buf + pos);
+      }
+    }
+    i += n;
+  }
+  if (pos > 0) {
+    trans_->write(buf, pos);
+    wsize += pos;
+  }
+  return wsize;
+}
+
 /**
  * Convert l into a zigzag long. This allows negative numbers to be
  * represented compactly as a varint.
@@ -646,6 +765,16 @@ uint32_t TCompactProtocolT<Transport_>::readI64(int64_t& i64) {
   return rsize;
 }
 
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI32Array(int32_t* values, const uint32_t size) {
+  return readVarintArray(values, size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI64Array(int64_t* values, const uint32_t size) {
+  return readVarintArray(values, size);
+}
+
 /**
  * No magic here - just read a double off the wire.
  */
@@ -707,6 +836,27 @@ uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
   return rsize + (uint32_t)size;
 }
 
+/**
+ * Read a byte[] from the wire as a slice of the transport's buffer.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinary(TBufferSlice& slice) {
+  int32_t rsize = 0;
+  int32_t size;
+
+  rsize += readVarint32(size);
+
+  // Catch error cases
+  if (size < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  }
+  if (string_limit_ > 0 && size > string_limit_) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+
+  return rsize + trans_->readSlice(slice, static_cast<uint32_t>(size));
+}
+
 /**
  * Read an i32 from the wire as a varint. The MSB of each byte is set
  * if there is another byte to follow. This can read up to 5 bytes.
@@ -770,6 +920,78 @@ uint32_t TCompactProtocolT<Transport_>::readVarint64(int64_t& i64) {
   }
 }
 
+/**
+ * Read the zigzag varints of a list of i32 or i64.
+ */
+template <class Transport_>
+template <typename Int_>
+uint32_t TCompactProtocolT<Transport_>::readVarintArray(Int_* values, const uint32_t size) {
+  using detail::compact::CONTINUATION_BITS;
+  uint32_t rsize = 0;
+  uint32_t i = 0;
+  while (i < size) {
+    // Each step loads a word and a varint may take 10 bytes, so decoding
+    // out of the borrowed buffer stops 16 bytes short of its end
+    uint32_t got = 16;
+    const uint8_t* borrowed = trans_->borrow(NULL, &got);
+    if (borrowed != NULL) {
+      const uint8_t* p = borrowed;
+      const uint8_t* end = borrowed + got - 16;
+      while (i < size && p <= end) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        word = letohll(word);
+        uint64_t stops = ~word & CONTINUATION_BITS;
+        if (stops == CONTINUATION_BITS && size - i >= 8) {
+          // eight one byte varints
+          for (uint32_t j = 0; j < 8; ++j) {
+            fromZigzag((word >> (8 * j)) & 0x7F, values[i + j]);
+          }
+          p += 8;
+          i += 8;
+        } else if (stops != 0) {
+          uint32_t len = (detail::compact::lowestBit(stops) + 1) / 8;
+          if (len < 8) {
+            word &= (static_cast<uint64_t>(1) << (8 * len)) - 1;
+          }
+          fromZigzag(detail::compact::packVarint(word), values[i]);
+          p += len;
+          ++i;
+        } else {
+          // nine or ten bytes, the first eight of which are all in word
+          uint64_t val = detail::compact::packVarint(word);
+          uint32_t len = 9;
+          val |= (uint64_t)(p[8] & 0x7f) << 56;
+          if (p[8] & 0x80) {
+            val |= (uint64_t)(p[9] & 0x7f) << 63;
+            len = 10;
+            if (UNLIKELY(p[9] & 0x80)) {
+              throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+            }
+          }
+          fromZigzag(val, values[i]);
+          p += len;
+          ++i;
+        }
+      }
+      uint32_t used = static_cast<uint32_t>(p - borrowed);
+      trans_->consume(used);
+      rsize += used;
+      if (i == size) {
+        break;
+      }
+    }
+
+    // Near the end of the buffer, or none to borrow: take one varint the
+    // usual way, which may refill the buffer for the next round
+    int64_t value;
+    rsize += readVarint64(value);
+    fromZigzag(static_cast<uint64_t>(value), values[i]);
+    ++i;
+  }
+  return rsize;
+}
+
 /**
  * Convert from zigzag int to int.
  */
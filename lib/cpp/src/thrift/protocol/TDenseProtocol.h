@@ -78,6 +78,9 @@ public:
       standalone_(true) {}
 
   void setTypeSpec(TypeSpec* type_spec) { type_spec_ = type_spec; }
+
+  // Values are not encoded the way TBinaryProtocol encodes them
+  TValueEncoding getValueEncoding() const { return T_ENCODING_UNKNOWN; }
   TypeSpec* getTypeSpec() { return type_spec_; }
 
   /*
@@ -19,8 +19,20 @@
 
 #include <thrift/protocol/TJSONProtocol.h>
 
+#include <algorithm>
+#include <errno.h>
 #include <math.h>
-#include <boost/lexical_cast.hpp>
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+#include <locale.h>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits/is_unsigned.hpp>
 #include <thrift/protocol/TBase64Utils.h>
 #include <thrift/transport/TTransportException.h>
 
@@ -52,6 +64,10 @@ static const std::string kThriftNan("NaN");
 static const std::string kThriftInfinity("Infinity");
 static const std::string kThriftNegativeInfinity("-Infinity");
 
+// Longest number read; shortest round trip doubles take at most 24
+// characters and integers 20
+static const uint32_t kJSONMaxNumericChars = 64;
+
 static const std::string kTypeNameBool("tf");
 static const std::string kTypeNameByte("i8");
 static const std::string kTypeNameI16("i16");
@@ -279,6 +295,163 @@ static bool isJSONNumeric(uint8_t ch) {
   return false;
 }
 
+// Returns how many characters at the start of str, up to len, can be
+// copied as they are: up to the first '"' or '\\' and, if stopAtControl,
+// the first control character. Eight characters are checked at a time.
+static uint32_t plainJSONChars(const uint8_t* str, uint32_t len, bool stopAtControl) {
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+  uint32_t n = 0;
+  while (n + 8 <= len) {
+    uint64_t word;
+    memcpy(&word, str + n, sizeof(word));
+    // subtracting borrows into the high bit of a byte that was below the
+    // subtrahend, which for the xors means one that matched
+    uint64_t below = ((word ^ (ones * kJSONStringDelimiter)) - ones)
+                     | ((word ^ (ones * kJSONBackslash)) - ones);
+    if (stopAtControl) {
+      below |= word - ones * 0x20;
+    }
+    if (below & ~word & highs) {
+      break;
+    }
+    n += 8;
+  }
+  for (; n < len; ++n) {
+    uint8_t ch = str[n];
+    if (ch == kJSONStringDelimiter || ch == kJSONBackslash || (stopAtControl && ch < 0x20)) {
+      break;
+    }
+  }
+  return n;
+}
+
+// Writes the decimal digits of num to buf, which must hold 21 characters,
+// and returns how many were written
+static uint32_t formatJSONInteger(uint64_t num, char* buf) {
+  char digits[20];
+  uint32_t n = 0;
+  do {
+    digits[n++] = static_cast<char>('0' + num % 10);
+    num /= 10;
+  } while (num != 0);
+  for (uint32_t i = 0; i < n; ++i) {
+    buf[i] = digits[n - 1 - i];
+  }
+  return n;
+}
+
+static uint32_t formatJSONInteger(int64_t num, char* buf) {
+  if (num >= 0) {
+    return formatJSONInteger(static_cast<uint64_t>(num), buf);
+  }
+  buf[0] = '-';
+  // negate in unsigned arithmetic so the minimum value does not overflow
+  return 1 + formatJSONInteger(~static_cast<uint64_t>(num) + 1, buf + 1);
+}
+
+// Parses the len characters at str as an integer of NumberType, returning
+// false if they are not one or it does not fit. As with lexical_cast, a
+// negative value for an unsigned type wraps around.
+template <typename NumberType>
+static bool parseJSONInteger(const char* str, uint32_t len, NumberType& num) {
+  const char* end = str + len;
+  bool negative = false;
+  if (str != end && (*str == '-' || *str == '+')) {
+    negative = *str == '-';
+    ++str;
+  }
+  if (str == end) {
+    return false;
+  }
+  uint64_t magnitude = 0;
+  for (; str != end; ++str) {
+    if (*str < '0' || *str > '9') {
+      return false;
+    }
+    uint64_t digit = static_cast<uint64_t>(*str - '0');
+    if (magnitude > ((std::numeric_limits<uint64_t>::max)() - digit) / 10) {
+      return false;
+    }
+    magnitude = magnitude * 10 + digit;
+  }
+
+  const uint64_t max = static_cast<uint64_t>((std::numeric_limits<NumberType>::max)());
+  if (std::numeric_limits<NumberType>::is_signed && negative) {
+    // the minimum is one further from zero than the maximum
+    if (magnitude > max + 1) {
+      return false;
+    }
+    num = magnitude == 0 ? 0 : static_cast<NumberType>(-static_cast<int64_t>(magnitude - 1) - 1);
+    return true;
+  }
+  if (magnitude > max) {
+    return false;
+  }
+  num = static_cast<NumberType>(negative ? ~magnitude + 1 : magnitude);
+  return true;
+}
+
+#ifndef __cpp_lib_to_chars
+// The locale's decimal point, which strtod() and snprintf() use
+static char localeDecimalPoint() {
+  const char* point = localeconv()->decimal_point;
+  return point != NULL && point[0] != '\0' ? point[0] : '.';
+}
+#endif
+
+// Writes the shortest representation of the finite number num that reads
+// back as the same value to buf, which must hold 32 characters, and
+// returns its length
+static uint32_t formatJSONDouble(double num, char* buf) {
+#ifdef __cpp_lib_to_chars
+  return static_cast<uint32_t>(std::to_chars(buf, buf + 32, num).ptr - buf);
+#else
+  int len = 0;
+  for (int precision = 15; precision <= 17; ++precision) {
+    len = THRIFT_SNPRINTF(buf, 32, "%.*g", precision, num);
+    if (strtod(buf, NULL) == num) {
+      break;
+    }
+  }
+  char point = localeDecimalPoint();
+  if (point != '.') {
+    for (int i = 0; i < len; ++i) {
+      if (buf[i] == point) {
+        buf[i] = '.';
+      }
+    }
+  }
+  return static_cast<uint32_t>(len);
+#endif
+}
+
+// Parses the len characters at str as a double, returning false if they
+// are not one or it is out of range
+static bool parseJSONDouble(const char* str, uint32_t len, double& num) {
+  if (len > 0 && *str == '+') {
+    ++str;
+    --len;
+  }
+#ifdef __cpp_lib_to_chars
+  std::from_chars_result parsed = std::from_chars(str, str + len, num);
+  return parsed.ec == std::errc() && parsed.ptr == str + len && len > 0;
+#else
+  char buf[kJSONMaxNumericChars + 1];
+  char point = localeDecimalPoint();
+  for (uint32_t i = 0; i < len; ++i) {
+    buf[i] = str[i] == '.' ? point : str[i];
+  }
+  buf[len] = '\0';
+  char* end;
+  errno = 0;
+  num = strtod(buf, &end);
+  // denormals set ERANGE too, but are not out of range
+  bool outOfRange = errno == ERANGE && (num == 0 || num == HUGE_VAL || num == -HUGE_VAL);
+  return len > 0 && end == buf + len && !outOfRange;
+#endif
+}
+
 /**
  * Class to serve as base JSON context and as base class for other context
  * implementations
@@ -444,10 +617,23 @@ uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
   uint32_t result = context_->write(*trans_);
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  std::string::const_iterator iter(str.begin());
-  std::string::const_iterator end(str.end());
-  while (iter != end) {
-    result += writeJSONChar(*iter++);
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  const uint8_t* bytes = (const uint8_t*)str.data();
+  uint32_t len = static_cast<uint32_t>(str.length());
+  while (len > 0) {
+    // Write runs that need no escaping in one go
+    uint32_t run = plainJSONChars(bytes, len, true);
+    if (run > 0) {
+      trans_->write(bytes, run);
+      result += run;
+      bytes += run;
+      len -= run;
+    }
+    if (len > 0) {
+      result += writeJSONChar(*bytes++);
+      --len;
+    }
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -459,23 +645,19 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
   uint32_t result = context_->write(*trans_);
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  uint8_t b[4];
+  uint8_t b[4096];
   const uint8_t* bytes = (const uint8_t*)str.c_str();
   if (str.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   uint32_t len = static_cast<uint32_t>(str.length());
-  while (len >= 3) {
-    // Encode 3 bytes at a time
-    base64_encode(bytes, 3, b);
-    trans_->write(b, 4);
-    result += 4;
-    bytes += 3;
-    len -= 3;
-  }
-  if (len) { // Handle remainder
-    base64_encode(bytes, len, b);
-    trans_->write(b, len + 1);
-    result += len + 1;
+  while (len > 0) {
+    // Encode as many bytes as fill the buffer at a time
+    uint32_t n = (std::min)(len, static_cast<uint32_t>(sizeof(b) / 4 * 3));
+    uint32_t encoded = base64_encode_block(bytes, n, b);
+    trans_->write(b, encoded);
+    result += encoded;
+    bytes += n;
+    len -= n;
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -485,17 +667,18 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
 // if the context requires it (eg: key in a map pair).
 template <typename NumberType>
 uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
+  typedef typename boost::mpl::if_c<boost::is_unsigned<NumberType>::value, uint64_t, int64_t>::type
+      WideType;
   uint32_t result = context_->write(*trans_);
-  std::string val(boost::lexical_cast<std::string>(num));
+  char val[21];
+  uint32_t len = formatJSONInteger(static_cast<WideType>(num), val);
   bool escapeNum = context_->escapeNum();
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
+  trans_->write(reinterpret_cast<const uint8_t*>(val), len);
+  result += len;
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
@@ -507,27 +690,21 @@ uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
 // "NaN" or "Infinity" or "-Infinity".
 uint32_t TJSONProtocol::writeJSONDouble(double num) {
   uint32_t result = context_->write(*trans_);
-  std::string val(boost::lexical_cast<std::string>(num));
-
-  // Normalize output of boost::lexical_cast for NaNs and Infinities
+  char buf[32];
+  const char* val = buf;
+  uint32_t len;
   bool special = false;
-  switch (val[0]) {
-  case 'N':
-  case 'n':
-    val = kThriftNan;
+  if (num != num) {
+    val = kThriftNan.data();
+    len = static_cast<uint32_t>(kThriftNan.length());
     special = true;
-    break;
-  case 'I':
-  case 'i':
-    val = kThriftInfinity;
+  } else if (num == HUGE_VAL || num == -HUGE_VAL) {
+    const std::string& name = num > 0 ? kThriftInfinity : kThriftNegativeInfinity;
+    val = name.data();
+    len = static_cast<uint32_t>(name.length());
     special = true;
-    break;
-  case '-':
-    if ((val[1] == 'I') || (val[1] == 'i')) {
-      val = kThriftNegativeInfinity;
-      special = true;
-    }
-    break;
+  } else {
+    len = formatJSONDouble(num, buf);
   }
 
   bool escapeNum = special || context_->escapeNum();
@@ -535,10 +712,8 @@ uint32_t TJSONProtocol::writeJSONDouble(double num) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
+  trans_->write(reinterpret_cast<const uint8_t*>(val), len);
+  result += len;
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
@@ -656,9 +831,7 @@ uint32_t TJSONProtocol::writeBool(const bool value) {
 }
 
 uint32_t TJSONProtocol::writeByte(const int8_t byte) {
-  // writeByte() must be handled specially because boost::lexical cast sees
-  // int8_t as a text type instead of an integer type
-  return writeJSONInteger((int16_t)byte);
+  return writeJSONInteger(byte);
 }
 
 uint32_t TJSONProtocol::writeI16(const int16_t i16) {
@@ -713,6 +886,19 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
   uint8_t ch;
   str.clear();
   while (true) {
+    // Copy runs without quotes or escapes straight out of the transport's
+    // buffer
+    uint32_t avail = 1;
+    const uint8_t* borrowed = trans_->borrow(NULL, &avail);
+    if (borrowed != NULL) {
+      uint32_t run = plainJSONChars(borrowed, avail, false);
+      if (run > 0) {
+        str.append((const char*)borrowed, run);
+        trans_->consume(run);
+        result += run;
+      }
+    }
+
     ch = reader_.read();
     ++result;
     if (ch == kJSONStringDelimiter) {
@@ -740,43 +926,49 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
 
 // Reads a block of base64 characters, decoding it, and returns via str
 uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
-  std::string tmp;
-  uint32_t result = readJSONString(tmp);
-  uint8_t* b = (uint8_t*)tmp.c_str();
-  if (tmp.length() > (std::numeric_limits<uint32_t>::max)())
+  uint32_t result = readJSONString(str);
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  uint32_t len = static_cast<uint32_t>(tmp.length());
-  str.clear();
-  while (len >= 4) {
-    base64_decode(b, 4);
-    str.append((const char*)b, 3);
-    b += 4;
-    len -= 4;
-  }
-  // Don't decode if we hit the end or got a single leftover byte (invalid
-  // base64 but legal for skip of regular string type)
-  if (len > 1) {
-    base64_decode(b, len);
-    str.append((const char*)b, len - 1);
+  // Decode in place. A single leftover character is invalid base64 but
+  // legal for skip of regular string type, so it is dropped.
+  uint32_t len = static_cast<uint32_t>(str.length());
+  if (len > 0) {
+    uint8_t* b = (uint8_t*)&str[0];
+    str.resize(base64_decode_block(b, len, b));
   }
   return result;
 }
 
 // Reads a sequence of characters, stopping at the first one that is not
-// a valid JSON numeric character.
-uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
-  uint32_t result = 0;
-  str.clear();
+// a valid JSON numeric character, into buf, which holds size characters.
+uint32_t TJSONProtocol::readJSONNumericChars(char* buf, uint32_t size, uint32_t& len) {
+  len = 0;
   while (true) {
     uint8_t ch = reader_.peek();
     if (!isJSONNumeric(ch)) {
       break;
     }
+    if (len == size) {
+      throw TProtocolException(TProtocolException::INVALID_DATA, "Numeric value too long");
+    }
     reader_.read();
-    str += ch;
-    ++result;
+    buf[len++] = static_cast<char>(ch);
+
+    // take the rest of the run straight out of the transport's buffer
+    uint32_t avail = 1;
+    const uint8_t* borrowed = trans_->borrow(NULL, &avail);
+    if (borrowed != NULL) {
+      uint32_t n = 0;
+      while (n < avail && isJSONNumeric(borrowed[n])) {
+        if (len == size) {
+          throw TProtocolException(TProtocolException::INVALID_DATA, "Numeric value too long");
+        }
+        buf[len++] = static_cast<char>(borrowed[n++]);
+      }
+      trans_->consume(n);
+    }
   }
-  return result;
+  return len;
 }
 
 // Reads a sequence of characters and assembles them into a number,
@@ -787,13 +979,12 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
   if (context_->escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
-  std::string str;
-  result += readJSONNumericChars(str);
-  try {
-    num = boost::lexical_cast<NumberType>(str);
-  } catch (boost::bad_lexical_cast e) {
-    throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                 "Expected numeric value; got \"" + str + "\"");
+  char str[kJSONMaxNumericChars];
+  uint32_t len;
+  result += readJSONNumericChars(str, sizeof(str), len);
+  if (!parseJSONInteger(str, len, num)) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Expected numeric value; got \"" + std::string(str, len) + "\"");
   }
   if (context_->escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
@@ -804,8 +995,8 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
 // Reads a JSON number or string and interprets it as a double.
 uint32_t TJSONProtocol::readJSONDouble(double& num) {
   uint32_t result = context_->read(reader_);
-  std::string str;
   if (reader_.peek() == kJSONStringDelimiter) {
+    std::string str;
     result += readJSONString(str, true);
     // Check for NaN, Infinity and -Infinity
     if (str == kThriftNan) {
@@ -817,14 +1008,13 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
     } else {
       if (!context_->escapeNum()) {
         // Throw exception -- we should not be in a string in this case
-        throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                     "Numeric data unexpectedly quoted");
+        throw TProtocolException(TProtocolException::INVALID_DATA,
+                                 "Numeric data unexpectedly quoted");
       }
-      try {
-        num = boost::lexical_cast<double>(str);
-      } catch (boost::bad_lexical_cast e) {
-        throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                     "Expected numeric value; got \"" + str + "\"");
+      if (str.length() > kJSONMaxNumericChars
+          || !parseJSONDouble(str.data(), static_cast<uint32_t>(str.length()), num)) {
+        throw TProtocolException(TProtocolException::INVALID_DATA,
+                                 "Expected numeric value; got \"" + str + "\"");
       }
     }
   } else {
@@ -832,12 +1022,12 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
       // This will throw - we should have had a quote if escapeNum == true
       readJSONSyntaxChar(kJSONStringDelimiter);
     }
-    result += readJSONNumericChars(str);
-    try {
-      num = boost::lexical_cast<double>(str);
-    } catch (boost::bad_lexical_cast e) {
-      throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                   "Expected numeric value; got \"" + str + "\"");
+    char str[kJSONMaxNumericChars];
+    uint32_t len;
+    result += readJSONNumericChars(str, sizeof(str), len);
+    if (!parseJSONDouble(str, len, num)) {
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Expected numeric value; got \"" + std::string(str, len) + "\"");
     }
   }
   return result;
@@ -984,8 +1174,8 @@ uint32_t TJSONProtocol::readBool(bool& value) {
   return readJSONInteger(value);
 }
 
-// readByte() must be handled properly because boost::lexical cast sees int8_t
-// as a text type instead of an integer type
+// readByte() reads an int16_t so that bytes sent as unsigned values, up to
+// 255, still read back
 uint32_t TJSONProtocol::readByte(int8_t& byte) {
   int16_t tmp = (int16_t)byte;
   uint32_t result = readJSONInteger(tmp);
@@ -129,7 +129,7 @@ private:
 
   uint32_t readJSONBase64(std::string& str);
 
-  uint32_t readJSONNumericChars(std::string& str);
+  uint32_t readJSONNumericChars(char* buf, uint32_t size, uint32_t& len);
 
   template <typename NumberType>
   uint32_t readJSONInteger(NumberType& num);
@@ -178,6 +178,17 @@ enum TMessageType {
   T_ONEWAY     = 4
 };
 
+/**
+ * Encodings in which the serialized form of a value does not depend on
+ * anything written before it, so it can be copied verbatim between protocol
+ * instances using the same encoding. Used by lazily deserialized fields.
+ */
+enum TValueEncoding {
+  T_ENCODING_UNKNOWN = 0,
+  T_ENCODING_BINARY  = 1,
+  T_ENCODING_COMPACT = 2
+};
+
 
 /**
  * Helper template for implementing TProtocol::skip().
@@ -348,6 +359,37 @@ public:
 
   virtual uint32_t writeBinary_virt(const std::string& str) = 0;
 
+  virtual uint32_t writeBinary_virt(const TBufferSlice& slice) { return writeBinary_virt(slice.str()); }
+
+  /**
+   * Bulk versions of writeI32(), writeI64() and writeDouble() for the
+   * elements of a list. The defaults write one element at a time;
+   * protocols that can encode a whole array at once override them.
+   */
+  virtual uint32_t writeI32Array_virt(const int32_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += writeI32_virt(values[i]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t writeI64Array_virt(const int64_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += writeI64_virt(values[i]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t writeDoubleArray_virt(const double* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += writeDouble_virt(values[i]);
+    }
+    return xfer;
+  }
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int32_t seqid) {
@@ -455,6 +497,26 @@ public:
     return writeBinary_virt(str);
   }
 
+  uint32_t writeBinary(const TBufferSlice& slice) {
+    T_VIRTUAL_CALL();
+    return writeBinary_virt(slice);
+  }
+
+  uint32_t writeI32Array(const int32_t* values, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return writeI32Array_virt(values, size);
+  }
+
+  uint32_t writeI64Array(const int64_t* values, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return writeI64Array_virt(values, size);
+  }
+
+  uint32_t writeDoubleArray(const double* values, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return writeDoubleArray_virt(values, size);
+  }
+
   /**
    * Reading functions
    */
@@ -503,6 +565,46 @@ public:
 
   virtual uint32_t readBinary_virt(std::string& str) = 0;
 
+  /**
+   * Protocols that can read binary fields as slices of the transport's
+   * buffer override this; the default reads a std::string and copies it.
+   */
+  virtual uint32_t readBinary_virt(TBufferSlice& slice) {
+    std::string str;
+    uint32_t result = readBinary_virt(str);
+    slice.assign(str);
+    return result;
+  }
+
+  /**
+   * Bulk versions of readI32(), readI64() and readDouble() that fill an
+   * array with the elements of a list. The defaults read one element at a
+   * time; protocols that can decode a whole array at once override them.
+   */
+  virtual uint32_t readI32Array_virt(int32_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += readI32_virt(values[i]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t readI64Array_virt(int64_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += readI64_virt(values[i]);
+    }
+    return xfer;
+  }
+
+  virtual uint32_t readDoubleArray_virt(double* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += readDouble_virt(values[i]);
+    }
+    return xfer;
+  }
+
   uint32_t readMessageBegin(std::string& name, TMessageType& messageType, int32_t& seqid) {
     T_VIRTUAL_CALL();
     return readMessageBegin_virt(name, messageType, seqid);
@@ -603,6 +705,26 @@ public:
     return readBinary_virt(str);
   }
 
+  uint32_t readBinary(TBufferSlice& slice) {
+    T_VIRTUAL_CALL();
+    return readBinary_virt(slice);
+  }
+
+  uint32_t readI32Array(int32_t* values, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return readI32Array_virt(values, size);
+  }
+
+  uint32_t readI64Array(int64_t* values, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return readI64Array_virt(values, size);
+  }
+
+  uint32_t readDoubleArray(double* values, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return readDoubleArray_virt(values, size);
+  }
+
   /*
    * std::vector is specialized for bool, and its elements are individual bits
    * rather than bools.   We need to define a different version of readBool()
@@ -624,6 +746,21 @@ public:
 
   inline boost::shared_ptr<TTransport> getTransport() { return ptrans_; }
 
+  /**
+   * The encoding of the values this protocol reads and writes, or
+   * T_ENCODING_UNKNOWN if their serialized form cannot be copied from one
+   * protocol instance to another.
+   */
+  virtual TValueEncoding getValueEncoding() const { return T_ENCODING_UNKNOWN; }
+
+  /**
+   * The largest string and container sizes this protocol reads, or 0 if it
+   * does not limit them. Values read from its serialized form later on, as
+   * TLazy does, are held to the same limits.
+   */
+  virtual int32_t getStringSizeLimit() const { return 0; }
+  virtual int32_t getContainerSizeLimit() const { return 0; }
+
   // TODO: remove these two calls, they are for backwards
   // compatibility
   inline boost::shared_ptr<TTransport> getInputTransport() { return ptrans_; }
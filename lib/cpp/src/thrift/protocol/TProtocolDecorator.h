@@ -92,6 +92,18 @@ public:
   virtual uint32_t writeDouble_virt(const double dub) { return protocol->writeDouble(dub); }
   virtual uint32_t writeString_virt(const std::string& str) { return protocol->writeString(str); }
   virtual uint32_t writeBinary_virt(const std::string& str) { return protocol->writeBinary(str); }
+  virtual uint32_t writeBinary_virt(const TBufferSlice& slice) {
+    return protocol->writeBinary(slice);
+  }
+  virtual uint32_t writeI32Array_virt(const int32_t* values, const uint32_t size) {
+    return protocol->writeI32Array(values, size);
+  }
+  virtual uint32_t writeI64Array_virt(const int64_t* values, const uint32_t size) {
+    return protocol->writeI64Array(values, size);
+  }
+  virtual uint32_t writeDoubleArray_virt(const double* values, const uint32_t size) {
+    return protocol->writeDoubleArray(values, size);
+  }
 
   virtual uint32_t readMessageBegin_virt(std::string& name,
                                          TMessageType& messageType,
@@ -140,6 +152,20 @@ public:
 
   virtual uint32_t readString_virt(std::string& str) { return protocol->readString(str); }
   virtual uint32_t readBinary_virt(std::string& str) { return protocol->readBinary(str); }
+  virtual uint32_t readBinary_virt(TBufferSlice& slice) { return protocol->readBinary(slice); }
+  virtual uint32_t readI32Array_virt(int32_t* values, const uint32_t size) {
+    return protocol->readI32Array(values, size);
+  }
+  virtual uint32_t readI64Array_virt(int64_t* values, const uint32_t size) {
+    return protocol->readI64Array(values, size);
+  }
+  virtual uint32_t readDoubleArray_virt(double* values, const uint32_t size) {
+    return protocol->readDoubleArray(values, size);
+  }
+
+  virtual TValueEncoding getValueEncoding() const { return protocol->getValueEncoding(); }
+  virtual int32_t getStringSizeLimit() const { return protocol->getStringSizeLimit(); }
+  virtual int32_t getContainerSizeLimit() const { return protocol->getContainerSizeLimit(); }
 
 private:
   shared_ptr<TProtocol> protocol;
@@ -393,6 +393,18 @@ public:
     return static_cast<Protocol_*>(this)->writeBinary(str);
   }
 
+  virtual uint32_t writeI32Array_virt(const int32_t* values, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->writeI32Array(values, size);
+  }
+
+  virtual uint32_t writeI64Array_virt(const int64_t* values, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->writeI64Array(values, size);
+  }
+
+  virtual uint32_t writeDoubleArray_virt(const double* values, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->writeDoubleArray(values, size);
+  }
+
   /**
    * Reading functions
    */
@@ -471,6 +483,18 @@ public:
     return static_cast<Protocol_*>(this)->readBinary(str);
   }
 
+  virtual uint32_t readI32Array_virt(int32_t* values, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->readI32Array(values, size);
+  }
+
+  virtual uint32_t readI64Array_virt(int64_t* values, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->readI64Array(values, size);
+  }
+
+  virtual uint32_t readDoubleArray_virt(double* values, const uint32_t size) {
+    return static_cast<Protocol_*>(this)->readDoubleArray(values, size);
+  }
+
   virtual uint32_t skip_virt(TType type) { return static_cast<Protocol_*>(this)->skip(type); }
 
   /*
@@ -503,6 +527,59 @@ public:
   }
   using Super_::readBool; // so we don't hide readBool(bool&)
 
+  /*
+   * Provide default bulk array methods that use the non-virtual element
+   * methods, one element at a time. Protocols with a fixed-width encoding
+   * can override them.
+   */
+  uint32_t writeI32Array(const int32_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += static_cast<Protocol_*>(this)->writeI32(values[i]);
+    }
+    return xfer;
+  }
+
+  uint32_t writeI64Array(const int64_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += static_cast<Protocol_*>(this)->writeI64(values[i]);
+    }
+    return xfer;
+  }
+
+  uint32_t writeDoubleArray(const double* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += static_cast<Protocol_*>(this)->writeDouble(values[i]);
+    }
+    return xfer;
+  }
+
+  uint32_t readI32Array(int32_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += static_cast<Protocol_*>(this)->readI32(values[i]);
+    }
+    return xfer;
+  }
+
+  uint32_t readI64Array(int64_t* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += static_cast<Protocol_*>(this)->readI64(values[i]);
+    }
+    return xfer;
+  }
+
+  uint32_t readDoubleArray(double* values, const uint32_t size) {
+    uint32_t xfer = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      xfer += static_cast<Protocol_*>(this)->readDouble(values[i]);
+    }
+    return xfer;
+  }
+
 protected:
   TVirtualProtocol(boost::shared_ptr<TTransport> ptrans) : Super_(ptrans) {}
 };
@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/server/TBufferPool.h>
+
+#include <cstdlib>
+#include <new>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::concurrency::Guard;
+
+TBufferPool::TBufferPool(size_t maxCachedBytes)
+  : maxCachedBytes_(maxCachedBytes), bytesCached_(0), bytesInUse_(0) {
+}
+
+TBufferPool::~TBufferPool() {
+  for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+    for (size_t j = 0; j < freeLists_[i].size(); ++j) {
+      std::free(freeLists_[i][j]);
+    }
+  }
+}
+
+int TBufferPool::sizeClass(uint32_t size) {
+  int sizeClass = 0;
+  for (uint32_t classSize = MIN_BUFFER_SIZE; classSize < size; classSize *= 2) {
+    if (++sizeClass == NUM_SIZE_CLASSES) {
+      break;
+    }
+  }
+  return sizeClass;
+}
+
+uint8_t* TBufferPool::borrow(uint32_t size, uint32_t* capacity) {
+  int index = sizeClass(size);
+  uint32_t bufSize = index < NUM_SIZE_CLASSES ? MIN_BUFFER_SIZE << index : size;
+
+  {
+    Guard g(mutex_);
+    bytesInUse_ += bufSize;
+    if (index < NUM_SIZE_CLASSES && !freeLists_[index].empty()) {
+      uint8_t* buf = freeLists_[index].back();
+      freeLists_[index].pop_back();
+      bytesCached_ -= bufSize;
+      *capacity = bufSize;
+      return buf;
+    }
+  }
+
+  uint8_t* buf = static_cast<uint8_t*>(std::malloc(bufSize));
+  if (buf == NULL) {
+    Guard g(mutex_);
+    bytesInUse_ -= bufSize;
+    throw std::bad_alloc();
+  }
+  *capacity = bufSize;
+  return buf;
+}
+
+void TBufferPool::giveBack(uint8_t* buf, uint32_t capacity) {
+  if (buf == NULL) {
+    return;
+  }
+
+  int index = sizeClass(capacity);
+  {
+    Guard g(mutex_);
+    bytesInUse_ -= capacity;
+    if (index < NUM_SIZE_CLASSES && bytesCached_ + capacity <= maxCachedBytes_) {
+      freeLists_[index].push_back(buf);
+      bytesCached_ += capacity;
+      return;
+    }
+  }
+  std::free(buf);
+}
+
+size_t TBufferPool::getBytesInUse() const {
+  Guard g(mutex_);
+  return bytesInUse_;
+}
+
+size_t TBufferPool::getBytesCached() const {
+  Guard g(mutex_);
+  return bytesCached_;
+}
+
+void TBufferPool::setMaxCachedBytes(size_t maxCachedBytes) {
+  std::vector<uint8_t*> trimmed;
+  {
+    Guard g(mutex_);
+    maxCachedBytes_ = maxCachedBytes;
+    // drop cached buffers, largest first, until we are within the limit
+    for (int i = NUM_SIZE_CLASSES - 1; i >= 0 && bytesCached_ > maxCachedBytes_; --i) {
+      while (!freeLists_[i].empty() && bytesCached_ > maxCachedBytes_) {
+        trimmed.push_back(freeLists_[i].back());
+        freeLists_[i].pop_back();
+        bytesCached_ -= MIN_BUFFER_SIZE << i;
+      }
+    }
+  }
+  for (size_t i = 0; i < trimmed.size(); ++i) {
+    std::free(trimmed[i]);
+  }
+}
+
+size_t TBufferPool::getMaxCachedBytes() const {
+  Guard g(mutex_);
+  return maxCachedBytes_;
+}
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TBUFFERPOOL_H_
+#define _THRIFT_SERVER_TBUFFERPOOL_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/concurrency/Mutex.h>
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Size-classed pool of I/O buffers.  Buffers are rounded up to a power of
+ * two between MIN_BUFFER_SIZE and MAX_POOLED_SIZE; returned buffers are kept
+ * on a free list per size class until the pool caches more than its limit,
+ * at which point they go back to the heap.  Larger buffers are never cached.
+ *
+ * The pool also keeps track of the bytes currently lent out, so that their
+ * owner can enforce a memory budget.  It is safe to use from several threads,
+ * though it is meant to be used mostly by a single one (e.g. an IO thread).
+ */
+class TBufferPool : boost::noncopyable {
+public:
+  /// Size of the smallest size class
+  static const uint32_t MIN_BUFFER_SIZE = 1024;
+
+  /// Size of the largest size class
+  static const uint32_t MAX_POOLED_SIZE = 1024 * 1024;
+
+  /// Free bytes cached by default
+  static const size_t DEFAULT_MAX_CACHED_BYTES = 4 * 1024 * 1024;
+
+  explicit TBufferPool(size_t maxCachedBytes = DEFAULT_MAX_CACHED_BYTES);
+
+  ~TBufferPool();
+
+  /**
+   * Borrow a buffer of at least size bytes.
+   *
+   * @param size the number of bytes needed.
+   * @param capacity set to the actual size of the buffer.
+   * @return the buffer, to be handed back with giveBack().
+   * @throws std::bad_alloc if memory is exhausted.
+   */
+  uint8_t* borrow(uint32_t size, uint32_t* capacity);
+
+  /**
+   * Hand back a buffer obtained from borrow().
+   *
+   * @param buf the buffer, may be NULL.
+   * @param capacity the capacity borrow() returned with it.
+   */
+  void giveBack(uint8_t* buf, uint32_t capacity);
+
+  /// Bytes currently lent out.
+  size_t getBytesInUse() const;
+
+  /// Bytes held on the free lists.
+  size_t getBytesCached() const;
+
+  /// Set the most bytes kept on the free lists; 0 disables caching.
+  void setMaxCachedBytes(size_t maxCachedBytes);
+
+  size_t getMaxCachedBytes() const;
+
+private:
+  /// # of power of two size classes from MIN_BUFFER_SIZE to MAX_POOLED_SIZE
+  static const int NUM_SIZE_CLASSES = 11;
+
+  /// Size class for size bytes, NUM_SIZE_CLASSES if too large to pool.
+  static int sizeClass(uint32_t size);
+
+  mutable concurrency::Mutex mutex_;
+  std::vector<uint8_t*> freeLists_[NUM_SIZE_CLASSES];
+  size_t maxCachedBytes_;
+  size_t bytesCached_;
+  size_t bytesInUse_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TBUFFERPOOL_H_
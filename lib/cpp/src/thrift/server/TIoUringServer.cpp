@@ -0,0 +1,1051 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/server/TIoUringServer.h>
+#include <thrift/server/TThreadedServer.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/transport/PlatformSocket.h>
+
+#include <boost/make_shared.hpp>
+
+#include <string.h>
+#include <typeinfo>
+#include <errno.h>
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Multishot receive arrived together with provided buffer rings, so it is
+// the oldest header revision that has everything the ring thread uses
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_EVENTFD_H) && defined(IORING_RECV_MULTISHOT)
+#define THRIFT_HAVE_IO_URING 1
+#endif
+
+#ifndef SOCKOPT_CAST_T
+#ifndef _WIN32
+#define SOCKOPT_CAST_T void
+#else
+#define SOCKOPT_CAST_T char
+#endif // _WIN32
+#endif
+
+template <class T>
+inline const SOCKOPT_CAST_T* const_cast_sockopt(const T* v) {
+  return reinterpret_cast<const SOCKOPT_CAST_T*>(v);
+}
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+using namespace apache::thrift::concurrency;
+using namespace std;
+using boost::shared_ptr;
+
+#ifdef THRIFT_HAVE_IO_URING
+
+namespace {
+
+// Operation tags kept in the low bits of an SQE's user_data. Connections
+// are heap allocated, so their addresses leave these bits clear.
+enum OpType { OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3, OP_CANCEL = 4, OP_WAKEUP = 5 };
+const uint64_t OP_MASK = 7;
+
+// Provided buffer group used for all connection receives
+const uint16_t RECV_BUFFER_GROUP = 0;
+
+int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+int sys_io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+uint32_t roundUpPowerOfTwo(uint32_t v) {
+  uint32_t r = 1;
+  while (r < v && r < 0x8000) {
+    r <<= 1;
+  }
+  return r;
+}
+}
+
+/**
+ * Minimal io_uring wrapper: the mapped submission and completion queues plus
+ * one provided buffer ring for receives. Only the ring thread touches it.
+ */
+class TIoUringServer::Ring {
+public:
+  Ring(boost::atomic<uint64_t>& submitCalls)
+    : submitCalls_(submitCalls),
+      fd_(-1),
+      sqRing_(MAP_FAILED),
+      cqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      cqRingSize_(0),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqesSize_(0),
+      sqeTail_(0),
+      sqeHead_(0),
+      bufRing_(static_cast<struct io_uring_buf_ring*>(MAP_FAILED)),
+      bufRingSize_(0),
+      bufMem_(NULL),
+      bufCount_(0),
+      bufSize_(0),
+      bufTail_(0) {}
+
+  ~Ring() {
+    if (bufRing_ != MAP_FAILED) {
+      munmap(bufRing_, bufRingSize_);
+    }
+    delete[] bufMem_;
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+      munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+      munmap(sqRing_, sqRingSize_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  /**
+   * Creates the ring and registers the receive buffers. Returns false with
+   * errno set if the kernel lacks anything the server needs.
+   */
+  bool init(uint32_t entries, uint32_t bufCount, uint32_t bufSize) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    fd_ = sys_io_uring_setup(entries, &p);
+    if (fd_ < 0 && errno == EINVAL) {
+      // older kernels reject the hint flags, they are only an optimization
+      memset(&p, 0, sizeof(p));
+      fd_ = sys_io_uring_setup(entries, &p);
+    }
+    if (fd_ < 0) {
+      return false;
+    }
+
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      sqRingSize_ = cqRingSize_ = (std::max)(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                   IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+      return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      cqRing_ = sqRing_;
+    } else {
+      cqRing_ = mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                     IORING_OFF_CQ_RING);
+      if (cqRing_ == MAP_FAILED) {
+        return false;
+      }
+    }
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, fd_,
+                                                   IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<uint32_t*>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<uint32_t*>(sq + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<uint32_t*>(sq + p.sq_off.ring_mask);
+    sqEntries_ = p.sq_entries;
+    uint32_t* sqArray = reinterpret_cast<uint32_t*>(sq + p.sq_off.array);
+    for (uint32_t i = 0; i < sqEntries_; ++i) {
+      sqArray[i] = i;
+    }
+    sqeTail_ = sqeHead_ = *sqTail_;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<uint32_t*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<uint32_t*>(cq + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<uint32_t*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    return probe() && initBuffers(bufCount, bufSize);
+  }
+
+  /**
+   * Returns a zeroed SQE, submitting what is queued first if the
+   * submission queue is full. Never returns NULL.
+   */
+  struct io_uring_sqe* getSqe() {
+    while (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+      if (submit(0) < 0 && errno != EBUSY && errno != EAGAIN) {
+        throw TException("TIoUringServer: io_uring_enter failed: " + errnoString(errno));
+      }
+    }
+    struct io_uring_sqe* sqe = &sqes_[sqeTail_ & sqMask_];
+    memset(sqe, 0, sizeof(*sqe));
+    ++sqeTail_;
+    return sqe;
+  }
+
+  /**
+   * Hands all queued SQEs to the kernel and optionally waits for
+   * completions, in a single io_uring_enter() call.
+   */
+  int submit(uint32_t waitFor) {
+    uint32_t toSubmit = sqeTail_ - sqeHead_;
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    int ret;
+    do {
+      ++submitCalls_;
+      ret = sys_io_uring_enter(fd_, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR && !waitFor);
+    if (ret > 0) {
+      sqeHead_ += ret;
+    }
+    return ret;
+  }
+
+  /// Pops the next completion, returning false when the queue is empty
+  bool nextCqe(uint64_t& userData, int32_t& res, uint32_t& flags) {
+    uint32_t head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    const struct io_uring_cqe* cqe = &cqes_[head & cqMask_];
+    userData = cqe->user_data;
+    res = cqe->res;
+    flags = cqe->flags;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  const uint8_t* buffer(uint16_t bid) const { return bufMem_ + static_cast<size_t>(bid) * bufSize_; }
+
+  /// Gives a receive buffer back to the kernel
+  void recycleBuffer(uint16_t bid) {
+    // Not bufRing_->bufs: the header's flex array member ends up at offset 8
+    // when compiled as C++, while the kernel expects the entries at offset 0
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(bufRing_)
+                               + (bufTail_ & (bufCount_ - 1));
+    buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf->len = bufSize_;
+    buf->bid = bid;
+    ++bufTail_;
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+  }
+
+private:
+  bool probe() {
+    const size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    std::vector<uint8_t> mem(len, 0);
+    struct io_uring_probe* p = reinterpret_cast<struct io_uring_probe*>(&mem[0]);
+    if (sys_io_uring_register(fd_, IORING_REGISTER_PROBE, p, 256) < 0) {
+      return false;
+    }
+    const uint8_t ops[] = {IORING_OP_ACCEPT,
+                           IORING_OP_RECV,
+                           IORING_OP_SEND,
+                           IORING_OP_READ,
+                           IORING_OP_ASYNC_CANCEL};
+    for (size_t i = 0; i < sizeof(ops); ++i) {
+      if (ops[i] > p->last_op || !(p->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+        errno = ENOSYS;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool initBuffers(uint32_t count, uint32_t size) {
+    bufCount_ = roundUpPowerOfTwo(count);
+    bufSize_ = size;
+    bufRingSize_ = bufCount_ * sizeof(struct io_uring_buf);
+    bufRing_ = static_cast<struct io_uring_buf_ring*>(
+        mmap(NULL, bufRingSize_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+    if (bufRing_ == MAP_FAILED) {
+      return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+    reg.ring_entries = bufCount_;
+    reg.bgid = RECV_BUFFER_GROUP;
+    if (sys_io_uring_register(fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      return false;
+    }
+
+    bufMem_ = new uint8_t[static_cast<size_t>(bufCount_) * bufSize_];
+    for (uint32_t i = 0; i < bufCount_; ++i) {
+      recycleBuffer(static_cast<uint16_t>(i));
+    }
+    return true;
+  }
+
+  static std::string errnoString(int err) { return TOutput::strerror_s(err); }
+
+  boost::atomic<uint64_t>& submitCalls_;
+  int fd_;
+
+  void* sqRing_;
+  void* cqRing_;
+  size_t sqRingSize_;
+  size_t cqRingSize_;
+  struct io_uring_sqe* sqes_;
+  size_t sqesSize_;
+
+  uint32_t* sqHead_;
+  uint32_t* sqTail_;
+  uint32_t sqMask_;
+  uint32_t sqEntries_;
+  uint32_t sqeTail_;
+  uint32_t sqeHead_;
+
+  uint32_t* cqHead_;
+  uint32_t* cqTail_;
+  uint32_t cqMask_;
+  struct io_uring_cqe* cqes_;
+
+  struct io_uring_buf_ring* bufRing_;
+  size_t bufRingSize_;
+  uint8_t* bufMem_;
+  uint32_t bufCount_;
+  uint32_t bufSize_;
+  uint16_t bufTail_;
+};
+
+/**
+ * Per-client state on the ring thread: the bytes received so far, the
+ * memory transports requests are processed through and the responses
+ * waiting to be sent.
+ */
+class TIoUringServer::Connection {
+public:
+  Connection(TIoUringServer* server, THRIFT_SOCKET fd)
+    : socket_(new TSocket(fd)),
+      inputTransport_(new TMemoryBuffer()),
+      outputTransport_(new TMemoryBuffer()),
+      connectionContext_(NULL),
+      inStart_(0),
+      sendOffset_(0),
+      recvArmed_(false),
+      recvPaused_(false),
+      sendInFlight_(false),
+      closing_(false) {
+    factoryInputTransport_ = server->getInputTransportFactory()->getTransport(inputTransport_);
+    factoryOutputTransport_ = server->getOutputTransportFactory()->getTransport(outputTransport_);
+    inputProtocol_ = server->getInputProtocolFactory()->getProtocol(factoryInputTransport_);
+    outputProtocol_ = server->getOutputProtocolFactory()->getProtocol(factoryOutputTransport_);
+    processor_ = server->getProcessor(inputProtocol_, outputProtocol_, socket_);
+  }
+
+  THRIFT_SOCKET fd() { return socket_->getSocketFD(); }
+
+  /// Nothing in flight references this connection any more
+  bool idle() const { return !recvArmed_ && !sendInFlight_; }
+
+  shared_ptr<TSocket> socket_;
+  shared_ptr<TMemoryBuffer> inputTransport_;
+  shared_ptr<TMemoryBuffer> outputTransport_;
+  shared_ptr<TTransport> factoryInputTransport_;
+  shared_ptr<TTransport> factoryOutputTransport_;
+  shared_ptr<TProtocol> inputProtocol_;
+  shared_ptr<TProtocol> outputProtocol_;
+  shared_ptr<TProcessor> processor_;
+  void* connectionContext_;
+
+  /// Received bytes, of which the ones before inStart_ are already consumed
+  std::vector<uint8_t> in_;
+  size_t inStart_;
+
+  /// Responses produced while a send was in flight
+  std::string pending_;
+  /// The buffer the outstanding send reads from
+  std::string sending_;
+  size_t sendOffset_;
+
+  bool recvArmed_;
+  /// Receiving stopped because too many responses are waiting to be sent
+  bool recvPaused_;
+  bool sendInFlight_;
+  bool closing_;
+};
+
+#else
+
+class TIoUringServer::Ring {};
+
+#endif // THRIFT_HAVE_IO_URING
+
+void TIoUringServer::init(int port) {
+  port_ = port;
+  listenPort_ = port;
+  serverSocket_ = THRIFT_INVALID_SOCKET;
+  useIoUring_ = true;
+  usingIoUring_ = false;
+  ringEntries_ = DEFAULT_RING_ENTRIES;
+  recvBufferCount_ = DEFAULT_RECV_BUFFER_COUNT;
+  recvBufferSize_ = DEFAULT_RECV_BUFFER_SIZE;
+  maxFrameSize_ = MAX_FRAME_SIZE;
+  maxPendingOutput_ = DEFAULT_MAX_PENDING_OUTPUT;
+  ring_ = NULL;
+  wakeupFd_ = -1;
+  wakeupValue_ = 0;
+  acceptArmed_ = false;
+  wakeupArmed_ = false;
+  multishotAccept_ = true;
+  multishotRecv_ = true;
+  shuttingDown_ = false;
+  stop_ = false;
+  fallbackListening_ = false;
+  numSubmitCalls_ = 0;
+  numRequests_ = 0;
+  numConnections_ = 0;
+}
+
+TIoUringServer::~TIoUringServer() {
+  delete ring_;
+  if (serverSocket_ != THRIFT_INVALID_SOCKET) {
+    ::THRIFT_CLOSESOCKET(serverSocket_);
+  }
+#ifdef THRIFT_HAVE_IO_URING
+  for (std::set<Connection*>::iterator it = connections_.begin(); it != connections_.end(); ++it) {
+    delete *it;
+  }
+  if (wakeupFd_ >= 0) {
+    ::close(wakeupFd_);
+  }
+#endif
+}
+
+bool TIoUringServer::isAvailable() {
+#ifdef THRIFT_HAVE_IO_URING
+  boost::atomic<uint64_t> submitCalls(0);
+  Ring ring(submitCalls);
+  return ring.init(4, 1, 64);
+#else
+  return false;
+#endif
+}
+
+int TIoUringServer::getListenPort() const {
+  Guard g(fallbackMutex_);
+  return listenPort_;
+}
+
+void TIoUringServer::serve() {
+#ifdef THRIFT_HAVE_IO_URING
+  if (useIoUring_) {
+    Ring* ring = new Ring(numSubmitCalls_);
+    if (ring->init(ringEntries_, recvBufferCount_, recvBufferSize_)) {
+      ring_ = ring;
+      serveIoUring();
+      return;
+    }
+    int errno_copy = errno;
+    delete ring;
+    GlobalOutput.perror("TIoUringServer: io_uring unavailable, using TThreadedServer ", errno_copy);
+  }
+#endif
+  serveFallback();
+}
+
+void TIoUringServer::stop() {
+  Guard g(fallbackMutex_);
+  stop_ = true;
+  // before it listens the fallback cannot be interrupted yet, fallbackListen()
+  // stops it instead
+  if (fallbackListening_) {
+    fallbackServer_->stop();
+  }
+#ifdef THRIFT_HAVE_IO_URING
+  if (wakeupFd_ >= 0) {
+    eventfd_write(wakeupFd_, 1);
+  }
+#endif
+}
+
+void TIoUringServer::serveFallback() {
+  shared_ptr<TThreadedServer> server;
+  {
+    Guard g(fallbackMutex_);
+    if (stop_) {
+      return;
+    }
+    fallbackSocket_.reset(new TServerSocket(port_));
+    fallbackSocket_->setListenCallback(
+        apache::thrift::stdcxx::bind(&TIoUringServer::fallbackListen,
+                                     this,
+                                     apache::thrift::stdcxx::placeholders::_1));
+    server.reset(new TThreadedServer(processorFactory_,
+                                     fallbackSocket_,
+                                     boost::make_shared<TFramedTransportFactory>(),
+                                     inputProtocolFactory_));
+    server->setOutputProtocolFactory(outputProtocolFactory_);
+    server->setServerEventHandler(eventHandler_);
+    fallbackServer_ = server;
+  }
+  server->serve();
+}
+
+void TIoUringServer::fallbackListen(THRIFT_SOCKET fd) {
+  (void)fd;
+  // called from TServerSocket::listen() once the socket is bound and its
+  // interrupt sockets exist, so a stop() that came in earlier can be honored
+  Guard g(fallbackMutex_);
+  listenPort_ = fallbackSocket_->getPort();
+  fallbackListening_ = true;
+  if (stop_) {
+    fallbackServer_->stop();
+  }
+}
+
+#ifdef THRIFT_HAVE_IO_URING
+
+namespace {
+uint64_t userData(void* connection, OpType op) {
+  return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(connection)) | op;
+}
+}
+
+void TIoUringServer::serveIoUring() {
+  serverSocket_ = createListenSocket();
+  {
+    Guard g(fallbackMutex_);
+    wakeupFd_ = eventfd(0, EFD_CLOEXEC);
+    if (wakeupFd_ < 0) {
+      throw TException("TIoUringServer::serve() eventfd: "
+                       + TOutput::strerror_s(THRIFT_GET_SOCKET_ERROR));
+    }
+  }
+  usingIoUring_ = true;
+
+  armAccept();
+  armWakeup();
+
+  if (eventHandler_) {
+    eventHandler_->preServe();
+  }
+
+  for (;;) {
+    if (stop_ && !shuttingDown_) {
+      beginShutdown();
+    }
+    if (shuttingDown_ && connections_.empty() && !acceptArmed_ && !wakeupArmed_) {
+      break;
+    }
+
+    // everything queued while handling the previous batch goes out here
+    if (ring_->submit(1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+      GlobalOutput.perror("TIoUringServer: io_uring_enter ", errno);
+      break;
+    }
+
+    uint64_t data;
+    int32_t res;
+    uint32_t flags;
+    while (ring_->nextCqe(data, res, flags)) {
+      handleCompletion(data, res, flags);
+    }
+  }
+
+  // The ring goes first so that the kernel drops every reference to our
+  // buffers and sockets before they are released
+  delete ring_;
+  ring_ = NULL;
+  for (std::set<Connection*>::iterator it = connections_.begin(); it != connections_.end(); ++it) {
+    delete *it;
+  }
+  connections_.clear();
+  numConnections_ = 0;
+  ::THRIFT_CLOSESOCKET(serverSocket_);
+  serverSocket_ = THRIFT_INVALID_SOCKET;
+  {
+    Guard g(fallbackMutex_);
+    ::close(wakeupFd_);
+    wakeupFd_ = -1;
+  }
+}
+
+/**
+ * Creates the listening socket on the wildcard address, preferring IPv6
+ * so that IPv4 clients are accepted through mapped addresses.
+ */
+THRIFT_SOCKET TIoUringServer::createListenSocket() {
+  struct addrinfo hints, *res, *res0;
+  char port[sizeof("65536") + 1];
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = PF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_ADDRCONFIG;
+  sprintf(port, "%d", port_);
+
+  int error = getaddrinfo(NULL, port, &hints, &res0);
+  if (error) {
+    throw TException("TIoUringServer::serve() getaddrinfo " + string(THRIFT_GAI_STRERROR(error)));
+  }
+  for (res = res0; res; res = res->ai_next) {
+    if (res->ai_family == AF_INET6 || res->ai_next == NULL)
+      break;
+  }
+
+  THRIFT_SOCKET s = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+  if (s == THRIFT_INVALID_SOCKET) {
+    freeaddrinfo(res0);
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TIoUringServer::serve() socket()",
+                              THRIFT_GET_SOCKET_ERROR);
+  }
+
+#ifdef IPV6_V6ONLY
+  if (res->ai_family == AF_INET6) {
+    int zero = 0;
+    if (-1 == setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, const_cast_sockopt(&zero), sizeof(zero))) {
+      GlobalOutput("TIoUringServer::serve() IPV6_V6ONLY");
+    }
+  }
+#endif // #ifdef IPV6_V6ONLY
+
+  int one = 1;
+  setsockopt(s, SOL_SOCKET, THRIFT_NO_SOCKET_CACHING, const_cast_sockopt(&one), sizeof(one));
+
+  if (::bind(s, res->ai_addr, static_cast<int>(res->ai_addrlen)) == -1
+      || ::listen(s, LISTEN_BACKLOG) == -1) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    ::THRIFT_CLOSESOCKET(s);
+    freeaddrinfo(res0);
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TIoUringServer::serve() bind/listen",
+                              errno_copy);
+  }
+  freeaddrinfo(res0);
+
+  if (port_ == 0) {
+    struct sockaddr_storage addr;
+    socklen_t size = sizeof(addr);
+    if (!getsockname(s, reinterpret_cast<struct sockaddr*>(&addr), &size)) {
+      Guard g(fallbackMutex_);
+      if (addr.ss_family == AF_INET6) {
+        listenPort_ = ntohs(reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port);
+      } else {
+        listenPort_ = ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port);
+      }
+    } else {
+      GlobalOutput.perror("TIoUringServer::serve() getsockname() ", THRIFT_GET_SOCKET_ERROR);
+    }
+  }
+  return s;
+}
+
+void TIoUringServer::armAccept() {
+  struct io_uring_sqe* sqe = ring_->getSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = serverSocket_;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  if (multishotAccept_) {
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  }
+  sqe->user_data = userData(NULL, OP_ACCEPT);
+  acceptArmed_ = true;
+}
+
+void TIoUringServer::armRecv(Connection* connection) {
+  struct io_uring_sqe* sqe = ring_->getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = connection->fd();
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = RECV_BUFFER_GROUP;
+  if (multishotRecv_) {
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+  }
+  sqe->user_data = userData(connection, OP_RECV);
+  connection->recvArmed_ = true;
+}
+
+/**
+ * Sends whatever has not been written yet from connection->sending_,
+ * first moving all pending responses there if it is empty.
+ */
+void TIoUringServer::armSend(Connection* connection) {
+  if (connection->sendOffset_ == connection->sending_.size()) {
+    connection->sending_.swap(connection->pending_);
+    connection->pending_.clear();
+    connection->sendOffset_ = 0;
+  }
+  struct io_uring_sqe* sqe = ring_->getSqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = connection->fd();
+  sqe->addr = reinterpret_cast<uint64_t>(connection->sending_.data() + connection->sendOffset_);
+  sqe->len = static_cast<uint32_t>(connection->sending_.size() - connection->sendOffset_);
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = userData(connection, OP_SEND);
+  connection->sendInFlight_ = true;
+}
+
+/**
+ * Keeps a receive armed for the connection, unless maxPendingOutput_ bytes
+ * of responses are queued behind its send. Then the requests are left
+ * unread until handleSend() has moved the queue out.
+ */
+void TIoUringServer::updateRecv(Connection* connection) {
+  if (connection->pending_.size() >= maxPendingOutput_) {
+    if (connection->recvArmed_ && !connection->recvPaused_) {
+      // a multishot receive would keep delivering
+      cancel(userData(connection, OP_RECV));
+    }
+    connection->recvPaused_ = true;
+  } else {
+    connection->recvPaused_ = false;
+    if (!connection->recvArmed_) {
+      armRecv(connection);
+    }
+  }
+}
+
+void TIoUringServer::armWakeup() {
+  struct io_uring_sqe* sqe = ring_->getSqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wakeupFd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&wakeupValue_);
+  sqe->len = sizeof(wakeupValue_);
+  sqe->user_data = userData(NULL, OP_WAKEUP);
+  wakeupArmed_ = true;
+}
+
+void TIoUringServer::cancel(uint64_t target) {
+  struct io_uring_sqe* sqe = ring_->getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = target;
+  sqe->user_data = userData(NULL, OP_CANCEL);
+}
+
+void TIoUringServer::handleCompletion(uint64_t data, int32_t res, uint32_t flags) {
+  Connection* connection = reinterpret_cast<Connection*>(static_cast<uintptr_t>(data & ~OP_MASK));
+  switch (data & OP_MASK) {
+  case OP_ACCEPT:
+    handleAccept(res, flags);
+    break;
+  case OP_RECV:
+    handleRecv(connection, res, flags);
+    break;
+  case OP_SEND:
+    handleSend(connection, res);
+    break;
+  case OP_WAKEUP:
+    wakeupArmed_ = false;
+    if (!stop_ && res >= 0) {
+      armWakeup();
+    }
+    break;
+  case OP_CANCEL:
+  default:
+    break;
+  }
+}
+
+void TIoUringServer::handleAccept(int32_t res, uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    acceptArmed_ = false;
+  }
+
+  if (res >= 0) {
+    if (shuttingDown_) {
+      ::THRIFT_CLOSESOCKET(res);
+      return;
+    }
+    int one = 1;
+#ifndef TCP_NOPUSH
+    setsockopt(res, IPPROTO_TCP, TCP_NODELAY, const_cast_sockopt(&one), sizeof(one));
+#endif
+    Connection* connection = NULL;
+    try {
+      connection = new Connection(this, res);
+    } catch (const std::exception& x) {
+      GlobalOutput.printf("TIoUringServer: failed to set up connection: %s", x.what());
+      ::THRIFT_CLOSESOCKET(res);
+    }
+    if (connection) {
+      if (eventHandler_) {
+        connection->connectionContext_
+            = eventHandler_->createContext(connection->inputProtocol_, connection->outputProtocol_);
+      }
+      connections_.insert(connection);
+      ++numConnections_;
+      armRecv(connection);
+    }
+  } else if (res == -EINVAL && multishotAccept_) {
+    // kernel without multishot accept, re-arm one accept at a time
+    multishotAccept_ = false;
+  } else if (res != -ECANCELED) {
+    GlobalOutput.perror("TIoUringServer: accept ", -res);
+  }
+
+  if (!acceptArmed_ && !shuttingDown_) {
+    armAccept();
+  }
+}
+
+void TIoUringServer::handleRecv(Connection* connection, int32_t res, uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    connection->recvArmed_ = false;
+  }
+
+  if (res > 0) {
+    uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    const uint8_t* buf = ring_->buffer(bid);
+    connection->in_.insert(connection->in_.end(), buf, buf + res);
+    ring_->recycleBuffer(bid);
+    if (!connection->closing_) {
+      processFrames(connection);
+    }
+  } else if (res == -ENOBUFS) {
+    // every provided buffer was in use; they are all back now, so just retry
+  } else if (res == -EINVAL && multishotRecv_) {
+    // kernel without multishot receive, re-arm one receive at a time
+    multishotRecv_ = false;
+  } else if (res == -ECANCELED && !connection->closing_) {
+    // cancelled by updateRecv(), which re-arms once the responses are out
+  } else {
+    if (res < 0 && res != -ECONNRESET && res != -ECANCELED) {
+      GlobalOutput.perror("TIoUringServer: recv ", -res);
+    }
+    closeConnection(connection);
+  }
+
+  if (connection->closing_) {
+    if (connection->idle()) {
+      releaseConnection(connection);
+    }
+  } else {
+    updateRecv(connection);
+  }
+}
+
+void TIoUringServer::handleSend(Connection* connection, int32_t res) {
+  connection->sendInFlight_ = false;
+
+  if (res < 0) {
+    if (res == -EAGAIN || res == -EINTR) {
+      armSend(connection);
+      return;
+    }
+    if (res != -EPIPE && res != -ECONNRESET) {
+      GlobalOutput.perror("TIoUringServer: send ", -res);
+    }
+    closeConnection(connection);
+  } else {
+    connection->sendOffset_ += res;
+    if (connection->sendOffset_ == connection->sending_.size()) {
+      connection->sending_.clear();
+      connection->sendOffset_ = 0;
+    }
+    // partial sends and responses queued meanwhile go out in the next batch
+    if (!connection->closing_
+        && (connection->sendOffset_ < connection->sending_.size()
+            || !connection->pending_.empty())) {
+      armSend(connection);
+    }
+    // the queued responses are on their way, so read the client's requests
+    // again, starting with the ones received before receiving paused
+    if (!connection->closing_ && connection->recvPaused_
+        && connection->pending_.size() < maxPendingOutput_) {
+      processFrames(connection);
+      if (!connection->closing_) {
+        updateRecv(connection);
+      }
+    }
+  }
+
+  if (connection->closing_ && connection->idle()) {
+    releaseConnection(connection);
+  }
+}
+
+/**
+ * Runs every complete frame received so far through the processor and
+ * appends the framed responses to the connection's pending output, stopping
+ * early once that holds maxPendingOutput_ bytes.
+ */
+void TIoUringServer::processFrames(Connection* connection) {
+  std::vector<uint8_t>& in = connection->in_;
+
+  while (in.size() - connection->inStart_ >= 4
+         && connection->pending_.size() < maxPendingOutput_) {
+    uint32_t frameSize;
+    memcpy(&frameSize, &in[connection->inStart_], 4);
+    frameSize = ntohl(frameSize);
+    if (frameSize > maxFrameSize_) {
+      GlobalOutput.printf("TIoUringServer: frame size too large (%u > %lu) from client %s. "
+                          "Remote side not using TFramedTransport?",
+                          frameSize,
+                          (unsigned long)maxFrameSize_,
+                          connection->socket_->getSocketInfo().c_str());
+      closeConnection(connection);
+      return;
+    }
+    if (in.size() - connection->inStart_ - 4 < frameSize) {
+      break;
+    }
+
+    connection->inputTransport_->resetBuffer(in.data() + connection->inStart_ + 4, frameSize);
+    connection->inStart_ += 4 + frameSize;
+
+    // reserve room for the frame size of the response
+    connection->outputTransport_->resetBuffer();
+    connection->outputTransport_->getWritePtr(4);
+    connection->outputTransport_->wroteBytes(4);
+
+    try {
+      if (eventHandler_) {
+        eventHandler_->processContext(connection->connectionContext_, connection->socket_);
+      }
+      connection->processor_->process(connection->inputProtocol_,
+                                      connection->outputProtocol_,
+                                      connection->connectionContext_);
+    } catch (const TTransportException& ttx) {
+      GlobalOutput.printf("TIoUringServer transport error in process(): %s", ttx.what());
+      closeConnection(connection);
+      return;
+    } catch (const std::exception& x) {
+      GlobalOutput.printf("TIoUringServer: process() exception: %s: %s",
+                          typeid(x).name(),
+                          x.what());
+      closeConnection(connection);
+      return;
+    } catch (...) {
+      GlobalOutput.printf("TIoUringServer: unknown exception while processing.");
+      closeConnection(connection);
+      return;
+    }
+    ++numRequests_;
+
+    uint8_t* buf;
+    uint32_t size;
+    connection->outputTransport_->getBuffer(&buf, &size);
+    // oneway calls leave nothing beyond the reserved frame size
+    if (size > 4) {
+      int32_t frameSizeOut = (int32_t)htonl(size - 4);
+      memcpy(buf, &frameSizeOut, 4);
+      connection->pending_.append(reinterpret_cast<const char*>(buf), size);
+    }
+  }
+
+  if (connection->inStart_ == in.size()) {
+    in.clear();
+    connection->inStart_ = 0;
+  } else if (connection->inStart_ > in.size() / 2) {
+    in.erase(in.begin(), in.begin() + connection->inStart_);
+    connection->inStart_ = 0;
+  }
+
+  if (!connection->sendInFlight_ && !connection->pending_.empty()) {
+    armSend(connection);
+  }
+}
+
+/**
+ * Stops all further work on a connection. It is released once the
+ * operations the kernel still holds for it have completed.
+ */
+void TIoUringServer::closeConnection(Connection* connection) {
+  if (connection->closing_) {
+    return;
+  }
+  connection->closing_ = true;
+  if (connection->recvArmed_) {
+    cancel(userData(connection, OP_RECV));
+  }
+  // an outstanding send fails quickly once the socket is shut down
+  ::shutdown(connection->fd(), THRIFT_SHUT_RDWR);
+}
+
+void TIoUringServer::releaseConnection(Connection* connection) {
+  connections_.erase(connection);
+  --numConnections_;
+  if (eventHandler_) {
+    eventHandler_->deleteContext(connection->connectionContext_,
+                                 connection->inputProtocol_,
+                                 connection->outputProtocol_);
+  }
+  delete connection;
+}
+
+void TIoUringServer::beginShutdown() {
+  shuttingDown_ = true;
+  if (acceptArmed_) {
+    cancel(userData(NULL, OP_ACCEPT));
+  }
+  if (wakeupArmed_) {
+    cancel(userData(NULL, OP_WAKEUP));
+  }
+  for (std::set<Connection*>::iterator it = connections_.begin(); it != connections_.end(); ++it) {
+    closeConnection(*it);
+  }
+}
+
+#endif // THRIFT_HAVE_IO_URING
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,250 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TIOURINGSERVER_H_
+#define _THRIFT_SERVER_TIOURINGSERVER_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/server/TServer.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/concurrency/Mutex.h>
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <set>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::TProcessor;
+using apache::thrift::protocol::TProtocolFactory;
+
+/**
+ * A framed-transport server driven by a single io_uring instance.
+ *
+ * Accepts are issued as one multishot accept, reads as multishot receives
+ * into a ring of kernel-provided buffers and responses are queued as sends.
+ * All submissions made while handling one batch of completions go to the
+ * kernel with a single io_uring_enter() call. Requests are processed on the
+ * ring thread, so handlers should not block; run slow work elsewhere.
+ *
+ * The wire format is the same as TNonblockingServer (TFramedTransport). On
+ * systems without io_uring support, or where it has been disabled by
+ * setUseIoUring(false), serve() falls back to a TThreadedServer listening on
+ * a TServerSocket with framed transports, so clients see no difference.
+ */
+class TIoUringServer : public TServer {
+public:
+  /// Default number of submission queue entries
+  static const uint32_t DEFAULT_RING_ENTRIES = 256;
+
+  /// Default number of receive buffers handed to the kernel (power of two)
+  static const uint32_t DEFAULT_RECV_BUFFER_COUNT = 256;
+
+  /// Default size of each receive buffer
+  static const uint32_t DEFAULT_RECV_BUFFER_SIZE = 16384;
+
+  /// Listen backlog
+  static const int LISTEN_BACKLOG = 1024;
+
+  /// Largest frame accepted from a client before the connection is dropped
+  static const int MAX_FRAME_SIZE = 256 * 1024 * 1024;
+
+  /// Default bytes of unsent responses per connection before receiving pauses
+  static const uint32_t DEFAULT_MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+
+  template <typename ProcessorFactory>
+  TIoUringServer(const boost::shared_ptr<ProcessorFactory>& processorFactory,
+                 int port,
+                 THRIFT_OVERLOAD_IF(ProcessorFactory, TProcessorFactory))
+    : TServer(processorFactory) {
+    init(port);
+  }
+
+  template <typename Processor>
+  TIoUringServer(const boost::shared_ptr<Processor>& processor,
+                 int port,
+                 THRIFT_OVERLOAD_IF(Processor, TProcessor))
+    : TServer(processor) {
+    init(port);
+  }
+
+  template <typename ProcessorFactory>
+  TIoUringServer(const boost::shared_ptr<ProcessorFactory>& processorFactory,
+                 const boost::shared_ptr<TProtocolFactory>& protocolFactory,
+                 int port,
+                 THRIFT_OVERLOAD_IF(ProcessorFactory, TProcessorFactory))
+    : TServer(processorFactory) {
+    init(port);
+    setInputProtocolFactory(protocolFactory);
+    setOutputProtocolFactory(protocolFactory);
+  }
+
+  template <typename Processor>
+  TIoUringServer(const boost::shared_ptr<Processor>& processor,
+                 const boost::shared_ptr<TProtocolFactory>& protocolFactory,
+                 int port,
+                 THRIFT_OVERLOAD_IF(Processor, TProcessor))
+    : TServer(processor) {
+    init(port);
+    setInputProtocolFactory(protocolFactory);
+    setOutputProtocolFactory(protocolFactory);
+  }
+
+  virtual ~TIoUringServer();
+
+  /**
+   * Returns true if the running kernel supports everything the io_uring
+   * path needs (provided buffer rings and the accept/recv/send opcodes).
+   */
+  static bool isAvailable();
+
+  /**
+   * Enable or disable the io_uring path. When disabled, or when
+   * isAvailable() returns false, serve() uses the TThreadedServer fallback.
+   */
+  void setUseIoUring(bool useIoUring) { useIoUring_ = useIoUring; }
+
+  bool getUseIoUring() const { return useIoUring_; }
+
+  /**
+   * Returns true once serve() has started on the io_uring path, false if
+   * it is running (or would run) the fallback.
+   */
+  bool isUsingIoUring() const { return usingIoUring_; }
+
+  void setRingEntries(uint32_t entries) { ringEntries_ = entries; }
+
+  uint32_t getRingEntries() const { return ringEntries_; }
+
+  /**
+   * Set the number of receive buffers in the provided buffer ring. Rounded
+   * up to a power of two.
+   */
+  void setRecvBufferCount(uint32_t count) { recvBufferCount_ = count; }
+
+  uint32_t getRecvBufferCount() const { return recvBufferCount_; }
+
+  void setRecvBufferSize(uint32_t size) { recvBufferSize_ = size; }
+
+  uint32_t getRecvBufferSize() const { return recvBufferSize_; }
+
+  void setMaxFrameSize(size_t maxFrameSize) { maxFrameSize_ = maxFrameSize; }
+
+  size_t getMaxFrameSize() const { return maxFrameSize_; }
+
+  /**
+   * Set how many bytes of responses may queue up behind the outstanding
+   * send of a connection. Beyond that no more requests are read from the
+   * client until the queue has been handed to the kernel, so a client that
+   * pipelines requests without reading the responses cannot grow the
+   * server's memory without bound.
+   */
+  void setMaxPendingOutput(size_t maxPendingOutput) { maxPendingOutput_ = maxPendingOutput; }
+
+  size_t getMaxPendingOutput() const { return maxPendingOutput_; }
+
+  /**
+   * Returns the port the server is listening on, which is only known once
+   * serve() has bound the socket when it was constructed with port 0.
+   */
+  int getListenPort() const;
+
+  /// Number of io_uring_enter() calls made by the ring thread
+  uint64_t getNumSubmitCalls() const { return numSubmitCalls_; }
+
+  /// Number of requests processed on the io_uring path
+  uint64_t getNumRequests() const { return numRequests_; }
+
+  /// Number of connections currently open on the io_uring path
+  size_t getNumConnections() const { return numConnections_; }
+
+  virtual void serve();
+
+  virtual void stop();
+
+private:
+  class Connection;
+  class Ring;
+
+  void init(int port);
+
+  void serveFallback();
+  void serveIoUring();
+
+  THRIFT_SOCKET createListenSocket();
+
+  void armAccept();
+  void armRecv(Connection* connection);
+  void armSend(Connection* connection);
+  void updateRecv(Connection* connection);
+  void armWakeup();
+  void cancel(uint64_t userData);
+
+  void handleCompletion(uint64_t userData, int32_t res, uint32_t flags);
+  void handleAccept(int32_t res, uint32_t flags);
+  void handleRecv(Connection* connection, int32_t res, uint32_t flags);
+  void handleSend(Connection* connection, int32_t res);
+  void processFrames(Connection* connection);
+  void closeConnection(Connection* connection);
+  void releaseConnection(Connection* connection);
+  void beginShutdown();
+  void fallbackListen(THRIFT_SOCKET fd);
+
+  int port_;
+  int listenPort_;
+  THRIFT_SOCKET serverSocket_;
+
+  bool useIoUring_;
+  boost::atomic<bool> usingIoUring_;
+  uint32_t ringEntries_;
+  uint32_t recvBufferCount_;
+  uint32_t recvBufferSize_;
+  size_t maxFrameSize_;
+  size_t maxPendingOutput_;
+
+  Ring* ring_;
+  int wakeupFd_;
+  uint64_t wakeupValue_;
+  bool acceptArmed_;
+  bool wakeupArmed_;
+  bool multishotAccept_;
+  bool multishotRecv_;
+  bool shuttingDown_;
+  std::set<Connection*> connections_;
+
+  boost::atomic<bool> stop_;
+  boost::atomic<uint64_t> numSubmitCalls_;
+  boost::atomic<uint64_t> numRequests_;
+  boost::atomic<size_t> numConnections_;
+
+  /// Guards listenPort_, the fallback and wakeupFd_ against a concurrent stop()
+  mutable concurrency::Mutex fallbackMutex_;
+  boost::shared_ptr<TServer> fallbackServer_;
+  boost::shared_ptr<transport::TServerSocket> fallbackSocket_;
+  bool fallbackListening_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TIOURINGSERVER_H_
@@ -23,11 +23,18 @@
 
 #include <thrift/server/TNonblockingServer.h>
 #include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Util.h>
+#include <thrift/TApplicationException.h>
 #include <thrift/transport/TSocket.h>
+#include <thrift/concurrency/CpuAffinity.h>
 #include <thrift/concurrency/PlatformThreadFactory.h>
 #include <thrift/transport/PlatformSocket.h>
 
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <iostream>
+#include <utility>
 
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
@@ -56,6 +63,18 @@
 #include <sched.h>
 #endif
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #ifndef AF_LOCAL
 #define AF_LOCAL AF_UNIX
 #endif
@@ -80,6 +99,9 @@ using boost::shared_ptr;
 /// Three states for sockets: recv frame size, recv data, and send mode
 enum TSocketState { SOCKET_RECV_FRAMING, SOCKET_RECV, SOCKET_SEND };
 
+/// Most buffers (response pieces) written by a single send syscall
+static const int MAX_GATHERED_BUFFERS = 64;
+
 /**
  * Five states for the nonblocking server:
  *  1) initialize
@@ -97,15 +119,139 @@ enum TAppState {
   APP_CLOSE_CONNECTION
 };
 
+/**
+ * Response buffer of a connection or pipelined request.  The first four
+ * bytes are reserved for the frame size.  Like TFramedTransport, it links
+ * TBufferSlice payloads of at least TFramedTransport::MIN_LINK_SIZE bytes
+ * in by reference instead of copying them, so a large binary field goes
+ * out straight from where the handler keeps it, gathered with the bytes
+ * around it into one send.
+ */
+class TResponseBuffer : public TMemoryBuffer {
+public:
+  explicit TResponseBuffer(uint32_t size) : TMemoryBuffer(size), linkedBytes_(0) { reset(); }
+
+  /// Start a new response.
+  void reset() {
+    resetBuffer();
+    clearLinks();
+    getWritePtr(4);
+    wroteBytes(4);
+  }
+
+  /// Start a new response in a fresh buffer of the given size.
+  void reset(uint32_t size) {
+    resetBuffer(size);
+    clearLinks();
+    getWritePtr(4);
+    wroteBytes(4);
+  }
+
+  virtual void writeSlice_virt(const TBufferSlice& slice) {
+    if (slice.size() < TFramedTransport::MIN_LINK_SIZE || !slice.owner()) {
+      write(slice.data(), slice.size());
+      return;
+    }
+    links_.push_back(std::make_pair(available_read(), slice));
+    linkedBytes_ += slice.size();
+  }
+
+  /**
+   * Put the frame size into the reserved bytes.
+   *
+   * @return the size of the framed response, 0 if nothing was written
+   *         (oneway calls).
+   */
+  uint32_t finish() {
+    uint32_t size = getResponseSize();
+    if (size > 0) {
+      uint8_t* buf;
+      uint32_t have;
+      getBuffer(&buf, &have);
+      int32_t frameSize = (int32_t)htonl(size - 4);
+      memcpy(buf, &frameSize, 4);
+    }
+    return size;
+  }
+
+  /// The size of the framed response, 0 if nothing was written.
+  uint32_t getResponseSize() const {
+    uint32_t size = available_read() + linkedBytes_;
+    return size > 4 ? size : 0;
+  }
+
+  /**
+   * Describe the bytes of the response from offset pos on as buffers to
+   * send, in order.
+   *
+   * @param max the most entries to fill in.
+   * @return the number of entries filled in.
+   */
+  int gather(uint32_t pos, const uint8_t** bufs, uint32_t* lens, int max) {
+    if (getResponseSize() == 0) {
+      return 0;
+    }
+    uint8_t* buf;
+    uint32_t size;
+    getBuffer(&buf, &size);
+
+    int count = 0;
+    uint32_t start = 0;     // response offset of the current piece
+    uint32_t bufferPos = 0; // buffered bytes covered so far
+    // alternate between buffered bytes and the slices linked in between
+    for (size_t k = 0; k <= 2 * links_.size() && count < max; ++k) {
+      const uint8_t* piece;
+      uint32_t len;
+      if (k % 2 == 0) {
+        uint32_t end = k / 2 < links_.size() ? links_[k / 2].first : size;
+        piece = buf + bufferPos;
+        len = end - bufferPos;
+        bufferPos = end;
+      } else {
+        piece = links_[k / 2].second.data();
+        len = links_[k / 2].second.size();
+      }
+      if (len > 0 && start + len > pos) {
+        uint32_t skip = pos > start ? pos - start : 0;
+        bufs[count] = piece + skip;
+        lens[count] = len - skip;
+        ++count;
+      }
+      start += len;
+    }
+    return count;
+  }
+
+private:
+  void clearLinks() {
+    links_.clear();
+    linkedBytes_ = 0;
+  }
+
+  // slices linked in, each with the buffer offset it goes in front of
+  std::vector<std::pair<uint32_t, TBufferSlice> > links_;
+  uint32_t linkedBytes_;
+};
+
 /**
  * Represents a connection that is handled via libevent. This connection
  * essentially encapsulates a socket that has some associated libevent state.
  */
 class TNonblockingServer::TConnection {
 private:
+  friend class TNonblockingIOThread;
+
+  class Request;
+
   /// Server IO Thread handling this connection
   TNonblockingIOThread* ioThread_;
 
+  /// Next connection in the IO thread's completion queue
+  TConnection* nextNotification_;
+
+  /// Set while this connection sits in the IO thread's completion queue
+  boost::atomic<bool> notificationPending_;
+
   /// Server handle
   TNonblockingServer* server_;
 
@@ -121,6 +267,16 @@ private:
   /// Libevent flags
   short eventFlags_;
 
+  /// Registered with the IO thread's epoll descriptor (edge-triggered loop)
+  bool epollRegistered_;
+
+  /// Readiness reported by epoll since the last read / write that would block
+  bool readable_;
+  bool writable_;
+
+  /// Sitting in the IO thread's queue of ready connections
+  bool readyQueued_;
+
   /// Socket mode
   TSocketState socketState_;
 
@@ -139,10 +295,23 @@ private:
   /// Read buffer size
   uint32_t readBufferSize_;
 
-  /// Write buffer
-  uint8_t* writeBuffer_;
+  /// Start of the bytes not dispatched yet (pipelined connections)
+  uint32_t readBufferHead_;
+
+  /// Pipelined requests reading their frame out of readBuffer_
+  uint32_t readBufferRefs_;
+
+  /// A former read buffer that pipelined requests still read frames from
+  struct RetiredReadBuffer {
+    uint8_t* buffer;
+    uint32_t size;
+    uint32_t refs;
+  };
+
+  /// Former read buffers, given back once their last request is accounted
+  std::vector<RetiredReadBuffer> retiredReadBuffers_;
 
-  /// Write buffer size
+  /// Size of the framed response being sent
   uint32_t writeBufferSize_;
 
   /// How far through writing are we?
@@ -158,7 +327,7 @@ private:
   boost::shared_ptr<TMemoryBuffer> inputTransport_;
 
   /// Transport that processor writes to
-  boost::shared_ptr<TMemoryBuffer> outputTransport_;
+  boost::shared_ptr<TResponseBuffer> outputTransport_;
 
   /// extra transport generated by transport factory (e.g. BufferedRouterTransport)
   boost::shared_ptr<TTransport> factoryInputTransport_;
@@ -170,12 +339,31 @@ private:
   /// Protocol encoder
   boost::shared_ptr<TProtocol> outputProtocol_;
 
+  /// Transport and protocol to peek at method names for inline calls
+  boost::shared_ptr<TMemoryBuffer> peekTransport_;
+  boost::shared_ptr<TProtocol> peekProtocol_;
+
   /// Server event handler, if any
   boost::shared_ptr<TServerEventHandler> serverEventHandler_;
 
   /// Thrift call context, if any
   void* connectionContext_;
 
+  /// Dispatch frames to the thread pool as they arrive (pipeline depth > 1)
+  bool pipelined_;
+
+  /// Pipelined requests in processing or waiting to be written, in order
+  std::deque<Request*> pipeline_;
+
+  /// Pipelined request objects available for reuse
+  std::vector<Request*> freeRequests_;
+
+  /// Pipelined requests handed to the thread pool and not yet back
+  uint32_t numRequestsInFlight_;
+
+  /// Close as soon as no pipelined request is in flight anymore
+  bool closePending_;
+
   /// Go into read mode
   void setRead() { setFlags(EV_READ | EV_PERSIST); }
 
@@ -185,6 +373,26 @@ private:
   /// Set socket idle
   void setIdle() { setFlags(0); }
 
+  /**
+   * Read up to len bytes from the socket.  On the edge-triggered epoll loop
+   * a read that would block clears the readable state and returns false
+   * rather than throwing; a short read clears it too, since the socket
+   * buffer has been drained then.
+   *
+   * @param got set to the number of bytes read, 0 on remote disconnect.
+   * @return false if there was nothing to read (epoll loop only).
+   */
+  bool readSocket(uint8_t* buf, uint32_t len, uint32_t& got);
+
+  /// Record the readiness epoll_wait() reported and queue the connection.
+  void epollEvent(uint32_t events);
+
+  /**
+   * Run workSocket() for the wanted events that are ready, and queue the
+   * connection again if some still are after it (epoll loop only).
+   */
+  void runReady();
+
   /**
    * Set event flags for this connection.
    *
@@ -200,6 +408,87 @@ private:
    */
   void workSocket();
 
+  /**
+   * Pipelined counterpart of workSocket(): writes completed responses and
+   * reads as many bytes as are available, depending on the flags libevent
+   * passed, since both may be wanted at the same time.
+   *
+   * @param which the flags associated with the event.
+   */
+  void workSocketPipelined(short which);
+
+  /**
+   * Write as many completed pipelined responses as the socket takes,
+   * gathering all that are ready (up to MAX_GATHERED_BUFFERS pieces) into
+   * one sendmsg() so that a burst of small responses costs a single syscall.
+   */
+  void writeResponses();
+
+  /**
+   * Send as much of the given buffers as the socket takes with one
+   * sendmsg(), or one send() of the first buffer without <sys/uio.h>.
+   *
+   * @return the number of bytes written.
+   */
+  uint32_t writeGathered(const uint8_t** bufs, const uint32_t* lens, int count);
+
+  /**
+   * Pipelined counterpart of transition(): collects requests the thread
+   * pool finished, dispatches complete frames from the read buffer while
+   * the pipeline has room, and picks the events to wait for.
+   */
+  void transitionPipelined();
+
+  /**
+   * Hand one complete frame to the thread pool, or process it right away if
+   * it is an inline call.
+   */
+  void dispatchRequest(uint8_t* frame, uint32_t size);
+
+  /// Take requests the thread pool finished into account, in order.
+  void accountRequests();
+
+  /**
+   * Whether the frame holds a call the processor allows to run on the IO
+   * thread (see TProcessor::isInlineSafe()).  Peeks at the message header
+   * with the server's input protocol, directly on the frame.
+   */
+  bool isInlineCall(const uint8_t* frame, uint32_t size);
+
+  /// Schedule close() for when every in-flight request has come back.
+  void closeWhenIdle() {
+    closePending_ = true;
+    setIdle();
+  }
+
+  /// Free all pipelined request objects; none may be in flight.
+  void releaseRequests();
+
+  /**
+   * Move the bytes not dispatched yet into a fresh read buffer of size
+   * bytes, keeping the current one alive for the requests that read their
+   * frames out of it.
+   */
+  void retireReadBuffer(uint32_t size);
+
+  /// Drop the reference a finished request held on the buffer it read from.
+  void releaseFrame(const uint8_t* buffer);
+
+  /**
+   * Replace the read buffer with one of at least size bytes from the IO
+   * thread's pool, keeping the readBufferPos_ bytes received so far.
+   */
+  void growReadBuffer(uint32_t size);
+
+  /// Hand the read buffer back to the IO thread's pool.
+  void releaseReadBuffer() {
+    if (readBuffer_ != NULL) {
+      ioThread_->getBufferPool().giveBack(readBuffer_, readBufferSize_);
+      readBuffer_ = NULL;
+      readBufferSize_ = 0;
+    }
+  }
+
 public:
   class Task;
 
@@ -210,6 +499,10 @@ public:
               socklen_t addrLen) {
     readBuffer_ = NULL;
     readBufferSize_ = 0;
+    readBufferHead_ = 0;
+    readBufferRefs_ = 0;
+    nextNotification_ = NULL;
+    numRequestsInFlight_ = 0;
 
     ioThread_ = ioThread;
     server_ = ioThread->getServer();
@@ -218,12 +511,16 @@ public:
     // once per TConnection (they don't need to be reallocated on init() call)
     inputTransport_.reset(new TMemoryBuffer(readBuffer_, readBufferSize_));
     outputTransport_.reset(
-        new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+        new TResponseBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
     tSocket_.reset(new TSocket());
     init(socket, ioThread, addr, addrLen);
   }
 
-  ~TConnection() { std::free(readBuffer_); }
+  ~TConnection() {
+    releaseRequests();
+    // close() hands the read buffer back to its pool
+    assert(readBuffer_ == NULL);
+  }
 
   /// Close this connection and free or reset its resources.
   void close();
@@ -257,9 +554,13 @@ public:
    * @param which the flags associated with the event.
    * @param v void* callback arg where we placed TConnection's "this".
    */
-  static void eventHandler(evutil_socket_t fd, short /* which */, void* v) {
+  static void eventHandler(evutil_socket_t fd, short which, void* v) {
     assert(fd == static_cast<evutil_socket_t>(((TConnection*)v)->getTSocket()->getSocketFD()));
-    ((TConnection*)v)->workSocket();
+    if (((TConnection*)v)->pipelined_) {
+      ((TConnection*)v)->workSocketPipelined(which);
+    } else {
+      ((TConnection*)v)->workSocket();
+    }
   }
 
   /**
@@ -279,14 +580,12 @@ public:
    */
   int getIOThreadNumber() const { return ioThread_->getThreadNumber(); }
 
-  /// Force connection shutdown for this connection.
-  void forceClose() {
-    appState_ = APP_CLOSE_CONNECTION;
-    if (!notifyIOThread()) {
-      close();
-      throw TException("TConnection::forceClose: failed write on notify pipe");
-    }
-  }
+  /**
+   * Force connection shutdown for this connection.
+   *
+   * @param request the pipelined request whose task was dropped, if any.
+   */
+  void forceClose(Request* request = NULL);
 
   /// return the server this connection was initialized for.
   TNonblockingServer* getServer() const { return server_; }
@@ -304,28 +603,103 @@ public:
   void* getConnectionContext() { return connectionContext_; }
 };
 
+/**
+ * A request of a pipelined connection.  Each one reads its frame in place
+ * out of the connection's read buffer and owns a response buffer and the
+ * protocols around them, so that several requests of the same connection
+ * can be processed by the thread pool at once.
+ */
+class TNonblockingServer::TConnection::Request {
+public:
+  Request(TNonblockingServer* server)
+    : inputTransport_(new TMemoryBuffer(NULL, 0)),
+      outputTransport_(
+          new TResponseBuffer(static_cast<uint32_t>(server->getWriteBufferDefaultSize()))),
+      done_(false),
+      dropped_(false),
+      accounted_(false) {
+    factoryInputTransport_ = server->getInputTransportFactory()->getTransport(inputTransport_);
+    factoryOutputTransport_ = server->getOutputTransportFactory()->getTransport(outputTransport_);
+    inputProtocol_ = server->getInputProtocolFactory()->getProtocol(factoryInputTransport_);
+    outputProtocol_ = server->getOutputProtocolFactory()->getProtocol(factoryOutputTransport_);
+  }
+
+  ~Request() {
+    factoryInputTransport_->close();
+    factoryOutputTransport_->close();
+  }
+
+  /**
+   * Point the input at a frame inside buffer, which must stay untouched
+   * until the request is accounted, and leave room for the response frame
+   * size.
+   */
+  void reset(uint8_t* buffer, uint8_t* frame, uint32_t size) {
+    frameBuffer_ = buffer;
+    inputTransport_->resetBuffer(frame, size);
+    outputTransport_->reset();
+    done_.store(false, boost::memory_order_relaxed);
+    dropped_ = false;
+    accounted_ = false;
+  }
+
+  /// Called from the worker (or on drop) before notifying the IO thread.
+  void complete(bool dropped) {
+    dropped_ = dropped;
+    done_.store(true, boost::memory_order_release);
+  }
+
+  bool isDone() const { return done_.load(boost::memory_order_acquire); }
+
+  boost::shared_ptr<TMemoryBuffer> inputTransport_;
+  boost::shared_ptr<TResponseBuffer> outputTransport_;
+  boost::shared_ptr<TTransport> factoryInputTransport_;
+  boost::shared_ptr<TTransport> factoryOutputTransport_;
+  boost::shared_ptr<TProtocol> inputProtocol_;
+  boost::shared_ptr<TProtocol> outputProtocol_;
+
+  /// The read buffer the frame lives in
+  uint8_t* frameBuffer_;
+
+  /// Set once processing finished (or was abandoned)
+  boost::atomic<bool> done_;
+
+  /// The task never ran (drained on overload or expired)
+  bool dropped_;
+
+  /// Already taken into account by the IO thread
+  bool accounted_;
+};
+
 class TNonblockingServer::TConnection::Task : public Runnable {
 public:
   Task(boost::shared_ptr<TProcessor> processor,
        boost::shared_ptr<TProtocol> input,
        boost::shared_ptr<TProtocol> output,
-       TConnection* connection)
+       TConnection* connection,
+       Request* request = NULL)
     : processor_(processor),
       input_(input),
       output_(output),
       connection_(connection),
+      request_(request),
       serverEventHandler_(connection_->getServerEventHandler()),
-      connectionContext_(connection_->getConnectionContext()) {}
+      connectionContext_(connection_->getConnectionContext()),
+      queuedAt_(Util::currentTimeUsec()) {}
 
   void run() {
     try {
-      for (;;) {
-        if (serverEventHandler_) {
-          serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
-        }
-        if (!processor_->process(input_, output_, connectionContext_)
-            || !input_->getTransport()->peek()) {
-          break;
+      if (connection_->getServer()->shedQueuedRequest(Util::currentTimeUsec() - queuedAt_)) {
+        rejectRequest();
+      } else {
+        for (;;) {
+          if (serverEventHandler_) {
+            serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
+          }
+          if (!processor_->process(input_, output_, connectionContext_)
+              || !input_->getTransport()->peek()) {
+            break;
+          }
         }
       }
     } catch (const TTransportException& ttx) {
@@ -341,7 +715,11 @@ public:
       GlobalOutput.printf("TNonblockingServer: unknown exception while processing.");
     }
 
-    // Signal completion back to the libevent thread via a pipe
+    if (request_) {
+      request_->complete(false);
+    }
+
+    // Signal completion back to the libevent thread via its completion queue
     if (!connection_->notifyIOThread()) {
       GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
       connection_->close();
@@ -351,13 +729,52 @@ public:
 
   TConnection* getTConnection() { return connection_; }
 
+  /// The pipelined request this task processes, NULL if not pipelined.
+  Request* getRequest() { return request_; }
+
 private:
+  /**
+   * Answer every request of the frame with an exception rather than
+   * processing them late.
+   */
+  void rejectRequest() {
+    try {
+      do {
+        std::string name;
+        TMessageType type;
+        int32_t seqid;
+        input_->readMessageBegin(name, type, seqid);
+        input_->skip(T_STRUCT);
+        input_->readMessageEnd();
+        input_->getTransport()->readEnd();
+        if (type == T_ONEWAY) {
+          // nobody is waiting for an answer
+          continue;
+        }
+
+        TApplicationException x(TApplicationException::INTERNAL_ERROR,
+                                "TNonblockingServer: overloaded, request waited too long");
+        output_->writeMessageBegin(name, T_EXCEPTION, seqid);
+        x.write(output_.get());
+        output_->writeMessageEnd();
+        output_->getTransport()->writeEnd();
+        output_->getTransport()->flush();
+      } while (input_->getTransport()->peek());
+    } catch (const TException& tx) {
+      // the requests read so far are answered, the rest is unreadable
+      GlobalOutput.printf("TNonblockingServer: malformed request shed: %s", tx.what());
+    }
+  }
+
+
   boost::shared_ptr<TProcessor> processor_;
   boost::shared_ptr<TProtocol> input_;
   boost::shared_ptr<TProtocol> output_;
   TConnection* connection_;
+  Request* request_;
   boost::shared_ptr<TServerEventHandler> serverEventHandler_;
   void* connectionContext_;
+  int64_t queuedAt_;
 };
 
 void TNonblockingServer::TConnection::init(THRIFT_SOCKET socket,
@@ -371,11 +788,15 @@ void TNonblockingServer::TConnection::init(THRIFT_SOCKET socket,
   server_ = ioThread->getServer();
   appState_ = APP_INIT;
   eventFlags_ = 0;
+  epollRegistered_ = false;
+  readable_ = false;
+  writable_ = false;
+  readyQueued_ = false;
 
   readBufferPos_ = 0;
+  readBufferHead_ = 0;
   readWant_ = 0;
 
-  writeBuffer_ = NULL;
   writeBufferSize_ = 0;
   writeBufferPos_ = 0;
   largestWriteBufferSize_ = 0;
@@ -383,6 +804,11 @@ void TNonblockingServer::TConnection::init(THRIFT_SOCKET socket,
   socketState_ = SOCKET_RECV_FRAMING;
   callsForResize_ = 0;
 
+  notificationPending_.store(false, boost::memory_order_relaxed);
+  pipelined_ = server_->isThreadPoolProcessing() && server_->getPipelineDepth() > 1;
+  assert(pipeline_.empty() && numRequestsInFlight_ == 0);
+  closePending_ = false;
+
   // get input/transports
   factoryInputTransport_ = server_->getInputTransportFactory()->getTransport(inputTransport_);
   factoryOutputTransport_ = server_->getOutputTransportFactory()->getTransport(outputTransport_);
@@ -419,8 +845,11 @@ void TNonblockingServer::TConnection::workSocket() {
     // determine size of this frame
     try {
       // Read from the socket
-      fetch = tSocket_->read(&framing.buf[readBufferPos_],
-                             uint32_t(sizeof(framing.size) - readBufferPos_));
+      if (!readSocket(&framing.buf[readBufferPos_],
+                      uint32_t(sizeof(framing.size) - readBufferPos_),
+                      fetch)) {
+        return;
+      }
       if (fetch == 0) {
         // Whenever we get here it means a remote disconnect
         close();
@@ -466,7 +895,11 @@ void TNonblockingServer::TConnection::workSocket() {
     try {
       // Read from the socket
       fetch = readWant_ - readBufferPos_;
-      got = tSocket_->read(readBuffer_ + readBufferPos_, fetch);
+      uint32_t received = 0;
+      if (!readSocket(readBuffer_ + readBufferPos_, fetch, received)) {
+        return;
+      }
+      got = received;
     } catch (TTransportException& te) {
       GlobalOutput.printf("TConnection::workSocket(): %s", te.what());
       close();
@@ -505,8 +938,15 @@ void TNonblockingServer::TConnection::workSocket() {
     }
 
     try {
-      left = writeBufferSize_ - writeBufferPos_;
-      sent = tSocket_->write_partial(writeBuffer_ + writeBufferPos_, left);
+      // frame header, body and any linked slices go out together
+      const uint8_t* bufs[MAX_GATHERED_BUFFERS];
+      uint32_t lens[MAX_GATHERED_BUFFERS];
+      int count = outputTransport_->gather(writeBufferPos_, bufs, lens, MAX_GATHERED_BUFFERS);
+      left = 0;
+      for (int i = 0; i < count; ++i) {
+        left += lens[i];
+      }
+      sent = writeGathered(bufs, lens, count);
     } catch (TTransportException& te) {
       GlobalOutput.printf("TConnection::workSocket(): %s ", te.what());
       close();
@@ -514,6 +954,10 @@ void TNonblockingServer::TConnection::workSocket() {
     }
 
     writeBufferPos_ += sent;
+    if (sent < left) {
+      // socket buffer is full
+      writable_ = false;
+    }
 
     // Did we overdo it?
     assert(writeBufferPos_ <= writeBufferSize_);
@@ -541,6 +985,11 @@ void TNonblockingServer::TConnection::transition() {
   assert(ioThread_);
   assert(server_);
 
+  if (pipelined_) {
+    transitionPipelined();
+    return;
+  }
+
   // Switch upon the state that we are currently in and move to a new state
   switch (appState_) {
 
@@ -548,15 +997,13 @@ void TNonblockingServer::TConnection::transition() {
     // We are done reading the request, package the read buffer into transport
     // and get back some data from the dispatch function
     inputTransport_->resetBuffer(readBuffer_, readBufferPos_);
-    outputTransport_->resetBuffer();
-    // Prepend four bytes of blank space to the buffer so we can
-    // write the frame size there later.
-    outputTransport_->getWritePtr(4);
-    outputTransport_->wroteBytes(4);
+    // Leaves four bytes of blank space at the start of the buffer so we
+    // can write the frame size there later.
+    outputTransport_->reset();
 
     server_->incrementActiveProcessors();
 
-    if (server_->isThreadPoolProcessing()) {
+    if (server_->isThreadPoolProcessing() && !isInlineCall(readBuffer_, readBufferPos_)) {
       // We are setting up a Task to do this work and we will wait on it
 
       // Create task and dispatch to the thread manager
@@ -566,7 +1013,7 @@ void TNonblockingServer::TConnection::transition() {
       appState_ = APP_WAIT_TASK;
 
       try {
-        server_->addTask(task);
+        server_->addTask(task, ioThread_->getNumaNode());
       } catch (IllegalStateException& ise) {
         // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
         GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
@@ -612,30 +1059,24 @@ void TNonblockingServer::TConnection::transition() {
     }
 
   // Intentionally fall through here, the call to process has written into
-  // the writeBuffer_
+  // the outputTransport_
 
   case APP_WAIT_TASK:
     // We have now finished processing a task and the result has been written
-    // into the outputTransport_, so we grab its contents and place them into
-    // the writeBuffer_ for actual writing by the libevent thread
+    // into the outputTransport_, which the libevent thread sends from
 
     server_->decrementActiveProcessors();
-    // Get the result of the operation
-    outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
+    // Put the frame size in front of the result of the operation
+    writeBufferSize_ = outputTransport_->finish();
 
     // If the function call generated return data, then move into the send
     // state and get going
-    // 4 bytes were reserved for frame size
-    if (writeBufferSize_ > 4) {
+    if (writeBufferSize_ > 0) {
 
       // Move into write state
       writeBufferPos_ = 0;
       socketState_ = SOCKET_SEND;
 
-      // Put the frame size into the write buffer
-      int32_t frameSize = (int32_t)htonl(writeBufferSize_ - 4);
-      memcpy(writeBuffer_, &frameSize, 4);
-
       // Socket into write mode
       appState_ = APP_SEND_RESULT;
       setWrite();
@@ -652,9 +1093,11 @@ void TNonblockingServer::TConnection::transition() {
 
   case APP_SEND_RESULT:
     // it's now safe to perform buffer size housekeeping.
-    if (writeBufferSize_ > largestWriteBufferSize_) {
-      largestWriteBufferSize_ = writeBufferSize_;
+    if (outputTransport_->available_read() > largestWriteBufferSize_) {
+      largestWriteBufferSize_ = outputTransport_->available_read();
     }
+    // don't keep linked slices alive while the connection waits
+    outputTransport_->reset();
     if (server_->getResizeBufferEveryN() > 0
         && ++callsForResize_ >= server_->getResizeBufferEveryN()) {
       checkIdleBufferMemLimit(server_->getIdleReadBufferLimit(),
@@ -667,8 +1110,10 @@ void TNonblockingServer::TConnection::transition() {
   LABEL_APP_INIT:
   case APP_INIT:
 
+    // The read buffer is only needed while a frame is in flight
+    releaseReadBuffer();
+
     // Clear write buffer variables
-    writeBuffer_ = NULL;
     writeBufferPos_ = 0;
     writeBufferSize_ = 0;
 
@@ -687,28 +1132,14 @@ void TNonblockingServer::TConnection::transition() {
     return;
 
   case APP_READ_FRAME_SIZE:
-    // We just read the request length
-    // Double the buffer size until it is big enough
-    if (readWant_ > readBufferSize_) {
-      if (readBufferSize_ == 0) {
-        readBufferSize_ = 1;
-      }
-      uint32_t newSize = readBufferSize_;
-      while (readWant_ > newSize) {
-        newSize *= 2;
-      }
+    // We just read the request length (readBufferPos_ counted its bytes)
+    readBufferPos_ = 0;
 
-      uint8_t* newBuffer = (uint8_t*)std::realloc(readBuffer_, newSize);
-      if (newBuffer == NULL) {
-        // nothing else to be done...
-        throw std::bad_alloc();
-      }
-      readBuffer_ = newBuffer;
-      readBufferSize_ = newSize;
+    // Borrow a buffer big enough for the frame
+    if (readWant_ > readBufferSize_) {
+      growReadBuffer(readWant_);
     }
 
-    readBufferPos_ = 0;
-
     // Move into read request state
     socketState_ = SOCKET_RECV;
     appState_ = APP_READ_REQUEST;
@@ -729,14 +1160,408 @@ void TNonblockingServer::TConnection::transition() {
   }
 }
 
+void TNonblockingServer::TConnection::workSocketPipelined(short which) {
+  if (which & EV_WRITE) {
+    writeResponses();
+  }
+
+  if ((which & EV_READ) && !closePending_) {
+    // Make room for at least the rest of the frame we're in the middle of
+    uint32_t buffered = readBufferPos_ - readBufferHead_;
+    uint32_t need = buffered + 1;
+    if (buffered >= sizeof(uint32_t)) {
+      uint32_t frameSize;
+      memcpy(&frameSize, readBuffer_ + readBufferHead_, sizeof(frameSize));
+      frameSize = ntohl(frameSize);
+      if (frameSize <= server_->getMaxFrameSize()) {
+        need = std::max(need, static_cast<uint32_t>(sizeof(uint32_t) + frameSize));
+      }
+    }
+    if (readBufferHead_ + need > readBufferSize_) {
+      uint32_t size = need > readBufferSize_ ? std::max(readBufferSize_ * 2, need)
+                                              : readBufferSize_;
+      if (readBufferRefs_ > 0) {
+        // the frames before readBufferHead_ are still being processed
+        retireReadBuffer(size);
+      } else {
+        assert(readBufferHead_ == 0);
+        growReadBuffer(size);
+      }
+    }
+
+    uint32_t got = 0;
+    bool readable = true;
+    try {
+      readable = readSocket(readBuffer_ + readBufferPos_, readBufferSize_ - readBufferPos_, got);
+    } catch (TTransportException& te) {
+      GlobalOutput.printf("TConnection::workSocketPipelined(): %s", te.what());
+    }
+    if (readable && got == 0) {
+      // remote disconnect or error; let in-flight requests drain first
+      closeWhenIdle();
+    }
+    readBufferPos_ += got;
+  }
+
+  transitionPipelined();
+}
+
+void TNonblockingServer::TConnection::writeResponses() {
+  // Write back completed responses, strictly in request order
+  while (!closePending_ && !pipeline_.empty() && pipeline_.front()->accounted_) {
+    // Gather everything that is ready into a single send
+    const uint8_t* bufs[MAX_GATHERED_BUFFERS];
+    uint32_t lens[MAX_GATHERED_BUFFERS];
+    int count = 0;
+    uint32_t offset = writeBufferPos_;
+    for (std::deque<Request*>::iterator it = pipeline_.begin();
+         it != pipeline_.end() && (*it)->accounted_ && count < MAX_GATHERED_BUFFERS;
+         ++it) {
+      // oneway calls have nothing to send
+      count += (*it)->outputTransport_->gather(offset,
+                                               bufs + count,
+                                               lens + count,
+                                               MAX_GATHERED_BUFFERS - count);
+      offset = 0;
+    }
+    uint32_t total = 0;
+    for (int i = 0; i < count; ++i) {
+      total += lens[i];
+    }
+
+    uint32_t sent = 0;
+    if (count > 0) {
+      try {
+        sent = writeGathered(bufs, lens, count);
+      } catch (TTransportException& te) {
+        GlobalOutput.printf("TConnection::writeResponses(): %s ", te.what());
+        closeWhenIdle();
+        return;
+      }
+    }
+
+    // Retire the responses that went out completely
+    const bool shortWrite = sent < total;
+    while (!pipeline_.empty() && pipeline_.front()->accounted_) {
+      Request* request = pipeline_.front();
+      uint32_t size = request->outputTransport_->getResponseSize();
+      uint32_t left = size > 0 ? size - writeBufferPos_ : 0;
+      if (left > sent) {
+        writeBufferPos_ += sent;
+        sent = 0;
+        break;
+      }
+      sent -= left;
+
+      writeBufferPos_ = 0;
+      pipeline_.pop_front();
+      // don't keep linked slices alive while the request sits unused
+      request->outputTransport_->reset();
+      freeRequests_.push_back(request);
+
+      if (server_->getResizeBufferEveryN() > 0
+          && ++callsForResize_ >= server_->getResizeBufferEveryN()) {
+        checkIdleBufferMemLimit(server_->getIdleReadBufferLimit(),
+                                server_->getIdleWriteBufferLimit());
+        callsForResize_ = 0;
+      }
+    }
+    assert(sent == 0);
+
+    if (shortWrite) {
+      // socket buffer is full, wait for the next write event
+      writable_ = false;
+      return;
+    }
+  }
+}
+
+uint32_t TNonblockingServer::TConnection::writeGathered(const uint8_t** bufs,
+                                                         const uint32_t* lens,
+                                                         int count) {
+  uint32_t sent;
+#ifdef HAVE_SYS_UIO_H
+  struct iovec iov[MAX_GATHERED_BUFFERS];
+  for (int i = 0; i < count; ++i) {
+    iov[i].iov_base = const_cast<uint8_t*>(bufs[i]);
+    iov[i].iov_len = lens[i];
+  }
+  sent = tSocket_->writev_partial(iov, count);
+#else
+  sent = tSocket_->write_partial(bufs[0], lens[0]);
+#endif
+  ioThread_->recordWrite(sent);
+  return sent;
+}
+
+void TNonblockingServer::TConnection::transitionPipelined() {
+  if (appState_ == APP_INIT) {
+    readBufferPos_ = 0;
+    readBufferHead_ = 0;
+    writeBufferPos_ = 0;
+    appState_ = APP_READ_REQUEST;
+  }
+
+  accountRequests();
+
+  if (closePending_) {
+    setIdle();
+    if (numRequestsInFlight_ == 0) {
+      close();
+    }
+    return;
+  }
+
+  // Dispatch every complete frame we already have while there is room
+  const size_t depth = server_->getPipelineDepth();
+  uint32_t pos = readBufferHead_;
+  while (pipeline_.size() < depth && readBufferPos_ - pos >= sizeof(uint32_t)) {
+    uint32_t frameSize;
+    memcpy(&frameSize, readBuffer_ + pos, sizeof(frameSize));
+    frameSize = ntohl(frameSize);
+    if (frameSize > server_->getMaxFrameSize()) {
+      GlobalOutput.printf(
+          "TNonblockingServer: frame size too large "
+          "(%" PRIu32 " > %" PRIu64
+          ") from client %s. "
+          "Remote side not using TFramedTransport?",
+          frameSize,
+          (uint64_t)server_->getMaxFrameSize(),
+          tSocket_->getSocketInfo().c_str());
+      closeWhenIdle();
+      transitionPipelined();
+      return;
+    }
+    if (readBufferPos_ - pos - sizeof(uint32_t) < frameSize) {
+      break;
+    }
+    dispatchRequest(readBuffer_ + pos + sizeof(uint32_t), frameSize);
+    pos += static_cast<uint32_t>(sizeof(uint32_t)) + frameSize;
+    readBufferHead_ = pos;
+    if (closePending_) {
+      transitionPipelined();
+      return;
+    }
+  }
+  // pick up the requests that were run inline
+  accountRequests();
+
+  // Dispatched frames are read in place, so the rest of the buffer can only
+  // move to the front once no request reads from it anymore
+  if (readBufferRefs_ == 0 && readBufferHead_ > 0) {
+    memmove(readBuffer_, readBuffer_ + readBufferHead_, readBufferPos_ - readBufferHead_);
+    readBufferPos_ -= readBufferHead_;
+    readBufferHead_ = 0;
+  }
+  if (readBufferPos_ == 0) {
+    // nothing buffered, hand the buffer back until more data arrives
+    releaseReadBuffer();
+  }
+
+  short eventFlags = 0;
+  if (pipeline_.size() < depth) {
+    eventFlags |= EV_READ;
+  }
+  if (!pipeline_.empty() && pipeline_.front()->accounted_) {
+    eventFlags |= EV_WRITE;
+  }
+  setFlags(eventFlags ? eventFlags | EV_PERSIST : 0);
+}
+
+void TNonblockingServer::TConnection::accountRequests() {
+  // Account for requests the thread pool finished since we last looked
+  for (std::deque<Request*>::iterator it = pipeline_.begin(); it != pipeline_.end(); ++it) {
+    Request* request = *it;
+    if (!request->accounted_ && request->isDone()) {
+      request->accounted_ = true;
+      --numRequestsInFlight_;
+      server_->decrementActiveProcessors();
+      releaseFrame(request->frameBuffer_);
+
+      if (request->dropped_) {
+        // we can't answer out of order, so give up on the whole connection
+        closePending_ = true;
+        continue;
+      }
+
+      // Put the frame size into the response
+      request->outputTransport_->finish();
+    }
+  }
+}
+
+bool TNonblockingServer::TConnection::isInlineCall(const uint8_t* frame, uint32_t size) {
+  if (!processor_->hasInlineSafeCalls()) {
+    return false;
+  }
+  if (!peekProtocol_) {
+    peekTransport_.reset(new TMemoryBuffer());
+    peekProtocol_ = server_->getInputProtocolFactory()->getProtocol(peekTransport_);
+  }
+  peekTransport_->resetBuffer(const_cast<uint8_t*>(frame), size);
+
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+  try {
+    peekProtocol_->readMessageBegin(name, type, seqid);
+  } catch (const TException&) {
+    // not something we can make sense of here, leave it to the processor
+    return false;
+  }
+  return (type == T_CALL || type == T_ONEWAY) && processor_->isInlineSafe(name);
+}
+
+void TNonblockingServer::TConnection::dispatchRequest(uint8_t* frame, uint32_t size) {
+  Request* request;
+  if (freeRequests_.empty()) {
+    request = new Request(server_);
+  } else {
+    request = freeRequests_.back();
+    freeRequests_.pop_back();
+  }
+  request->reset(readBuffer_, frame, size);
+  ++readBufferRefs_;
+  pipeline_.push_back(request);
+
+  server_->incrementActiveProcessors();
+  ++numRequestsInFlight_;
+
+  if (isInlineCall(frame, size)) {
+    // Cheap enough to run right here; the response still goes out in order
+    bool ok = true;
+    try {
+      if (serverEventHandler_) {
+        serverEventHandler_->processContext(connectionContext_, getTSocket());
+      }
+      processor_->process(request->inputProtocol_, request->outputProtocol_, connectionContext_);
+    } catch (const std::exception& x) {
+      GlobalOutput.printf("TNonblockingServer: inline process() exception: %s: %s",
+                          typeid(x).name(),
+                          x.what());
+      ok = false;
+    } catch (...) {
+      GlobalOutput.printf("TNonblockingServer: unknown exception while processing inline.");
+      ok = false;
+    }
+    request->complete(!ok);
+    return;
+  }
+
+  boost::shared_ptr<Runnable> task = boost::shared_ptr<Runnable>(
+      new Task(processor_, request->inputProtocol_, request->outputProtocol_, this, request));
+  try {
+    server_->addTask(task, ioThread_->getNumaNode());
+  } catch (IllegalStateException& ise) {
+    // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
+    GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
+    request->complete(true);
+    closePending_ = true;
+  } catch (TimedOutException& to) {
+    GlobalOutput.printf("[ERROR] TimedOutException: Server::process() %s", to.what());
+    request->complete(true);
+    closePending_ = true;
+  }
+}
+
+void TNonblockingServer::TConnection::retireReadBuffer(uint32_t size) {
+  RetiredReadBuffer retired;
+  retired.buffer = readBuffer_;
+  retired.size = readBufferSize_;
+  retired.refs = readBufferRefs_;
+
+  uint32_t capacity;
+  uint8_t* newBuffer = ioThread_->getBufferPool().borrow(size, &capacity);
+  if (readBufferPos_ > readBufferHead_) {
+    memcpy(newBuffer, readBuffer_ + readBufferHead_, readBufferPos_ - readBufferHead_);
+  }
+  retiredReadBuffers_.push_back(retired);
+  readBuffer_ = newBuffer;
+  readBufferSize_ = capacity;
+  readBufferPos_ -= readBufferHead_;
+  readBufferHead_ = 0;
+  readBufferRefs_ = 0;
+}
+
+void TNonblockingServer::TConnection::releaseFrame(const uint8_t* buffer) {
+  if (buffer == readBuffer_) {
+    assert(readBufferRefs_ > 0);
+    --readBufferRefs_;
+    return;
+  }
+  for (std::vector<RetiredReadBuffer>::iterator it = retiredReadBuffers_.begin();
+       it != retiredReadBuffers_.end();
+       ++it) {
+    if (it->buffer == buffer) {
+      if (--it->refs == 0) {
+        ioThread_->getBufferPool().giveBack(it->buffer, it->size);
+        retiredReadBuffers_.erase(it);
+      }
+      return;
+    }
+  }
+  assert(0);
+}
+
+void TNonblockingServer::TConnection::releaseRequests() {
+  assert(numRequestsInFlight_ == 0);
+  assert(readBufferRefs_ == 0 && retiredReadBuffers_.empty());
+  while (!pipeline_.empty()) {
+    delete pipeline_.front();
+    pipeline_.pop_front();
+  }
+  while (!freeRequests_.empty()) {
+    delete freeRequests_.back();
+    freeRequests_.pop_back();
+  }
+}
+
+void TNonblockingServer::TConnection::forceClose(Request* request) {
+  if (request) {
+    // the IO thread closes the connection once the request is collected
+    request->complete(true);
+  } else {
+    appState_ = APP_CLOSE_CONNECTION;
+  }
+  if (!notifyIOThread()) {
+    close();
+    throw TException("TConnection::forceClose: failed write on notify pipe");
+  }
+}
+
 void TNonblockingServer::TConnection::setFlags(short eventFlags) {
   // Catch the do nothing case
   if (eventFlags_ == eventFlags) {
     return;
   }
 
+#ifdef HAVE_SYS_EPOLL_H
+  if (ioThread_->usingEpoll()) {
+    // Register once for both directions; after that only what we want
+    // changes, and that is entirely up to us
+    if (!epollRegistered_ && eventFlags != 0) {
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+      ev.data.ptr = this;
+      if (epoll_ctl(ioThread_->getEpollFD(), EPOLL_CTL_ADD, tSocket_->getSocketFD(), &ev) == -1) {
+        GlobalOutput.perror("TConnection::setFlags() epoll_ctl: ", THRIFT_GET_SOCKET_ERROR);
+        return;
+      }
+      ioThread_->recordEventChange();
+      epollRegistered_ = true;
+    }
+    eventFlags_ = eventFlags;
+    if ((readable_ && (eventFlags_ & EV_READ)) || (writable_ && (eventFlags_ & EV_WRITE))) {
+      ioThread_->scheduleReady(this);
+    }
+    return;
+  }
+#endif
+
   // Delete a previously existing event
   if (eventFlags_ != 0) {
+    ioThread_->recordEventChange();
     if (event_del(&event_) == -1) {
       GlobalOutput("TConnection::setFlags event_del");
       return;
@@ -781,9 +1606,84 @@ void TNonblockingServer::TConnection::setFlags(short eventFlags) {
   event_set(&event_, tSocket_->getSocketFD(), eventFlags_, TConnection::eventHandler, this);
   event_base_set(ioThread_->getEventBase(), &event_);
 
-  // Add the event
-  if (event_add(&event_, 0) == -1) {
-    GlobalOutput("TConnection::setFlags(): could not event_add");
+  // Add the event
+  ioThread_->recordEventChange();
+  if (event_add(&event_, 0) == -1) {
+    GlobalOutput("TConnection::setFlags(): could not event_add");
+  }
+}
+
+bool TNonblockingServer::TConnection::readSocket(uint8_t* buf, uint32_t len, uint32_t& got) {
+#ifdef HAVE_SYS_EPOLL_H
+  if (ioThread_->usingEpoll()) {
+    for (;;) {
+      ssize_t n = ::recv(tSocket_->getSocketFD(), cast_sockopt(buf), len, 0);
+      if (n >= 0) {
+        got = static_cast<uint32_t>(n);
+        if (got < len) {
+          readable_ = false;
+        }
+        return true;
+      }
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      if (errno_copy == THRIFT_EAGAIN || errno_copy == THRIFT_EWOULDBLOCK) {
+        readable_ = false;
+        got = 0;
+        return false;
+      }
+      if (errno_copy == THRIFT_ECONNRESET) {
+        got = 0;
+        return true;
+      }
+      throw TTransportException(TTransportException::UNKNOWN,
+                                "TConnection::readSocket() recv()",
+                                errno_copy);
+    }
+  }
+#endif
+  got = tSocket_->read(buf, len);
+  return true;
+}
+
+void TNonblockingServer::TConnection::epollEvent(uint32_t events) {
+#ifdef HAVE_SYS_EPOLL_H
+  // errors and hangups show up on the next read or write
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+    readable_ = true;
+  }
+  if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+    writable_ = true;
+  }
+#else
+  THRIFT_UNUSED_VARIABLE(events);
+#endif
+  if ((readable_ && (eventFlags_ & EV_READ)) || (writable_ && (eventFlags_ & EV_WRITE))) {
+    ioThread_->scheduleReady(this);
+  }
+}
+
+void TNonblockingServer::TConnection::runReady() {
+  short which = 0;
+  if (readable_ && (eventFlags_ & EV_READ)) {
+    which |= EV_READ;
+  }
+  if (writable_ && (eventFlags_ & EV_WRITE)) {
+    which |= EV_WRITE;
+  }
+  if (which == 0) {
+    return;
+  }
+
+  eventHandler(tSocket_->getSocketFD(), which, this);
+
+  // close() takes the connection out of the loop; otherwise let the other
+  // ready connections have their turn before serving what is left
+  if (epollRegistered_
+      && ((readable_ && (eventFlags_ & EV_READ)) || (writable_ && (eventFlags_ & EV_WRITE)))) {
+    ioThread_->scheduleReady(this);
   }
 }
 
@@ -791,15 +1691,32 @@ void TNonblockingServer::TConnection::setFlags(short eventFlags) {
  * Closes a connection
  */
 void TNonblockingServer::TConnection::close() {
-  // Delete the registered libevent
-  if (event_del(&event_) == -1) {
-    GlobalOutput.perror("TConnection::close() event_del", THRIFT_GET_SOCKET_ERROR);
+  if (ioThread_->usingEpoll()) {
+#ifdef HAVE_SYS_EPOLL_H
+    ioThread_->unscheduleReady(this);
+    if (epollRegistered_) {
+      ioThread_->recordEventChange();
+      struct epoll_event ev;
+      if (epoll_ctl(ioThread_->getEpollFD(), EPOLL_CTL_DEL, tSocket_->getSocketFD(), &ev) == -1) {
+        GlobalOutput.perror("TConnection::close() epoll_ctl", THRIFT_GET_SOCKET_ERROR);
+      }
+      epollRegistered_ = false;
+    }
+    readable_ = writable_ = false;
+#endif
+  } else {
+    // Delete the registered libevent
+    if (eventFlags_ != 0) {
+      ioThread_->recordEventChange();
+    }
+    if (event_del(&event_) == -1) {
+      GlobalOutput.perror("TConnection::close() event_del", THRIFT_GET_SOCKET_ERROR);
+    }
   }
 
   if (serverEventHandler_) {
     serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
   }
-  ioThread_ = NULL;
 
   // Close the socket
   tSocket_->close();
@@ -811,22 +1728,50 @@ void TNonblockingServer::TConnection::close() {
   // release processor and handler
   processor_.reset();
 
+  // drop pipelined requests along with their transports and protocols
+  releaseRequests();
+
+  // back to the pool of the IO thread we are leaving
+  releaseReadBuffer();
+
+  ioThread_ = NULL;
+
   // Give this object back to the server that owns it
   server_->returnConnection(this);
 }
 
+void TNonblockingServer::TConnection::growReadBuffer(uint32_t size) {
+  uint32_t capacity;
+  uint8_t* newBuffer = ioThread_->getBufferPool().borrow(size, &capacity);
+  if (readBufferPos_ > 0) {
+    memcpy(newBuffer, readBuffer_, readBufferPos_);
+  }
+  releaseReadBuffer();
+  readBuffer_ = newBuffer;
+  readBufferSize_ = capacity;
+}
+
 void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit, size_t writeLimit) {
-  if (readLimit > 0 && readBufferSize_ > readLimit) {
-    free(readBuffer_);
-    readBuffer_ = NULL;
-    readBufferSize_ = 0;
+  // pipelined connections may hold the start of the next frames
+  if (readLimit > 0 && readBufferSize_ > readLimit && readBufferPos_ == 0
+      && readBufferRefs_ == 0) {
+    releaseReadBuffer();
   }
 
   if (writeLimit > 0 && largestWriteBufferSize_ > writeLimit) {
     // just start over
-    outputTransport_->resetBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+    outputTransport_->reset(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
     largestWriteBufferSize_ = 0;
   }
+
+  // the same limit applies to the response buffers of idle pipelined
+  // requests; their input only ever points into the read buffer
+  for (size_t i = 0; i < freeRequests_.size(); ++i) {
+    TResponseBuffer* output = freeRequests_[i]->outputTransport_.get();
+    if (writeLimit > 0 && output->writeEnd() + output->available_write() > writeLimit) {
+      output->reset(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+    }
+  }
 }
 
 TNonblockingServer::~TNonblockingServer() {
@@ -854,18 +1799,22 @@ TNonblockingServer::~TNonblockingServer() {
  * Creates a new connection either by reusing an object off the stack or
  * by allocating a new one entirely
  */
-TNonblockingServer::TConnection* TNonblockingServer::createConnection(THRIFT_SOCKET socket,
-                                                                      const sockaddr* addr,
-                                                                      socklen_t addrLen) {
+TNonblockingServer::TConnection* TNonblockingServer::createConnection(
+    THRIFT_SOCKET socket,
+    const sockaddr* addr,
+    socklen_t addrLen,
+    TNonblockingIOThread* ioThread) {
   // Check the stack
   Guard g(connMutex_);
 
   // pick an IO thread to handle this connection -- currently round robin
-  assert(nextIOThread_ < ioThreads_.size());
-  int selectedThreadIdx = nextIOThread_;
-  nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
+  if (ioThread == NULL) {
+    assert(nextIOThread_ < ioThreads_.size());
+    int selectedThreadIdx = nextIOThread_;
+    nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
 
-  TNonblockingIOThread* ioThread = ioThreads_[selectedThreadIdx].get();
+    ioThread = ioThreads_[selectedThreadIdx].get();
+  }
 
   // Check the connection stack to see if we can re-use
   TConnection* result = NULL;
@@ -905,10 +1854,13 @@ void TNonblockingServer::returnConnection(TConnection* connection) {
  * Server socket had something happen.  We accept all waiting client
  * connections on fd and assign TConnection objects to handle those requests.
  */
-void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
+void TNonblockingServer::handleEvent(THRIFT_SOCKET fd,
+                                     short which,
+                                     TNonblockingIOThread* acceptThread) {
   (void)which;
   // Make sure that libevent didn't mess up the socket handles
-  assert(fd == serverSocket_);
+  assert(fd == serverSocket_ || !reusePortSockets_.empty());
+  assert(acceptThread);
 
   // Server socket accepted a new connection
   socklen_t addrLen;
@@ -923,19 +1875,22 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
   // one, this helps us to avoid having to go back into the libevent engine so
   // many times
   while ((clientSocket = ::accept(fd, addrp, &addrLen)) != -1) {
-    // If we're overloaded, take action here
-    if (overloadAction_ != T_OVERLOAD_NO_ACTION && serverOverloaded()) {
+    // If we're overloaded, take action here.  With SO_REUSEPORT listeners
+    // several IO threads accept concurrently, so check under the lock.
+    if (overloadAction_ != T_OVERLOAD_NO_ACTION) {
       Guard g(connMutex_);
-      nConnectionsDropped_++;
-      nTotalConnectionsDropped_++;
-      if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
-        ::THRIFT_CLOSESOCKET(clientSocket);
-        return;
-      } else if (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) {
-        if (!drainPendingTask()) {
-          // Nothing left to discard, so we drop connection instead.
+      if (serverOverloaded()) {
+        nConnectionsDropped_++;
+        nTotalConnectionsDropped_++;
+        if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
           ::THRIFT_CLOSESOCKET(clientSocket);
           return;
+        } else if (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) {
+          if (!drainPendingTask(acceptThread->getNumaNode())) {
+            // Nothing left to discard, so we drop connection instead.
+            ::THRIFT_CLOSESOCKET(clientSocket);
+            return;
+          }
         }
       }
     }
@@ -950,8 +1905,13 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
       return;
     }
 
-    // Create a new TConnection for this client socket.
-    TConnection* clientConnection = createConnection(clientSocket, addrp, addrLen);
+    // Create a new TConnection for this client socket.  Connections accepted
+    // on a per-thread SO_REUSEPORT socket stay on the accepting thread.
+    TConnection* clientConnection
+        = createConnection(clientSocket,
+                           addrp,
+                           addrLen,
+                           reusePortSockets_.empty() ? NULL : acceptThread);
 
     // Fail fast if we could not create a TConnection object
     if (clientConnection == NULL) {
@@ -967,12 +1927,8 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
      *
      * (We need to avoid writing to our own notification pipe, to
      * avoid possible deadlocks if the pipe is full.)
-     *
-     * The IO thread #0 is the only one that handles these listen
-     * events, so unless the connection has been assigned to thread #0
-     * we know it's not on our thread.
      */
-    if (clientConnection->getIOThreadNumber() == 0) {
+    if (clientConnection->getIOThreadNumber() == acceptThread->getThreadNumber()) {
       clientConnection->transition();
     } else {
       if (!clientConnection->notifyIOThread()) {
@@ -996,6 +1952,29 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
  * Creates a socket to listen on and binds it to the local port.
  */
 void TNonblockingServer::createAndListenOnSocket() {
+  // Set up this file descriptor for listening
+  listenSocket(bindSocket(port_));
+
+  if (useReusePortListeners_) {
+#ifdef SO_REUSEPORT
+    // One more socket per remaining IO thread, all bound to the port the
+    // first one ended up on so that the kernel balances accepts across them
+    for (size_t i = 1; i < numIOThreads_; ++i) {
+      THRIFT_SOCKET s = bindSocket(listenPort_);
+      prepareListenSocket(s);
+      reusePortSockets_.push_back(s);
+    }
+#else
+    GlobalOutput("TNonblockingServer: SO_REUSEPORT not supported, using a single listener");
+    useReusePortListeners_ = false;
+#endif
+  }
+}
+
+/**
+ * Creates a socket bound to the wildcard address on the given port.
+ */
+THRIFT_SOCKET TNonblockingServer::bindSocket(int listenPort) {
   THRIFT_SOCKET s;
 
   struct addrinfo hints, *res, *res0;
@@ -1006,7 +1985,7 @@ void TNonblockingServer::createAndListenOnSocket() {
   hints.ai_family = PF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_flags = AI_PASSIVE | AI_ADDRCONFIG;
-  sprintf(port, "%d", port_);
+  sprintf(port, "%d", listenPort);
 
   // Wildcard address
   error = getaddrinfo(NULL, port, &hints, &res0);
@@ -1043,6 +2022,20 @@ void TNonblockingServer::createAndListenOnSocket() {
   // Set THRIFT_NO_SOCKET_CACHING to avoid 2MSL delay on server restart
   setsockopt(s, SOL_SOCKET, THRIFT_NO_SOCKET_CACHING, const_cast_sockopt(&one), sizeof(one));
 
+#ifdef SO_REUSEPORT
+  // Every per-thread listener has to opt in before bind(), including the first
+  if (useReusePortListeners_) {
+    if (-1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, const_cast_sockopt(&one), sizeof(one))) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      ::THRIFT_CLOSESOCKET(s);
+      freeaddrinfo(res0);
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "TNonblockingServer::serve() SO_REUSEPORT",
+                                errno_copy);
+    }
+  }
+#endif
+
   if (::bind(s, res->ai_addr, static_cast<int>(res->ai_addrlen)) == -1) {
     ::THRIFT_CLOSESOCKET(s);
     freeaddrinfo(res0);
@@ -1054,8 +2047,7 @@ void TNonblockingServer::createAndListenOnSocket() {
   // Done with the addr info
   freeaddrinfo(res0);
 
-  // Set up this file descriptor for listening
-  listenSocket(s);
+  return s;
 }
 
 /**
@@ -1063,6 +2055,23 @@ void TNonblockingServer::createAndListenOnSocket() {
  * to prepare for use in the server.
  */
 void TNonblockingServer::listenSocket(THRIFT_SOCKET s) {
+  prepareListenSocket(s);
+
+  // Cool, this socket is good to go, set it as the serverSocket_
+  serverSocket_ = s;
+
+  if (!port_) {
+    sockaddr_in addr;
+    unsigned int size = sizeof(addr);
+    if (!getsockname(serverSocket_, reinterpret_cast<sockaddr*>(&addr), &size)) {
+      listenPort_ = ntohs(addr.sin_port);
+    } else {
+      GlobalOutput.perror("TNonblocking: failed to get listen port: ", THRIFT_GET_SOCKET_ERROR);
+    }
+  }
+}
+
+void TNonblockingServer::prepareListenSocket(THRIFT_SOCKET s) {
   // Set socket to nonblocking mode
   int flags;
   if ((flags = THRIFT_FCNTL(s, THRIFT_F_GETFL, 0)) < 0
@@ -1096,19 +2105,76 @@ void TNonblockingServer::listenSocket(THRIFT_SOCKET s) {
     ::THRIFT_CLOSESOCKET(s);
     throw TException("TNonblockingServer::serve() listen");
   }
+}
 
-  // Cool, this socket is good to go, set it as the serverSocket_
-  serverSocket_ = s;
+uint64_t TNonblockingServer::getNumNotifications() const {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < ioThreads_.size(); ++i) {
+    total += ioThreads_[i]->getNumNotifications();
+  }
+  return total;
+}
 
-  if (!port_) {
-    sockaddr_in addr;
-    unsigned int size = sizeof(addr);
-    if (!getsockname(serverSocket_, reinterpret_cast<sockaddr*>(&addr), &size)) {
-      listenPort_ = ntohs(addr.sin_port);
-    } else {
-      GlobalOutput.perror("TNonblocking: failed to get listen port: ", THRIFT_GET_SOCKET_ERROR);
-    }
+uint64_t TNonblockingServer::getNumNotificationWakeups() const {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < ioThreads_.size(); ++i) {
+    total += ioThreads_[i]->getNumNotificationWakeups();
+  }
+  return total;
+}
+
+size_t TNonblockingServer::getBufferMemoryInUse() const {
+  size_t total = 0;
+  for (uint32_t i = 0; i < ioThreads_.size(); ++i) {
+    total += ioThreads_[i]->getBufferPool().getBytesInUse();
+  }
+  return total;
+}
+
+uint64_t TNonblockingServer::getNumWriteSyscalls() const {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < ioThreads_.size(); ++i) {
+    total += ioThreads_[i]->getNumWriteSyscalls();
+  }
+  return total;
+}
+
+uint64_t TNonblockingServer::getNumBytesWritten() const {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < ioThreads_.size(); ++i) {
+    total += ioThreads_[i]->getNumBytesWritten();
+  }
+  return total;
+}
+
+uint64_t TNonblockingServer::getNumEventChanges() const {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < ioThreads_.size(); ++i) {
+    total += ioThreads_[i]->getNumEventChanges();
+  }
+  return total;
+}
+
+void TNonblockingServer::setNumaThreadManager(int node,
+                                              boost::shared_ptr<ThreadManager> threadManager) {
+  assert(node >= 0);
+  if (static_cast<size_t>(node) >= numaThreadManagers_.size()) {
+    numaThreadManagers_.resize(node + 1);
+  }
+  numaThreadManagers_[node] = threadManager;
+  if (threadManager) {
+    threadManager->setExpireCallback(
+        apache::thrift::stdcxx::bind(&TNonblockingServer::expireClose,
+                                     this,
+                                     apache::thrift::stdcxx::placeholders::_1));
+  }
+}
+
+boost::shared_ptr<ThreadManager> TNonblockingServer::getNumaThreadManager(int node) const {
+  if (node < 0 || static_cast<size_t>(node) >= numaThreadManagers_.size()) {
+    return boost::shared_ptr<ThreadManager>();
   }
+  return numaThreadManagers_[node];
 }
 
 void TNonblockingServer::setThreadManager(boost::shared_ptr<ThreadManager> threadManager) {
@@ -1124,16 +2190,91 @@ void TNonblockingServer::setThreadManager(boost::shared_ptr<ThreadManager> threa
   }
 }
 
+bool TNonblockingServer::shedQueuedRequest(int64_t latency) {
+  if (queueTargetLatency_ <= 0) {
+    return false;
+  }
+  const int64_t target = queueTargetLatency_ * 1000;
+  const int64_t interval = queueLatencyInterval_ * 1000;
+  const int64_t now = Util::currentTimeUsec();
+
+  Guard g(queueLatencyMutex_);
+  queueLastDequeue_ = now;
+
+  // CoDel (RFC 8289), with each task leaving the queue as a packet
+  bool okToDrop = false;
+  if (latency < target) {
+    queueFirstAboveTime_ = 0;
+  } else if (queueFirstAboveTime_ == 0) {
+    queueFirstAboveTime_ = now + interval;
+  } else if (now >= queueFirstAboveTime_) {
+    okToDrop = true;
+  }
+
+  bool drop = false;
+  if (queueDropping_) {
+    if (!okToDrop) {
+      GlobalOutput.printf("TNonblockingServer: queue latency overload ended.");
+      queueDropping_ = false;
+    } else if (now >= queueDropNext_) {
+      drop = true;
+      ++queueDropCount_;
+      queueDropNext_ = queueControlLaw(queueDropNext_, queueDropCount_);
+    }
+  } else if (okToDrop) {
+    GlobalOutput.printf("TNonblockingServer: queue latency overload begun.");
+    drop = true;
+    queueDropping_ = true;
+    // pick up where we left off if we were shedding recently
+    uint32_t delta = queueDropCount_ - queueLastDropCount_;
+    if (delta > 1 && now - queueDropNext_ < 16 * interval) {
+      queueDropCount_ = delta;
+    } else {
+      queueDropCount_ = 1;
+    }
+    queueLastDropCount_ = queueDropCount_;
+    queueDropNext_ = queueControlLaw(now, queueDropCount_);
+  }
+
+  if (drop) {
+    ++numRequestsShed_;
+  }
+  return drop;
+}
+
+int64_t TNonblockingServer::queueControlLaw(int64_t t, uint32_t count) const {
+  return t + static_cast<int64_t>(queueLatencyInterval_ * 1000 / std::sqrt(double(count)));
+}
+
+uint64_t TNonblockingServer::getNumRequestsShed() {
+  Guard g(queueLatencyMutex_);
+  return numRequestsShed_;
+}
+
+bool TNonblockingServer::queueOverloaded() {
+  if (queueTargetLatency_ <= 0) {
+    return false;
+  }
+  Guard g(queueLatencyMutex_);
+  // no task has run for a whole interval, so nothing is waiting either
+  return queueDropping_
+         && Util::currentTimeUsec() < queueLastDequeue_ + queueLatencyInterval_ * 1000;
+}
+
 bool TNonblockingServer::serverOverloaded() {
   size_t activeConnections = numTConnections_ - connectionStack_.size();
-  if (numActiveProcessors_ > maxActiveProcessors_ || activeConnections > maxConnections_) {
+  size_t bufferMemory = maxBufferMemory_ > 0 ? getBufferMemoryInUse() : 0;
+  bool queueStanding = queueOverloaded();
+  if (numActiveProcessors_ > maxActiveProcessors_ || activeConnections > maxConnections_
+      || (maxBufferMemory_ > 0 && bufferMemory > maxBufferMemory_) || queueStanding) {
     if (!overloaded_) {
       GlobalOutput.printf("TNonblockingServer: overload condition begun.");
       overloaded_ = true;
     }
   } else {
     if (overloaded_ && (numActiveProcessors_ <= overloadHysteresis_ * maxActiveProcessors_)
-        && (activeConnections <= overloadHysteresis_ * maxConnections_)) {
+        && (activeConnections <= overloadHysteresis_ * maxConnections_)
+        && (bufferMemory <= overloadHysteresis_ * maxBufferMemory_)) {
       GlobalOutput.printf(
           "TNonblockingServer: overload ended; "
           "%u dropped (%llu total)",
@@ -1147,13 +2288,31 @@ bool TNonblockingServer::serverOverloaded() {
   return overloaded_;
 }
 
-bool TNonblockingServer::drainPendingTask() {
+bool TNonblockingServer::drainPendingTask(int numaNode) {
+  // Tasks of pinned IO threads queue on their node's thread manager, so try
+  // the accepting thread's node first, then the other nodes, then the default
+  std::vector<boost::shared_ptr<ThreadManager> > managers;
+  boost::shared_ptr<ThreadManager> nodeManager = getNumaThreadManager(numaNode);
+  if (nodeManager) {
+    managers.push_back(nodeManager);
+  }
+  for (size_t i = 0; i < numaThreadManagers_.size(); ++i) {
+    if (numaThreadManagers_[i] && numaThreadManagers_[i] != nodeManager) {
+      managers.push_back(numaThreadManagers_[i]);
+    }
+  }
   if (threadManager_) {
-    boost::shared_ptr<Runnable> task = threadManager_->removeNextPending();
+    managers.push_back(threadManager_);
+  }
+
+  for (size_t i = 0; i < managers.size(); ++i) {
+    boost::shared_ptr<Runnable> task = managers[i]->removeNextPending();
     if (task) {
-      TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
-      assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
-      connection->forceClose();
+      TConnection::Task* connectionTask = static_cast<TConnection::Task*>(task.get());
+      TConnection* connection = connectionTask->getTConnection();
+      assert(connection && connection->getServer()
+             && (connectionTask->getRequest() || connection->getState() == APP_WAIT_TASK));
+      connection->forceClose(connectionTask->getRequest());
       return true;
     }
   }
@@ -1161,9 +2320,11 @@ bool TNonblockingServer::drainPendingTask() {
 }
 
 void TNonblockingServer::expireClose(boost::shared_ptr<Runnable> task) {
-  TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
-  assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
-  connection->forceClose();
+  TConnection::Task* connectionTask = static_cast<TConnection::Task*>(task.get());
+  TConnection* connection = connectionTask->getTConnection();
+  assert(connection && connection->getServer()
+         && (connectionTask->getRequest() || connection->getState() == APP_WAIT_TASK));
+  connection->forceClose(connectionTask->getRequest());
 }
 
 void TNonblockingServer::stop() {
@@ -1192,8 +2353,14 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
   assert(numIOThreads_ == 1 || !userEventBase_);
 
   for (uint32_t id = 0; id < numIOThreads_; ++id) {
-    // the first IO thread also does the listening on server socket
-    THRIFT_SOCKET listenFd = (id == 0 ? serverSocket_ : THRIFT_INVALID_SOCKET);
+    // the first IO thread also does the listening on server socket, the
+    // others only if they got their own SO_REUSEPORT socket
+    THRIFT_SOCKET listenFd = THRIFT_INVALID_SOCKET;
+    if (id == 0) {
+      listenFd = serverSocket_;
+    } else if (id - 1 < reusePortSockets_.size()) {
+      listenFd = reusePortSockets_[id - 1];
+    }
 
     shared_ptr<TNonblockingIOThread> thread(
         new TNonblockingIOThread(this, id, listenFd, useHighPriorityIOThreads_));
@@ -1267,8 +2434,18 @@ TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
     number_(number),
     listenSocket_(listenSocket),
     useHighPriority_(useHighPriority),
+    numaNode_(server->useNumaAffinity() ? number % CpuAffinity::getNumaNodeCount() : -1),
     eventBase_(NULL),
-    ownEventBase_(false) {
+    ownEventBase_(false),
+    epollFd_(-1),
+    epollLoopBreak_(false),
+    notificationQueue_(NULL),
+    numNotifications_(0),
+    numNotificationWakeups_(0),
+    numWriteSyscalls_(0),
+    numBytesWritten_(0),
+    numEventChanges_(0),
+    bufferPool_(server->getBufferPoolCacheSize()) {
   notificationPipeFDs_[0] = -1;
   notificationPipeFDs_[1] = -1;
 }
@@ -1282,6 +2459,13 @@ TNonblockingIOThread::~TNonblockingIOThread() {
     ownEventBase_ = false;
   }
 
+  if (epollFd_ >= 0) {
+    if (0 != ::close(epollFd_)) {
+      GlobalOutput.perror("TNonblockingIOThread epoll close(): ", errno);
+    }
+    epollFd_ = -1;
+  }
+
   if (listenSocket_ >= 0) {
     if (0 != ::THRIFT_CLOSESOCKET(listenSocket_)) {
       GlobalOutput.perror("TNonblockingIOThread listenSocket_ close(): ", THRIFT_GET_SOCKET_ERROR);
@@ -1289,6 +2473,15 @@ TNonblockingIOThread::~TNonblockingIOThread() {
     listenSocket_ = THRIFT_INVALID_SOCKET;
   }
 
+#ifdef HAVE_SYS_EVENTFD_H
+  if (usingEventFD() && notificationPipeFDs_[0] >= 0) {
+    if (0 != ::close(notificationPipeFDs_[0])) {
+      GlobalOutput.perror("TNonblockingIOThread notification eventfd close(): ", errno);
+    }
+    notificationPipeFDs_[0] = notificationPipeFDs_[1] = THRIFT_INVALID_SOCKET;
+  }
+#endif
+
   for (int i = 0; i < 2; ++i) {
     if (notificationPipeFDs_[i] >= 0) {
       if (0 != ::THRIFT_CLOSESOCKET(notificationPipeFDs_[i])) {
@@ -1301,6 +2494,15 @@ TNonblockingIOThread::~TNonblockingIOThread() {
 }
 
 void TNonblockingIOThread::createNotificationPipe() {
+#ifdef HAVE_SYS_EVENTFD_H
+  int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd >= 0) {
+    notificationPipeFDs_[0] = notificationPipeFDs_[1] = efd;
+    return;
+  }
+  GlobalOutput.perror("TNonblockingServer::createNotificationPipe eventfd, using a pipe: ", errno);
+#endif
+
   if (evutil_socketpair(AF_LOCAL, SOCK_STREAM, 0, notificationPipeFDs_) == -1) {
     GlobalOutput.perror("TNonblockingServer::createNotificationPipe ", EVUTIL_SOCKET_ERROR());
     throw TException("can't create notification pipe");
@@ -1334,6 +2536,18 @@ void TNonblockingIOThread::createNotificationPipe() {
 void TNonblockingIOThread::registerEvents() {
   threadId_ = Thread::get_current();
 
+  if (getServer()->getEventLoopBackend() == T_EVENT_LOOP_EPOLL_ET) {
+#ifdef HAVE_SYS_EPOLL_H
+    if (getServer()->getUserEventBase() == NULL) {
+      registerEpollEvents();
+      return;
+    }
+    GlobalOutput.printf("TNonblockingServer: epoll loop unavailable with a user event base");
+#else
+    GlobalOutput.printf("TNonblockingServer: epoll loop unavailable, using libevent");
+#endif
+  }
+
   assert(eventBase_ == 0);
   eventBase_ = getServer()->getUserEventBase();
   if (eventBase_ == NULL) {
@@ -1354,7 +2568,7 @@ void TNonblockingIOThread::registerEvents() {
               listenSocket_,
               EV_READ | EV_PERSIST,
               TNonblockingIOThread::listenHandler,
-              server_);
+              this);
     event_base_set(eventBase_, &serverEvent_);
 
     // Add the event and start up the server
@@ -1387,56 +2601,241 @@ void TNonblockingIOThread::registerEvents() {
   GlobalOutput.printf("TNonblocking: IO thread #%d registered for notify.", number_);
 }
 
+void TNonblockingIOThread::registerEpollEvents() {
+#ifdef HAVE_SYS_EPOLL_H
+  assert(epollFd_ < 0);
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ < 0) {
+    throw TException("TNonblockingServer::serve(): epoll_create1() failed");
+  }
+  if (number_ == 0) {
+    GlobalOutput.printf("TNonblockingServer: using edge-triggered epoll");
+  }
+
+  // The listen and notification descriptors stay level-triggered: their
+  // handlers don't necessarily drain them.  They are told apart from
+  // connections by data.ptr being NULL or this.
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  if (listenSocket_ >= 0) {
+    ev.data.ptr = NULL;
+    if (-1 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenSocket_, &ev)) {
+      throw TException(
+          "TNonblockingServer::serve(): "
+          "epoll_ctl() failed on server listen socket");
+    }
+    GlobalOutput.printf("TNonblocking: IO thread #%d registered for listen.", number_);
+  }
+
+  createNotificationPipe();
+
+  ev.data.ptr = this;
+  if (-1 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, getNotificationRecvFD(), &ev)) {
+    throw TException(
+        "TNonblockingServer::serve(): "
+        "epoll_ctl() failed on task-done notification fd");
+  }
+  GlobalOutput.printf("TNonblocking: IO thread #%d registered for notify.", number_);
+#endif
+}
+
+void TNonblockingIOThread::runEpollLoop() {
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+
+  while (!epollLoopBreak_.load(boost::memory_order_acquire)) {
+    // don't sleep while connections are still waiting for their turn
+    int timeout = readyConnections_.empty() ? -1 : 0;
+    int count = epoll_wait(epollFd_, events, MAX_EPOLL_EVENTS, timeout);
+    if (count < 0) {
+      if (THRIFT_GET_SOCKET_ERROR == THRIFT_EINTR) {
+        continue;
+      }
+      GlobalOutput.perror("TNonblockingIOThread::runEpollLoop() epoll_wait: ",
+                          THRIFT_GET_SOCKET_ERROR);
+      breakLoop(true);
+      return;
+    }
+
+    // Only record connection readiness first: the handlers below may close
+    // connections, which would leave dangling pointers in this batch
+    bool listenReady = false;
+    bool notifyReady = false;
+    for (int i = 0; i < count; ++i) {
+      void* data = events[i].data.ptr;
+      if (data == NULL) {
+        listenReady = true;
+      } else if (data == this) {
+        notifyReady = true;
+      } else {
+        static_cast<TNonblockingServer::TConnection*>(data)->epollEvent(events[i].events);
+      }
+    }
+
+    if (notifyReady) {
+      notifyHandler(getNotificationRecvFD(), EV_READ, this);
+    }
+    if (listenReady) {
+      listenHandler(listenSocket_, EV_READ, this);
+    }
+
+    // Serve the connections that were ready when we started; the ones that
+    // still are get queued again behind them
+    for (size_t ready = readyConnections_.size(); ready > 0 && !readyConnections_.empty();
+         --ready) {
+      TNonblockingServer::TConnection* connection = readyConnections_.front();
+      readyConnections_.pop_front();
+      connection->readyQueued_ = false;
+      connection->runReady();
+    }
+  }
+#endif
+}
+
+void TNonblockingIOThread::scheduleReady(TNonblockingServer::TConnection* conn) {
+  if (!conn->readyQueued_) {
+    conn->readyQueued_ = true;
+    readyConnections_.push_back(conn);
+  }
+}
+
+void TNonblockingIOThread::unscheduleReady(TNonblockingServer::TConnection* conn) {
+  if (conn->readyQueued_) {
+    readyConnections_.erase(
+        std::find(readyConnections_.begin(), readyConnections_.end(), conn));
+    conn->readyQueued_ = false;
+  }
+}
+
 bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
   THRIFT_SOCKET fd = getNotificationSendFD();
   if (fd < 0) {
     return false;
   }
 
-  const int kSize = sizeof(conn);
-  if (send(fd, const_cast_sockopt(&conn), kSize, 0) != kSize) {
-    return false;
+  if (conn == NULL) {
+    return wakeup();
   }
 
+  // Pipelined requests of one connection complete independently; queue the
+  // connection only once; the drain looks at all of its finished requests.
+  if (conn->notificationPending_.exchange(true, boost::memory_order_acq_rel)) {
+    return true;
+  }
+
+  // Push onto the completion queue.  Only the producer that finds the queue
+  // empty has to signal the IO thread; everybody else piggybacks on the
+  // wakeup that is already pending.
+  TNonblockingServer::TConnection* head = notificationQueue_.load(boost::memory_order_relaxed);
+  do {
+    conn->nextNotification_ = head;
+  } while (!notificationQueue_.compare_exchange_weak(head,
+                                                     conn,
+                                                     boost::memory_order_release,
+                                                     boost::memory_order_relaxed));
+
+  if (head == NULL && !wakeup()) {
+    // The connection is queued and will be picked up by the next drain, so
+    // don't report failure: the caller would close it a second time.
+    GlobalOutput.perror("TNonblockingIOThread::notify() wakeup failed: ", THRIFT_GET_SOCKET_ERROR);
+  }
+  return true;
+}
+
+bool TNonblockingIOThread::wakeup() {
+  THRIFT_SOCKET fd = getNotificationSendFD();
+#ifdef HAVE_SYS_EVENTFD_H
+  if (usingEventFD()) {
+    uint64_t one = 1;
+    if (::write(fd, &one, sizeof(one)) != sizeof(one)) {
+      // EAGAIN means the counter is saturated, i.e. a wakeup is pending
+      return errno == EAGAIN;
+    }
+    return true;
+  }
+#endif
+  const char one = 1;
+  if (send(fd, const_cast_sockopt(&one), sizeof(one), 0) != sizeof(one)) {
+    // a full pipe means the reader has plenty of wakeups pending
+    return THRIFT_GET_SOCKET_ERROR == THRIFT_EWOULDBLOCK || THRIFT_GET_SOCKET_ERROR == THRIFT_EAGAIN;
+  }
   return true;
 }
 
+bool TNonblockingIOThread::clearWakeup() {
+  THRIFT_SOCKET fd = getNotificationRecvFD();
+#ifdef HAVE_SYS_EVENTFD_H
+  if (usingEventFD()) {
+    uint64_t count;
+    if (::read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+      GlobalOutput.perror("TNonblocking: notifyHandler eventfd read() failed: ", errno);
+      return false;
+    }
+    return true;
+  }
+#endif
+  while (true) {
+    char buf[64];
+    long nBytes = recv(fd, cast_sockopt(buf), sizeof(buf), 0);
+    if (nBytes > 0) {
+      continue;
+    } else if (nBytes == 0) {
+      GlobalOutput.printf("notifyHandler: Notify socket closed!");
+      return true;
+    } else if (THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
+               && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
+      GlobalOutput.perror("TNonblocking: notifyHandler read() failed: ", THRIFT_GET_SOCKET_ERROR);
+      return false;
+    }
+    return true;
+  }
+}
+
+void TNonblockingIOThread::drainNotifications() {
+  TNonblockingServer::TConnection* head
+      = notificationQueue_.exchange(NULL, boost::memory_order_acquire);
+
+  // The queue is a LIFO stack; reverse it so connections are serviced in
+  // the order they completed.
+  TNonblockingServer::TConnection* connection = NULL;
+  while (head) {
+    TNonblockingServer::TConnection* next = head->nextNotification_;
+    head->nextNotification_ = connection;
+    connection = head;
+    head = next;
+  }
+
+  while (connection) {
+    // transition() may close and recycle the connection, so step first
+    TNonblockingServer::TConnection* next = connection->nextNotification_;
+    connection->nextNotification_ = NULL;
+    // an RMW so that we see every request completed before this point
+    connection->notificationPending_.exchange(false, boost::memory_order_acq_rel);
+    ++numNotifications_;
+    connection->transition();
+    connection = next;
+  }
+}
+
 /* static */
 void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void* v) {
   TNonblockingIOThread* ioThread = (TNonblockingIOThread*)v;
   assert(ioThread);
   (void)which;
+  (void)fd;
 
-  while (true) {
-    TNonblockingServer::TConnection* connection = 0;
-    const int kSize = sizeof(connection);
-    long nBytes = recv(fd, cast_sockopt(&connection), kSize, 0);
-    if (nBytes == kSize) {
-      if (connection == NULL) {
-        // this is the command to stop our thread, exit the handler!
-        return;
-      }
-      connection->transition();
-    } else if (nBytes > 0) {
-      // throw away these bytes and hope that next time we get a solid read
-      GlobalOutput.printf("notifyHandler: Bad read of %d bytes, wanted %d", nBytes, kSize);
-      ioThread->breakLoop(true);
-      return;
-    } else if (nBytes == 0) {
-      GlobalOutput.printf("notifyHandler: Notify socket closed!");
-      // exit the loop
-      break;
-    } else { // nBytes < 0
-      if (THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
-          && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
-        GlobalOutput.perror("TNonblocking: notifyHandler read() failed: ", THRIFT_GET_SOCKET_ERROR);
-        ioThread->breakLoop(true);
-        return;
-      }
-      // exit the loop
-      break;
-    }
+  ++ioThread->numNotificationWakeups_;
+
+  // Reset the wakeup *before* draining: a producer that pushes onto the
+  // queue after we emptied it will then signal us again instead of having
+  // its wakeup swallowed.
+  if (!ioThread->clearWakeup()) {
+    ioThread->breakLoop(true);
+    return;
   }
+
+  ioThread->drainNotifications();
 }
 
 void TNonblockingIOThread::breakLoop(bool error) {
@@ -1449,7 +2848,11 @@ void TNonblockingIOThread::breakLoop(bool error) {
   }
 
   // sets a flag so that the loop exits on the next event
-  event_base_loopbreak(eventBase_);
+  if (usingEpoll()) {
+    epollLoopBreak_.store(true, boost::memory_order_release);
+  } else {
+    event_base_loopbreak(eventBase_);
+  }
 
   // event_base_loopbreak() only causes the loop to exit the next time
   // it wakes up.  We need to force it to wake up, in case there are
@@ -1493,8 +2896,18 @@ void TNonblockingIOThread::setCurrentThreadHighPriority(bool value) {
 #endif
 }
 
+void TNonblockingIOThread::setCurrentThreadNumaAffinity() {
+  if (CpuAffinity::setCurrentThreadAffinity(CpuAffinity::getNumaNodeCpus(numaNode_))) {
+    GlobalOutput.printf("TNonblocking: IO Thread #%d pinned to NUMA node %d", number_, numaNode_);
+  } else {
+    GlobalOutput.printf("TNonblocking: IO Thread #%d unable to pin to NUMA node %d",
+                        number_,
+                        numaNode_);
+  }
+}
+
 void TNonblockingIOThread::run() {
-  if (eventBase_ == NULL)
+  if (eventBase_ == NULL && !usingEpoll())
     registerEvents();
 
   GlobalOutput.printf("TNonblockingServer: IO thread #%d entering loop...", number_);
@@ -1503,8 +2916,16 @@ void TNonblockingIOThread::run() {
     setCurrentThreadHighPriority(true);
   }
 
-  // Run libevent engine, never returns, invokes calls to eventHandler
-  event_base_loop(eventBase_, 0);
+  if (numaNode_ >= 0) {
+    setCurrentThreadNumaAffinity();
+  }
+
+  // Run the event loop until stop(), invokes calls to eventHandler
+  if (usingEpoll()) {
+    runEpollLoop();
+  } else {
+    event_base_loop(eventBase_, 0);
+  }
 
   if (useHighPriority_) {
     setCurrentThreadHighPriority(false);
@@ -1517,6 +2938,17 @@ void TNonblockingIOThread::run() {
 }
 
 void TNonblockingIOThread::cleanupEvents() {
+#ifdef HAVE_SYS_EPOLL_H
+  if (usingEpoll()) {
+    struct epoll_event ev;
+    if (listenSocket_ >= 0) {
+      epoll_ctl(epollFd_, EPOLL_CTL_DEL, listenSocket_, &ev);
+    }
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, getNotificationRecvFD(), &ev);
+    return;
+  }
+#endif
+
   // stop the listen socket, if any
   if (listenSocket_ >= 0) {
     if (event_del(&serverEvent_) == -1) {
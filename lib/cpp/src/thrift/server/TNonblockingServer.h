@@ -22,6 +22,7 @@
 
 #include <thrift/Thrift.h>
 #include <thrift/server/TServer.h>
+#include <thrift/server/TBufferPool.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TSocket.h>
@@ -30,6 +31,8 @@
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/PlatformThreadFactory.h>
 #include <thrift/concurrency/Mutex.h>
+#include <boost/atomic.hpp>
+#include <deque>
 #include <stack>
 #include <vector>
 #include <string>
@@ -98,6 +101,14 @@ inline SOCKOPT_CAST_T* cast_sockopt(T* v) {
  * It does not use the TServerTransport framework, but rather has socket
  * operations hardcoded for use with select.
  *
+ * When processing with a thread pool, calls the processor reports as inline
+ * safe (see TProcessor::isInlineSafe(), set through the cpp.inline_safe
+ * function annotation) are still run directly on the IO thread, saving the
+ * round trip through the ThreadManager.  Such handlers must not block.  The
+ * method name is peeked with the server's input protocol straight from the
+ * frame, so this only works when the input transport factory does not
+ * change the framed bytes.
+ *
  */
 
 /// Overload condition actions.
@@ -107,6 +118,12 @@ enum TOverloadAction {
   T_OVERLOAD_DRAIN_TASK_QUEUE ///< Drop some tasks from head of task queue */
 };
 
+/// Event loop implementations for the IO threads.
+enum TEventLoopBackend {
+  T_EVENT_LOOP_LIBEVENT, ///< libevent, connection events re-armed on each state change */
+  T_EVENT_LOOP_EPOLL_ET  ///< Edge-triggered epoll, one registration per connection */
+};
+
 class TNonblockingIOThread;
 
 class TNonblockingServer : public TServer {
@@ -146,15 +163,33 @@ private:
   /// # of IO threads to use by default
   static const int DEFAULT_IO_THREADS = 1;
 
+  /// # of requests per connection processed concurrently by default
+  static const int DEFAULT_PIPELINE_DEPTH = 1;
+
+  /// Window for queue latency based admission control, in milliseconds
+  static const int DEFAULT_QUEUE_LATENCY_INTERVAL = 100;
+
   /// # of IO threads this server will use
   size_t numIOThreads_;
 
   /// Whether to set high scheduling priority for IO threads
   bool useHighPriorityIOThreads_;
 
+  /// Whether to pin IO threads to NUMA nodes
+  bool useNumaAffinity_;
+
+  /// Whether every IO thread listens on its own SO_REUSEPORT socket
+  bool useReusePortListeners_;
+
+  /// Event loop the IO threads run
+  TEventLoopBackend eventLoopBackend_;
+
   /// Server socket file descriptor
   THRIFT_SOCKET serverSocket_;
 
+  /// SO_REUSEPORT listen sockets for IO threads 1..N-1 (thread 0 uses serverSocket_)
+  std::vector<THRIFT_SOCKET> reusePortSockets_;
+
   /// Port server runs on. Zero when letting OS decide actual port
   int port_;
 
@@ -170,6 +205,9 @@ private:
   /// Is thread pool processing?
   bool threadPoolProcessing_;
 
+  /// Optional per NUMA node thread pools, indexed by node
+  std::vector<boost::shared_ptr<ThreadManager> > numaThreadManagers_;
+
   // Factory to create the IO threads
   boost::shared_ptr<PlatformThreadFactory> ioThreadFactory_;
 
@@ -200,9 +238,41 @@ private:
   /// Limit for frame size
   size_t maxFrameSize_;
 
+  /// Limit for requests of one connection in processing at the same time
+  size_t pipelineDepth_;
+
   /// Time in milliseconds before an unperformed task expires (0 == infinite).
   int64_t taskExpireTime_;
 
+  /// Queue latency in milliseconds CoDel aims to stay below (0 == disabled).
+  int64_t queueTargetLatency_;
+
+  /// Window in milliseconds over which CoDel looks at queue latency.
+  int64_t queueLatencyInterval_;
+
+  /// Guards the CoDel state below, updated by the worker threads
+  Mutex queueLatencyMutex_;
+
+  /// When (usec) the queue latency, above target since, makes a whole
+  /// interval (0 == below target)
+  int64_t queueFirstAboveTime_;
+
+  /// When (usec) the next request gets shed while in shedding state
+  int64_t queueDropNext_;
+
+  /// Requests shed since entering shedding state, and at its last exit
+  uint32_t queueDropCount_;
+  uint32_t queueLastDropCount_;
+
+  /// Set while shedding requests (CoDel's dropping state)
+  bool queueDropping_;
+
+  /// When (usec) a task last left the queue
+  int64_t queueLastDequeue_;
+
+  /// Requests answered with a TApplicationException for waiting too long
+  uint64_t numRequestsShed_;
+
   /**
    * Hysteresis for overload state.  This is the fraction of the overload
    * value that needs to be reached before the overload state is cleared;
@@ -242,6 +312,15 @@ private:
    */
   int32_t resizeBufferEveryN_;
 
+  /**
+   * Most bytes of read buffers lent out by the IO threads' buffer pools
+   * before the server considers itself overloaded.  0 means no limit.
+   */
+  size_t maxBufferMemory_;
+
+  /// Free bytes each IO thread's buffer pool keeps for reuse.
+  size_t bufferPoolCacheSize_;
+
   /// Set if we are currently in an overloaded state.
   bool overloaded_;
 
@@ -274,14 +353,24 @@ private:
    *
    * @param fd the listen socket.
    * @param which the event flag that triggered the handler.
+   * @param acceptThread the IO thread that owns the listen socket.
    */
-  void handleEvent(THRIFT_SOCKET fd, short which);
+  void handleEvent(THRIFT_SOCKET fd, short which, TNonblockingIOThread* acceptThread);
+
+  /// Whether requests are being shed for thread pool queue latency (CoDel).
+  bool queueOverloaded();
+
+  /// CoDel's control law: when to shed next after shedding count at t.
+  int64_t queueControlLaw(int64_t t, uint32_t count) const;
 
   void init(int port) {
     serverSocket_ = THRIFT_INVALID_SOCKET;
     numIOThreads_ = DEFAULT_IO_THREADS;
     nextIOThread_ = 0;
     useHighPriorityIOThreads_ = false;
+    useNumaAffinity_ = false;
+    useReusePortListeners_ = false;
+    eventLoopBackend_ = T_EVENT_LOOP_LIBEVENT;
     port_ = port;
     listenPort_ = port;
     userEventBase_ = NULL;
@@ -292,13 +381,25 @@ private:
     maxActiveProcessors_ = MAX_ACTIVE_PROCESSORS;
     maxConnections_ = MAX_CONNECTIONS;
     maxFrameSize_ = MAX_FRAME_SIZE;
+    pipelineDepth_ = DEFAULT_PIPELINE_DEPTH;
     taskExpireTime_ = 0;
+    queueTargetLatency_ = 0;
+    queueLatencyInterval_ = DEFAULT_QUEUE_LATENCY_INTERVAL;
+    queueFirstAboveTime_ = 0;
+    queueDropNext_ = 0;
+    queueDropCount_ = 0;
+    queueLastDropCount_ = 0;
+    queueDropping_ = false;
+    queueLastDequeue_ = 0;
+    numRequestsShed_ = 0;
     overloadHysteresis_ = 0.8;
     overloadAction_ = T_OVERLOAD_NO_ACTION;
     writeBufferDefaultSize_ = WRITE_BUFFER_DEFAULT_SIZE;
     idleReadBufferLimit_ = IDLE_READ_BUFFER_LIMIT;
     idleWriteBufferLimit_ = IDLE_WRITE_BUFFER_LIMIT;
     resizeBufferEveryN_ = RESIZE_BUFFER_EVERY_N;
+    maxBufferMemory_ = 0;
+    bufferPoolCacheSize_ = TBufferPool::DEFAULT_MAX_CACHED_BYTES;
     overloaded_ = false;
     nConnectionsDropped_ = 0;
     nTotalConnectionsDropped_ = 0;
@@ -421,9 +522,63 @@ public:
   /** Set whether the IO threads will get high scheduling priority. */
   void setUseHighPriorityIOThreads(bool val) { useHighPriorityIOThreads_ = val; }
 
+  /** Return whether the IO threads are pinned to NUMA nodes. */
+  bool useNumaAffinity() const { return useNumaAffinity_; }
+
+  /**
+   * Set whether IO thread #N is pinned to the CPUs of NUMA node N modulo the
+   * number of nodes.  IO thread #0 runs in the thread that calls serve(), so
+   * that thread gets pinned as well.  Tasks from connections of a pinned IO
+   * thread go to the thread manager registered for its node with
+   * setNumaThreadManager(), if any.  Can only be used before the call to
+   * serve().
+   */
+  void setUseNumaAffinity(bool val) { useNumaAffinity_ = val; }
+
+  /**
+   * Sets the thread manager that runs tasks for connections of IO threads
+   * pinned to a NUMA node.  Its workers are usually created by a
+   * PosixThreadFactory with setNumaNodeAffinity(node).  Only used with
+   * setUseNumaAffinity(true) and in addition to the thread manager from
+   * setThreadManager(), which still enables thread pool processing and
+   * serves nodes without a thread manager of their own.
+   */
+  void setNumaThreadManager(int node, boost::shared_ptr<ThreadManager> threadManager);
+
+  /** Return the thread manager for a NUMA node, or NULL if it has none. */
+  boost::shared_ptr<ThreadManager> getNumaThreadManager(int node) const;
+
   /** Return the number of IO threads used by this server. */
   size_t getNumIOThreads() const { return numIOThreads_; }
 
+  /** Return whether every IO thread accepts on its own SO_REUSEPORT socket. */
+  bool useReusePortListeners() const { return useReusePortListeners_; }
+
+  /**
+   * Set whether every IO thread opens its own SO_REUSEPORT listen socket on
+   * the server port.  The kernel then spreads incoming connections across
+   * the IO threads, and each thread accepts directly into its own
+   * connections instead of IO thread #0 accepting everything and handing
+   * sockets over through the notification queue.  Only has an effect when
+   * set before the listen socket is created, and is ignored on platforms
+   * without SO_REUSEPORT.
+   */
+  void setUseReusePortListeners(bool val) { useReusePortListeners_ = val; }
+
+  /** Return the event loop the IO threads run. */
+  TEventLoopBackend getEventLoopBackend() const { return eventLoopBackend_; }
+
+  /**
+   * Set the event loop the IO threads run.  T_EVENT_LOOP_EPOLL_ET registers
+   * every connection once for both reading and writing in edge-triggered
+   * mode and keeps track of readiness itself, so switching a connection
+   * between reading and writing costs no syscall.  It is only available
+   * where epoll is, and not with a user-provided event base; the IO threads
+   * fall back to libevent otherwise.  Can only be used before the call to
+   * serve().
+   */
+  void setEventLoopBackend(TEventLoopBackend backend) { eventLoopBackend_ = backend; }
+
   /**
    * Get the maximum number of unused TConnection we will hold in reserve.
    *
@@ -440,8 +595,20 @@ public:
 
   bool isThreadPoolProcessing() const { return threadPoolProcessing_; }
 
-  void addTask(boost::shared_ptr<Runnable> task) {
-    threadManager_->add(task, 0LL, taskExpireTime_);
+  /**
+   * Hands a task to the thread pool.
+   *
+   * @param task the task to run.
+   * @param numaNode NUMA node of the IO thread that received the request,
+   *        -1 if it is not pinned.
+   */
+  void addTask(boost::shared_ptr<Runnable> task, int numaNode = -1) {
+    if (numaNode >= 0 && static_cast<size_t>(numaNode) < numaThreadManagers_.size()
+        && numaThreadManagers_[numaNode]) {
+      numaThreadManagers_[numaNode]->add(task, 0LL, taskExpireTime_);
+    } else {
+      threadManager_->add(task, 0LL, taskExpireTime_);
+    }
   }
 
   /**
@@ -475,6 +642,54 @@ public:
    */
   size_t getNumActiveProcessors() const { return numActiveProcessors_; }
 
+  /**
+   * Return the number of task completions and connection handoffs delivered
+   * to the IO threads through their completion queues.
+   *
+   * @return # of notifications drained by all IO threads.
+   */
+  uint64_t getNumNotifications() const;
+
+  /**
+   * Return the number of times the IO threads were woken up to drain their
+   * completion queues.  Each wakeup costs one signal and one reset syscall,
+   * so 2 * wakeups / notifications is the notification syscall cost per
+   * request (it was always 2 with the old one-pointer-per-write pipe).
+   *
+   * @return # of notification wakeups across all IO threads.
+   */
+  uint64_t getNumNotificationWakeups() const;
+
+  /**
+   * Return the number of send syscalls the IO threads made to write
+   * responses.  Each response goes out with a single sendmsg() gathering
+   * its frame header, body and large binary fields linked in by reference,
+   * and pipelined connections add every other response that is ready, so
+   * getNumBytesWritten() / getNumWriteSyscalls() shows how well writes are
+   * being coalesced.
+   *
+   * @return # of response write syscalls across all IO threads.
+   */
+  uint64_t getNumWriteSyscalls() const;
+
+  /**
+   * Return the number of response bytes (frame headers included) the IO
+   * threads wrote to their connections.
+   *
+   * @return # of bytes written across all IO threads.
+   */
+  uint64_t getNumBytesWritten() const;
+
+  /**
+   * Return the number of times the IO threads registered, changed or
+   * removed the events of a connection with the kernel.  With libevent this
+   * happens on every switch between reading and writing, with the
+   * edge-triggered epoll loop only when a connection opens and closes.
+   *
+   * @return # of event changes across all IO threads.
+   */
+  uint64_t getNumEventChanges() const;
+
   /// Increment the count of connections currently processing.
   void incrementActiveProcessors() {
     Guard g(connMutex_);
@@ -536,6 +751,28 @@ public:
    */
   void setMaxFrameSize(size_t maxFrameSize) { maxFrameSize_ = maxFrameSize; }
 
+  /**
+   * Get the maximum number of requests of a single connection that are
+   * processed at the same time.
+   *
+   * @return current pipeline depth.
+   */
+  size_t getPipelineDepth() const { return pipelineDepth_; }
+
+  /**
+   * Set the maximum number of requests of a single connection that are
+   * processed at the same time.  With a depth above 1 and a thread pool,
+   * frames are parsed eagerly as they arrive and each one is dispatched to
+   * the ThreadManager right away; responses are still written back in
+   * request order.  Every dispatched frame counts as an active processor.
+   * Note that the processor (and its handler) of a connection may then be
+   * invoked from several threads at once.  Only affects connections
+   * accepted after the call.
+   *
+   * @param depth requests in flight per connection, 1 disables pipelining.
+   */
+  void setPipelineDepth(size_t depth) { pipelineDepth_ = depth > 0 ? depth : 1; }
+
   /**
    * Get fraction of maximum limits before an overload condition is cleared.
    *
@@ -583,12 +820,69 @@ public:
    */
   void setTaskExpireTime(int64_t taskExpireTime) { taskExpireTime_ = taskExpireTime; }
 
+  /**
+   * Get the queue latency admission control target (0 == disabled).
+   *
+   * @return the target time in milliseconds a task may wait for a thread.
+   */
+  int64_t getQueueTargetLatency() const { return queueTargetLatency_; }
+
+  /**
+   * Enable CoDel admission control on the thread pool queue.  The time each
+   * task waited in the ThreadManager before running is measured.  Once it
+   * has stayed above target for a whole interval, the queue is standing:
+   * the server is overloaded and sheds requests, answering them with a
+   * TApplicationException instead of processing them late.  Following
+   * CoDel's control law, the first one is shed right away and the next ones
+   * after interval / sqrt(n) for the n-th, so shedding grows until the
+   * queue latency drops below target, which ends it.
+   *
+   * Only applies when processing with a thread pool.
+   *
+   * @param target time in milliseconds, 0 (the default) disables.
+   */
+  void setQueueTargetLatency(int64_t target) { queueTargetLatency_ = target; }
+
+  /**
+   * Get the window over which queue latency is checked against the target.
+   *
+   * @return the interval in milliseconds.
+   */
+  int64_t getQueueLatencyInterval() const { return queueLatencyInterval_; }
+
+  /**
+   * Set the window over which queue latency is checked against the target.
+   * It should be on the order of the worst case request processing time.
+   *
+   * @param interval time in milliseconds, DEFAULT_QUEUE_LATENCY_INTERVAL by
+   *        default.
+   */
+  void setQueueLatencyInterval(int64_t interval) { queueLatencyInterval_ = interval; }
+
+  /**
+   * Account for the time a task waited in the thread pool queue and decide
+   * whether its request should be shed.  Called by the worker threads.
+   *
+   * @param latency time in microseconds the task waited.
+   * @return true if the request should be rejected.
+   */
+  bool shedQueuedRequest(int64_t latency);
+
+  /**
+   * Return the number of requests rejected by queue latency admission
+   * control.
+   *
+   * @return # of requests answered with a TApplicationException.
+   */
+  uint64_t getNumRequestsShed();
+
   /**
    * Determine if the server is currently overloaded.
    * This function checks the maximums for open connections and connections
    * currently in processing, and sets an overload condition if they are
    * exceeded.  The overload will persist until both values are below the
-   * current hysteresis fraction of their maximums.
+   * current hysteresis fraction of their maximums.  A standing thread pool
+   * queue (see setQueueTargetLatency()) is an overload condition as well.
    *
    * @return true if an overload condition exists, false if not.
    */
@@ -596,9 +890,13 @@ public:
 
   /** Pop and discard next task on threadpool wait queue.
    *
-   * @return true if a task was discarded, false if the wait queue was empty.
+   * The queue of the thread manager for numaNode is drained first, then those
+   * of the other NUMA nodes and finally the one from setThreadManager().
+   *
+   * @param numaNode NUMA node of the accepting IO thread, or -1 if unpinned.
+   * @return true if a task was discarded, false if the wait queues were empty.
    */
-  bool drainPendingTask();
+  bool drainPendingTask(int numaNode);
 
   /**
    * Get the starting size of a TConnection object's write buffer.
@@ -686,6 +984,48 @@ public:
    */
   void setResizeBufferEveryN(int32_t count) { resizeBufferEveryN_ = count; }
 
+  /**
+   * Get the read buffer memory budget.
+   *
+   * @return # bytes of read buffers in use beyond which we are overloaded.
+   */
+  size_t getMaxBufferMemory() const { return maxBufferMemory_; }
+
+  /**
+   * Set the read buffer memory budget.  Connections borrow their read
+   * buffers from a per IO thread pool only while a frame is being received
+   * or processed; once the buffers lent out exceed this many bytes across all
+   * IO threads the server is overloaded and takes its overload action on new
+   * connections, until usage falls below the hysteresis fraction again.
+   *
+   * @param limit # bytes, or 0 (the default) for no limit.
+   */
+  void setMaxBufferMemory(size_t limit) { maxBufferMemory_ = limit; }
+
+  /**
+   * Get the number of free bytes each IO thread's buffer pool caches.
+   *
+   * @return # bytes kept for reuse per IO thread.
+   */
+  size_t getBufferPoolCacheSize() const { return bufferPoolCacheSize_; }
+
+  /**
+   * Set the number of free bytes each IO thread's buffer pool caches.
+   * Buffers handed back beyond this go back to the heap.  Must be called
+   * before serve().
+   *
+   * @param size # bytes kept for reuse per IO thread, 0 disables caching.
+   */
+  void setBufferPoolCacheSize(size_t size) { bufferPoolCacheSize_ = size; }
+
+  /**
+   * Return the bytes of read buffers currently lent out by the IO threads'
+   * buffer pools.
+   *
+   * @return # bytes of read buffers in use across all IO threads.
+   */
+  size_t getBufferMemoryInUse() const;
+
   /**
    * Main workhorse function, starts up the server listening on a port and
    * loops over the libevent handler.
@@ -697,7 +1037,11 @@ public:
    */
   void stop();
 
-  /// Creates a socket to listen on and binds it to the local port.
+  /**
+   * Creates a socket to listen on and binds it to the local port.  With
+   * setUseReusePortListeners(true) also creates one additional SO_REUSEPORT
+   * socket for each of the other IO threads.
+   */
   void createAndListenOnSocket();
 
   /**
@@ -725,6 +1069,21 @@ public:
   event_base* getUserEventBase() const { return userEventBase_; }
 
 private:
+  /**
+   * Creates a socket bound to the wildcard address on the given port.
+   *
+   * @param listenPort the port to bind to, 0 to let the OS choose.
+   * @return the bound (but not yet listening) socket.
+   */
+  THRIFT_SOCKET bindSocket(int listenPort);
+
+  /**
+   * Sets the options used by all listen sockets and starts listening.
+   *
+   * @param fd descriptor of the bound socket.
+   */
+  void prepareListenSocket(THRIFT_SOCKET fd);
+
   /**
    * Callback function that the threadmanager calls when a task reaches
    * its expiration time.  It is needed to clean up the expired connection.
@@ -741,9 +1100,14 @@ private:
    * @param socket FD of socket associated with this connection.
    * @param addr the sockaddr of the client
    * @param addrLen the length of addr
+   * @param ioThread the IO thread to serve the connection, or NULL to pick
+   *        one round robin.
    * @return pointer to initialized TConnection object.
    */
-  TConnection* createConnection(THRIFT_SOCKET socket, const sockaddr* addr, socklen_t addrLen);
+  TConnection* createConnection(THRIFT_SOCKET socket,
+                                const sockaddr* addr,
+                                socklen_t addrLen,
+                                TNonblockingIOThread* ioThread = NULL);
 
   /**
    * Returns a connection to pool or deletion.  If the connection pool
@@ -770,6 +1134,9 @@ public:
   // Returns the event-base for this thread.
   event_base* getEventBase() const { return eventBase_; }
 
+  // Returns the NUMA node this thread is pinned to, or -1.
+  int getNumaNode() const { return numaNode_; }
+
   // Returns the server for this thread.
   TNonblockingServer* getServer() const { return server_; }
 
@@ -786,13 +1153,59 @@ public:
   // Returns the read-fd for task complete notifications.
   evutil_socket_t getNotificationRecvFD() const { return notificationPipeFDs_[0]; }
 
+  // Returns true if notifications are signalled through an eventfd rather
+  // than a socket pair.
+  bool usingEventFD() const { return notificationPipeFDs_[0] == notificationPipeFDs_[1]; }
+
+  // Returns the number of connections handed to this thread via notify().
+  uint64_t getNumNotifications() const { return numNotifications_; }
+
+  // Returns the number of times the notification fd woke this thread up.
+  uint64_t getNumNotificationWakeups() const { return numNotificationWakeups_; }
+
+  // Returns the number of response write syscalls made by this thread.
+  uint64_t getNumWriteSyscalls() const { return numWriteSyscalls_; }
+
+  // Returns the number of response bytes written by this thread.
+  uint64_t getNumBytesWritten() const { return numBytesWritten_; }
+
+  // Returns the number of connection event changes made by this thread.
+  uint64_t getNumEventChanges() const { return numEventChanges_; }
+
+  // Accounts for one connection event change; called by the connections.
+  void recordEventChange() { ++numEventChanges_; }
+
+  // Returns true if this thread runs the edge-triggered epoll loop.
+  bool usingEpoll() const { return epollFd_ >= 0; }
+
+  // Returns the epoll descriptor, or -1 when running libevent.
+  int getEpollFD() const { return epollFd_; }
+
+  // Queues a connection whose wanted events are ready for the epoll loop.
+  void scheduleReady(TNonblockingServer::TConnection* conn);
+
+  // Removes a closing connection from the epoll loop's ready queue.
+  void unscheduleReady(TNonblockingServer::TConnection* conn);
+
+  // Returns the pool the connections of this thread borrow buffers from.
+  TBufferPool& getBufferPool() { return bufferPool_; }
+
+  // Accounts for one response write syscall; called by the connections.
+  void recordWrite(uint32_t bytes) {
+    ++numWriteSyscalls_;
+    numBytesWritten_ += bytes;
+  }
+
   // Returns the actual thread object associated with this IO thread.
   boost::shared_ptr<Thread> getThread() const { return thread_; }
 
   // Sets the actual thread object associated with this IO thread.
   void setThread(const boost::shared_ptr<Thread>& t) { thread_ = t; }
 
-  // Used by TConnection objects to indicate processing has finished.
+  // Used by TConnection objects to indicate processing has finished.  The
+  // connection is pushed onto a lock-free completion queue and the
+  // notification fd is only signalled when the queue was empty.  A NULL
+  // connection just wakes the event loop up.
   bool notify(TNonblockingServer::TConnection* conn);
 
   // Enters the event loop and does not return until a call to stop().
@@ -810,9 +1223,9 @@ public:
 private:
   /**
    * C-callable event handler for signaling task completion.  Provides a
-   * callback that libevent can understand that will read a connection
-   * object's address from a pipe and call connection->transition() for
-   * that object.
+   * callback that libevent can understand that will reset the notification
+   * fd, drain every connection queued by notify() and call
+   * connection->transition() for each of them in the order they completed.
    *
    * @param fd the descriptor the event occurred on.
    */
@@ -824,24 +1237,46 @@ private:
    *
    * @param fd the descriptor the event occurred on.
    * @param which the flags associated with the event.
-   * @param v void* callback arg where we placed TNonblockingServer's "this".
+   * @param v void* callback arg where we placed TNonblockingIOThread's "this".
    */
   static void listenHandler(evutil_socket_t fd, short which, void* v) {
-    ((TNonblockingServer*)v)->handleEvent(fd, which);
+    TNonblockingIOThread* ioThread = (TNonblockingIOThread*)v;
+    ioThread->getServer()->handleEvent(fd, which, ioThread);
   }
 
   /// Exits the loop ASAP in case of shutdown or error.
   void breakLoop(bool error);
 
-  /// Create the pipe used to notify I/O process of task completion.
+  /// Create the eventfd (or pipe) used to notify I/O process of task completion.
   void createNotificationPipe();
 
+  /// Signal the notification fd so that the event loop wakes up.
+  bool wakeup();
+
+  /// Consume pending wakeups; returns false if the notification fd failed.
+  bool clearWakeup();
+
+  /// Pop every queued connection and transition() them in FIFO order.
+  void drainNotifications();
+
   /// Unregisters our events for notification and listen sockets.
   void cleanupEvents();
 
   /// Sets (or clears) high priority scheduling status for the current thread.
   void setCurrentThreadHighPriority(bool value);
 
+  /// Pins the current thread to the CPUs of numaNode_.
+  void setCurrentThreadNumaAffinity();
+
+  /// Creates the epoll descriptor and adds the listen and notification fds.
+  void registerEpollEvents();
+
+  /// The edge-triggered epoll counterpart of event_base_loop().
+  void runEpollLoop();
+
+  /// Max events taken from the kernel by one epoll_wait()
+  static const int MAX_EPOLL_EVENTS = 64;
+
 private:
   /// associated server
   TNonblockingServer* server_;
@@ -858,6 +1293,9 @@ private:
   /// Sets a high scheduling priority when running
   bool useHighPriority_;
 
+  /// NUMA node to pin to when running, -1 for none
+  int numaNode_;
+
   /// pointer to eventbase to be used for looping
   event_base* eventBase_;
 
@@ -871,9 +1309,40 @@ private:
   /// Used with eventBase_ for task completion notification
   struct event notificationEvent_;
 
-  /// File descriptors for pipe used for task completion notification.
+  /// epoll descriptor when running the edge-triggered loop, -1 otherwise
+  int epollFd_;
+
+  /// Set to leave the epoll loop, possibly from another thread
+  boost::atomic<bool> epollLoopBreak_;
+
+  /// Connections with wanted events that are ready, served in order
+  std::deque<TNonblockingServer::TConnection*> readyConnections_;
+
+  /// File descriptors for pipe used for task completion notification.  When
+  /// an eventfd is available both entries hold the same descriptor.
   evutil_socket_t notificationPipeFDs_[2];
 
+  /// Head of the intrusive MPSC completion queue (LIFO, reversed on drain).
+  boost::atomic<TNonblockingServer::TConnection*> notificationQueue_;
+
+  /// Connections drained from the completion queue.
+  boost::atomic<uint64_t> numNotifications_;
+
+  /// Times notifyHandler() was woken up by the notification fd.
+  boost::atomic<uint64_t> numNotificationWakeups_;
+
+  /// Response write syscalls made by connections of this thread.
+  boost::atomic<uint64_t> numWriteSyscalls_;
+
+  /// Response bytes written by connections of this thread.
+  boost::atomic<uint64_t> numBytesWritten_;
+
+  /// Connection events registered, changed or removed by this thread.
+  boost::atomic<uint64_t> numEventChanges_;
+
+  /// Read buffers of the connections of this thread.
+  TBufferPool bufferPool_;
+
   /// Actual IO Thread
   boost::shared_ptr<Thread> thread_;
 };
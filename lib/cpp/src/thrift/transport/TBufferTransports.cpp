@@ -201,8 +201,9 @@ bool TFramedTransport::readFrame() {
     throw TTransportException("Frame size has negative value");
   }
 
-  // Read the frame payload, and reset markers.
-  if (sz > static_cast<int32_t>(rBufSize_)) {
+  // Read the frame payload, and reset markers. A buffer still referenced by
+  // slices of the previous frame is left to them.
+  if (sz > static_cast<int32_t>(rBufSize_) || (rBuf_ && !rBuf_.unique())) {
     rBuf_.reset(new uint8_t[sz]);
     rBufSize_ = sz;
   }
@@ -211,11 +212,30 @@ bool TFramedTransport::readFrame() {
   return true;
 }
 
+uint32_t TFramedTransport::readSlice_virt(TBufferSlice& slice, uint32_t len) {
+  if (len == 0) {
+    slice.clear();
+    return 0;
+  }
+  if (rBase_ == rBound_) {
+    // Nothing buffered; pull in the next frame (the contents of the empty
+    // current one are not needed) and slice from it
+    readFrame();
+  }
+  if (static_cast<ptrdiff_t>(len) <= rBound_ - rBase_) {
+    slice = TBufferSlice(rBuf_, rBase_, len);
+    rBase_ += len;
+    return len;
+  }
+  // the bytes span frames, so they have to be copied together
+  return TTransport::readSlice_virt(slice, len);
+}
+
 void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   // Double buffer size until sufficient.
   uint32_t have = static_cast<uint32_t>(wBase_ - wBuf_.get());
   uint32_t new_size = wBufSize_;
-  if (len + have < have /* overflow */ || len + have > 0x7fffffff) {
+  if (len + have < have /* overflow */ || len + have > 0x7fffffff - wLinkedBytes_) {
     throw TTransportException(TTransportException::BAD_ARGS,
                               "Attempted to write over 2 GB to TFramedTransport.");
   }
@@ -243,12 +263,28 @@ void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   wBase_ += len;
 }
 
+void TFramedTransport::writeSlice_virt(const TBufferSlice& slice) {
+  if (slice.size() < MIN_LINK_SIZE || !slice.owner()) {
+    write(slice.data(), slice.size());
+    return;
+  }
+
+  uint32_t have = static_cast<uint32_t>(wBase_ - wBuf_.get());
+  if (slice.size() > 0x7fffffff - wLinkedBytes_ - have) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to write over 2 GB to TFramedTransport.");
+  }
+  wLinks_.push_back(std::make_pair(have, slice));
+  wLinkedBytes_ += slice.size();
+}
+
 void TFramedTransport::flush() {
   int32_t sz_hbo, sz_nbo;
   assert(wBufSize_ > sizeof(sz_nbo));
 
   // Slip the frame size into the start of the buffer.
-  sz_hbo = static_cast<uint32_t>(wBase_ - (wBuf_.get() + sizeof(sz_nbo)));
+  uint32_t have = static_cast<uint32_t>(wBase_ - wBuf_.get());
+  sz_hbo = static_cast<uint32_t>(have - sizeof(sz_nbo) + wLinkedBytes_);
   sz_nbo = (int32_t)htonl((uint32_t)(sz_hbo));
   memcpy(wBuf_.get(), (uint8_t*)&sz_nbo, sizeof(sz_nbo));
 
@@ -259,8 +295,30 @@ void TFramedTransport::flush() {
     // up an exception
     wBase_ = wBuf_.get() + sizeof(sz_nbo);
 
-    // Write size and frame body.
-    transport_->write(wBuf_.get(), static_cast<uint32_t>(sizeof(sz_nbo)) + sz_hbo);
+    if (wLinks_.empty()) {
+      // Write size and frame body.
+      transport_->write(wBuf_.get(), have);
+    } else {
+      // Interleave the buffered bytes with the linked slices and hand them
+      // all over at once.
+      std::vector<std::pair<uint32_t, TBufferSlice> > links;
+      links.swap(wLinks_);
+      wLinkedBytes_ = 0;
+
+      std::vector<TBufferSlice> pieces;
+      pieces.reserve(2 * links.size() + 1);
+      uint32_t start = 0;
+      for (size_t i = 0; i < links.size(); ++i) {
+        pieces.push_back(TBufferSlice(boost::shared_array<uint8_t>(),
+                                      wBuf_.get() + start,
+                                      links[i].first - start));
+        pieces.push_back(links[i].second);
+        start = links[i].first;
+      }
+      pieces.push_back(
+          TBufferSlice(boost::shared_array<uint8_t>(), wBuf_.get() + start, have - start));
+      transport_->writeSlices(&pieces[0], static_cast<uint32_t>(pieces.size()));
+    }
   }
 
   // Flush the underlying transport.
@@ -279,7 +337,7 @@ void TFramedTransport::flush() {
 }
 
 uint32_t TFramedTransport::writeEnd() {
-  return static_cast<uint32_t>(wBase_ - wBuf_.get());
+  return static_cast<uint32_t>(wBase_ - wBuf_.get()) + wLinkedBytes_;
 }
 
 const uint8_t* TFramedTransport::borrowSlow(uint8_t* buf, uint32_t* len) {
@@ -394,6 +452,20 @@ void TMemoryBuffer::wroteBytes(uint32_t len) {
   wBase_ += len;
 }
 
+uint32_t TMemoryBuffer::readSlice_virt(TBufferSlice& slice, uint32_t len) {
+  if (!frame_ || len == 0) {
+    return TTransport::readSlice_virt(slice, len);
+  }
+  uint8_t* start;
+  uint32_t give;
+  computeRead(len, &start, &give);
+  if (give < len) {
+    throw TTransportException(TTransportException::END_OF_FILE, "No more data to read.");
+  }
+  slice = TBufferSlice(frame_, start, give);
+  return give;
+}
+
 const uint8_t* TMemoryBuffer::borrowSlow(uint8_t* buf, uint32_t* len) {
   (void)buf;
   rBound_ = wBase_;
@@ -403,6 +475,221 @@ const uint8_t* TMemoryBuffer::borrowSlow(uint8_t* buf, uint32_t* len) {
   }
   return NULL;
 }
+
+void TChainedBuffer::syncTail() {
+  if (tailWritable_) {
+    Segment& tail = chain_.back();
+    tail.size = static_cast<uint32_t>(wBase_ - tail.data);
+  }
+}
+
+void TChainedBuffer::pushSegment(const Segment& segment, bool writable, uint32_t capacity) {
+  syncTail();
+  chain_.push_back(segment);
+  uint8_t* data = const_cast<uint8_t*>(segment.data);
+  if (chain_.size() == 1) {
+    setReadBuffer(data, 0);
+  }
+  tailWritable_ = writable;
+  if (writable) {
+    wBase_ = data + segment.size;
+    wBound_ = data + capacity;
+  } else {
+    // Force the next write into the slow path, which starts a new segment
+    setWriteBuffer(NULL, 0);
+  }
+}
+
+bool TChainedBuffer::advanceRead() {
+  syncTail();
+  while (!chain_.empty()) {
+    Segment& front = chain_.front();
+    rBound_ = const_cast<uint8_t*>(front.data) + front.size;
+    if (rBase_ < rBound_) {
+      return true;
+    }
+
+    if (chain_.size() == 1 && tailWritable_) {
+      // Everything has been read; rewind the segment unless a slice still
+      // refers to its bytes.
+      if (front.buffer.unique()) {
+        front.size = 0;
+        wBase_ = rBase_ = rBound_ = const_cast<uint8_t*>(front.data);
+      }
+      return false;
+    }
+
+    chain_.pop_front();
+    if (chain_.empty()) {
+      setReadBuffer(NULL, 0);
+      setWriteBuffer(NULL, 0);
+      tailWritable_ = false;
+    } else {
+      setReadBuffer(const_cast<uint8_t*>(chain_.front().data), 0);
+    }
+  }
+  return false;
+}
+
+void TChainedBuffer::unreadRange(size_t i, const uint8_t** begin, const uint8_t** end) const {
+  const Segment& segment = chain_[i];
+  *begin = (i == 0) ? rBase_ : segment.data;
+  *end = (i == chain_.size() - 1 && tailWritable_) ? wBase_ : segment.data + segment.size;
+}
+
+uint32_t TChainedBuffer::readSlow(uint8_t* buf, uint32_t len) {
+  uint32_t got = 0;
+  while (got < len && advanceRead()) {
+    uint32_t give = (std::min)(len - got, static_cast<uint32_t>(rBound_ - rBase_));
+    memcpy(buf + got, rBase_, give);
+    rBase_ += give;
+    got += give;
+  }
+  return got;
+}
+
+void TChainedBuffer::writeSlow(const uint8_t* buf, uint32_t len) {
+  // Fill up the current segment, then put the rest into a new one
+  uint32_t space = static_cast<uint32_t>(wBound_ - wBase_);
+  if (space > 0) {
+    memcpy(wBase_, buf, space);
+    wBase_ += space;
+    buf += space;
+    len -= space;
+  }
+
+  uint32_t capacity = (std::max)(segmentSize_, len);
+  Segment segment;
+  segment.buffer.reset(new uint8_t[capacity]);
+  segment.data = segment.buffer.get();
+  segment.size = 0;
+  pushSegment(segment, true, capacity);
+
+  memcpy(wBase_, buf, len);
+  wBase_ += len;
+}
+
+const uint8_t* TChainedBuffer::borrowSlow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  if (advanceRead() && static_cast<ptrdiff_t>(*len) <= rBound_ - rBase_) {
+    *len = static_cast<uint32_t>(rBound_ - rBase_);
+    return rBase_;
+  }
+  return NULL;
+}
+
+void TChainedBuffer::append(const TBufferSlice& slice) {
+  if (slice.empty()) {
+    return;
+  }
+  if (!slice.owner()) {
+    write(slice.data(), slice.size());
+    return;
+  }
+  Segment segment;
+  segment.buffer = slice.owner();
+  segment.data = slice.data();
+  segment.size = slice.size();
+  pushSegment(segment, false, slice.size());
+}
+
+void TChainedBuffer::writeSlice_virt(const TBufferSlice& slice) {
+  if (slice.size() >= linkThreshold_) {
+    append(slice);
+  } else {
+    write(slice.data(), slice.size());
+  }
+}
+
+uint32_t TChainedBuffer::readSlice_virt(TBufferSlice& slice, uint32_t len) {
+  if (len > 0 && advanceRead() && static_cast<ptrdiff_t>(len) <= rBound_ - rBase_) {
+    slice = TBufferSlice(chain_.front().buffer, rBase_, len);
+    rBase_ += len;
+    return len;
+  }
+  // empty, or the bytes cross a segment boundary
+  return TTransport::readSlice_virt(slice, len);
+}
+
+void TChainedBuffer::getSlices(std::vector<TBufferSlice>& slices) const {
+  slices.clear();
+  for (size_t i = 0; i < chain_.size(); ++i) {
+    const uint8_t* begin;
+    const uint8_t* end;
+    unreadRange(i, &begin, &end);
+    if (begin < end) {
+      slices.push_back(
+          TBufferSlice(chain_[i].buffer, begin, static_cast<uint32_t>(end - begin)));
+    }
+  }
+}
+
+void TChainedBuffer::writeTo(TTransport& transport) {
+  std::vector<TBufferSlice> slices;
+  getSlices(slices);
+  // Empty the chain first, so that it is in a sane state if the write
+  // throws; the slices keep the segments alive until then.
+  resetBuffer();
+  if (!slices.empty()) {
+    transport.writeSlices(&slices[0], static_cast<uint32_t>(slices.size()));
+  }
+}
+
+std::string TChainedBuffer::getBufferAsString() const {
+  std::string str;
+  str.reserve(available_read());
+  for (size_t i = 0; i < chain_.size(); ++i) {
+    const uint8_t* begin;
+    const uint8_t* end;
+    unreadRange(i, &begin, &end);
+    if (begin < end) {
+      str.append(reinterpret_cast<const char*>(begin), end - begin);
+    }
+  }
+  return str;
+}
+
+void TChainedBuffer::resetBuffer() {
+  syncTail();
+  bool reuse = tailWritable_ && chain_.back().buffer.unique()
+               && static_cast<uint32_t>(wBound_ - chain_.back().data) == segmentSize_;
+  if (reuse) {
+    Segment tail = chain_.back();
+    tail.size = 0;
+    chain_.clear();
+    tailWritable_ = false;
+    pushSegment(tail, true, segmentSize_);
+  } else {
+    chain_.clear();
+    tailWritable_ = false;
+    setReadBuffer(NULL, 0);
+    setWriteBuffer(NULL, 0);
+  }
+}
+
+uint32_t TChainedBuffer::available_read() const {
+  uint32_t total = 0;
+  for (size_t i = 0; i < chain_.size(); ++i) {
+    const uint8_t* begin;
+    const uint8_t* end;
+    unreadRange(i, &begin, &end);
+    total += static_cast<uint32_t>(end - begin);
+  }
+  return total;
+}
+
+uint32_t TChainedBuffer::getSegmentCount() const {
+  uint32_t count = 0;
+  for (size_t i = 0; i < chain_.size(); ++i) {
+    const uint8_t* begin;
+    const uint8_t* end;
+    unreadRange(i, &begin, &end);
+    if (begin < end) {
+      ++count;
+    }
+  }
+  return count;
+}
 }
 }
 } // apache::thrift::transport
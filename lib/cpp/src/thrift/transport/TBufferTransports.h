@@ -21,8 +21,12 @@
 #define _THRIFT_TRANSPORT_TBUFFERTRANSPORTS_H_ 1
 
 #include <cstring>
+#include <deque>
 #include <limits>
+#include <utility>
+#include <vector>
 #include <boost/scoped_array.hpp>
+#include <boost/shared_array.hpp>
 
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
@@ -301,11 +305,18 @@ public:
  * binary chunk followed by the data payload. This allows the receiver on the
  * other end to always do fixed-length reads.
  *
+ * Slices of at least MIN_LINK_SIZE bytes passed to writeSlice() are not
+ * copied into the buffer; flush() sends the buffer and the linked slices
+ * together with one writeSlices() call on the underlying transport.
+ *
  */
 class TFramedTransport : public TVirtualTransport<TFramedTransport, TBufferBase> {
 public:
   static const int DEFAULT_BUFFER_SIZE = 512;
 
+  /// Smallest slice that writeSlice() links in instead of copying
+  static const uint32_t MIN_LINK_SIZE = 4096;
+
   /// Use default buffer sizes.
   TFramedTransport(boost::shared_ptr<TTransport> transport)
     : transport_(transport),
@@ -313,6 +324,7 @@ public:
       wBufSize_(DEFAULT_BUFFER_SIZE),
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
+      wLinkedBytes_(0),
       bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()) {
     initPointers();
   }
@@ -325,6 +337,7 @@ public:
       wBufSize_(sz),
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
+      wLinkedBytes_(0),
       bufReclaimThresh_(bufReclaimThresh) {
     initPointers();
   }
@@ -352,6 +365,18 @@ public:
 
   const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len);
 
+  /**
+   * Returns a slice of the current frame without copying. The frame buffer
+   * is not reused for later frames while a slice still refers to it.
+   */
+  virtual uint32_t readSlice_virt(TBufferSlice& slice, uint32_t len);
+
+  /**
+   * Links large slices into the pending frame by reference, copies small
+   * ones into the write buffer.
+   */
+  virtual void writeSlice_virt(const TBufferSlice& slice);
+
   boost::shared_ptr<TTransport> getUnderlyingTransport() { return transport_; }
 
   /*
@@ -387,8 +412,12 @@ protected:
 
   uint32_t rBufSize_;
   uint32_t wBufSize_;
-  boost::scoped_array<uint8_t> rBuf_;
+  // shared so that slices handed out by readSlice() can keep a frame alive
+  boost::shared_array<uint8_t> rBuf_;
   boost::scoped_array<uint8_t> wBuf_;
+  // slices linked into the pending frame, each with its offset in wBuf_
+  std::vector<std::pair<uint32_t, TBufferSlice> > wLinks_;
+  uint32_t wLinkedBytes_;
   uint32_t bufReclaimThresh_;
 };
 
@@ -588,6 +617,15 @@ public:
     // Our old self gets destroyed.
   }
 
+  /**
+   * Observes sz bytes of frame while holding a reference to it, so that
+   * readSlice() can hand out slices that alias the frame instead of copying.
+   */
+  void resetBuffer(const boost::shared_array<uint8_t>& frame, uint32_t sz) {
+    resetBuffer(frame.get(), sz, OBSERVE);
+    frame_ = frame;
+  }
+
   /// See constructor documentation.
   void resetBuffer(uint32_t sz) {
     // Construct the new buffer.
@@ -648,6 +686,12 @@ public:
    */
   uint32_t readAll(uint8_t* buf, uint32_t len) { return TBufferBase::readAll(buf, len); }
 
+  /**
+   * Aliases the buffer when it was set up from a shared frame, copies
+   * otherwise.
+   */
+  virtual uint32_t readSlice_virt(TBufferSlice& slice, uint32_t len);
+
 protected:
   void swap(TMemoryBuffer& that) {
     using std::swap;
@@ -660,6 +704,7 @@ protected:
     swap(wBound_, that.wBound_);
 
     swap(owner_, that.owner_);
+    frame_.swap(that.frame_);
   }
 
   // Make sure there's at least 'len' bytes available for writing.
@@ -683,9 +728,130 @@ protected:
   // Is this object the owner of the buffer?
   bool owner_;
 
+  // Keeps an observed buffer alive for slices, see resetBuffer()
+  boost::shared_array<uint8_t> frame_;
+
   // Don't forget to update constrctors, initCommon, and swap if
   // you add new members.
 };
+
+/**
+ * An in-memory transport that keeps its contents in a chain of segments
+ * rather than one contiguous buffer.
+ *
+ * Writes fill fixed-size segments and start a new one when the last is
+ * full, so growing never copies what was already written. Slices of at
+ * least the link threshold passed to writeSlice() (which is how
+ * TBinaryProtocol and TCompactProtocol write TBufferSlice fields) are
+ * linked into the chain by reference, as are slices given to append().
+ *
+ * Reads consume the chain from the front; readSlice() aliases a segment
+ * when the bytes do not cross into the next one. writeTo() passes all
+ * unread segments to another transport in a single writeSlices() call,
+ * which TSocket turns into one sendmsg().
+ *
+ */
+class TChainedBuffer : public TVirtualTransport<TChainedBuffer, TBufferBase> {
+public:
+  static const uint32_t DEFAULT_SEGMENT_SIZE = 16384;
+  static const uint32_t DEFAULT_LINK_THRESHOLD = 4096;
+
+  TChainedBuffer(uint32_t segmentSize = DEFAULT_SEGMENT_SIZE,
+                 uint32_t linkThreshold = DEFAULT_LINK_THRESHOLD)
+    : segmentSize_(segmentSize > 0 ? segmentSize : 1),
+      linkThreshold_(linkThreshold),
+      tailWritable_(false) {
+    setReadBuffer(NULL, 0);
+    setWriteBuffer(NULL, 0);
+  }
+
+  bool isOpen() { return true; }
+
+  bool peek() { return available_read() > 0; }
+
+  void open() {}
+
+  void close() {}
+
+  /**
+   * Links the slice into the chain by reference, whatever its size. A
+   * slice that does not own its bytes is copied instead.
+   */
+  void append(const TBufferSlice& slice);
+
+  /**
+   * Links slices of at least the link threshold, copies smaller ones.
+   */
+  virtual void writeSlice_virt(const TBufferSlice& slice);
+
+  virtual uint32_t readSlice_virt(TBufferSlice& slice, uint32_t len);
+
+  /**
+   * Returns slices covering the unread contents, without consuming them.
+   */
+  void getSlices(std::vector<TBufferSlice>& slices) const;
+
+  /**
+   * Writes the unread contents to the given transport with one
+   * writeSlices() call and empties the chain. The transport is not flushed.
+   */
+  void writeTo(TTransport& transport);
+
+  std::string getBufferAsString() const;
+
+  /**
+   * Discards the contents. The last segment is kept for reuse when
+   * nothing else refers to it.
+   */
+  void resetBuffer();
+
+  uint32_t available_read() const;
+
+  /// Number of segments holding unread bytes
+  uint32_t getSegmentCount() const;
+
+  uint32_t getSegmentSize() const { return segmentSize_; }
+
+  uint32_t getLinkThreshold() const { return linkThreshold_; }
+
+  /*
+   * TVirtualTransport provides a default implementation of readAll().
+   * We want to use the TBufferBase version instead.
+   */
+  uint32_t readAll(uint8_t* buf, uint32_t len) { return TBufferBase::readAll(buf, len); }
+
+protected:
+  struct Segment {
+    boost::shared_array<uint8_t> buffer;
+    const uint8_t* data;
+    uint32_t size;
+  };
+
+  uint32_t readSlow(uint8_t* buf, uint32_t len);
+
+  void writeSlow(const uint8_t* buf, uint32_t len);
+
+  const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len);
+
+  // Records how far the writable last segment has been filled.
+  void syncTail();
+
+  // Adds a segment at the end of the chain.
+  void pushSegment(const Segment& segment, bool writable, uint32_t capacity);
+
+  // Points rBase_/rBound_ at the first unread bytes, dropping consumed
+  // segments. Returns false if there is nothing to read.
+  bool advanceRead();
+
+  // The unread range of the i-th segment.
+  void unreadRange(size_t i, const uint8_t** begin, const uint8_t** end) const;
+
+  uint32_t segmentSize_;
+  uint32_t linkThreshold_;
+  std::deque<Segment> chain_;
+  // whether wBase_/wBound_ point into the last segment of chain_
+  bool tailWritable_;
+};
 }
 }
 } // apache::thrift::transport
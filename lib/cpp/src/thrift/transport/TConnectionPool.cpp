@@ -0,0 +1,422 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <algorithm>
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+
+#include <boost/lexical_cast.hpp>
+
+#include <thrift/concurrency/Util.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TConnectionPool.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using namespace std;
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Util;
+using boost::shared_ptr;
+
+/**
+ * TConnectionLease implementation
+ */
+TConnectionLease::State::~State() {
+  if (pool != NULL && socket) {
+    pool->giveBack(*server, socket);
+  }
+}
+
+shared_ptr<TSocket> TConnectionLease::getSocket() const {
+  return state_ ? state_->socket : shared_ptr<TSocket>();
+}
+
+shared_ptr<TSocketPoolServer> TConnectionLease::getServer() const {
+  return state_ ? state_->server : shared_ptr<TSocketPoolServer>();
+}
+
+void TConnectionLease::recordLatency(int64_t usec) {
+  if (state_ && state_->pool != NULL) {
+    state_->server->recordLatency(usec);
+  }
+}
+
+void TConnectionLease::release() {
+  if (valid()) {
+    shared_ptr<TSocket> socket;
+    socket.swap(state_->socket);
+    state_->pool->giveBack(*state_->server, socket);
+  }
+}
+
+void TConnectionLease::invalidate() {
+  if (valid()) {
+    shared_ptr<TSocket> socket;
+    socket.swap(state_->socket);
+    socket->close();
+    state_->pool->giveBack(*state_->server, socket);
+  }
+}
+
+/**
+ * TConnectionPool implementation
+ */
+TConnectionPool::TConnectionPool()
+  : maxIdlePerHost_(8),
+    idleTimeout_(60 * 1000),
+    retryInterval_(60),
+    maxConsecutiveFailures_(1),
+    randomize_(true),
+    connTimeout_(0),
+    sendTimeout_(0),
+    recvTimeout_(0),
+    numCreated_(0),
+    numReused_(0) {
+}
+
+TConnectionPool::TConnectionPool(const vector<pair<string, int> >& servers)
+  : maxIdlePerHost_(8),
+    idleTimeout_(60 * 1000),
+    retryInterval_(60),
+    maxConsecutiveFailures_(1),
+    randomize_(true),
+    connTimeout_(0),
+    sendTimeout_(0),
+    recvTimeout_(0),
+    numCreated_(0),
+    numReused_(0) {
+  for (size_t i = 0; i < servers.size(); ++i) {
+    addServer(servers[i].first, servers[i].second);
+  }
+}
+
+TConnectionPool::TConnectionPool(const vector<shared_ptr<TSocketPoolServer> >& servers)
+  : servers_(servers),
+    maxIdlePerHost_(8),
+    idleTimeout_(60 * 1000),
+    retryInterval_(60),
+    maxConsecutiveFailures_(1),
+    randomize_(true),
+    connTimeout_(0),
+    sendTimeout_(0),
+    recvTimeout_(0),
+    numCreated_(0),
+    numReused_(0) {
+}
+
+TConnectionPool::~TConnectionPool() {
+  clear();
+}
+
+void TConnectionPool::addServer(const string& host, int port) {
+  Guard g(mutex_);
+  servers_.push_back(shared_ptr<TSocketPoolServer>(new TSocketPoolServer(host, port)));
+}
+
+void TConnectionPool::addServer(const shared_ptr<TSocketPoolServer>& server) {
+  if (server) {
+    Guard g(mutex_);
+    servers_.push_back(server);
+  }
+}
+
+void TConnectionPool::getServers(vector<shared_ptr<TSocketPoolServer> >& servers) {
+  Guard g(mutex_);
+  servers = servers_;
+}
+
+void TConnectionPool::setMaxIdlePerHost(size_t maxIdle) {
+  Guard g(mutex_);
+  maxIdlePerHost_ = maxIdle;
+}
+
+void TConnectionPool::setIdleTimeout(int ms) {
+  Guard g(mutex_);
+  idleTimeout_ = ms;
+}
+
+void TConnectionPool::setRetryInterval(int retryInterval) {
+  Guard g(mutex_);
+  retryInterval_ = retryInterval;
+}
+
+void TConnectionPool::setMaxConsecutiveFailures(int maxConsecutiveFailures) {
+  Guard g(mutex_);
+  maxConsecutiveFailures_ = maxConsecutiveFailures;
+}
+
+void TConnectionPool::setRandomize(bool randomize) {
+  Guard g(mutex_);
+  randomize_ = randomize;
+}
+
+void TConnectionPool::setPolicy(shared_ptr<TSocketPoolPolicy> policy) {
+  Guard g(mutex_);
+  policy_ = policy;
+}
+
+void TConnectionPool::setConnTimeout(int ms) {
+  Guard g(mutex_);
+  connTimeout_ = ms;
+}
+
+void TConnectionPool::setSendTimeout(int ms) {
+  Guard g(mutex_);
+  sendTimeout_ = ms;
+}
+
+void TConnectionPool::setRecvTimeout(int ms) {
+  Guard g(mutex_);
+  recvTimeout_ = ms;
+}
+
+TConnectionLease TConnectionPool::checkout() {
+  return checkout(0, shared_ptr<TSocketPoolServer>());
+}
+
+TConnectionLease TConnectionPool::checkout(int64_t deadline,
+                                           const shared_ptr<TSocketPoolServer>& exclude) {
+  vector<shared_ptr<TSocketPoolServer> > servers;
+  {
+    Guard g(mutex_);
+    servers = servers_;
+    if (exclude) {
+      servers.erase(remove(servers.begin(), servers.end(), exclude), servers.end());
+    }
+    if (policy_) {
+      policy_->order(servers);
+    } else if (randomize_ && servers.size() > 1) {
+      random_shuffle(servers.begin(), servers.end());
+    }
+  }
+  if (servers.empty()) {
+    throw TTransportException(TTransportException::NOT_OPEN, "TConnectionPool: no servers");
+  }
+
+  // an idle connection to any server that is up beats a new connection
+  for (size_t i = 0; i < servers.size(); ++i) {
+    if (!isDown(*servers[i])) {
+      shared_ptr<TSocket> socket = takeIdle(*servers[i]);
+      if (socket) {
+        return lease(servers[i], socket, true);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < servers.size(); ++i) {
+    // like TSocketPool, always try the last server even if it is down
+    if (!isDown(*servers[i]) || i == servers.size() - 1) {
+      shared_ptr<TSocket> socket = connect(*servers[i], deadline);
+      if (socket) {
+        return lease(servers[i], socket, false);
+      }
+    }
+  }
+
+  GlobalOutput("TConnectionPool::checkout: all connections failed");
+  throw TTransportException(TTransportException::NOT_OPEN);
+}
+
+TConnectionLease TConnectionPool::checkout(const shared_ptr<TSocketPoolServer>& server) {
+  shared_ptr<TSocket> socket = takeIdle(*server);
+  if (socket) {
+    return lease(server, socket, true);
+  }
+  socket = connect(*server, 0);
+  if (!socket) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TConnectionPool::checkout: cannot connect to " + key(*server));
+  }
+  return lease(server, socket, false);
+}
+
+void TConnectionPool::clear() {
+  map<string, deque<IdleConnection> > idle;
+  {
+    Guard g(mutex_);
+    idle.swap(idle_);
+  }
+  for (map<string, deque<IdleConnection> >::iterator it = idle.begin(); it != idle.end(); ++it) {
+    for (size_t i = 0; i < it->second.size(); ++i) {
+      it->second[i].socket->close();
+    }
+  }
+}
+
+size_t TConnectionPool::getNumIdle() {
+  Guard g(mutex_);
+  size_t count = 0;
+  for (map<string, deque<IdleConnection> >::iterator it = idle_.begin(); it != idle_.end(); ++it) {
+    count += it->second.size();
+  }
+  return count;
+}
+
+uint64_t TConnectionPool::getNumCreated() {
+  Guard g(mutex_);
+  return numCreated_;
+}
+
+uint64_t TConnectionPool::getNumReused() {
+  Guard g(mutex_);
+  return numReused_;
+}
+
+shared_ptr<TSocket> TConnectionPool::newConnection(const TSocketPoolServer& server) {
+  shared_ptr<TSocket> socket(new TSocket(server.host_, server.port_));
+  Guard g(mutex_);
+  socket->setConnTimeout(connTimeout_);
+  socket->setSendTimeout(sendTimeout_);
+  socket->setRecvTimeout(recvTimeout_);
+  return socket;
+}
+
+bool TConnectionPool::validate(TSocket& socket) {
+  if (!socket.isOpen()) {
+    return false;
+  }
+  THRIFT_POLLFD fd;
+  fd.fd = socket.getSocketFD();
+  fd.events = THRIFT_POLLIN;
+  fd.revents = 0;
+  // nothing may be readable on an idle connection, not even EOF
+  return THRIFT_POLL(&fd, 1, 0) == 0;
+}
+
+string TConnectionPool::key(const TSocketPoolServer& server) {
+  return server.host_ + ":" + boost::lexical_cast<string>(server.port_);
+}
+
+shared_ptr<TSocket> TConnectionPool::takeIdle(const TSocketPoolServer& server) {
+  string k = key(server);
+  int64_t now = Util::currentTime();
+  for (;;) {
+    shared_ptr<TSocket> socket;
+    {
+      Guard g(mutex_);
+      map<string, deque<IdleConnection> >::iterator it = idle_.find(k);
+      if (it == idle_.end()) {
+        return socket;
+      }
+      deque<IdleConnection>& idle = it->second;
+      // the oldest connections are at the front
+      while (!idle.empty() && idleTimeout_ > 0 && now - idle.front().since > idleTimeout_) {
+        idle.front().socket->close();
+        idle.pop_front();
+      }
+      if (idle.empty()) {
+        idle_.erase(it);
+        return socket;
+      }
+      socket = idle.back().socket;
+      idle.pop_back();
+    }
+    if (validate(*socket)) {
+      Guard g(mutex_);
+      ++numReused_;
+      return socket;
+    }
+    socket->close();
+  }
+}
+
+shared_ptr<TSocket> TConnectionPool::connect(TSocketPoolServer& server, int64_t deadline) {
+  shared_ptr<TSocket> socket = newConnection(server);
+  if (deadline > 0) {
+    int64_t left = deadline - Util::currentTime();
+    if (left <= 0) {
+      throw TTransportException(TTransportException::TIMED_OUT,
+                                "TConnectionPool::checkout: deadline exceeded");
+    }
+    int connTimeout;
+    {
+      Guard g(mutex_);
+      connTimeout = connTimeout_;
+    }
+    if (connTimeout <= 0 || left < connTimeout) {
+      socket->setConnTimeout(static_cast<int>(left));
+    }
+  }
+  int64_t start = Util::currentTimeUsec();
+  try {
+    socket->open();
+  } catch (const TException& e) {
+    string errStr = "TConnectionPool::checkout failed " + key(server) + ": " + e.what();
+    GlobalOutput(errStr.c_str());
+    int maxConsecutiveFailures;
+    {
+      Guard g(mutex_);
+      maxConsecutiveFailures = maxConsecutiveFailures_;
+    }
+    server.recordFailure(maxConsecutiveFailures);
+    return shared_ptr<TSocket>();
+  }
+  server.recordSuccess();
+  server.recordLatency(Util::currentTimeUsec() - start);
+  Guard g(mutex_);
+  ++numCreated_;
+  return socket;
+}
+
+bool TConnectionPool::isDown(const TSocketPoolServer& server) {
+  time_t lastFailTime = server.getLastFailTime();
+  Guard g(mutex_);
+  return lastFailTime > 0 && time(NULL) - lastFailTime <= retryInterval_;
+}
+
+void TConnectionPool::giveBack(TSocketPoolServer& server, const shared_ptr<TSocket>& socket) {
+  --server.outstanding_;
+  {
+    Guard g(mutex_);
+    if (!socket->isOpen()) {
+      return;
+    }
+    deque<IdleConnection>& idle = idle_[key(server)];
+    if (idle.size() < maxIdlePerHost_) {
+      IdleConnection connection;
+      connection.socket = socket;
+      connection.since = Util::currentTime();
+      idle.push_back(connection);
+      return;
+    }
+  }
+  socket->close();
+}
+
+TConnectionLease TConnectionPool::lease(const shared_ptr<TSocketPoolServer>& server,
+                                        const shared_ptr<TSocket>& socket,
+                                        bool reused) {
+  ++server->outstanding_;
+  TConnectionLease lease;
+  lease.state_.reset(new TConnectionLease::State);
+  lease.state_->pool = this;
+  lease.state_->server = server;
+  lease.state_->socket = socket;
+  lease.state_->reused = reused;
+  return lease;
+}
+}
+}
+} // apache::thrift::transport
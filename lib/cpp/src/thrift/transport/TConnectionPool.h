@@ -0,0 +1,297 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCONNECTIONPOOL_H_
+#define _THRIFT_TRANSPORT_TCONNECTIONPOOL_H_ 1
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/TSocketPool.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+class TConnectionPool;
+
+/**
+ * A connection checked out of a TConnectionPool.
+ *
+ * Copies of a lease share the connection; it goes back to the pool when
+ * the last copy is destroyed or release() is called, unless it has been
+ * closed or invalidated in the meantime. Anything layered on top of the
+ * socket, such as a buffered transport or a protocol, must be done with
+ * it by then and must not hold unflushed data.
+ */
+class TConnectionLease {
+public:
+  TConnectionLease() {}
+
+  /**
+   * Whether this lease holds a connection.
+   */
+  bool valid() const { return state_ && state_->socket; }
+
+  /**
+   * The leased connection, NULL once released.
+   */
+  boost::shared_ptr<TSocket> getSocket() const;
+
+  TSocket* operator->() const { return getSocket().get(); }
+
+  /**
+   * The server the connection goes to.
+   */
+  boost::shared_ptr<TSocketPoolServer> getServer() const;
+
+  /**
+   * Whether the connection was reused rather than newly opened.
+   */
+  bool isReused() const { return state_ && state_->reused; }
+
+  /**
+   * Reports the latency of a call made on the connection, in
+   * microseconds, for the pool's policy.
+   */
+  void recordLatency(int64_t usec);
+
+  /**
+   * Hand the connection back to the pool now.
+   */
+  void release();
+
+  /**
+   * Close the connection instead of handing it back, e.g. after an error
+   * that left it in an unknown state.
+   */
+  void invalidate();
+
+private:
+  friend class TConnectionPool;
+
+  struct State {
+    State() : pool(NULL), reused(false) {}
+    ~State();
+
+    TConnectionPool* pool;
+    boost::shared_ptr<TSocketPoolServer> server;
+    boost::shared_ptr<TSocket> socket;
+    bool reused;
+  };
+
+  boost::shared_ptr<State> state_;
+};
+
+/**
+ * Thread safe pool of open client connections, keyed by server.
+ *
+ * checkout() hands out an idle connection to one of the servers if there
+ * is a healthy one and otherwise opens a new one, trying the servers the
+ * way TSocketPool does: servers that failed more than the allowed number
+ * of consecutive times are skipped until the retry interval has passed.
+ * The failure state lives in the TSocketPoolServer objects, which guard it
+ * themselves, so a pool and a TSocketPool can share it. So do the latency of opens and of calls
+ * reported on leases, and the number of leases out per server, which a
+ * TSocketPoolPolicy can use to prefer some servers over others.
+ *
+ * Idle connections are checked before reuse: one the peer has closed, or
+ * that has been idle for longer than the idle timeout, is dropped.
+ *
+ * Subclasses can override newConnection(), e.g. to create TSSLSockets.
+ * The pool must outlive the leases it hands out.
+ */
+class TConnectionPool {
+public:
+  TConnectionPool();
+
+  /**
+   * @param servers list of pairs of host name and port
+   */
+  TConnectionPool(const std::vector<std::pair<std::string, int> >& servers);
+
+  /**
+   * @param servers list of TSocketPoolServers, possibly shared with a TSocketPool
+   */
+  TConnectionPool(const std::vector<boost::shared_ptr<TSocketPoolServer> >& servers);
+
+  /**
+   * Closes all idle connections.
+   */
+  virtual ~TConnectionPool();
+
+  /**
+   * Add a server to the pool
+   */
+  void addServer(const std::string& host, int port);
+
+  /**
+   * Add a server to the pool
+   */
+  void addServer(const boost::shared_ptr<TSocketPoolServer>& server);
+
+  /**
+   * Get list of servers in this pool
+   */
+  void getServers(std::vector<boost::shared_ptr<TSocketPoolServer> >& servers);
+
+  /**
+   * Sets how many idle connections to keep per server. Connections
+   * released beyond that are closed.
+   */
+  void setMaxIdlePerHost(size_t maxIdle);
+
+  /**
+   * Sets how long in milliseconds a connection may stay idle before it is
+   * closed. 0 keeps idle connections forever.
+   */
+  void setIdleTimeout(int ms);
+
+  /**
+   * Sets how long to wait until retrying a server if it was marked down
+   */
+  void setRetryInterval(int retryInterval);
+
+  /**
+   * Sets how many times connecting to a server may fail in a row before
+   * it is marked as down.
+   */
+  void setMaxConsecutiveFailures(int maxConsecutiveFailures);
+
+  /**
+   * Turns randomization in connect order on or off.
+   */
+  void setRandomize(bool randomize);
+
+  /**
+   * Sets the policy that orders the servers on checkout(), replacing
+   * setRandomize(). NULL restores the default.
+   */
+  void setPolicy(boost::shared_ptr<TSocketPoolPolicy> policy);
+
+  /**
+   * Timeouts in milliseconds for the sockets newConnection() creates.
+   */
+  void setConnTimeout(int ms);
+  void setSendTimeout(int ms);
+  void setRecvTimeout(int ms);
+
+  /**
+   * Check out a connection to any of the servers.
+   *
+   * @throws TTransportException if no server can be reached
+   */
+  TConnectionLease checkout();
+
+  /**
+   * Check out a connection to the given server, which need not be one of
+   * the pool's servers.
+   *
+   * @throws TTransportException if the server cannot be reached
+   */
+  TConnectionLease checkout(const boost::shared_ptr<TSocketPoolServer>& server);
+
+  /**
+   * Check out a connection to any of the servers but the excluded one,
+   * e.g. to send a second copy of a request elsewhere. No new connection
+   * is attempted past the deadline, in Util::currentTime() milliseconds,
+   * and none may take longer to connect than what is left of it.
+   *
+   * @param deadline absolute deadline, 0 for none
+   * @param exclude  server to skip, may be NULL
+   * @throws TTransportException TIMED_OUT once the deadline has passed,
+   *         NOT_OPEN if no server can be reached
+   */
+  TConnectionLease checkout(int64_t deadline, const boost::shared_ptr<TSocketPoolServer>& exclude);
+
+  /**
+   * Closes all idle connections.
+   */
+  void clear();
+
+  /// Number of idle connections to all servers
+  size_t getNumIdle();
+
+  /// Number of connections opened so far
+  uint64_t getNumCreated();
+
+  /// Number of checkouts served by an idle connection
+  uint64_t getNumReused();
+
+protected:
+  /**
+   * Creates a connection to the server; checkout() opens it. The default
+   * creates a TSocket with the configured timeouts.
+   */
+  virtual boost::shared_ptr<TSocket> newConnection(const TSocketPoolServer& server);
+
+  /**
+   * Whether an idle connection can be handed out again. The default
+   * checks, without blocking, that the socket is open and has nothing to
+   * read; data or EOF on an idle connection means the peer closed it.
+   */
+  virtual bool validate(TSocket& socket);
+
+private:
+  friend class TConnectionLease;
+  friend struct TConnectionLease::State;
+
+  struct IdleConnection {
+    boost::shared_ptr<TSocket> socket;
+    int64_t since;
+  };
+
+  static std::string key(const TSocketPoolServer& server);
+
+  boost::shared_ptr<TSocket> takeIdle(const TSocketPoolServer& server);
+  boost::shared_ptr<TSocket> connect(TSocketPoolServer& server, int64_t deadline);
+  bool isDown(const TSocketPoolServer& server);
+  void giveBack(TSocketPoolServer& server, const boost::shared_ptr<TSocket>& socket);
+  TConnectionLease lease(const boost::shared_ptr<TSocketPoolServer>& server,
+                         const boost::shared_ptr<TSocket>& socket,
+                         bool reused);
+
+  concurrency::Mutex mutex_;
+  std::vector<boost::shared_ptr<TSocketPoolServer> > servers_;
+  // idle connections by host:port, most recently released last
+  std::map<std::string, std::deque<IdleConnection> > idle_;
+
+  size_t maxIdlePerHost_;
+  int idleTimeout_;
+  time_t retryInterval_;
+  int maxConsecutiveFailures_;
+  bool randomize_;
+  boost::shared_ptr<TSocketPoolPolicy> policy_;
+  int connTimeout_;
+  int sendTimeout_;
+  int recvTimeout_;
+
+  uint64_t numCreated_;
+  uint64_t numReused_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TCONNECTIONPOOL_H_
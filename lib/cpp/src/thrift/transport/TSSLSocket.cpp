@@ -31,9 +31,14 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/shared_array.hpp>
 #include <openssl/err.h>
+#include <openssl/hmac.h>
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
 #include <thrift/concurrency/Mutex.h>
 #include <thrift/transport/TSSLSocket.h>
 #include <thrift/transport/PlatformSocket.h>
@@ -96,7 +101,7 @@ void initializeOpenSSL() {
   SSL_library_init();
   SSL_load_error_strings();
   // static locking
-  mutexes = boost::shared_array<Mutex>(new Mutex[ ::CRYPTO_num_locks()]);
+  mutexes = boost::shared_array<Mutex>(new Mutex[CRYPTO_num_locks()]);
   if (mutexes == NULL) {
     throw TTransportException(TTransportException::INTERNAL_ERROR,
                               "initializeOpenSSL() failed, "
@@ -135,12 +140,106 @@ static void buildErrors(string& message, int error = 0);
 static bool matchName(const char* host, const char* pattern, int size);
 static char uppercase(char c);
 
+// Session cache key of a client socket, empty if it has no host:port
+static string sessionPeer(TSocket& socket) {
+  if (socket.getHost().empty()) {
+    return string();
+  }
+  return socket.getHost() + ":" + boost::lexical_cast<string>(socket.getPort());
+}
+
+static SSLContext* contextOf(SSL* ssl) {
+  return static_cast<SSLContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+}
+
+// Called whenever a client receives a session it may resume later; in
+// TLS 1.3 that happens after the handshake, on a read
+static int newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  TSSLSocket* socket = static_cast<TSSLSocket*>(SSL_get_app_data(ssl));
+  SSLContext* ctx = contextOf(ssl);
+  if (socket == NULL || ctx == NULL || !ctx->sessionCache()) {
+    return 0;
+  }
+  string peer = sessionPeer(*socket);
+  if (peer.empty()) {
+    return 0;
+  }
+  ctx->storeSession(peer, session);
+  // the cache keeps the reference
+  return 1;
+}
+
+// Encrypts new session tickets under the current key and decrypts tickets
+// under any configured key. Returns 2 for tickets that should be replaced.
+static int ticketKeyCallback(SSL* ssl,
+                             unsigned char* name,
+                             unsigned char* iv,
+                             EVP_CIPHER_CTX* cipher,
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+                             EVP_MAC_CTX* mac,
+#else
+                             HMAC_CTX* mac,
+#endif
+                             int enc) {
+  SSLContext* ctx = contextOf(ssl);
+  if (ctx == NULL) {
+    return -1;
+  }
+  vector<string> keys = ctx->ticketKeys();
+  if (keys.empty()) {
+    return 0;
+  }
+  size_t index = 0;
+  if (enc) {
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) != 1) {
+      return -1;
+    }
+    memcpy(name, keys[0].data(), 16);
+  } else {
+    while (index < keys.size() && memcmp(name, keys[index].data(), 16) != 0) {
+      ++index;
+    }
+    if (index == keys.size()) {
+      // unknown or retired key: fall back to a full handshake
+      return 0;
+    }
+  }
+  const unsigned char* key = reinterpret_cast<const unsigned char*>(keys[index].data());
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  OSSL_PARAM params[2];
+  params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+  params[1] = OSSL_PARAM_construct_end();
+  if (EVP_MAC_init(mac, key + 16, 16, params) != 1) {
+    return -1;
+  }
+#else
+  if (HMAC_Init_ex(mac, key + 16, 16, EVP_sha256(), NULL) != 1) {
+    return -1;
+  }
+#endif
+  if (EVP_CipherInit_ex(cipher, EVP_aes_128_cbc(), NULL, key + 32, iv, enc) != 1) {
+    return -1;
+  }
+#ifdef TLS1_3_VERSION
+  // clients use TLS 1.3 tickets only once, so always hand out a new one
+  if (SSL_version(ssl) >= TLS1_3_VERSION) {
+    return 2;
+  }
+#endif
+  return index == 0 ? 1 : 2;
+}
+
 // SSLContext implementation
-SSLContext::SSLContext(const SSLProtocol& protocol) {
+SSLContext::SSLContext(const SSLProtocol& protocol)
+  : sessionCache_(true), fullHandshakes_(0), resumedHandshakes_(0) {
   if (protocol == SSLTLS) {
     ctx_ = SSL_CTX_new(SSLv23_method());
   } else if (protocol == SSLv3) {
+#ifndef OPENSSL_NO_SSL3_METHOD
     ctx_ = SSL_CTX_new(SSLv3_method());
+#else
+    throw TSSLException("SSL_CTX_new: SSLv3 is not supported by this OpenSSL");
+#endif
   } else if (protocol == TLSv1_0) {
     ctx_ = SSL_CTX_new(TLSv1_method());
   } else if (protocol == TLSv1_1) {
@@ -158,6 +257,11 @@ SSLContext::SSLContext(const SSLProtocol& protocol) {
     throw TSSLException("SSL_CTX_new: " + errors);
   }
   SSL_CTX_set_mode(ctx_, SSL_MODE_AUTO_RETRY);
+  SSL_CTX_set_app_data(ctx_, this);
+  // servers refuse to resume sessions of verified peers without one
+  SSL_CTX_set_session_id_context(ctx_, reinterpret_cast<const unsigned char*>("thrift"), 6);
+  SSL_CTX_sess_set_new_cb(ctx_, newSessionCallback);
+  sessionCacheMode(false);
 
   // Disable horribly insecure SSLv2!
   if (protocol == SSLTLS) {
@@ -166,6 +270,9 @@ SSLContext::SSLContext(const SSLProtocol& protocol) {
 }
 
 SSLContext::~SSLContext() {
+  for (map<string, SSL_SESSION*>::iterator it = sessions_.begin(); it != sessions_.end(); ++it) {
+    SSL_SESSION_free(it->second);
+  }
   if (ctx_ != NULL) {
     SSL_CTX_free(ctx_);
     ctx_ = NULL;
@@ -182,17 +289,117 @@ SSL* SSLContext::createSSL() {
   return ssl;
 }
 
+void SSLContext::sessionCacheMode(bool server) {
+  if (server) {
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+  } else {
+    // client sessions are cached per peer in sessions_ instead
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  }
+}
+
+SSL_SESSION* SSLContext::findSession(const string& peer) {
+  Guard guard(mutex_);
+  map<string, SSL_SESSION*>::iterator it = sessions_.find(peer);
+  if (it == sessions_.end()) {
+    return NULL;
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  if (!SSL_SESSION_is_resumable(it->second)) {
+    SSL_SESSION_free(it->second);
+    sessions_.erase(it);
+    return NULL;
+  }
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  SSL_SESSION_up_ref(it->second);
+#else
+  CRYPTO_add(&it->second->references, 1, CRYPTO_LOCK_SSL_SESSION);
+#endif
+  return it->second;
+}
+
+void SSLContext::storeSession(const string& peer, SSL_SESSION* session) {
+  Guard guard(mutex_);
+  SSL_SESSION*& entry = sessions_[peer];
+  if (entry != NULL) {
+    SSL_SESSION_free(entry);
+  }
+  entry = session;
+}
+
+void SSLContext::removeSession(const string& peer) {
+  Guard guard(mutex_);
+  map<string, SSL_SESSION*>::iterator it = sessions_.find(peer);
+  if (it != sessions_.end()) {
+    SSL_SESSION_free(it->second);
+    sessions_.erase(it);
+  }
+}
+
+void SSLContext::ticketKeys(const vector<string>& keys) {
+  if (keys.empty()) {
+    throw TTransportException(TTransportException::BAD_ARGS, "ticketKeys: no keys");
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (keys[i].size() != TICKET_KEY_SIZE) {
+      throw TTransportException(TTransportException::BAD_ARGS,
+                                "ticketKeys: keys must be 48 bytes long");
+    }
+  }
+  Guard guard(mutex_);
+  if (ticketKeys_.empty()) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_, ticketKeyCallback);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx_, ticketKeyCallback);
+#endif
+  }
+  ticketKeys_ = keys;
+}
+
+vector<string> SSLContext::ticketKeys() {
+  Guard guard(mutex_);
+  return ticketKeys_;
+}
+
+void SSLContext::countHandshake(bool resumed) {
+  if (resumed) {
+    ++resumedHandshakes_;
+  } else {
+    ++fullHandshakes_;
+  }
+}
+
 // TSSLSocket implementation
 TSSLSocket::TSSLSocket(boost::shared_ptr<SSLContext> ctx)
-  : TSocket(), server_(false), ssl_(NULL), ctx_(ctx) {
+  : TSocket(),
+    server_(false),
+    kernelTLS_(false),
+    ktlsSend_(false),
+    ktlsRecv_(false),
+    ssl_(NULL),
+    ctx_(ctx) {
 }
 
 TSSLSocket::TSSLSocket(boost::shared_ptr<SSLContext> ctx, THRIFT_SOCKET socket)
-  : TSocket(socket), server_(false), ssl_(NULL), ctx_(ctx) {
+  : TSocket(socket),
+    server_(false),
+    kernelTLS_(false),
+    ktlsSend_(false),
+    ktlsRecv_(false),
+    ssl_(NULL),
+    ctx_(ctx) {
 }
 
 TSSLSocket::TSSLSocket(boost::shared_ptr<SSLContext> ctx, string host, int port)
-  : TSocket(host, port), server_(false), ssl_(NULL), ctx_(ctx) {
+  : TSocket(host, port),
+    server_(false),
+    kernelTLS_(false),
+    ktlsSend_(false),
+    ktlsRecv_(false),
+    ssl_(NULL),
+    ctx_(ctx) {
 }
 
 TSSLSocket::~TSSLSocket() {
@@ -254,6 +461,8 @@ void TSSLSocket::close() {
     }
     SSL_free(ssl_);
     ssl_ = NULL;
+    ktlsSend_ = false;
+    ktlsRecv_ = false;
     ERR_remove_state(0);
   }
   TSocket::close();
@@ -281,6 +490,11 @@ uint32_t TSSLSocket::read(uint8_t* buf, uint32_t len) {
 
 void TSSLSocket::write(const uint8_t* buf, uint32_t len) {
   checkHandshake();
+  if (ktlsSend_) {
+    // the kernel frames and encrypts whatever is sent on the socket
+    TSocket::write(buf, len);
+    return;
+  }
   // loop in case SSL_MODE_ENABLE_PARTIAL_WRITE is set in SSL_CTX.
   uint32_t written = 0;
   while (written < len) {
@@ -295,6 +509,18 @@ void TSSLSocket::write(const uint8_t* buf, uint32_t len) {
   }
 }
 
+void TSSLSocket::writeSlices_virt(const TBufferSlice* slices, uint32_t count) {
+  checkHandshake();
+#ifdef HAVE_SYS_UIO_H
+  if (ktlsSend_) {
+    TSocket::writeSlices_virt(slices, count);
+    return;
+  }
+#endif
+  // the plain socket gather path would bypass encryption
+  TTransport::writeSlices_virt(slices, count);
+}
+
 void TSSLSocket::flush() {
   // Don't throw exception if not open. Thrift servers close socket twice.
   if (ssl_ == NULL) {
@@ -321,7 +547,26 @@ void TSSLSocket::checkHandshake() {
     return;
   }
   ssl_ = ctx_->createSSL();
+#ifdef SSL_OP_ENABLE_KTLS
+  if (kernelTLS_) {
+    // OpenSSL installs the keys into the socket as soon as they are known,
+    // provided the kernel supports the negotiated cipher
+    SSL_set_options(ssl_, SSL_OP_ENABLE_KTLS);
+  }
+#endif
   SSL_set_fd(ssl_, socket_);
+  string peer;
+  if (!server() && ctx_->sessionCache()) {
+    peer = sessionPeer(*this);
+  }
+  if (!peer.empty()) {
+    SSL_set_app_data(ssl_, this);
+    SSL_SESSION* session = ctx_->findSession(peer);
+    if (session != NULL) {
+      SSL_set_session(ssl_, session);
+      SSL_SESSION_free(session);
+    }
+  }
   int rc;
   if (server()) {
     rc = SSL_accept(ssl_);
@@ -330,12 +575,40 @@ void TSSLSocket::checkHandshake() {
   }
   if (rc <= 0) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    if (!peer.empty()) {
+      ctx_->removeSession(peer);
+    }
     string fname(server() ? "SSL_accept" : "SSL_connect");
     string errors;
     buildErrors(errors, errno_copy);
     throw TSSLException(fname + ": " + errors);
   }
+  bool resumed = SSL_session_reused(ssl_) != 0;
+  ctx_->countHandshake(resumed);
+  if (resumed && !peer.empty()) {
+    // a resumed TLS 1.2 session may come with a renewed ticket, which
+    // does not go through the new session callback
+    SSL_SESSION* session = SSL_get1_session(ssl_);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (!SSL_SESSION_is_resumable(session)) {
+      SSL_SESSION_free(session);
+      session = NULL;
+    }
+#endif
+    if (session != NULL) {
+      ctx_->storeSession(peer, session);
+    }
+  }
   authorize();
+#ifdef SSL_OP_ENABLE_KTLS
+  if (kernelTLS_) {
+    ktlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_)) != 0;
+    // reads keep going through SSL_read(), which then receives plaintext
+    // straight into the caller's buffer and still handles the alerts and
+    // post-handshake messages a plain recv() would fail on
+    ktlsRecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_)) != 0;
+  }
+#endif
 }
 
 void TSSLSocket::authorize() {
@@ -449,7 +722,8 @@ uint64_t TSSLSocketFactory::count_ = 0;
 Mutex TSSLSocketFactory::mutex_;
 bool TSSLSocketFactory::manualOpenSSLInitialization_ = false;
 
-TSSLSocketFactory::TSSLSocketFactory(const SSLProtocol& protocol) : server_(false) {
+TSSLSocketFactory::TSSLSocketFactory(const SSLProtocol& protocol)
+  : server_(false), kernelTLS_(false) {
   Guard guard(mutex_);
   if (count_ == 0) {
     if (!manualOpenSSLInitialization_) {
@@ -488,8 +762,46 @@ boost::shared_ptr<TSSLSocket> TSSLSocketFactory::createSocket(const string& host
   return ssl;
 }
 
+void TSSLSocketFactory::server(bool flag) {
+  server_ = flag;
+  ctx_->sessionCacheMode(flag);
+}
+
+void TSSLSocketFactory::sessionCache(bool flag) {
+  ctx_->sessionCache(flag);
+}
+
+bool TSSLSocketFactory::sessionCache() const {
+  return ctx_->sessionCache();
+}
+
+void TSSLSocketFactory::ticketKeys(const vector<string>& keys) {
+  ctx_->ticketKeys(keys);
+}
+
+void TSSLSocketFactory::rotateTicketKey(const string& key, size_t maxKeys) {
+  if (maxKeys == 0) {
+    throw TTransportException(TTransportException::BAD_ARGS, "rotateTicketKey: maxKeys is 0");
+  }
+  vector<string> keys = ctx_->ticketKeys();
+  keys.insert(keys.begin(), key);
+  if (keys.size() > maxKeys) {
+    keys.resize(maxKeys);
+  }
+  ctx_->ticketKeys(keys);
+}
+
+uint64_t TSSLSocketFactory::getFullHandshakes() const {
+  return ctx_->getFullHandshakes();
+}
+
+uint64_t TSSLSocketFactory::getResumedHandshakes() const {
+  return ctx_->getResumedHandshakes();
+}
+
 void TSSLSocketFactory::setup(boost::shared_ptr<TSSLSocket> ssl) {
   ssl->server(server());
+  ssl->kernelTLS(kernelTLS());
   if (access_ == NULL && !server()) {
     access_ = boost::shared_ptr<AccessManager>(new DefaultClientAccessManager);
   }
@@ -20,7 +20,10 @@
 #ifndef _THRIFT_TRANSPORT_TSSLSOCKET_H_
 #define _THRIFT_TRANSPORT_TSSLSOCKET_H_ 1
 
+#include <map>
 #include <string>
+#include <vector>
+#include <boost/atomic.hpp>
 #include <boost/shared_ptr.hpp>
 #include <openssl/ssl.h>
 #include <thrift/concurrency/Mutex.h>
@@ -75,6 +78,11 @@ public:
   uint32_t read(uint8_t* buf, uint32_t len);
   void write(const uint8_t* buf, uint32_t len);
   void flush();
+  /**
+   * Writes the slices one by one through SSL_write(), or in one gathering
+   * system call once the kernel encrypts for us.
+   */
+  virtual void writeSlices_virt(const TBufferSlice* slices, uint32_t count);
   /**
   * Set whether to use client or server side SSL handshake protocol.
   *
@@ -91,6 +99,28 @@ public:
    * @param manager  Instance of AccessManager
    */
   virtual void access(boost::shared_ptr<AccessManager> manager) { access_ = manager; }
+  /**
+   * Request kernel TLS offload. If set before the handshake and both the
+   * kernel and OpenSSL support it for the negotiated cipher, the session
+   * keys are installed into the socket once the handshake completes and
+   * records are encrypted and decrypted by the kernel from then on.
+   *
+   * @param flag  Try to offload to the kernel if true.
+   */
+  void kernelTLS(bool flag) { kernelTLS_ = flag; }
+  /**
+   * Whether kernel TLS offload was requested.
+   */
+  bool kernelTLS() const { return kernelTLS_; }
+  /**
+   * Whether the kernel encrypts outgoing records for this connection.
+   * Writes then go straight to the socket with send()/writev().
+   */
+  bool kernelTLSSend() const { return ktlsSend_; }
+  /**
+   * Whether the kernel decrypts incoming records for this connection.
+   */
+  bool kernelTLSRecv() const { return ktlsRecv_; }
 
 protected:
   /**
@@ -120,6 +150,9 @@ protected:
   void checkHandshake();
 
   bool server_;
+  bool kernelTLS_;
+  bool ktlsSend_;
+  bool ktlsRecv_;
   SSL* ssl_;
   boost::shared_ptr<SSLContext> ctx_;
   boost::shared_ptr<AccessManager> access_;
@@ -200,7 +233,7 @@ public:
    *
    * @param flag  Server mode if true
    */
-  virtual void server(bool flag) { server_ = flag; }
+  virtual void server(bool flag);
   /**
    * Determine whether the socket is in server or client mode.
    *
@@ -213,6 +246,61 @@ public:
    * @param manager  The AccessManager instance
    */
   virtual void access(boost::shared_ptr<AccessManager> manager) { access_ = manager; }
+  /**
+   * Enable/Disable kernel TLS offload for the sockets created from now on.
+   * See TSSLSocket::kernelTLS(). Connections fall back to encrypting in
+   * user space when offload is not available.
+   *
+   * @param flag  Try to offload to the kernel if true
+   */
+  virtual void kernelTLS(bool flag) { kernelTLS_ = flag; }
+  /**
+   * Whether kernel TLS offload is requested for new sockets.
+   */
+  virtual bool kernelTLS() const { return kernelTLS_; }
+  /**
+   * Enable/Disable the client session cache. When enabled (the default),
+   * client sockets remember the TLS session of each host:port they
+   * connected to and offer it on the next connection, which lets the
+   * server skip the full handshake. Sockets created from a file descriptor
+   * have no host:port and never resume.
+   *
+   * @param flag  Cache and resume client sessions if true
+   */
+  virtual void sessionCache(bool flag);
+  /**
+   * Whether client sessions are cached.
+   */
+  virtual bool sessionCache() const;
+  /**
+   * Set the keys protecting the session tickets this server hands out.
+   * Each key is 48 bytes: a 16 byte name, a 16 byte HMAC secret and a
+   * 16 byte AES key. New tickets are issued under the first key; tickets
+   * under any of the others are still accepted and replaced with a ticket
+   * under the first. Servers sharing the keys can resume each other's
+   * sessions. Without keys OpenSSL uses random per-process keys.
+   *
+   * @param keys  The ticket keys, current key first
+   */
+  virtual void ticketKeys(const std::vector<std::string>& keys);
+  /**
+   * Make key the current ticket key, keeping the previous keys for
+   * decryption up to a total of maxKeys.
+   *
+   * @param key      48 byte ticket key, see ticketKeys()
+   * @param maxKeys  Number of keys to keep, including the new one
+   */
+  virtual void rotateTicketKey(const std::string& key, size_t maxKeys = 2);
+  /**
+   * Number of handshakes completed by sockets of this factory that
+   * established a new session.
+   */
+  uint64_t getFullHandshakes() const;
+  /**
+   * Number of handshakes completed by sockets of this factory that resumed
+   * an earlier session.
+   */
+  uint64_t getResumedHandshakes() const;
   static void setManualOpenSSLInitialization(bool manualOpenSSLInitialization) {
     manualOpenSSLInitialization_ = manualOpenSSLInitialization;
   }
@@ -231,6 +319,7 @@ protected:
 
 private:
   bool server_;
+  bool kernelTLS_;
   boost::shared_ptr<AccessManager> access_;
   static concurrency::Mutex mutex_;
   static uint64_t count_;
@@ -261,13 +350,51 @@ public:
  */
 class SSLContext {
 public:
+  /// Size of a session ticket key, see TSSLSocketFactory::ticketKeys()
+  static const size_t TICKET_KEY_SIZE = 48;
+
   SSLContext(const SSLProtocol& protocol = SSLTLS);
   virtual ~SSLContext();
   SSL* createSSL();
   SSL_CTX* get() { return ctx_; }
 
+  /**
+   * Switch the OpenSSL session cache between the server side cache and
+   * the client cache kept here.
+   */
+  void sessionCacheMode(bool server);
+  void sessionCache(bool enable) { sessionCache_ = enable; }
+  bool sessionCache() const { return sessionCache_; }
+  /**
+   * Returns a new reference to the session cached for peer, or NULL.
+   */
+  SSL_SESSION* findSession(const std::string& peer);
+  /**
+   * Cache session for peer, replacing any previous one. Takes over the
+   * caller's reference.
+   */
+  void storeSession(const std::string& peer, SSL_SESSION* session);
+  void removeSession(const std::string& peer);
+
+  void ticketKeys(const std::vector<std::string>& keys);
+  /**
+   * Returns a copy of the ticket keys, current key first.
+   */
+  std::vector<std::string> ticketKeys();
+
+  void countHandshake(bool resumed);
+  uint64_t getFullHandshakes() const { return fullHandshakes_; }
+  uint64_t getResumedHandshakes() const { return resumedHandshakes_; }
+
 private:
   SSL_CTX* ctx_;
+  bool sessionCache_;
+  concurrency::Mutex mutex_;
+  // client sessions by host:port
+  std::map<std::string, SSL_SESSION*> sessions_;
+  std::vector<std::string> ticketKeys_;
+  boost::atomic<uint64_t> fullHandshakes_;
+  boost::atomic<uint64_t> resumedHandshakes_;
 };
 
 /**
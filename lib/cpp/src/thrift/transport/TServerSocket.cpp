@@ -88,6 +88,8 @@ TServerSocket::TServerSocket(int port)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
+    tcpFastOpen_(0),
     intSock1_(THRIFT_INVALID_SOCKET),
     intSock2_(THRIFT_INVALID_SOCKET) {
 }
@@ -104,6 +106,8 @@ TServerSocket::TServerSocket(int port, int sendTimeout, int recvTimeout)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
+    tcpFastOpen_(0),
     intSock1_(THRIFT_INVALID_SOCKET),
     intSock2_(THRIFT_INVALID_SOCKET) {
 }
@@ -121,6 +125,8 @@ TServerSocket::TServerSocket(string path)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
+    tcpFastOpen_(0),
     intSock1_(THRIFT_INVALID_SOCKET),
     intSock2_(THRIFT_INVALID_SOCKET) {
 }
@@ -236,6 +242,26 @@ void TServerSocket::listen() {
 #endif
   }
 
+  if (reusePort_ && path_.empty()) {
+#ifdef SO_REUSEPORT
+    if (-1 == setsockopt(serverSocket_,
+                         SOL_SOCKET,
+                         SO_REUSEPORT,
+                         cast_sockopt(&one),
+                         sizeof(one))) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TServerSocket::listen() setsockopt() SO_REUSEPORT ", errno_copy);
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "Could not set SO_REUSEPORT",
+                                errno_copy);
+    }
+#else
+    close();
+    throw TTransportException(TTransportException::NOT_OPEN, "SO_REUSEPORT is not supported");
+#endif
+  }
+
   // Set TCP buffer sizes
   if (tcpSendBuffer_ > 0) {
     if (-1 == setsockopt(serverSocket_,
@@ -281,6 +307,23 @@ void TServerSocket::listen() {
   }
 #endif // #ifdef TCP_DEFER_ACCEPT
 
+  // Fast open is an optimization only; clients just do the full handshake
+  // if it cannot be enabled
+  if (tcpFastOpen_ > 0 && path_.empty()) {
+#ifdef TCP_FASTOPEN
+    if (-1 == setsockopt(serverSocket_,
+                         IPPROTO_TCP,
+                         TCP_FASTOPEN,
+                         cast_sockopt(&tcpFastOpen_),
+                         sizeof(tcpFastOpen_))) {
+      GlobalOutput.perror("TServerSocket::listen() setsockopt() TCP_FASTOPEN ",
+                          THRIFT_GET_SOCKET_ERROR);
+    }
+#else
+    GlobalOutput("TServerSocket::listen() TCP_FASTOPEN is not supported");
+#endif
+  }
+
 #ifdef IPV6_V6ONLY
   if (res->ai_family == AF_INET6 && path_.empty()) {
     int zero = 0;
@@ -485,8 +528,17 @@ shared_ptr<TTransport> TServerSocket::acceptImpl() {
 
   struct sockaddr_storage clientAddress;
   int size = sizeof(clientAddress);
+#ifdef HAVE_ACCEPT4
+  // Unlike accept() on some platforms, accept4() never copies O_NONBLOCK
+  // from the listening socket, so the client socket is blocking already
+  THRIFT_SOCKET clientSocket = ::accept4(serverSocket_,
+                                         (struct sockaddr*)&clientAddress,
+                                         (socklen_t*)&size,
+                                         SOCK_CLOEXEC);
+#else
   THRIFT_SOCKET clientSocket
       = ::accept(serverSocket_, (struct sockaddr*)&clientAddress, (socklen_t*)&size);
+#endif
 
   if (clientSocket == -1) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
@@ -494,6 +546,7 @@ shared_ptr<TTransport> TServerSocket::acceptImpl() {
     throw TTransportException(TTransportException::UNKNOWN, "accept()", errno_copy);
   }
 
+#ifndef HAVE_ACCEPT4
   // Make sure client socket is blocking
   int flags = THRIFT_FCNTL(clientSocket, THRIFT_F_GETFL, 0);
   if (flags == -1) {
@@ -513,6 +566,7 @@ shared_ptr<TTransport> TServerSocket::acceptImpl() {
                               "THRIFT_FCNTL(THRIFT_F_SETFL)",
                               errno_copy);
   }
+#endif
 
   shared_ptr<TSocket> client = createSocket(clientSocket);
   if (sendTimeout_ > 0) {
@@ -62,6 +62,17 @@ public:
   void setTcpSendBuffer(int tcpSendBuffer);
   void setTcpRecvBuffer(int tcpRecvBuffer);
 
+  // Sets SO_REUSEPORT, so that several server sockets, in this process or
+  // others, can listen on the same port; the kernel spreads the incoming
+  // connections over them. Every one of them must set it.
+  void setReusePort(bool reusePort) { reusePort_ = reusePort; }
+
+  // Enables TCP Fast Open for connections to this socket, which lets
+  // clients that have connected before send their first request with the
+  // SYN. queueLength bounds the number of pending fast open requests;
+  // 0 disables it.
+  void setTcpFastOpen(int queueLength) { tcpFastOpen_ = queueLength; }
+
   // listenCallback gets called just before listen, and after all Thrift
   // setsockopt calls have been made.  If you have custom setsockopt
   // things that need to happen on the listening socket, this is the place to do it.
@@ -96,6 +107,8 @@ private:
   int tcpSendBuffer_;
   int tcpRecvBuffer_;
   bool keepAlive_;
+  bool reusePort_;
+  int tcpFastOpen_;
 
   THRIFT_SOCKET intSock1_;
   THRIFT_SOCKET intSock2_;
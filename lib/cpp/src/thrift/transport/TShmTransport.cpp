@@ -0,0 +1,712 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TShmTransport.h>
+#include <thrift/transport/TSocket.h>
+
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_SYS_UN_H)
+#define THRIFT_HAVE_SHM_TRANSPORT 1
+#endif
+
+#ifdef THRIFT_HAVE_SHM_TRANSPORT
+#include <climits>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using boost::shared_ptr;
+
+namespace {
+
+const uint32_t SHM_MAGIC = 0x54534d31; // "TSM1"
+
+// How long a sleeping side waits before checking whether the peer is
+// still alive
+const int SLEEP_TIMEOUT_MS = 100;
+
+const size_t CACHE_LINE_SIZE = 64;
+
+struct Hello {
+  uint32_t magic;
+  uint32_t ringSize;
+};
+
+uint32_t roundUpToPowerOfTwo(uint32_t n) {
+  uint32_t p = 4096;
+  while (p < n && p < 0x80000000u) {
+    p <<= 1;
+  }
+  return p;
+}
+}
+
+/**
+ * The shared state of one direction. The producer owns head, the consumer
+ * owns tail; both are free running and only masked when indexing the data.
+ * A side about to sleep raises its waiting flag and then sleeps on the seq
+ * word, which the other side bumps before waking it.
+ */
+struct TShmTransport::Ring {
+  boost::atomic<uint32_t> head;
+  char pad0[CACHE_LINE_SIZE - sizeof(boost::atomic<uint32_t>)];
+  boost::atomic<uint32_t> tail;
+  char pad1[CACHE_LINE_SIZE - sizeof(boost::atomic<uint32_t>)];
+  boost::atomic<uint32_t> dataSeq;
+  boost::atomic<uint32_t> consumerWaiting;
+  boost::atomic<uint32_t> spaceSeq;
+  boost::atomic<uint32_t> producerWaiting;
+  // set by the producer once it has published its last bytes
+  boost::atomic<uint32_t> closed;
+  char pad2[CACHE_LINE_SIZE - 5 * sizeof(boost::atomic<uint32_t>)];
+};
+
+/**
+ * Layout of the mapping. The ring data follows the header, client to server
+ * first.
+ */
+struct TShmTransport::Region {
+  uint32_t magic;
+  uint32_t ringSize;
+  char pad[CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+  Ring rings[2];
+};
+
+// The futex words are the atomics themselves
+BOOST_STATIC_ASSERT(sizeof(boost::atomic<uint32_t>) == sizeof(uint32_t));
+
+#ifdef THRIFT_HAVE_SHM_TRANSPORT
+
+namespace {
+
+inline void cpuRelax() {
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Returns false if the wait timed out
+bool futexWait(boost::atomic<uint32_t>* word, uint32_t expected, int timeoutMs) {
+  struct timespec ts;
+  ts.tv_sec = timeoutMs / 1000;
+  ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+  // not FUTEX_PRIVATE_FLAG, the word is shared with another process
+  long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, NULL, 0);
+  return ret == 0 || errno != ETIMEDOUT;
+}
+
+void futexWake(boost::atomic<uint32_t>* word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+void bumpAndWake(boost::atomic<uint32_t>* word) {
+  word->fetch_add(1);
+  futexWake(word);
+}
+
+int createRegionFd(size_t size) {
+  int fd = -1;
+#ifdef __NR_memfd_create
+  fd = static_cast<int>(syscall(__NR_memfd_create, "thrift-shm", 1U /* MFD_CLOEXEC */));
+#endif
+  if (fd < 0) {
+    char name[] = "/dev/shm/thrift-shm-XXXXXX";
+    fd = mkstemp(name);
+    if (fd >= 0) {
+      unlink(name);
+    }
+  }
+  if (fd < 0) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TShmServerTransport create shared memory ", errno_copy);
+    throw TTransportException(TTransportException::UNKNOWN, "shared memory", errno_copy);
+  }
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    int errno_copy = errno;
+    ::close(fd);
+    GlobalOutput.perror("TShmServerTransport ftruncate() ", errno_copy);
+    throw TTransportException(TTransportException::UNKNOWN, "ftruncate()", errno_copy);
+  }
+  return fd;
+}
+
+void* mapRegion(int fd, size_t size) {
+  void* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (region == MAP_FAILED) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TShmTransport mmap() ", errno_copy);
+    throw TTransportException(TTransportException::UNKNOWN, "mmap()", errno_copy);
+  }
+  return region;
+}
+
+void sendRegion(THRIFT_SOCKET socket, int fd, const Hello& hello) {
+  struct iovec iov;
+  iov.iov_base = const_cast<Hello*>(&hello);
+  iov.iov_len = sizeof(hello);
+
+  char control[CMSG_SPACE(sizeof(int))];
+  std::memset(control, 0, sizeof(control));
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  if (sendmsg(socket, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(hello))) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TShmServerTransport sendmsg() ", errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, "sendmsg()", errno_copy);
+  }
+}
+
+// Returns the received descriptor
+int recvRegion(THRIFT_SOCKET socket, Hello& hello) {
+  struct iovec iov;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t got;
+  do {
+    got = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+  } while (got < 0 && errno == EINTR);
+  if (got < 0) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TShmTransport recvmsg() ", errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, "recvmsg()", errno_copy);
+  }
+
+  int fd = -1;
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  if (got != static_cast<ssize_t>(sizeof(hello)) || fd < 0) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TShmTransport: server did not send a shared memory region");
+  }
+  return fd;
+}
+}
+
+#endif // THRIFT_HAVE_SHM_TRANSPORT
+
+namespace {
+
+// Spinning while the peer cannot run on another CPU only delays it
+uint32_t defaultSpinCount() {
+#ifdef THRIFT_HAVE_SHM_TRANSPORT
+  static const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 1 ? TShmTransport::DEFAULT_SPIN_COUNT : 0;
+#else
+  return TShmTransport::DEFAULT_SPIN_COUNT;
+#endif
+}
+}
+
+TShmTransport::TShmTransport(const std::string& path)
+  : path_(path),
+    spinCount_(defaultSpinCount()),
+    region_(NULL),
+    regionSize_(0),
+    closed_(false),
+    rx_(NULL),
+    tx_(NULL),
+    rxData_(NULL),
+    txData_(NULL),
+    mask_(0),
+    txPending_(0),
+    numSleeps_(0) {
+}
+
+TShmTransport::TShmTransport(shared_ptr<TSocket> control, void* region, size_t size)
+  : spinCount_(defaultSpinCount()),
+    control_(control),
+    region_(NULL),
+    regionSize_(0),
+    closed_(false),
+    rx_(NULL),
+    tx_(NULL),
+    rxData_(NULL),
+    txData_(NULL),
+    mask_(0),
+    txPending_(0),
+    numSleeps_(0) {
+  attach(region, size, true);
+}
+
+TShmTransport::~TShmTransport() {
+  try {
+    close();
+  } catch (const TTransportException& ttx) {
+    GlobalOutput.printf("TShmTransport close failed: %s", ttx.what());
+  }
+  detach();
+}
+
+bool TShmTransport::isSupported() {
+#ifdef THRIFT_HAVE_SHM_TRANSPORT
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool TShmTransport::isOpen() {
+  return region_ != NULL && !closed_;
+}
+
+void TShmTransport::checkOpen() {
+  if (!isOpen()) {
+    throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport is not open");
+  }
+}
+
+size_t TShmTransport::regionSize(uint32_t ringSize) {
+  return sizeof(Region) + 2 * static_cast<size_t>(ringSize);
+}
+
+void TShmTransport::initRegion(void* region, uint32_t ringSize) {
+  // the file starts out zeroed, which is a valid state for the atomics
+  Region* header = static_cast<Region*>(region);
+  header->magic = SHM_MAGIC;
+  header->ringSize = ringSize;
+}
+
+uint32_t TShmTransport::getRingSize() const {
+  return region_ != NULL ? region_->ringSize : 0;
+}
+
+const std::string TShmTransport::getOrigin() {
+  return control_ ? control_->getOrigin() : "shm:" + path_;
+}
+
+void TShmTransport::attach(void* region, size_t size, bool server) {
+  region_ = static_cast<Region*>(region);
+  regionSize_ = size;
+  closed_ = false;
+  mask_ = region_->ringSize - 1;
+
+  uint8_t* data = static_cast<uint8_t*>(region) + sizeof(Region);
+  Ring* toServer = &region_->rings[0];
+  Ring* toClient = &region_->rings[1];
+  if (server) {
+    rx_ = toServer;
+    rxData_ = data;
+    tx_ = toClient;
+    txData_ = data + region_->ringSize;
+  } else {
+    rx_ = toClient;
+    rxData_ = data + region_->ringSize;
+    tx_ = toServer;
+    txData_ = data;
+  }
+  txPending_ = tx_->head.load(boost::memory_order_relaxed);
+}
+
+#ifdef THRIFT_HAVE_SHM_TRANSPORT
+
+void TShmTransport::detach() {
+  if (region_ != NULL) {
+    munmap(region_, regionSize_);
+    region_ = NULL;
+    rx_ = tx_ = NULL;
+    rxData_ = txData_ = NULL;
+  }
+}
+
+void TShmTransport::open() {
+  if (isOpen()) {
+    return;
+  }
+  if (path_.empty()) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TShmTransport: cannot reopen an accepted connection");
+  }
+  detach();
+
+  control_.reset(new TSocket(path_));
+  control_->open();
+
+  Hello hello;
+  int fd = recvRegion(control_->getSocketFD(), hello);
+  void* region = NULL;
+  try {
+    struct stat st;
+    if (hello.magic != SHM_MAGIC || hello.ringSize == 0 || (hello.ringSize & (hello.ringSize - 1))
+        || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != regionSize(hello.ringSize)) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "TShmTransport: bad shared memory region");
+    }
+    region = mapRegion(fd, regionSize(hello.ringSize));
+  } catch (...) {
+    ::close(fd);
+    control_->close();
+    throw;
+  }
+  ::close(fd);
+
+  if (static_cast<Region*>(region)->magic != SHM_MAGIC) {
+    munmap(region, regionSize(hello.ringSize));
+    control_->close();
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "TShmTransport: bad shared memory region");
+  }
+  attach(region, regionSize(hello.ringSize), false);
+}
+
+void TShmTransport::close() {
+  if (isOpen()) {
+    // Hand over anything still pending, then tell the peer we are gone
+    publish();
+    closed_ = true;
+    tx_->closed.store(1);
+    wakeAll();
+  }
+  if (control_) {
+    control_->close();
+  }
+}
+
+void TShmTransport::wakeAll() {
+  // The peer may sleep on either word of either ring, and so may other
+  // threads of ours when close() is called concurrently
+  bumpAndWake(&tx_->dataSeq);
+  bumpAndWake(&tx_->spaceSeq);
+  bumpAndWake(&rx_->dataSeq);
+  bumpAndWake(&rx_->spaceSeq);
+}
+
+bool TShmTransport::peerGone() {
+  if (!control_ || !control_->isOpen()) {
+    return true;
+  }
+  // Nothing is ever sent on the control socket after the handshake, so it
+  // only becomes readable once the peer has closed it
+  struct pollfd fds;
+  fds.fd = control_->getSocketFD();
+  fds.events = POLLIN;
+  fds.revents = 0;
+  if (poll(&fds, 1, 0) <= 0) {
+    return false;
+  }
+  if (fds.revents & (POLLHUP | POLLERR)) {
+    return true;
+  }
+  char c;
+  return recv(fds.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+uint32_t TShmTransport::waitForData() {
+  uint32_t tail = rx_->tail.load(boost::memory_order_relaxed);
+  for (uint32_t i = 0;; ++i) {
+    uint32_t head = rx_->head.load(boost::memory_order_acquire);
+    if (head != tail) {
+      return checkUsed(head, tail);
+    }
+    if (i >= spinCount_) {
+      break;
+    }
+    cpuRelax();
+  }
+
+  for (;;) {
+    uint32_t seq = rx_->dataSeq.load();
+    rx_->consumerWaiting.store(1);
+    // the peer publishes its last bytes before it sets closed, so head has
+    // to be read after closed
+    bool peerClosed = rx_->closed.load() != 0;
+    uint32_t head = rx_->head.load();
+    if (head != tail || peerClosed || closed_) {
+      rx_->consumerWaiting.store(0);
+      return checkUsed(head, tail);
+    }
+
+    ++numSleeps_;
+    bool woken = futexWait(&rx_->dataSeq, seq, SLEEP_TIMEOUT_MS);
+    rx_->consumerWaiting.store(0);
+    if (!woken && peerGone()) {
+      return checkUsed(rx_->head.load(), tail);
+    }
+  }
+}
+
+void TShmTransport::waitForSpace() {
+  uint32_t capacity = mask_ + 1;
+  for (uint32_t i = 0;; ++i) {
+    if (checkUsed(txPending_, tx_->tail.load(boost::memory_order_acquire)) < capacity) {
+      return;
+    }
+    if (i >= spinCount_) {
+      break;
+    }
+    cpuRelax();
+  }
+
+  for (;;) {
+    uint32_t seq = tx_->spaceSeq.load();
+    tx_->producerWaiting.store(1);
+    if (checkUsed(txPending_, tx_->tail.load()) < capacity) {
+      tx_->producerWaiting.store(0);
+      return;
+    }
+    if (rx_->closed.load() || closed_) {
+      tx_->producerWaiting.store(0);
+      throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport peer closed");
+    }
+
+    ++numSleeps_;
+    bool woken = futexWait(&tx_->spaceSeq, seq, SLEEP_TIMEOUT_MS);
+    tx_->producerWaiting.store(0);
+    if (!woken && peerGone()) {
+      throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport peer went away");
+    }
+  }
+}
+
+void TShmTransport::publish() {
+  if (txPending_ == tx_->head.load(boost::memory_order_relaxed)) {
+    return;
+  }
+  tx_->head.store(txPending_);
+  if (tx_->consumerWaiting.load()) {
+    bumpAndWake(&tx_->dataSeq);
+  }
+}
+
+#else // THRIFT_HAVE_SHM_TRANSPORT
+
+void TShmTransport::detach() {
+}
+
+void TShmTransport::open() {
+  throw TTransportException(TTransportException::NOT_OPEN,
+                            "TShmTransport is not supported on this platform");
+}
+
+void TShmTransport::close() {
+}
+
+void TShmTransport::wakeAll() {
+}
+
+bool TShmTransport::peerGone() {
+  return true;
+}
+
+uint32_t TShmTransport::waitForData() {
+  return 0;
+}
+
+void TShmTransport::waitForSpace() {
+}
+
+void TShmTransport::publish() {
+}
+
+#endif // THRIFT_HAVE_SHM_TRANSPORT
+
+uint32_t TShmTransport::checkUsed(uint32_t head, uint32_t tail) {
+  // Both indices live in memory the peer can write to, and everything
+  // indexing the data relies on them being at most a ring apart
+  uint32_t used = head - tail;
+  if (used > mask_ + 1) {
+    // nothing pending can be trusted to reach the peer intact either
+    txPending_ = tx_->head.load(boost::memory_order_relaxed);
+    close();
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "TShmTransport: peer corrupted the ring indices");
+  }
+  return used;
+}
+
+bool TShmTransport::peek() {
+  return isOpen() && waitForData() > 0;
+}
+
+uint32_t TShmTransport::read(uint8_t* buf, uint32_t len) {
+  checkOpen();
+  uint32_t avail = waitForData();
+  if (avail == 0 || len == 0) {
+    // EOF
+    return 0;
+  }
+
+  uint32_t give = (std::min)(len, avail);
+  uint32_t tail = rx_->tail.load(boost::memory_order_relaxed);
+  uint32_t offset = tail & mask_;
+  uint32_t first = (std::min)(give, mask_ + 1 - offset);
+  std::memcpy(buf, rxData_ + offset, first);
+  std::memcpy(buf + first, rxData_, give - first);
+
+  rx_->tail.store(tail + give);
+  if (rx_->producerWaiting.load()) {
+    bumpAndWake(&rx_->spaceSeq);
+  }
+  return give;
+}
+
+void TShmTransport::write(const uint8_t* buf, uint32_t len) {
+  checkOpen();
+  uint32_t capacity = mask_ + 1;
+  while (len > 0) {
+    uint32_t tail = tx_->tail.load(boost::memory_order_acquire);
+    uint32_t space = capacity - checkUsed(txPending_, tail);
+    if (space == 0) {
+      // let the peer drain what we have so far
+      publish();
+      waitForSpace();
+      continue;
+    }
+
+    uint32_t put = (std::min)(len, space);
+    uint32_t offset = txPending_ & mask_;
+    uint32_t first = (std::min)(put, capacity - offset);
+    std::memcpy(txData_ + offset, buf, first);
+    std::memcpy(txData_, buf + first, put - first);
+    txPending_ += put;
+    buf += put;
+    len -= put;
+  }
+}
+
+void TShmTransport::flush() {
+  checkOpen();
+  if (rx_->closed.load()) {
+    throw TTransportException(TTransportException::NOT_OPEN, "TShmTransport peer closed");
+  }
+  publish();
+}
+
+TShmServerTransport::TShmServerTransport(const std::string& path, uint32_t ringSize)
+  : path_(path), ringSize_(roundUpToPowerOfTwo(ringSize)) {
+}
+
+TShmServerTransport::~TShmServerTransport() {
+  close();
+}
+
+void TShmServerTransport::listen() {
+  if (!TShmTransport::isSupported()) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TShmTransport is not supported on this platform");
+  }
+  control_.reset(new TServerSocket(path_));
+  control_->listen();
+}
+
+void TShmServerTransport::interrupt() {
+  if (control_) {
+    control_->interrupt();
+  }
+}
+
+void TShmServerTransport::close() {
+  if (control_) {
+    control_->close();
+    control_.reset();
+#ifdef THRIFT_HAVE_SHM_TRANSPORT
+    // the socket file would make the next listen() on this path fail
+    unlink(path_.c_str());
+#endif
+  }
+}
+
+shared_ptr<TTransport> TShmServerTransport::acceptImpl() {
+  if (!control_) {
+    throw TTransportException(TTransportException::NOT_OPEN, "TShmServerTransport not listening");
+  }
+  shared_ptr<TSocket> socket = boost::dynamic_pointer_cast<TSocket>(control_->accept());
+
+#ifdef THRIFT_HAVE_SHM_TRANSPORT
+  size_t size = TShmTransport::regionSize(ringSize_);
+  void* region = NULL;
+  int fd = -1;
+  try {
+    fd = createRegionFd(size);
+    region = mapRegion(fd, size);
+    TShmTransport::initRegion(region, ringSize_);
+
+    Hello hello;
+    hello.magic = SHM_MAGIC;
+    hello.ringSize = ringSize_;
+    sendRegion(socket->getSocketFD(), fd, hello);
+  } catch (...) {
+    if (region != NULL) {
+      munmap(region, size);
+    }
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    socket->close();
+    throw;
+  }
+  ::close(fd);
+  return shared_ptr<TTransport>(new TShmTransport(socket, region, size));
+#else
+  socket->close();
+  throw TTransportException(TTransportException::NOT_OPEN,
+                            "TShmTransport is not supported on this platform");
+#endif
+}
+}
+}
+} // apache::thrift::transport
@@ -0,0 +1,198 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TSHMTRANSPORT_H_
+#define _THRIFT_TRANSPORT_TSHMTRANSPORT_H_ 1
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <thrift/transport/TServerTransport.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+class TServerSocket;
+class TSocket;
+
+/**
+ * Shared memory transport for processes on the same host.
+ *
+ * Each connection maps one shared memory region holding a single-producer,
+ * single-consumer byte ring per direction. Bytes written go straight into
+ * the ring and become visible to the peer on flush(), or as soon as the
+ * ring fills up. A side that finds its ring empty (or full) spins for a
+ * while and then sleeps on a futex in the region until the peer wakes it,
+ * so an idle connection costs no CPU and a busy one makes no system calls.
+ *
+ * Connections are set up over a unix domain socket: TShmServerTransport
+ * listens on a path, creates the region for each connection it accepts and
+ * passes its file descriptor to the client. The socket stays open for the
+ * lifetime of the connection so that either side notices when the other
+ * one goes away without closing.
+ *
+ * Only supported on Linux; elsewhere open() and accept() throw.
+ */
+class TShmTransport : public TVirtualTransport<TShmTransport> {
+public:
+  /// Default capacity of each ring in bytes
+  static const uint32_t DEFAULT_RING_SIZE = 1024 * 1024;
+
+  /// Default number of polls of an empty or full ring before sleeping, on
+  /// hosts with more than one CPU. Uniprocessors never spin.
+  static const uint32_t DEFAULT_SPIN_COUNT = 4000;
+
+  /**
+   * Constructs a client transport that connects to a TShmServerTransport
+   * listening on the given unix domain socket path when opened.
+   */
+  TShmTransport(const std::string& path);
+
+  /**
+   * Constructs the server side of an accepted connection. Used by
+   * TShmServerTransport.
+   *
+   * @param control  The connected unix domain socket
+   * @param region   The mapped shared memory region, which this takes over
+   * @param size     Size of the mapping
+   */
+  TShmTransport(boost::shared_ptr<TSocket> control, void* region, size_t size);
+
+  virtual ~TShmTransport();
+
+  /**
+   * Whether the platform supports shared memory transports.
+   */
+  static bool isSupported();
+
+  bool isOpen();
+
+  /**
+   * Waits until there is data to read, returns false if the peer has closed
+   * the connection.
+   */
+  bool peek();
+
+  void open();
+
+  void close();
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+
+  void write(const uint8_t* buf, uint32_t len);
+
+  /**
+   * Makes everything written so far visible to the peer, waking it if it
+   * is asleep.
+   */
+  void flush();
+
+  /**
+   * Set the number of times an empty or full ring is polled before the
+   * thread goes to sleep. 0 sleeps right away.
+   */
+  void setSpinCount(uint32_t spinCount) { spinCount_ = spinCount; }
+
+  uint32_t getSpinCount() const { return spinCount_; }
+
+  /// Capacity of each ring once open, as chosen by the server
+  uint32_t getRingSize() const;
+
+  /// Number of times this side went to sleep waiting for the peer
+  uint64_t getNumSleeps() const { return numSleeps_; }
+
+  virtual const std::string getOrigin();
+
+private:
+  friend class TShmServerTransport;
+
+  struct Region;
+  struct Ring;
+
+  static size_t regionSize(uint32_t ringSize);
+  static void initRegion(void* region, uint32_t ringSize);
+
+  void attach(void* region, size_t size, bool server);
+  void detach();
+  void checkOpen();
+
+  uint32_t checkUsed(uint32_t head, uint32_t tail);
+  uint32_t waitForData();
+  void waitForSpace();
+  void publish();
+  void wakeAll();
+  bool peerGone();
+
+  std::string path_;
+  uint32_t spinCount_;
+  boost::shared_ptr<TSocket> control_;
+
+  Region* region_;
+  size_t regionSize_;
+  bool closed_;
+  Ring* rx_;
+  Ring* tx_;
+  uint8_t* rxData_;
+  uint8_t* txData_;
+  uint32_t mask_;
+  // write position in tx_, ahead of the published head until flush()
+  uint32_t txPending_;
+  uint64_t numSleeps_;
+};
+
+/**
+ * Accepts TShmTransport connections on a unix domain socket path.
+ *
+ * Plugs into any server that takes a TServerTransport, such as
+ * TSimpleServer or TThreadPoolServer, in place of a TServerSocket.
+ */
+class TShmServerTransport : public TServerTransport {
+public:
+  /**
+   * @param path      Unix domain socket path to listen on
+   * @param ringSize  Capacity of each ring of an accepted connection,
+   *                  rounded up to a power of two
+   */
+  TShmServerTransport(const std::string& path,
+                      uint32_t ringSize = TShmTransport::DEFAULT_RING_SIZE);
+
+  virtual ~TShmServerTransport();
+
+  void listen();
+
+  void interrupt();
+
+  void close();
+
+protected:
+  boost::shared_ptr<TTransport> acceptImpl();
+
+private:
+  std::string path_;
+  uint32_t ringSize_;
+  boost::shared_ptr<TServerSocket> control_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TSHMTRANSPORT_H_
@@ -39,6 +39,10 @@
 #include <unistd.h>
 #endif
 #include <fcntl.h>
+#ifdef HAVE_SYS_UIO_H
+#include <limits.h>
+#endif
+#include <vector>
 
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/transport/TSocket.h>
@@ -89,6 +93,7 @@ TSocket::TSocket(string host, int port)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
+    fastOpen_(false),
     maxRecvRetries_(5) {
 }
 
@@ -104,6 +109,7 @@ TSocket::TSocket(string path)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
+    fastOpen_(false),
     maxRecvRetries_(5) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
@@ -120,6 +126,7 @@ TSocket::TSocket()
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
+    fastOpen_(false),
     maxRecvRetries_(5) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
@@ -136,6 +143,7 @@ TSocket::TSocket(THRIFT_SOCKET socket)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
+    fastOpen_(false),
     maxRecvRetries_(5) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 #ifdef SO_NOSIGPIPE
@@ -231,6 +239,20 @@ void TSocket::openConnection(struct addrinfo* res) {
   }
 #endif
 
+#ifdef TCP_FASTOPEN_CONNECT
+  if (fastOpen_ && path_.empty()) {
+    int one = 1;
+    if (-1 == setsockopt(socket_,
+                         IPPROTO_TCP,
+                         TCP_FASTOPEN_CONNECT,
+                         cast_sockopt(&one),
+                         sizeof(one))) {
+      GlobalOutput.perror("TSocket::open() setsockopt() TCP_FASTOPEN_CONNECT " + getSocketInfo(),
+                          THRIFT_GET_SOCKET_ERROR);
+    }
+  }
+#endif
+
   // Set the socket to be non blocking for connect if a timeout exists
   int flags = THRIFT_FCNTL(socket_, THRIFT_F_GETFL, 0);
   if (connTimeout_ > 0) {
@@ -601,6 +623,94 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return b;
 }
 
+#ifdef HAVE_SYS_UIO_H
+uint32_t TSocket::writev_partial(const struct iovec* iov, int iovcnt) {
+  if (socket_ == THRIFT_INVALID_SOCKET) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called writev on non-open socket");
+  }
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+
+  int flags = 0;
+#ifdef MSG_NOSIGNAL
+  // See write_partial() for why MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif // ifdef MSG_NOSIGNAL
+
+  int b = static_cast<int>(sendmsg(socket_, &msg, flags));
+  ++g_socket_syscalls;
+
+  if (b < 0) {
+    if (THRIFT_GET_SOCKET_ERROR == THRIFT_EWOULDBLOCK || THRIFT_GET_SOCKET_ERROR == THRIFT_EAGAIN) {
+      return 0;
+    }
+    // Fail on a send error
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    GlobalOutput.perror("TSocket::writev_partial() sendmsg() " + getSocketInfo(), errno_copy);
+
+    if (errno_copy == THRIFT_EPIPE || errno_copy == THRIFT_ECONNRESET
+        || errno_copy == THRIFT_ENOTCONN) {
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN, "writev() sendmsg()", errno_copy);
+    }
+
+    throw TTransportException(TTransportException::UNKNOWN, "writev() sendmsg()", errno_copy);
+  }
+
+  // Fail on blocked send
+  if (b == 0) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Socket sendmsg returned 0.");
+  }
+  return b;
+}
+
+void TSocket::writeSlices_virt(const TBufferSlice* slices, uint32_t count) {
+#ifdef IOV_MAX
+  const size_t max_iov = IOV_MAX;
+#else
+  const size_t max_iov = 64;
+#endif
+  std::vector<struct iovec> iov;
+  uint32_t next = 0;
+
+  for (;;) {
+    while (next < count && iov.size() < max_iov) {
+      if (!slices[next].empty()) {
+        struct iovec v;
+        v.iov_base = const_cast<uint8_t*>(slices[next].data());
+        v.iov_len = slices[next].size();
+        iov.push_back(v);
+      }
+      ++next;
+    }
+    if (iov.empty()) {
+      return;
+    }
+
+    uint32_t b = writev_partial(&iov[0], static_cast<int>(iov.size()));
+    if (b == 0) {
+      // This should only happen if the timeout set with SO_SNDTIMEO expired.
+      throw TTransportException(TTransportException::TIMED_OUT, "send timeout expired");
+    }
+
+    // Drop the buffers that went out completely and skip into a partial one
+    size_t done = 0;
+    while (done < iov.size() && b >= iov[done].iov_len) {
+      b -= static_cast<uint32_t>(iov[done].iov_len);
+      ++done;
+    }
+    if (done < iov.size()) {
+      iov[done].iov_base = static_cast<uint8_t*>(iov[done].iov_base) + b;
+      iov[done].iov_len -= b;
+    }
+    iov.erase(iov.begin(), iov.begin() + done);
+  }
+}
+#endif
+
 std::string TSocket::getHost() {
   return host_;
 }
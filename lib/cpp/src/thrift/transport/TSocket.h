@@ -36,6 +36,9 @@
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 
 namespace apache {
 namespace thrift {
@@ -115,6 +118,21 @@ public:
    */
   uint32_t write_partial(const uint8_t* buf, uint32_t len);
 
+#ifdef HAVE_SYS_UIO_H
+  /**
+   * Writes a sequence of buffers to the underlying socket.  Does a single
+   * sendmsg() and returns the number of bytes sent across all of them, 0 if
+   * the socket would block.
+   */
+  uint32_t writev_partial(const struct iovec* iov, int iovcnt);
+
+  /**
+   * Writes all the slices, gathering as many as possible into each
+   * sendmsg().  Loops until done or fail.
+   */
+  virtual void writeSlices_virt(const TBufferSlice* slices, uint32_t count);
+#endif
+
   /**
    * Get the host that the socket is connected to
    *
@@ -174,6 +192,16 @@ public:
    */
   void setSendTimeout(int ms);
 
+  /**
+   * Get the receive timeout
+   */
+  int getRecvTimeout() { return recvTimeout_; }
+
+  /**
+   * Get the send timeout
+   */
+  int getSendTimeout() { return sendTimeout_; }
+
   /**
    * Set the max number of recv retries in case of an THRIFT_EAGAIN
    * error
@@ -185,6 +213,13 @@ public:
    */
   void setKeepAlive(bool keepAlive);
 
+  /**
+   * Use TCP Fast Open for the next open(). Once the server has handed out
+   * a cookie, the first write goes out with the SYN instead of waiting for
+   * the handshake. Where the platform lacks it, the socket connects as usual.
+   */
+  void setTcpFastOpen(bool fastOpen) { fastOpen_ = fastOpen; }
+
   /**
    * Get socket information formatted as a string <Host: x Port: x>
    */
@@ -298,6 +333,9 @@ protected:
   /** Nodelay */
   bool noDelay_;
 
+  /** TCP Fast Open on connect */
+  bool fastOpen_;
+
   /** Recv EGAIN retries */
   int maxRecvRetries_;
 
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <iostream>
 
+#include <thrift/concurrency/Util.h>
 #include <thrift/transport/TSocketPool.h>
 
 namespace apache {
@@ -30,6 +31,8 @@ namespace transport {
 
 using namespace std;
 
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Util;
 using boost::shared_ptr;
 
 /**
@@ -37,7 +40,15 @@ using boost::shared_ptr;
  *
  */
 TSocketPoolServer::TSocketPoolServer()
-  : host_(""), port_(0), socket_(THRIFT_INVALID_SOCKET), lastFailTime_(0), consecutiveFailures_(0) {
+  : host_(""),
+    port_(0),
+    socket_(THRIFT_INVALID_SOCKET),
+    lastFailTime_(0),
+    consecutiveFailures_(0),
+    latency_(0),
+    outstanding_(0),
+    weight_(1),
+    currentWeight_(0) {
 }
 
 /**
@@ -48,7 +59,108 @@ TSocketPoolServer::TSocketPoolServer(const string& host, int port)
     port_(port),
     socket_(THRIFT_INVALID_SOCKET),
     lastFailTime_(0),
-    consecutiveFailures_(0) {
+    consecutiveFailures_(0),
+    latency_(0),
+    outstanding_(0),
+    weight_(1),
+    currentWeight_(0) {
+}
+
+void TSocketPoolServer::recordLatency(int64_t usec) {
+  // weight of a new sample; about the last ten samples dominate
+  const double alpha = 0.2;
+  Guard g(mutex_);
+  if (latency_ == 0) {
+    latency_ = static_cast<double>(usec);
+  } else {
+    latency_ += alpha * (static_cast<double>(usec) - latency_);
+  }
+}
+
+double TSocketPoolServer::getLatency() const {
+  Guard g(mutex_);
+  return latency_;
+}
+
+void TSocketPoolServer::recordFailure(int maxConsecutiveFailures) {
+  Guard g(mutex_);
+  if (++consecutiveFailures_ > maxConsecutiveFailures) {
+    // Mark server as down
+    consecutiveFailures_ = 0;
+    lastFailTime_ = time(NULL);
+  }
+}
+
+void TSocketPoolServer::recordSuccess() {
+  Guard g(mutex_);
+  consecutiveFailures_ = 0;
+  lastFailTime_ = 0;
+}
+
+time_t TSocketPoolServer::getLastFailTime() const {
+  Guard g(mutex_);
+  return lastFailTime_;
+}
+
+/**
+ * Policy implementations
+ */
+void TRandomPolicy::order(vector<shared_ptr<TSocketPoolServer> >& servers) {
+  random_shuffle(servers.begin(), servers.end());
+}
+
+namespace {
+
+double loadScore(const TSocketPoolServer& server) {
+  return server.getLatency() * (server.outstanding_.load() + 1);
+}
+
+bool fewerOutstanding(const shared_ptr<TSocketPoolServer>& a,
+                      const shared_ptr<TSocketPoolServer>& b) {
+  return a->outstanding_.load() < b->outstanding_.load();
+}
+
+bool heavier(const shared_ptr<TSocketPoolServer>& a, const shared_ptr<TSocketPoolServer>& b) {
+  return a->weight_ > b->weight_;
+}
+}
+
+void TLatencyPolicy::order(vector<shared_ptr<TSocketPoolServer> >& servers) {
+  if (servers.size() < 2) {
+    return;
+  }
+  // the first two servers are the random choices
+  random_shuffle(servers.begin(), servers.end());
+  if (loadScore(*servers[1]) < loadScore(*servers[0])) {
+    swap(servers[0], servers[1]);
+  }
+}
+
+void TLeastOutstandingPolicy::order(vector<shared_ptr<TSocketPoolServer> >& servers) {
+  random_shuffle(servers.begin(), servers.end());
+  stable_sort(servers.begin(), servers.end(), fewerOutstanding);
+}
+
+void TWeightedRoundRobinPolicy::order(vector<shared_ptr<TSocketPoolServer> >& servers) {
+  stable_sort(servers.begin(), servers.end(), heavier);
+
+  Guard g(mutex_);
+  int total = 0;
+  size_t best = servers.size();
+  for (size_t i = 0; i < servers.size(); ++i) {
+    TSocketPoolServer& server = *servers[i];
+    if (server.weight_ > 0) {
+      total += server.weight_;
+      server.currentWeight_ += server.weight_;
+      if (best == servers.size() || server.currentWeight_ > servers[best]->currentWeight_) {
+        best = i;
+      }
+    }
+  }
+  if (best < servers.size()) {
+    servers[best]->currentWeight_ -= total;
+    rotate(servers.begin(), servers.begin() + best, servers.begin() + best + 1);
+  }
 }
 
 /**
@@ -62,7 +174,8 @@ TSocketPool::TSocketPool()
     retryInterval_(60),
     maxConsecutiveFailures_(1),
     randomize_(true),
-    alwaysTryLast_(true) {
+    alwaysTryLast_(true),
+    callStart_(0) {
 }
 
 TSocketPool::TSocketPool(const vector<string>& hosts, const vector<int>& ports)
@@ -71,7 +184,8 @@ TSocketPool::TSocketPool(const vector<string>& hosts, const vector<int>& ports)
     retryInterval_(60),
     maxConsecutiveFailures_(1),
     randomize_(true),
-    alwaysTryLast_(true) {
+    alwaysTryLast_(true),
+    callStart_(0) {
   if (hosts.size() != ports.size()) {
     GlobalOutput("TSocketPool::TSocketPool: hosts.size != ports.size");
     throw TTransportException(TTransportException::BAD_ARGS);
@@ -88,7 +202,8 @@ TSocketPool::TSocketPool(const vector<pair<string, int> >& servers)
     retryInterval_(60),
     maxConsecutiveFailures_(1),
     randomize_(true),
-    alwaysTryLast_(true) {
+    alwaysTryLast_(true),
+    callStart_(0) {
   for (unsigned i = 0; i < servers.size(); ++i) {
     addServer(servers[i].first, servers[i].second);
   }
@@ -101,7 +216,8 @@ TSocketPool::TSocketPool(const vector<shared_ptr<TSocketPoolServer> >& servers)
     retryInterval_(60),
     maxConsecutiveFailures_(1),
     randomize_(true),
-    alwaysTryLast_(true) {
+    alwaysTryLast_(true),
+    callStart_(0) {
 }
 
 TSocketPool::TSocketPool(const string& host, int port)
@@ -110,11 +226,13 @@ TSocketPool::TSocketPool(const string& host, int port)
     retryInterval_(60),
     maxConsecutiveFailures_(1),
     randomize_(true),
-    alwaysTryLast_(true) {
+    alwaysTryLast_(true),
+    callStart_(0) {
   addServer(host, port);
 }
 
 TSocketPool::~TSocketPool() {
+  endCall(false);
   vector<shared_ptr<TSocketPoolServer> >::const_iterator iter = servers_.begin();
   vector<shared_ptr<TSocketPoolServer> >::const_iterator iterEnd = servers_.end();
   for (; iter != iterEnd; ++iter) {
@@ -161,6 +279,10 @@ void TSocketPool::setAlwaysTryLast(bool alwaysTryLast) {
   alwaysTryLast_ = alwaysTryLast;
 }
 
+void TSocketPool::setPolicy(shared_ptr<TSocketPoolPolicy> policy) {
+  policy_ = policy;
+}
+
 void TSocketPool::setCurrentServer(const shared_ptr<TSocketPoolServer>& server) {
   currentServer_ = server;
   host_ = server->host_;
@@ -185,7 +307,9 @@ void TSocketPool::open() {
     return;
   }
 
-  if (randomize_ && numServers > 1) {
+  if (policy_) {
+    policy_->order(servers_);
+  } else if (randomize_ && numServers > 1) {
     random_shuffle(servers_.begin(), servers_.end());
   }
 
@@ -200,12 +324,13 @@ void TSocketPool::open() {
       return;
     }
 
-    bool retryIntervalPassed = (server->lastFailTime_ == 0);
+    time_t lastFailTime = server->getLastFailTime();
+    bool retryIntervalPassed = (lastFailTime == 0);
     bool isLastServer = alwaysTryLast_ ? (i == (numServers - 1)) : false;
 
-    if (server->lastFailTime_ > 0) {
+    if (lastFailTime > 0) {
       // The server was marked as down, so check if enough time has elapsed to retry
-      time_t elapsedTime = time(NULL) - server->lastFailTime_;
+      time_t elapsedTime = time(NULL) - lastFailTime;
       if (elapsedTime > retryInterval_) {
         retryIntervalPassed = true;
       }
@@ -213,6 +338,7 @@ void TSocketPool::open() {
 
     if (retryIntervalPassed || isLastServer) {
       for (int j = 0; j < numRetries_; ++j) {
+        int64_t start = Util::currentTimeUsec();
         try {
           TSocket::open();
         } catch (TException e) {
@@ -224,18 +350,13 @@ void TSocketPool::open() {
 
         // Copy over the opened socket so that we can keep it persistent
         server->socket_ = socket_;
-        // reset lastFailTime_ is required
-        server->lastFailTime_ = 0;
+        server->recordSuccess();
+        server->recordLatency(Util::currentTimeUsec() - start);
         // success
         return;
       }
 
-      ++server->consecutiveFailures_;
-      if (server->consecutiveFailures_ > maxConsecutiveFailures_) {
-        // Mark server as down
-        server->consecutiveFailures_ = 0;
-        server->lastFailTime_ = time(NULL);
-      }
+      server->recordFailure(maxConsecutiveFailures_);
     }
   }
 
@@ -244,11 +365,46 @@ void TSocketPool::open() {
 }
 
 void TSocketPool::close() {
+  endCall(false);
   TSocket::close();
   if (currentServer_) {
     currentServer_->socket_ = THRIFT_INVALID_SOCKET;
   }
 }
+
+uint32_t TSocketPool::read(uint8_t* buf, uint32_t len) {
+  uint32_t got;
+  try {
+    got = TSocket::read(buf, len);
+  } catch (...) {
+    endCall(false);
+    throw;
+  }
+  if (got > 0) {
+    endCall(true);
+  }
+  return got;
+}
+
+void TSocketPool::write(const uint8_t* buf, uint32_t len) {
+  if (currentServer_) {
+    if (callStart_ == 0) {
+      ++currentServer_->outstanding_;
+    }
+    callStart_ = Util::currentTimeUsec();
+  }
+  TSocket::write(buf, len);
+}
+
+void TSocketPool::endCall(bool success) {
+  if (callStart_ != 0 && currentServer_) {
+    if (success) {
+      currentServer_->recordLatency(Util::currentTimeUsec() - callStart_);
+    }
+    --currentServer_->outstanding_;
+  }
+  callStart_ = 0;
+}
 }
 }
 } // apache::thrift::transport
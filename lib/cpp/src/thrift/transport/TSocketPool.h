@@ -21,6 +21,8 @@
 #define _THRIFT_TRANSPORT_TSOCKETPOOL_H_ 1
 
 #include <vector>
+#include <boost/atomic.hpp>
+#include <thrift/concurrency/Mutex.h>
 #include <thrift/transport/TSocket.h>
 
 namespace apache {
@@ -30,6 +32,8 @@ namespace transport {
 /**
  * Class to hold server information for TSocketPool
  *
+ * The statistics are updated by every pool the server is in, possibly from
+ * several threads, and are synchronized accordingly.
  */
 class TSocketPoolServer {
 
@@ -53,11 +57,106 @@ public:
   // Socket for the server
   THRIFT_SOCKET socket_;
 
-  // Last time connecting to this server failed
+  // Last time connecting to this server failed. Guarded by mutex_, use
+  // getLastFailTime() while the server is in use.
   time_t lastFailTime_;
 
-  // Number of consecutive times connecting to this server failed
+  // Number of consecutive times connecting to this server failed. Guarded
+  // by mutex_.
   int consecutiveFailures_;
+
+  // Smoothed latency of opens and calls in microseconds, 0 until measured.
+  // Guarded by mutex_, use getLatency() while the server is in use.
+  double latency_;
+
+  // Number of calls or leases in flight to this server
+  boost::atomic<int> outstanding_;
+
+  // Share of requests under weighted round robin, relative to the others
+  int weight_;
+
+  // Weighted round robin state
+  int currentWeight_;
+
+  /**
+   * Folds a new latency sample, in microseconds, into latency_.
+   */
+  void recordLatency(int64_t usec);
+
+  double getLatency() const;
+
+  /**
+   * Counts a failed connect, and marks the server as down if it failed
+   * more than maxConsecutiveFailures times in a row.
+   */
+  void recordFailure(int maxConsecutiveFailures);
+
+  /**
+   * Marks the server as up after a successful connect.
+   */
+  void recordSuccess();
+
+  time_t getLastFailTime() const;
+
+private:
+  mutable concurrency::Mutex mutex_;
+};
+
+/**
+ * Decides in which order a pool tries its servers. The pool still skips
+ * servers that are marked down, so the policy only expresses preference.
+ * A policy may be shared by several pools.
+ */
+class TSocketPoolPolicy {
+public:
+  virtual ~TSocketPoolPolicy() {}
+
+  /**
+   * Puts the servers in the order they should be tried in.
+   */
+  virtual void order(std::vector<boost::shared_ptr<TSocketPoolServer> >& servers) = 0;
+};
+
+/**
+ * Tries the servers in random order. This is what TSocketPool does
+ * without a policy.
+ */
+class TRandomPolicy : public TSocketPoolPolicy {
+public:
+  virtual void order(std::vector<boost::shared_ptr<TSocketPoolServer> >& servers);
+};
+
+/**
+ * Power of two choices on latency: of two servers picked at random, the
+ * one with the lower latency, weighted by its outstanding requests, is
+ * tried first. Servers that have not been measured yet count as fastest,
+ * so every server gets probed.
+ */
+class TLatencyPolicy : public TSocketPoolPolicy {
+public:
+  virtual void order(std::vector<boost::shared_ptr<TSocketPoolServer> >& servers);
+};
+
+/**
+ * Tries the server with the fewest outstanding requests first; ties are
+ * broken at random.
+ */
+class TLeastOutstandingPolicy : public TSocketPoolPolicy {
+public:
+  virtual void order(std::vector<boost::shared_ptr<TSocketPoolServer> >& servers);
+};
+
+/**
+ * Smooth weighted round robin on TSocketPoolServer::weight_, the way nginx
+ * does it: over any sum-of-weights picks each server comes first weight_
+ * times, spread out evenly. The others follow by weight for failover.
+ */
+class TWeightedRoundRobinPolicy : public TSocketPoolPolicy {
+public:
+  virtual void order(std::vector<boost::shared_ptr<TSocketPoolServer> >& servers);
+
+private:
+  concurrency::Mutex mutex_;
 };
 
 /**
@@ -152,6 +251,12 @@ public:
    */
   void setAlwaysTryLast(bool alwaysTryLast);
 
+  /**
+   * Sets the policy that orders the servers on open(), replacing
+   * setRandomize(). NULL restores the default.
+   */
+  void setPolicy(boost::shared_ptr<TSocketPoolPolicy> policy);
+
   /**
    * Creates and opens the UNIX socket.
    */
@@ -162,6 +267,14 @@ public:
    */
   void close();
 
+  /**
+   * Reads and writes time calls for the latency of the current server: a
+   * call lasts from the last write before a response until its first
+   * byte arrives.
+   */
+  virtual uint32_t read(uint8_t* buf, uint32_t len);
+  virtual void write(const uint8_t* buf, uint32_t len);
+
 protected:
   void setCurrentServer(const boost::shared_ptr<TSocketPoolServer>& server);
 
@@ -187,6 +300,15 @@ protected:
 
   /** Always try last host, even if marked down? */
   bool alwaysTryLast_;
+
+  /** Orders the servers on open, if set */
+  boost::shared_ptr<TSocketPoolPolicy> policy_;
+
+private:
+  void endCall(bool success);
+
+  /** Start of the call awaiting a response, 0 if there is none */
+  int64_t callStart_;
 };
 }
 }
@@ -21,6 +21,7 @@
 #define _THRIFT_TRANSPORT_TTRANSPORT_H_ 1
 
 #include <thrift/Thrift.h>
+#include <thrift/TBufferSlice.h>
 #include <boost/shared_ptr.hpp>
 #include <thrift/transport/TTransportException.h>
 #include <string>
@@ -228,6 +229,74 @@ public:
     throw TTransportException(TTransportException::NOT_OPEN, "Base TTransport cannot consume.");
   }
 
+  /**
+   * Reads exactly len bytes as a TBufferSlice.
+   *
+   * Transports that hold whole frames in memory return a slice aliasing the
+   * frame, which stays alive as long as the slice does. The default copies
+   * the bytes into a new buffer with readAll().
+   *
+   * @param slice  Set to the bytes read
+   * @param len    How many bytes to read
+   * @return How many bytes read, which must be equal to len
+   * @throws TTransportException If insufficient data was read
+   */
+  uint32_t readSlice(TBufferSlice& slice, uint32_t len) {
+    T_VIRTUAL_CALL();
+    return readSlice_virt(slice, len);
+  }
+  virtual uint32_t readSlice_virt(TBufferSlice& slice, uint32_t len) {
+    if (len == 0) {
+      slice.clear();
+      return 0;
+    }
+    boost::shared_array<uint8_t> buf(new uint8_t[len]);
+    uint32_t got = readAll(buf.get(), len);
+    slice = TBufferSlice(buf, buf.get(), got);
+    return got;
+  }
+
+  /**
+   * Writes the bytes of a slice.
+   *
+   * Transports that collect writes in memory may link the slice into their
+   * output by reference instead of copying it. The default calls write().
+   *
+   * @param slice  The bytes to write
+   * @throws TTransportException if an error occurs
+   */
+  void writeSlice(const TBufferSlice& slice) {
+    T_VIRTUAL_CALL();
+    writeSlice_virt(slice);
+  }
+  virtual void writeSlice_virt(const TBufferSlice& slice) {
+    if (!slice.empty()) {
+      write_virt(slice.data(), slice.size());
+    }
+  }
+
+  /**
+   * Writes a sequence of slices, as if by one write() call per slice.
+   *
+   * Socket transports send them with a single gathering system call. The
+   * slices only need to stay valid for the duration of the call.
+   *
+   * @param slices  The slices to write, in order
+   * @param count   Number of slices
+   * @throws TTransportException if an error occurs
+   */
+  void writeSlices(const TBufferSlice* slices, uint32_t count) {
+    T_VIRTUAL_CALL();
+    writeSlices_virt(slices, count);
+  }
+  virtual void writeSlices_virt(const TBufferSlice* slices, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+      if (!slices[i].empty()) {
+        write_virt(slices[i].data(), slices[i].size());
+      }
+    }
+  }
+
   /**
    * Returns the origin of the transports call. The value depends on the
    * transport used. An IP based transport for example will return the
@@ -21,6 +21,7 @@
 #define _THRIFT_TEST_GENERICPROTOCOLTEST_TCC_ 1
 
 #include <limits>
+#include <vector>
 
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -125,6 +126,62 @@ void testMessage() {
   }
 }
 
+template <typename TProto, TType type, typename Val>
+void testArray(uint32_t (TProtocol::*writeArray)(const Val*, const uint32_t),
+               uint32_t (TProtocol::*readArray)(Val*, const uint32_t),
+               uint32_t (TProtocol::*readElement)(Val&)) {
+  // runs of small values, then values of every length, enough of them to
+  // span several write chunks
+  std::vector<Val> values;
+  for (int i = 0; i < 2500; i++) {
+    uint64_t hash = static_cast<uint64_t>(i) * 0x9E3779B97F4A7C15ULL;
+    values.push_back(i < 500 ? static_cast<Val>(i % 50 - 25)
+                             : static_cast<Val>(static_cast<int64_t>(hash) >> (i % 64)));
+  }
+
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TProtocol> protocol(new TProto(buffer));
+  protocol->writeListBegin(type, static_cast<uint32_t>(values.size()));
+  ((*protocol).*writeArray)(&values[0], static_cast<uint32_t>(values.size()));
+  protocol->writeListEnd();
+  std::string wire = buffer->getBufferAsString();
+
+  // straight out of the memory buffer, then through a buffer that splits
+  // elements
+  TType elemType;
+  uint32_t size;
+  std::vector<Val> out;
+  for (int split = 0; split < 2; split++) {
+    buffer->resetBuffer(reinterpret_cast<uint8_t*>(&wire[0]), static_cast<uint32_t>(wire.size()));
+    shared_ptr<TTransport> transport(buffer);
+    if (split) {
+      transport.reset(new TBufferedTransport(buffer, 13));
+    }
+    protocol.reset(new TProto(transport));
+    protocol->readListBegin(elemType, size);
+    out.assign(size, Val());
+    ((*protocol).*readArray)(&out[0], size);
+    protocol->readListEnd();
+    if (elemType != type || out != values) {
+      THRIFT_SNPRINTF(errorMessage, ERR_LEN, "Invalid array read (type: %s)", typeid(Val).name());
+      throw TException(errorMessage);
+    }
+  }
+
+  // same encoding as the elements one by one
+  buffer->resetBuffer(reinterpret_cast<uint8_t*>(&wire[0]), static_cast<uint32_t>(wire.size()));
+  protocol.reset(new TProto(buffer));
+  protocol->readListBegin(elemType, size);
+  for (uint32_t i = 0; i < size; i++) {
+    ((*protocol).*readElement)(out[i]);
+  }
+  protocol->readListEnd();
+  if (out != values) {
+    THRIFT_SNPRINTF(errorMessage, ERR_LEN, "Invalid array encoding (type: %s)", typeid(Val).name());
+    throw TException(errorMessage);
+  }
+}
+
 template <typename TProto>
 void testProtocol(const char* protoname) {
   try {
@@ -213,6 +270,16 @@ void testProtocol(const char* protoname) {
     testField<TProto, T_STRING, std::string>("borderlinetiny");
     testField<TProto, T_STRING, std::string>("a bit longer than the smallest possible");
 
+    testArray<TProto, T_I32, int32_t>(&TProtocol::writeI32Array,
+                                      &TProtocol::readI32Array,
+                                      &TProtocol::readI32);
+    testArray<TProto, T_I64, int64_t>(&TProtocol::writeI64Array,
+                                      &TProtocol::readI64Array,
+                                      &TProtocol::readI64);
+    testArray<TProto, T_DOUBLE, double>(&TProtocol::writeDoubleArray,
+                                        &TProtocol::readDoubleArray,
+                                        &TProtocol::readDouble);
+
     testMessage<TProto>();
 
     printf("%s => OK\n", protoname);
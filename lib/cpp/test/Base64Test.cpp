@@ -22,6 +22,8 @@
 
 using apache::thrift::protocol::base64_encode;
 using apache::thrift::protocol::base64_decode;
+using apache::thrift::protocol::base64_encode_block;
+using apache::thrift::protocol::base64_decode_block;
 
 BOOST_AUTO_TEST_SUITE(Base64Test)
 
@@ -67,4 +69,31 @@ BOOST_AUTO_TEST_CASE(test_Base64_Encode_Decode) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_Base64_Encode_Decode_Block) {
+  uint8_t input[100];
+  for (int i = 0; i < 100; i++) {
+    input[i] = (uint8_t)(i * 37 + 11);
+  }
+
+  for (uint32_t len = 0; len <= 100; len++) {
+    // same as encoding three bytes at a time
+    uint8_t expected[136];
+    uint32_t expectedLen = 0;
+    for (uint32_t i = 0; i < len; i += 3) {
+      uint32_t n = len - i < 3 ? len - i : 3;
+      base64_encode(input + i, n, expected + expectedLen);
+      expectedLen += n + 1;
+    }
+    uint8_t encoded[136];
+    uint32_t encodedLen = base64_encode_block(input, len, encoded);
+    BOOST_CHECK_EQUAL(expectedLen, encodedLen);
+    BOOST_CHECK(0 == memcmp(expected, encoded, encodedLen));
+    checkEncoding(encoded, encodedLen);
+
+    // decoded in place
+    BOOST_CHECK_EQUAL(len, base64_decode_block(encoded, encodedLen, encoded));
+    BOOST_CHECK(0 == memcmp(input, encoded, len));
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,225 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Throughput of TJSONProtocol writing and reading lists of numbers,
+// strings and binaries.
+//
+// usage: JSONBenchmark [iterations]
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "thrift/concurrency/Util.h"
+#include "thrift/protocol/TJSONProtocol.h"
+#include "thrift/transport/TBufferTransports.h"
+
+using namespace apache::thrift;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+namespace {
+
+const uint32_t LIST_SIZE = 1000;
+
+int64_t nowNsec() {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+  return concurrency::Util::currentTimeUsec() * 1000;
+#endif
+}
+
+// A simple generator so every run sees the same payloads
+struct Random {
+  Random() : state(88172645463325252ULL) {}
+  uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+  uint64_t state;
+};
+
+double rate(int64_t start, int iterations) {
+  return static_cast<double>(LIST_SIZE) * iterations * 1000 / (nowNsec() - start);
+}
+
+template <typename Val>
+void run(const char* name,
+         TType type,
+         const std::vector<Val>& values,
+         uint32_t (TProtocol::*writeValue)(const Val),
+         uint32_t (TProtocol::*readValue)(Val&),
+         int iterations) {
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(LIST_SIZE * 32));
+  boost::shared_ptr<TProtocol> protocol(new TJSONProtocol(buffer));
+  int64_t start = nowNsec();
+  for (int i = 0; i < iterations; ++i) {
+    buffer->resetBuffer();
+    protocol->writeListBegin(type, LIST_SIZE);
+    for (uint32_t j = 0; j < LIST_SIZE; ++j) {
+      ((*protocol).*writeValue)(values[j]);
+    }
+    protocol->writeListEnd();
+  }
+  double write = rate(start, iterations);
+
+  std::string wire = buffer->getBufferAsString();
+  boost::shared_ptr<TMemoryBuffer> input(new TMemoryBuffer());
+  boost::shared_ptr<TProtocol> iprot(new TJSONProtocol(input));
+  std::vector<Val> out(LIST_SIZE);
+  start = nowNsec();
+  for (int i = 0; i < iterations; ++i) {
+    input->resetBuffer(reinterpret_cast<uint8_t*>(&wire[0]), static_cast<uint32_t>(wire.size()));
+    TType elemType;
+    uint32_t size;
+    iprot->readListBegin(elemType, size);
+    for (uint32_t j = 0; j < size; ++j) {
+      ((*iprot).*readValue)(out[j]);
+    }
+    iprot->readListEnd();
+  }
+  double read = rate(start, iterations);
+  if (out != values) {
+    std::cerr << name << ": values read back differ" << std::endl;
+    std::exit(1);
+  }
+
+  std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+            << std::setprecision(2) << " write " << std::setw(6) << write << " M/s   read "
+            << std::setw(6) << read << " M/s" << std::endl;
+}
+
+// Same for a list of strings, or of binaries, in megabytes per second
+void runStrings(const char* name,
+                const std::vector<std::string>& values,
+                bool binary,
+                int iterations) {
+  size_t bytes = 0;
+  for (size_t j = 0; j < values.size(); ++j) {
+    bytes += values[j].size();
+  }
+  const uint32_t size = static_cast<uint32_t>(values.size());
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(static_cast<uint32_t>(bytes * 2)));
+  boost::shared_ptr<TProtocol> protocol(new TJSONProtocol(buffer));
+  int64_t start = nowNsec();
+  for (int i = 0; i < iterations; ++i) {
+    buffer->resetBuffer();
+    protocol->writeListBegin(T_STRING, size);
+    for (uint32_t j = 0; j < size; ++j) {
+      if (binary) {
+        protocol->writeBinary(values[j]);
+      } else {
+        protocol->writeString(values[j]);
+      }
+    }
+    protocol->writeListEnd();
+  }
+  double write = static_cast<double>(bytes) * iterations * 1000 / (nowNsec() - start);
+
+  std::string wire = buffer->getBufferAsString();
+  boost::shared_ptr<TMemoryBuffer> input(new TMemoryBuffer());
+  boost::shared_ptr<TProtocol> iprot(new TJSONProtocol(input));
+  std::vector<std::string> out(size);
+  start = nowNsec();
+  for (int i = 0; i < iterations; ++i) {
+    input->resetBuffer(reinterpret_cast<uint8_t*>(&wire[0]), static_cast<uint32_t>(wire.size()));
+    TType elemType;
+    uint32_t outSize;
+    iprot->readListBegin(elemType, outSize);
+    for (uint32_t j = 0; j < outSize; ++j) {
+      if (binary) {
+        iprot->readBinary(out[j]);
+      } else {
+        iprot->readString(out[j]);
+      }
+    }
+    iprot->readListEnd();
+  }
+  double read = static_cast<double>(bytes) * iterations * 1000 / (nowNsec() - start);
+  if (out != values) {
+    std::cerr << name << ": values read back differ" << std::endl;
+    std::exit(1);
+  }
+
+  std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+            << std::setprecision(2) << " write " << std::setw(6) << write << " MB/s  read "
+            << std::setw(6) << read << " MB/s" << std::endl;
+}
+}
+
+int main(int argc, char** argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+  if (iterations <= 0) {
+    std::cerr << "usage: " << argv[0] << " [iterations]" << std::endl;
+    return 1;
+  }
+
+  Random random;
+  std::vector<int32_t> i32s(LIST_SIZE);
+  std::vector<int64_t> i64s(LIST_SIZE);
+  std::vector<double> prices(LIST_SIZE);
+  std::vector<double> doubles(LIST_SIZE);
+  for (uint32_t i = 0; i < LIST_SIZE; ++i) {
+    i32s[i] = static_cast<int32_t>(random.next() % 2000000) - 1000000;
+    i64s[i] = static_cast<int64_t>(random.next() >> 1);
+    // two decimal places, as money and measurements usually have
+    prices[i] = static_cast<double>(random.next() % 1000000) / 100;
+    doubles[i] = static_cast<double>(random.next() >> 11) / (1ULL << 53) * 1e6;
+  }
+
+  run("i32", T_I32, i32s, &TProtocol::writeI32, &TProtocol::readI32, iterations);
+  run("i64", T_I64, i64s, &TProtocol::writeI64, &TProtocol::readI64, iterations);
+  run("double prices", T_DOUBLE, prices, &TProtocol::writeDouble, &TProtocol::readDouble, iterations);
+  run("double random", T_DOUBLE, doubles, &TProtocol::writeDouble, &TProtocol::readDouble, iterations);
+
+  std::vector<std::string> text;
+  std::vector<std::string> quoted;
+  std::vector<std::string> binaries;
+  const std::string words[] = {"thrift ", "service ", "r\xc3\xa9sum\xc3\xa9 ", "request ", "id "};
+  for (uint32_t i = 0; i < 100; ++i) {
+    // sentences of about 200 characters, some with quotes and line breaks
+    std::string sentence;
+    while (sentence.size() < 200) {
+      sentence += words[random.next() % 5];
+    }
+    text.push_back(sentence);
+    sentence.insert(random.next() % sentence.size(), "\"quoted\"\n");
+    quoted.push_back(sentence);
+    std::string blob(4096, '\0');
+    for (size_t j = 0; j < blob.size(); ++j) {
+      blob[j] = static_cast<char>(random.next());
+    }
+    binaries.push_back(blob);
+  }
+  runStrings("string plain", text, false, iterations / 2);
+  runStrings("string escapes", quoted, false, iterations / 2);
+  runStrings("binary 4k", binaries, true, iterations / 20);
+  return 0;
+}
@@ -20,6 +20,7 @@
 #define _USE_MATH_DEFINES
 #include <iostream>
 #include <cmath>
+#include <limits>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/protocol/TJSONProtocol.h>
 #include "gen-cpp/DebugProtoTest_types.h"
@@ -135,6 +136,102 @@ int main() {
   dub.negzero = -0.0;
   cout << apache::thrift::ThriftJSONString(dub) << endl << endl;
 
+  cout << "Testing numbers" << endl;
+
+  // integer extremes read back exactly
+  const int64_t ints[] = {0,
+                          -1,
+                          (std::numeric_limits<int32_t>::min)(),
+                          (std::numeric_limits<int32_t>::max)(),
+                          (std::numeric_limits<int64_t>::min)(),
+                          (std::numeric_limits<int64_t>::max)()};
+  const uint32_t numInts = sizeof(ints) / sizeof(ints[0]);
+  proto->writeListBegin(apache::thrift::protocol::T_I64, numInts);
+  for (uint32_t i = 0; i < numInts; i++) {
+    proto->writeI64(ints[i]);
+  }
+  proto->writeListEnd();
+  apache::thrift::protocol::TType elemType;
+  uint32_t size;
+  proto->readListBegin(elemType, size);
+  assert(size == numInts);
+  for (uint32_t i = 0; i < numInts; i++) {
+    int64_t i64;
+    proto->readI64(i64);
+    assert(i64 == ints[i]);
+  }
+  proto->readListEnd();
+
+  // doubles are written in the shortest form that reads back exactly
+  const double dubs[] = {0.1, 100, 1E+21, -2.5, 1.7976931348623157E+308};
+  const uint32_t numDubs = sizeof(dubs) / sizeof(dubs[0]);
+  proto->writeListBegin(apache::thrift::protocol::T_DOUBLE, numDubs);
+  for (uint32_t i = 0; i < numDubs; i++) {
+    proto->writeDouble(dubs[i]);
+  }
+  proto->writeListEnd();
+  assert(buffer->getBufferAsString() == "[\"dbl\",5,0.1,100,1e+21,-2.5,1.7976931348623157e+308]");
+  proto->readListBegin(elemType, size);
+  for (uint32_t i = 0; i < numDubs; i++) {
+    double d;
+    proto->readDouble(d);
+    assert(d == dubs[i]);
+  }
+  proto->readListEnd();
+
+  // values that do not fit are rejected
+  buffer->resetBuffer();
+  const std::string tooBig("[\"i32\",1,2147483648]");
+  buffer->write(reinterpret_cast<const uint8_t*>(tooBig.data()),
+                static_cast<uint32_t>(tooBig.size()));
+  bool rejected = false;
+  try {
+    proto->readListBegin(elemType, size);
+    int32_t i32;
+    proto->readI32(i32);
+  } catch (apache::thrift::protocol::TProtocolException& e) {
+    rejected = e.getType() == apache::thrift::protocol::TProtocolException::INVALID_DATA;
+  }
+  assert(rejected);
+  buffer->resetBuffer();
+  proto.reset(new TJSONProtocol(buffer));
+
+  cout << "Testing strings" << endl;
+
+  // escapes at every position of the words the writer scans, and binary
+  // longer than the base64 buffer
+  std::string plain("plain text that needs no escaping at all, \xc3\xa9t\xc3\xa9");
+  std::string escaped;
+  for (int i = 0; i < 40; i++) {
+    escaped += std::string(i % 9, 'x') + "\"\\\n\x01/";
+  }
+  std::string binary;
+  for (int i = 0; i < 10000; i++) {
+    binary += static_cast<char>(i * 131 % 256);
+  }
+  buffer->resetBuffer();
+  proto->writeString("a\"b\\c\td\x1f");
+  assert(buffer->getBufferAsString() == "\"a\\\"b\\\\c\\td\\u001f\"");
+  proto->writeString(plain);
+  proto->writeString(escaped);
+  for (size_t len = 0; len < 8; len++) {
+    proto->writeBinary(binary.substr(0, len));
+  }
+  proto->writeBinary(binary);
+  std::string str;
+  proto->readString(str);
+  assert(str == "a\"b\\c\td\x1f");
+  proto->readString(str);
+  assert(str == plain);
+  proto->readString(str);
+  assert(str == escaped);
+  for (size_t len = 0; len < 8; len++) {
+    proto->readBinary(str);
+    assert(str == binary.substr(0, len));
+  }
+  proto->readBinary(str);
+  assert(str == binary);
+
   cout << "Testing base" << endl;
 
   Base64 base;
@@ -0,0 +1,186 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Round trip latency of a small RPC over TShmTransport compared to a
+// TSocket on a unix domain socket.
+//
+// usage: ShmBenchmark [iterations]
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <boost/make_shared.hpp>
+#include <time.h>
+#include <unistd.h>
+
+#include "thrift/concurrency/PlatformThreadFactory.h"
+#include "thrift/concurrency/Util.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/server/TSimpleServer.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/TServerSocket.h"
+#include "thrift/transport/TShmTransport.h"
+#include "thrift/transport/TSocket.h"
+#include "gen-cpp/ParentService.h"
+
+using namespace apache::thrift;
+using namespace apache::thrift::concurrency;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::server;
+using namespace apache::thrift::transport;
+
+namespace {
+
+struct Handler : public test::ParentServiceIf {
+  int32_t incrementGeneration() { return 0; }
+  int32_t getGeneration() { return 42; }
+  void addString(const std::string&) {}
+  void getStrings(std::vector<std::string>&) {}
+  void getDataWait(std::string&, int32_t) {}
+  void onewayWait() {}
+  void exceptionWait(const std::string&) {}
+  void unexpectedExceptionWait(const std::string&) {}
+};
+
+struct Runner : public Runnable {
+  boost::shared_ptr<TServer> server;
+  virtual void run() { server->serve(); }
+};
+
+int64_t nowNsec() {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+  return Util::currentTimeUsec() * 1000;
+#endif
+}
+
+void run(const char* name,
+         const boost::shared_ptr<TServer>& server,
+         const boost::shared_ptr<TTransport>& transport,
+         int iterations) {
+  boost::shared_ptr<Runner> runner(new Runner);
+  runner->server = server;
+  boost::shared_ptr<Thread> thread = PlatformThreadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+                                         PlatformThreadFactory::OTHER,
+                                         PlatformThreadFactory::NORMAL,
+                                         1,
+#endif
+                                         false).newThread(runner);
+  thread->start();
+
+  for (int i = 0;; ++i) {
+    try {
+      transport->open();
+      break;
+    } catch (const TTransportException&) {
+      if (i == 100) {
+        throw;
+      }
+      THRIFT_SLEEP_USEC(10000);
+    }
+  }
+
+  test::ParentServiceClient client(boost::make_shared<TBinaryProtocol>(transport));
+  // warm up
+  for (int i = 0; i < iterations / 10; ++i) {
+    client.getGeneration();
+  }
+
+  std::vector<int64_t> samples(iterations);
+  int64_t start = nowNsec();
+  for (int i = 0; i < iterations; ++i) {
+    int64_t before = nowNsec();
+    client.getGeneration();
+    samples[i] = nowNsec() - before;
+  }
+  int64_t total = nowNsec() - start;
+
+  transport->close();
+  server->stop();
+  thread->join();
+
+  std::sort(samples.begin(), samples.end());
+  std::cout << std::left << std::setw(20) << name << std::right << std::fixed
+            << std::setprecision(2) << " avg " << std::setw(8) << total / 1000.0 / iterations
+            << " us  p50 " << std::setw(8) << samples[iterations / 2] / 1000.0 << " us  p99 "
+            << std::setw(8) << samples[iterations * 99 / 100] / 1000.0 << " us" << std::endl;
+}
+
+std::string socketPath(const char* name) {
+  std::ostringstream path;
+  path << "/tmp/ShmBenchmark." << getpid() << "." << name;
+  unlink(path.str().c_str());
+  return path.str();
+}
+}
+
+int main(int argc, char** argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+  if (iterations <= 0) {
+    std::cerr << "usage: " << argv[0] << " [iterations]" << std::endl;
+    return 1;
+  }
+  boost::shared_ptr<TProcessor> processor(
+      new test::ParentServiceProcessor(boost::make_shared<Handler>()));
+  boost::shared_ptr<TProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
+
+  {
+    std::string path = socketPath("sock");
+    boost::shared_ptr<TServer> server(new TSimpleServer(processor,
+                                                        boost::make_shared<TServerSocket>(path),
+                                                        boost::make_shared<TBufferedTransportFactory>(),
+                                                        protocolFactory));
+    boost::shared_ptr<TTransport> transport(
+        new TBufferedTransport(boost::make_shared<TSocket>(path)));
+    run("unix socket", server, transport, iterations);
+    unlink(path.c_str());
+  }
+
+  if (!TShmTransport::isSupported()) {
+    std::cout << "shared memory transport not supported" << std::endl;
+    return 0;
+  }
+
+  std::string path = socketPath("shm");
+  boost::shared_ptr<TServer> server(new TSimpleServer(processor,
+                                                      boost::make_shared<TShmServerTransport>(path),
+                                                      boost::make_shared<TTransportFactory>(),
+                                                      protocolFactory));
+  boost::shared_ptr<TShmTransport> transport(new TShmTransport(path));
+  run("shm", server, transport, iterations);
+
+  server.reset(new TSimpleServer(processor,
+                                 boost::make_shared<TShmServerTransport>(path),
+                                 boost::make_shared<TTransportFactory>(),
+                                 protocolFactory));
+  transport.reset(new TShmTransport(path));
+  transport->setSpinCount(0);
+  run("shm, sleep only", server, transport, iterations);
+  return 0;
+}
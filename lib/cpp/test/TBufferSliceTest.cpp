@@ -0,0 +1,170 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TBufferSliceTest
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/TBufferSlice.h>
+#include <thrift/TToString.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/proc_types.h"
+
+using apache::thrift::TBufferSlice;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::test::Blob;
+using boost::shared_ptr;
+
+namespace {
+
+Blob makeBlob(const std::string& name, uint32_t size) {
+  Blob blob;
+  blob.name = name;
+  std::string data(size, '\0');
+  for (uint32_t i = 0; i < size; ++i) {
+    data[i] = static_cast<char>(i * 7);
+  }
+  blob.data.assign(data);
+  return blob;
+}
+
+bool within(const TBufferSlice& slice, const uint8_t* begin, const uint8_t* end) {
+  return slice.begin() >= begin && slice.end() <= end;
+}
+
+// Writes two framed messages of two blobs each, then reads them back and
+// checks that the blobs of one frame alias a single buffer.
+template <typename Protocol>
+void checkFramedSlices() {
+  shared_ptr<TMemoryBuffer> pipe(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> out(new TFramedTransport(pipe));
+  Protocol oprot(out);
+  std::vector<Blob> sent;
+  for (int i = 0; i < 4; ++i) {
+    sent.push_back(makeBlob("blob", 65536 + i));
+    sent.back().write(&oprot);
+    if (i % 2) {
+      out->flush();
+    }
+  }
+
+  shared_ptr<TFramedTransport> in(new TFramedTransport(pipe));
+  Protocol iprot(in);
+  std::vector<Blob> received(4);
+  for (size_t i = 0; i < received.size(); ++i) {
+    received[i].read(static_cast<TProtocol*>(&iprot));
+    BOOST_CHECK(received[i] == sent[i]);
+  }
+
+  const boost::shared_array<uint8_t>& first = received[0].data.owner();
+  const boost::shared_array<uint8_t>& second = received[2].data.owner();
+  BOOST_CHECK(first.get() == received[1].data.owner().get());
+  BOOST_CHECK(second.get() == received[3].data.owner().get());
+  // the first frame is still referenced, so the second got its own buffer
+  BOOST_CHECK(first.get() != second.get());
+  BOOST_CHECK(within(received[0].data, first.get(), received[1].data.begin()));
+
+  // the slices stay valid once the transport is gone
+  in.reset();
+  pipe.reset();
+  for (size_t i = 0; i < received.size(); ++i) {
+    BOOST_CHECK(received[i].data == sent[i].data);
+  }
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TBufferSliceTest)
+
+BOOST_AUTO_TEST_CASE(test_slice_basics) {
+  TBufferSlice empty;
+  BOOST_CHECK(empty.empty());
+  BOOST_CHECK_EQUAL(std::string(), empty.str());
+
+  TBufferSlice abc(std::string("abc"));
+  TBufferSlice abd(reinterpret_cast<const uint8_t*>("abd"), 3);
+  BOOST_CHECK_EQUAL(3u, abc.size());
+  BOOST_CHECK(abc != abd);
+  BOOST_CHECK(abc < abd);
+  BOOST_CHECK(empty < abc);
+  BOOST_CHECK(abc == TBufferSlice(std::string("abc")));
+  BOOST_CHECK_EQUAL("abc", apache::thrift::to_string(abc));
+
+  TBufferSlice alias(abc.owner(), abc.data() + 1, 2);
+  BOOST_CHECK_EQUAL("bc", alias.str());
+  abc.clear();
+  BOOST_CHECK_EQUAL("bc", alias.str());
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_framed) {
+  checkFramedSlices<TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_framed) {
+  checkFramedSlices<TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_buffer_frame) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol oprot(buffer);
+  Blob sent = makeBlob("blob", 1000);
+  sent.write(&oprot);
+
+  uint8_t* data;
+  uint32_t size;
+  buffer->getBuffer(&data, &size);
+  boost::shared_array<uint8_t> frame(new uint8_t[size]);
+  memcpy(frame.get(), data, size);
+
+  shared_ptr<TMemoryBuffer> in(new TMemoryBuffer());
+  in->resetBuffer(frame, size);
+  TBinaryProtocol iprot(in);
+  Blob received;
+  received.read(&iprot);
+  BOOST_CHECK(received == sent);
+  BOOST_CHECK(received.data.owner().get() == frame.get());
+  BOOST_CHECK(within(received.data, frame.get(), frame.get() + size));
+
+  // without a shared frame the bytes are copied
+  shared_ptr<TMemoryBuffer> observed(new TMemoryBuffer(frame.get(), size));
+  TBinaryProtocol cprot(observed);
+  Blob copied;
+  copied.read(&cprot);
+  BOOST_CHECK(copied == sent);
+  BOOST_CHECK(!within(copied.data, frame.get(), frame.get() + size));
+}
+
+BOOST_AUTO_TEST_CASE(test_other_protocols_copy) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TJSONProtocol prot(buffer);
+  Blob sent = makeBlob("blob", 300);
+  sent.write(static_cast<TProtocol*>(&prot));
+  Blob received;
+  received.read(static_cast<TProtocol*>(&prot));
+  BOOST_CHECK(received == sent);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,236 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+using apache::thrift::TBufferSlice;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::transport::TChainedBuffer;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransport;
+using boost::shared_ptr;
+
+namespace {
+
+std::string pattern(uint32_t size, int seed) {
+  std::string str(size, '\0');
+  for (uint32_t i = 0; i < size; ++i) {
+    str[i] = static_cast<char>(i * 13 + seed);
+  }
+  return str;
+}
+
+// Records how the bytes written to it arrive
+class RecordingTransport : public TTransport {
+public:
+  RecordingTransport() : writeCalls(0), writeSlicesCalls(0) {}
+
+  virtual void write_virt(const uint8_t* buf, uint32_t len) {
+    ++writeCalls;
+    data.append(reinterpret_cast<const char*>(buf), len);
+  }
+
+  virtual void writeSlices_virt(const TBufferSlice* slices, uint32_t count) {
+    ++writeSlicesCalls;
+    for (uint32_t i = 0; i < count; ++i) {
+      pointers.push_back(slices[i].data());
+      data.append(slices[i].str());
+    }
+  }
+
+  virtual void flush() {}
+
+  int writeCalls;
+  int writeSlicesCalls;
+  std::vector<const uint8_t*> pointers;
+  std::string data;
+};
+}
+
+BOOST_AUTO_TEST_SUITE(TChainedBufferTest)
+
+BOOST_AUTO_TEST_CASE(test_segments) {
+  TChainedBuffer chain(16);
+  std::string expected = pattern(100, 1);
+  for (size_t pos = 0; pos < expected.size(); pos += 7) {
+    std::string piece = expected.substr(pos, 7);
+    chain.write(reinterpret_cast<const uint8_t*>(piece.data()), static_cast<uint32_t>(piece.size()));
+  }
+  BOOST_CHECK_EQUAL(100u, chain.available_read());
+  BOOST_CHECK_EQUAL(7u, chain.getSegmentCount());
+  BOOST_CHECK(expected == chain.getBufferAsString());
+
+  // reads cross segment boundaries
+  std::string got;
+  uint8_t buf[11];
+  while (uint32_t n = chain.read(buf, sizeof(buf))) {
+    got.append(reinterpret_cast<char*>(buf), n);
+  }
+  BOOST_CHECK(expected == got);
+  BOOST_CHECK_EQUAL(0u, chain.available_read());
+
+  // writes larger than a segment get one segment of their own
+  std::string big = pattern(1000, 2);
+  chain.write(reinterpret_cast<const uint8_t*>(big.data()), static_cast<uint32_t>(big.size()));
+  BOOST_CHECK_LE(chain.getSegmentCount(), 2u);
+  uint32_t len = 10;
+  const uint8_t* borrowed = chain.borrow(NULL, &len);
+  BOOST_REQUIRE(borrowed != NULL);
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(borrowed), 10) == big.substr(0, 10));
+  chain.consume(10);
+  BOOST_CHECK(big.substr(10) == chain.getBufferAsString());
+}
+
+BOOST_AUTO_TEST_CASE(test_reset_reuses_segment) {
+  TChainedBuffer chain(64);
+  chain.write(reinterpret_cast<const uint8_t*>("hello"), 5);
+  std::vector<TBufferSlice> slices;
+  chain.getSlices(slices);
+  BOOST_REQUIRE_EQUAL(1u, slices.size());
+  const uint8_t* first = slices[0].data();
+  slices.clear();
+
+  chain.resetBuffer();
+  BOOST_CHECK_EQUAL(0u, chain.available_read());
+  chain.write(reinterpret_cast<const uint8_t*>("world"), 5);
+  chain.getSlices(slices);
+  BOOST_REQUIRE_EQUAL(1u, slices.size());
+  BOOST_CHECK(first == slices[0].data());
+  BOOST_CHECK_EQUAL("world", slices[0].str());
+}
+
+BOOST_AUTO_TEST_CASE(test_links_large_binary) {
+  shared_ptr<TChainedBuffer> chain(new TChainedBuffer(256, 1024));
+  TBinaryProtocol prot(chain);
+  TBufferSlice small(std::string("tiny"));
+  TBufferSlice large(pattern(5000, 3));
+
+  prot.writeBinary(small);
+  prot.writeBinary(large);
+  prot.writeI32(42);
+
+  // header + small, the linked slice, then the trailing i32
+  std::vector<TBufferSlice> slices;
+  chain->getSlices(slices);
+  BOOST_REQUIRE_EQUAL(3u, slices.size());
+  BOOST_CHECK(slices[1].data() == large.data());
+  BOOST_CHECK(slices[1].owner() == large.owner());
+
+  TBufferSlice readSmall, readLarge;
+  int32_t i32;
+  prot.readBinary(readSmall);
+  prot.readBinary(readLarge);
+  prot.readI32(i32);
+  BOOST_CHECK(readSmall == small);
+  BOOST_CHECK(readLarge == large);
+  // the linked segment is handed back out without a copy
+  BOOST_CHECK(readLarge.data() == large.data());
+  BOOST_CHECK_EQUAL(42, i32);
+}
+
+BOOST_AUTO_TEST_CASE(test_write_to_gathers) {
+  TChainedBuffer chain(128);
+  std::string head = pattern(300, 4);
+  TBufferSlice body(pattern(2000, 5));
+  std::string tail = pattern(50, 6);
+  chain.write(reinterpret_cast<const uint8_t*>(head.data()), static_cast<uint32_t>(head.size()));
+  chain.append(body);
+  chain.write(reinterpret_cast<const uint8_t*>(tail.data()), static_cast<uint32_t>(tail.size()));
+
+  RecordingTransport out;
+  chain.writeTo(out);
+  BOOST_CHECK_EQUAL(0, out.writeCalls);
+  BOOST_CHECK_EQUAL(1, out.writeSlicesCalls);
+  BOOST_CHECK(head + body.str() + tail == out.data);
+  BOOST_CHECK(std::find(out.pointers.begin(), out.pointers.end(), body.data())
+              != out.pointers.end());
+  BOOST_CHECK_EQUAL(0u, chain.available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_framed_links_slices) {
+  shared_ptr<RecordingTransport> out(new RecordingTransport);
+  shared_ptr<TFramedTransport> framed(new TFramedTransport(out));
+  TBinaryProtocol prot(framed);
+  TBufferSlice payload(pattern(TFramedTransport::MIN_LINK_SIZE * 2, 7));
+
+  prot.writeI32(1);
+  prot.writeBinary(payload);
+  prot.writeI32(2);
+  BOOST_CHECK_EQUAL(4u + 4u + 4u + payload.size() + 4u, framed->writeEnd());
+  framed->flush();
+  BOOST_CHECK_EQUAL(0, out->writeCalls);
+  BOOST_CHECK_EQUAL(1, out->writeSlicesCalls);
+  BOOST_CHECK(std::find(out->pointers.begin(), out->pointers.end(), payload.data())
+              != out->pointers.end());
+
+  // the frame reads back normally
+  shared_ptr<TMemoryBuffer> in(new TMemoryBuffer());
+  in->write(reinterpret_cast<const uint8_t*>(out->data.data()),
+            static_cast<uint32_t>(out->data.size()));
+  TBinaryProtocol iprot(shared_ptr<TTransport>(new TFramedTransport(in)));
+  int32_t first, second;
+  TBufferSlice readPayload;
+  iprot.readI32(first);
+  iprot.readBinary(readPayload);
+  iprot.readI32(second);
+  BOOST_CHECK_EQUAL(1, first);
+  BOOST_CHECK(readPayload == payload);
+  BOOST_CHECK_EQUAL(2, second);
+
+  // a frame without links takes the plain write path
+  prot.writeI32(3);
+  framed->flush();
+  BOOST_CHECK_EQUAL(1, out->writeCalls);
+  BOOST_CHECK_EQUAL(1, out->writeSlicesCalls);
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(test_socket_gather_write) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  shared_ptr<TSocket> writer(new TSocket(fds[0]));
+  TSocket reader(fds[1]);
+
+  std::vector<TBufferSlice> slices;
+  std::string expected;
+  for (int i = 0; i < 50; ++i) {
+    slices.push_back(TBufferSlice(pattern(100 + i, i)));
+    expected += slices.back().str();
+  }
+  slices.push_back(TBufferSlice());
+  writer->writeSlices(&slices[0], static_cast<uint32_t>(slices.size()));
+
+  std::string got(expected.size(), '\0');
+  reader.readAll(reinterpret_cast<uint8_t*>(&got[0]), static_cast<uint32_t>(got.size()));
+  BOOST_CHECK(expected == got);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <string>
+#include <vector>
+#include <thrift/transport/TConnectionPool.h>
+#include <thrift/transport/TServerSocket.h>
+
+using apache::thrift::transport::TConnectionLease;
+using apache::thrift::transport::TConnectionPool;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TSocketPoolServer;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using boost::shared_ptr;
+
+namespace {
+
+// Listens on an ephemeral loopback port; accepted connections are kept
+// open until the fixture goes away
+class PoolFixture {
+protected:
+  PoolFixture() : server(new TServerSocket(0)) {
+    server->listen();
+    port = server->getPort();
+    pool.addServer("127.0.0.1", port);
+  }
+
+  ~PoolFixture() {
+    pool.clear();
+    for (size_t i = 0; i < accepted.size(); ++i) {
+      accepted[i]->close();
+    }
+    server->close();
+  }
+
+  shared_ptr<TTransport> accept() {
+    accepted.push_back(server->accept());
+    return accepted.back();
+  }
+
+  shared_ptr<TServerSocket> server;
+  std::vector<shared_ptr<TTransport> > accepted;
+  int port;
+  TConnectionPool pool;
+};
+}
+
+BOOST_AUTO_TEST_SUITE(TConnectionPoolTest)
+
+BOOST_FIXTURE_TEST_CASE(test_reuse, PoolFixture) {
+  shared_ptr<TSocket> socket;
+  {
+    TConnectionLease lease = pool.checkout();
+    accept();
+    BOOST_CHECK(lease.valid());
+    BOOST_CHECK(!lease.isReused());
+    BOOST_CHECK_EQUAL(port, lease->getPort());
+    socket = lease.getSocket();
+    TConnectionLease copy = lease;
+  }
+  BOOST_CHECK_EQUAL(1u, pool.getNumIdle());
+
+  TConnectionLease lease = pool.checkout();
+  BOOST_CHECK(lease.isReused());
+  BOOST_CHECK(lease.getSocket() == socket);
+  BOOST_CHECK_EQUAL(0u, pool.getNumIdle());
+  BOOST_CHECK_EQUAL(1u, pool.getNumCreated());
+  BOOST_CHECK_EQUAL(1u, pool.getNumReused());
+
+  lease.release();
+  BOOST_CHECK(!lease.valid());
+  BOOST_CHECK_EQUAL(1u, pool.getNumIdle());
+}
+
+BOOST_FIXTURE_TEST_CASE(test_max_idle, PoolFixture) {
+  pool.setMaxIdlePerHost(2);
+  std::vector<TConnectionLease> leases;
+  for (int i = 0; i < 4; ++i) {
+    leases.push_back(pool.checkout());
+    accept();
+  }
+  std::vector<shared_ptr<TSocket> > sockets;
+  for (size_t i = 0; i < leases.size(); ++i) {
+    sockets.push_back(leases[i].getSocket());
+  }
+  leases.clear();
+  BOOST_CHECK_EQUAL(2u, pool.getNumIdle());
+  BOOST_CHECK(sockets[0]->isOpen());
+  BOOST_CHECK(sockets[1]->isOpen());
+  BOOST_CHECK(!sockets[2]->isOpen());
+  BOOST_CHECK(!sockets[3]->isOpen());
+
+  // the most recently released connection goes out first
+  BOOST_CHECK(pool.checkout().getSocket() == sockets[1]);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_idle_timeout, PoolFixture) {
+  pool.setIdleTimeout(20);
+  shared_ptr<TSocket> socket = pool.checkout().getSocket();
+  accept();
+  BOOST_CHECK_EQUAL(1u, pool.getNumIdle());
+  usleep(50 * 1000);
+
+  TConnectionLease lease = pool.checkout();
+  accept();
+  BOOST_CHECK(!lease.isReused());
+  BOOST_CHECK(!socket->isOpen());
+  BOOST_CHECK_EQUAL(2u, pool.getNumCreated());
+}
+
+BOOST_FIXTURE_TEST_CASE(test_validate, PoolFixture) {
+  shared_ptr<TSocket> socket = pool.checkout().getSocket();
+  accept()->close();
+  usleep(10 * 1000);
+
+  // the peer closed the idle connection, so a new one is opened
+  TConnectionLease lease = pool.checkout();
+  accept();
+  BOOST_CHECK(!lease.isReused());
+  BOOST_CHECK(lease.getSocket() != socket);
+  BOOST_CHECK(!socket->isOpen());
+}
+
+BOOST_FIXTURE_TEST_CASE(test_invalidate, PoolFixture) {
+  TConnectionLease lease = pool.checkout();
+  accept();
+  shared_ptr<TSocket> socket = lease.getSocket();
+  lease.invalidate();
+  BOOST_CHECK(!lease.valid());
+  BOOST_CHECK(!socket->isOpen());
+  BOOST_CHECK_EQUAL(0u, pool.getNumIdle());
+}
+
+BOOST_AUTO_TEST_CASE(test_failover) {
+  // grab a port nobody listens on
+  int deadPort;
+  {
+    TServerSocket dead(0);
+    dead.listen();
+    deadPort = dead.getPort();
+    dead.close();
+  }
+  TServerSocket server(0);
+  server.listen();
+
+  shared_ptr<TSocketPoolServer> down(new TSocketPoolServer("127.0.0.1", deadPort));
+  shared_ptr<TSocketPoolServer> up(new TSocketPoolServer("127.0.0.1", server.getPort()));
+  std::vector<shared_ptr<TSocketPoolServer> > servers;
+  servers.push_back(down);
+  servers.push_back(up);
+  TConnectionPool pool(servers);
+  pool.setRandomize(false);
+  pool.setMaxConsecutiveFailures(0);
+
+  TConnectionLease lease = pool.checkout();
+  BOOST_CHECK(lease.getServer() == up);
+  BOOST_CHECK(down->getLastFailTime() > 0);
+  BOOST_CHECK(up->getLastFailTime() == 0);
+
+  BOOST_CHECK_THROW(pool.checkout(down), TTransportException);
+  lease.invalidate();
+  server.close();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
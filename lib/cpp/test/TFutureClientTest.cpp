@@ -0,0 +1,322 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TFutureClientTest
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/smart_ptr.hpp>
+
+#include "thrift/async/TFutureChannel.h"
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/concurrency/PlatformThreadFactory.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/server/TThreadedServer.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/TServerSocket.h"
+#include "thrift/transport/TSocket.h"
+
+#include "gen-cpp/ChildService.h"
+
+using namespace apache::thrift;
+using apache::thrift::async::TFuture;
+using apache::thrift::async::TFutureChannel;
+using apache::thrift::transport::TTransportException;
+using boost::shared_ptr;
+using test::ChildServiceFutureClient;
+
+namespace {
+
+struct Handler : public test::ChildServiceIf {
+  Handler() : value(0) {}
+
+  int32_t getGeneration() { return 7; }
+  void addString(const std::string& s) {
+    concurrency::Guard g(mutex);
+    strings.push_back(s);
+  }
+  void getStrings(std::vector<std::string>& _return) {
+    concurrency::Guard g(mutex);
+    _return = strings;
+  }
+  void getDataWait(std::string& _return, int32_t length) { _return.assign(length, 'x'); }
+  void exceptionWait(const std::string& message) {
+    test::MyError e;
+    e.message = message;
+    throw e;
+  }
+  int32_t setValue(int32_t v) {
+    concurrency::Guard g(mutex);
+    int32_t old = value;
+    value = v;
+    return old;
+  }
+  int32_t getValue() {
+    concurrency::Guard g(mutex);
+    return value;
+  }
+
+  // dummy overrides not used in this test
+  int32_t incrementGeneration() { return 0; }
+  void onewayWait() {}
+  void unexpectedExceptionWait(const std::string&) {}
+
+  concurrency::Mutex mutex;
+  std::vector<std::string> strings;
+  int32_t value;
+};
+
+// A framed threaded server on an ephemeral port
+class Backend : public server::TServerEventHandler,
+                public concurrency::Runnable,
+                public boost::enable_shared_from_this<Backend> {
+public:
+  Backend() : handler(new Handler), socket(new transport::TServerSocket(0)), ready(false) {
+    server.reset(new server::TThreadedServer(
+        boost::make_shared<test::ChildServiceProcessor>(handler),
+        socket,
+        boost::make_shared<transport::TFramedTransportFactory>(),
+        boost::make_shared<protocol::TBinaryProtocolFactory>()));
+  }
+
+  void start() {
+    server->setServerEventHandler(shared_from_this());
+    thread = concurrency::PlatformThreadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+                 concurrency::PlatformThreadFactory::OTHER,
+                 concurrency::PlatformThreadFactory::NORMAL,
+                 1,
+#endif
+                 false).newThread(shared_from_this());
+    thread->start();
+    concurrency::Synchronized s(monitor);
+    while (!ready) {
+      monitor.wait();
+    }
+  }
+
+  void stop() {
+    server->stop();
+    thread->join();
+    server->setServerEventHandler(shared_ptr<server::TServerEventHandler>());
+  }
+
+  virtual void preServe() {
+    concurrency::Synchronized s(monitor);
+    ready = true;
+    monitor.notify();
+  }
+
+  virtual void run() { server->serve(); }
+
+  int port() { return socket->getPort(); }
+
+  shared_ptr<Handler> handler;
+
+private:
+  shared_ptr<transport::TServerSocket> socket;
+  shared_ptr<server::TThreadedServer> server;
+  shared_ptr<concurrency::Thread> thread;
+  concurrency::Monitor monitor;
+  bool ready;
+};
+
+shared_ptr<TFutureChannel> connect(int port) {
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("127.0.0.1", port));
+  socket->open();
+  return boost::make_shared<TFutureChannel>(socket,
+                                            boost::make_shared<protocol::TBinaryProtocolFactory>());
+}
+
+std::string readFrame(transport::TTransport& transport) {
+  uint8_t header[4];
+  transport.readAll(header, sizeof(header));
+  uint32_t size = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+  std::string frame(size, '\0');
+  transport.readAll(reinterpret_cast<uint8_t*>(&frame[0]), size);
+  return frame;
+}
+
+void writeFrame(transport::TTransport& transport, const std::string& frame) {
+  uint32_t size = static_cast<uint32_t>(frame.size());
+  uint8_t header[4] = {static_cast<uint8_t>(size >> 24),
+                       static_cast<uint8_t>(size >> 16),
+                       static_cast<uint8_t>(size >> 8),
+                       static_cast<uint8_t>(size)};
+  transport.write(header, sizeof(header));
+  transport.write(reinterpret_cast<const uint8_t*>(frame.data()), size);
+  transport.flush();
+}
+
+void record(concurrency::Mutex* mutex, std::vector<int>* order, int call) {
+  concurrency::Guard g(*mutex);
+  order->push_back(call);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TFutureClientTest)
+
+BOOST_AUTO_TEST_CASE(test_pipelined) {
+  shared_ptr<Backend> backend(new Backend);
+  backend->start();
+  {
+    ChildServiceFutureClient client(connect(backend->port()));
+
+    // all calls are on the wire before the first reply is looked at
+    TFuture<void> added = client.addString("a");
+    TFuture<int32_t> generation = client.getGeneration();
+    TFuture<int32_t> old = client.setValue(5);
+    TFuture<int32_t> value = client.getValue();
+    TFuture<std::vector<std::string> > strings = client.getStrings();
+
+    added.get();
+    BOOST_CHECK_EQUAL(7, generation.get());
+    BOOST_CHECK_EQUAL(0, old.get());
+    BOOST_CHECK_EQUAL(5, value.get());
+    BOOST_REQUIRE_EQUAL(1u, strings.get().size());
+    BOOST_CHECK_EQUAL("a", strings.get()[0]);
+    BOOST_CHECK_EQUAL(0u, client.getChannel()->getNumOutstanding());
+  }
+  backend->stop();
+}
+
+BOOST_AUTO_TEST_CASE(test_exception) {
+  shared_ptr<Backend> backend(new Backend);
+  backend->start();
+  {
+    ChildServiceFutureClient client(connect(backend->port()));
+
+    TFuture<void> failed = client.exceptionWait("boom");
+    TFuture<std::string> data = client.getDataWait(3);
+    try {
+      failed.get();
+      BOOST_FAIL("expected MyError");
+    } catch (const test::MyError& e) {
+      BOOST_CHECK_EQUAL("boom", e.message);
+    }
+    // the other call is not affected
+    BOOST_CHECK_EQUAL("xxx", data.get());
+  }
+  backend->stop();
+}
+
+BOOST_AUTO_TEST_CASE(test_out_of_order) {
+  transport::TServerSocket server(0);
+  server.listen();
+  shared_ptr<TFutureChannel> channel = connect(server.getPort());
+  ChildServiceFutureClient client(channel);
+
+  concurrency::Mutex mutex;
+  std::vector<int> order;
+  std::vector<TFuture<std::string> > calls;
+  for (int i = 0; i < 3; ++i) {
+    calls.push_back(client.getDataWait(i + 1));
+    calls.back().then(boost::bind(record, &mutex, &order, i));
+  }
+
+  // answer the calls in reverse order
+  shared_ptr<transport::TTransport> accepted = server.accept();
+  shared_ptr<Handler> handler(new Handler);
+  test::ChildServiceProcessor processor(handler);
+  protocol::TBinaryProtocolFactory protocolFactory;
+  std::vector<std::string> replies;
+  for (int i = 0; i < 3; ++i) {
+    std::string request = readFrame(*accepted);
+    shared_ptr<transport::TMemoryBuffer> in(
+        new transport::TMemoryBuffer(reinterpret_cast<uint8_t*>(&request[0]),
+                                     static_cast<uint32_t>(request.size())));
+    shared_ptr<transport::TMemoryBuffer> out(new transport::TMemoryBuffer());
+    processor.process(protocolFactory.getProtocol(in), protocolFactory.getProtocol(out), NULL);
+    replies.push_back(out->getBufferAsString());
+  }
+  for (int i = 2; i >= 0; --i) {
+    writeFrame(*accepted, replies[i]);
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    BOOST_CHECK_EQUAL(std::string(i + 1, 'x'), calls[i].get());
+  }
+  BOOST_REQUIRE_EQUAL(3u, order.size());
+  BOOST_CHECK_EQUAL(2, order[0]);
+  BOOST_CHECK_EQUAL(1, order[1]);
+  BOOST_CHECK_EQUAL(0, order[2]);
+  accepted->close();
+}
+
+BOOST_AUTO_TEST_CASE(test_close) {
+  transport::TServerSocket server(0);
+  server.listen();
+  shared_ptr<TFutureChannel> channel = connect(server.getPort());
+  ChildServiceFutureClient client(channel);
+
+  // nobody answers, so the call is still outstanding when the channel closes
+  TFuture<int32_t> value = client.getValue();
+  BOOST_CHECK(!value.wait(10));
+  BOOST_CHECK_EQUAL(1u, channel->getNumOutstanding());
+
+  channel->close();
+  BOOST_CHECK(value.ready());
+  BOOST_CHECK_THROW(value.get(), TTransportException);
+  BOOST_CHECK(!channel->good());
+  BOOST_CHECK_THROW(client.getValue(), TTransportException);
+  BOOST_CHECK_THROW(client.onewayWait(), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE(test_peer_closed) {
+  transport::TServerSocket server(0);
+  server.listen();
+  shared_ptr<TFutureChannel> channel = connect(server.getPort());
+  ChildServiceFutureClient client(channel);
+
+  TFuture<int32_t> value = client.getValue();
+  server.accept()->close();
+  BOOST_CHECK_THROW(value.get(), TTransportException);
+  BOOST_CHECK(!channel->good());
+}
+
+BOOST_AUTO_TEST_CASE(test_partial_write) {
+  transport::TServerSocket server(0);
+  server.listen();
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("127.0.0.1", server.getPort()));
+  socket->open();
+  socket->setSendTimeout(100);
+  shared_ptr<TFutureChannel> channel(
+      new TFutureChannel(socket, boost::make_shared<protocol::TBinaryProtocolFactory>()));
+  ChildServiceFutureClient client(channel);
+
+  // the peer never reads, so the send times out partway through the frame
+  shared_ptr<transport::TTransport> accepted = server.accept();
+  BOOST_CHECK_THROW(client.addString(std::string(64 * 1024 * 1024, 'x')), TTransportException);
+  BOOST_CHECK(!channel->good());
+  BOOST_CHECK_THROW(client.getValue(), TTransportException);
+  BOOST_CHECK_EQUAL(0u, channel->getNumOutstanding());
+  accepted->close();
+}
+
+BOOST_AUTO_TEST_CASE(test_default_future) {
+  TFuture<int32_t> value;
+  TFuture<void> done;
+  BOOST_CHECK(!value.valid());
+  BOOST_CHECK_THROW(value.get(), TException);
+  BOOST_CHECK_THROW(value.ready(), TException);
+  BOOST_CHECK_THROW(done.get(), TException);
+  BOOST_CHECK_THROW(done.wait(10), TException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
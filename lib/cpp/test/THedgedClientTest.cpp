@@ -0,0 +1,284 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE THedgedClientTest
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/smart_ptr.hpp>
+
+#include "thrift/THedgedClient.h"
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/concurrency/PlatformThreadFactory.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/Util.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/server/TThreadedServer.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/TServerSocket.h"
+
+#include "gen-cpp/ParentService.h"
+
+using namespace apache::thrift;
+using apache::thrift::concurrency::Util;
+using apache::thrift::transport::TConnectionPool;
+using apache::thrift::transport::TTransportException;
+using boost::shared_ptr;
+using test::ParentServiceClient;
+
+namespace {
+
+// Answers getGeneration() with its id after a delay
+struct Handler : public test::ParentServiceIf {
+  Handler(int32_t id) : id(id), delay(0) {}
+
+  int32_t getGeneration() {
+    THRIFT_SLEEP_USEC(delay * 1000);
+    return id;
+  }
+  void addString(const std::string& s) {
+    concurrency::Guard g(mutex);
+    strings.push_back(s);
+  }
+
+  // dummy overrides not used in this test
+  int32_t incrementGeneration() { return 0; }
+  void getStrings(std::vector<std::string>&) {}
+  void getDataWait(std::string&, int32_t) {}
+  void onewayWait() {}
+  void exceptionWait(const std::string&) {}
+  void unexpectedExceptionWait(const std::string&) {}
+
+  int32_t id;
+  int delay;
+  concurrency::Mutex mutex;
+  std::vector<std::string> strings;
+};
+
+// A threaded server on an ephemeral port
+class Backend : public server::TServerEventHandler,
+                public concurrency::Runnable,
+                public boost::enable_shared_from_this<Backend> {
+public:
+  Backend(int32_t id) : handler(new Handler(id)), socket(new transport::TServerSocket(0)), ready(false) {
+    server.reset(new server::TThreadedServer(
+        boost::make_shared<test::ParentServiceProcessor>(handler),
+        socket,
+        boost::make_shared<transport::TBufferedTransportFactory>(),
+        boost::make_shared<protocol::TBinaryProtocolFactory>()));
+  }
+
+  void start() {
+    server->setServerEventHandler(shared_from_this());
+    thread = concurrency::PlatformThreadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+                 concurrency::PlatformThreadFactory::OTHER,
+                 concurrency::PlatformThreadFactory::NORMAL,
+                 1,
+#endif
+                 false).newThread(shared_from_this());
+    thread->start();
+    concurrency::Synchronized s(monitor);
+    while (!ready) {
+      monitor.wait();
+    }
+  }
+
+  void stop() {
+    server->stop();
+    thread->join();
+    server->setServerEventHandler(shared_ptr<server::TServerEventHandler>());
+  }
+
+  virtual void preServe() {
+    concurrency::Synchronized s(monitor);
+    ready = true;
+    monitor.notify();
+  }
+
+  virtual void run() { server->serve(); }
+
+  int port() { return socket->getPort(); }
+
+  shared_ptr<Handler> handler;
+
+private:
+  shared_ptr<transport::TServerSocket> socket;
+  shared_ptr<server::TThreadedServer> server;
+  shared_ptr<concurrency::Thread> thread;
+  concurrency::Monitor monitor;
+  bool ready;
+};
+
+// Accepts one connection and answers its request with the start of a
+// reply, one byte at a time, so that no single read waits long
+class Dribbler : public concurrency::Runnable {
+public:
+  Dribbler() : socket(new transport::TServerSocket(0)) { socket->listen(); }
+
+  virtual void run() {
+    shared_ptr<transport::TTransport> peer = socket->accept();
+    uint8_t byte;
+    peer->read(&byte, 1);
+
+    shared_ptr<transport::TMemoryBuffer> reply(new transport::TMemoryBuffer);
+    protocol::TBinaryProtocol(reply).writeMessageBegin("getGeneration", protocol::T_REPLY, 0);
+    uint8_t* buf;
+    uint32_t len;
+    reply->getBuffer(&buf, &len);
+    try {
+      for (uint32_t i = 0; i < len; ++i) {
+        THRIFT_SLEEP_USEC(20 * 1000);
+        peer->write(buf + i, 1);
+      }
+    } catch (const TTransportException&) {
+      // the client gave up
+    }
+    peer->close();
+  }
+
+  shared_ptr<transport::TServerSocket> socket;
+};
+
+class Fixture {
+protected:
+  Fixture() : slow(new Backend(1)), fast(new Backend(2)), pool(new TConnectionPool) {
+    slow->start();
+    fast->start();
+    // in order, so the first attempt always goes to the slow backend
+    pool->setRandomize(false);
+    pool->addServer("127.0.0.1", slow->port());
+    pool->addServer("127.0.0.1", fast->port());
+    client.reset(new THedgedClient<ParentServiceClient>(
+        pool,
+        boost::make_shared<transport::TBufferedTransportFactory>(),
+        boost::make_shared<protocol::TBinaryProtocolFactory>()));
+    client->setHedgePercentile(0);
+  }
+
+  ~Fixture() {
+    pool->clear();
+    slow->stop();
+    fast->stop();
+  }
+
+  int32_t getGeneration(bool hedged) {
+    if (hedged) {
+      return client->hedgedCall(boost::bind(&ParentServiceClient::send_getGeneration, _1),
+                                boost::bind(&ParentServiceClient::recv_getGeneration, _1));
+    }
+    return client->call(boost::bind(&ParentServiceClient::send_getGeneration, _1),
+                        boost::bind(&ParentServiceClient::recv_getGeneration, _1));
+  }
+
+  shared_ptr<Backend> slow;
+  shared_ptr<Backend> fast;
+  shared_ptr<TConnectionPool> pool;
+  shared_ptr<THedgedClient<ParentServiceClient> > client;
+};
+}
+
+BOOST_AUTO_TEST_SUITE(THedgedClientTest)
+
+BOOST_FIXTURE_TEST_CASE(test_call, Fixture) {
+  BOOST_CHECK_EQUAL(1, getGeneration(false));
+  BOOST_CHECK_EQUAL(1, getGeneration(true));
+  BOOST_CHECK_EQUAL(0u, client->getNumHedged());
+  // the connection went back to the pool and was reused
+  BOOST_CHECK_EQUAL(1u, pool->getNumCreated());
+
+  client->call(boost::bind(&ParentServiceClient::send_addString, _1, std::string("void")),
+               boost::bind(&ParentServiceClient::recv_addString, _1));
+  BOOST_CHECK_EQUAL(1u, slow->handler->strings.size());
+}
+
+BOOST_FIXTURE_TEST_CASE(test_hedge, Fixture) {
+  slow->handler->delay = 300;
+  client->setHedgeDelay(20);
+
+  int64_t start = Util::currentTime();
+  BOOST_CHECK_EQUAL(2, getGeneration(true));
+  BOOST_CHECK(Util::currentTime() - start < 250);
+  BOOST_CHECK_EQUAL(1u, client->getNumHedged());
+  BOOST_CHECK_EQUAL(1u, client->getNumHedgeWins());
+
+  // the slow connection was closed, only the fast one is kept
+  BOOST_CHECK_EQUAL(1u, pool->getNumIdle());
+}
+
+BOOST_FIXTURE_TEST_CASE(test_deadline, Fixture) {
+  slow->handler->delay = 300;
+  client->setDeadline(50);
+
+  int64_t start = Util::currentTime();
+  BOOST_CHECK_THROW(getGeneration(false), TTransportException);
+  BOOST_CHECK(Util::currentTime() - start < 250);
+  BOOST_CHECK_EQUAL(0u, pool->getNumIdle());
+
+  // hedged, both copies miss the deadline
+  fast->handler->delay = 300;
+  client->setHedgeDelay(10);
+  start = Util::currentTime();
+  BOOST_CHECK_THROW(getGeneration(true), TTransportException);
+  BOOST_CHECK(Util::currentTime() - start < 250);
+  BOOST_CHECK_EQUAL(0u, pool->getNumIdle());
+}
+
+BOOST_AUTO_TEST_CASE(test_deadline_slow_response) {
+  shared_ptr<Dribbler> dribbler(new Dribbler);
+  shared_ptr<concurrency::Thread> thread = concurrency::PlatformThreadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+                                               concurrency::PlatformThreadFactory::OTHER,
+                                               concurrency::PlatformThreadFactory::NORMAL,
+                                               1,
+#endif
+                                               false).newThread(dribbler);
+  thread->start();
+
+  shared_ptr<TConnectionPool> pool(new TConnectionPool);
+  pool->addServer("127.0.0.1", dribbler->socket->getPort());
+  THedgedClient<ParentServiceClient> client(
+      pool,
+      boost::make_shared<transport::TBufferedTransportFactory>(),
+      boost::make_shared<protocol::TBinaryProtocolFactory>());
+  client.setDeadline(50);
+
+  // every byte comes well within the deadline, the whole reply does not
+  int64_t start = Util::currentTime();
+  BOOST_CHECK_THROW(client.call(boost::bind(&ParentServiceClient::send_getGeneration, _1),
+                                boost::bind(&ParentServiceClient::recv_getGeneration, _1)),
+                    TTransportException);
+  BOOST_CHECK(Util::currentTime() - start < 250);
+
+  pool->clear();
+  thread->join();
+  dribbler->socket->close();
+}
+
+BOOST_FIXTURE_TEST_CASE(test_percentile, Fixture) {
+  client->setHedgeDelay(1000);
+  BOOST_CHECK_EQUAL(1000, client->getHedgeDelay());
+  for (int i = 0; i < 100; ++i) {
+    getGeneration(true);
+  }
+  client->setHedgePercentile(0.9);
+  // local calls take well under the fixed delay
+  BOOST_CHECK(client->getHedgeDelay() < 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
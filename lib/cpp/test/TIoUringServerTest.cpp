@@ -0,0 +1,228 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TIoUringServerTest
+#include <boost/test/unit_test.hpp>
+#include <boost/smart_ptr.hpp>
+
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/PlatformThreadFactory.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/server/TIoUringServer.h"
+#include "thrift/server/TServer.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/TSocket.h"
+
+#include "gen-cpp/ParentService.h"
+
+using namespace apache::thrift;
+
+struct Handler : public test::ParentServiceIf {
+  void addString(const std::string& s) { strings_.push_back(s); }
+  void getStrings(std::vector<std::string>& _return) { _return = strings_; }
+  std::vector<std::string> strings_;
+
+  // dummy overrides not used in this test
+  void getDataWait(std::string&, int32_t) {}
+  int32_t incrementGeneration() { return 0; }
+  int32_t getGeneration() { return 0; }
+  void onewayWait() {}
+  void exceptionWait(const std::string&) {}
+  void unexpectedExceptionWait(const std::string&) {}
+};
+
+class Fixture {
+private:
+  struct Runner : public concurrency::Runnable {
+    boost::shared_ptr<server::TIoUringServer> server;
+    virtual void run() { server->serve(); }
+  };
+
+  // signals once the server listens and counts closed connections
+  struct EventHandler : public server::TServerEventHandler {
+    EventHandler() : listening(false), closed(0) {}
+
+    virtual void preServe() {
+      concurrency::Synchronized s(monitor);
+      listening = true;
+      monitor.notifyAll();
+    }
+
+    virtual void deleteContext(void*,
+                               boost::shared_ptr<protocol::TProtocol>,
+                               boost::shared_ptr<protocol::TProtocol>) {
+      concurrency::Synchronized s(monitor);
+      ++closed;
+      monitor.notifyAll();
+    }
+
+    concurrency::Monitor monitor;
+    bool listening;
+    int closed;
+  };
+
+protected:
+  Fixture()
+    : events(new EventHandler),
+      processor(new test::ParentServiceProcessor(boost::make_shared<Handler>())) {}
+
+  ~Fixture() {
+    if (server) {
+      server->stop();
+    }
+    if (thread) {
+      thread->join();
+    }
+  }
+
+  int startServer(bool useIoUring, size_t maxPendingOutput = 0) {
+    server.reset(new server::TIoUringServer(processor, 0));
+    server->setUseIoUring(useIoUring);
+    if (maxPendingOutput) {
+      server->setMaxPendingOutput(maxPendingOutput);
+    }
+    server->setServerEventHandler(events);
+
+    boost::shared_ptr<Runner> runner(new Runner);
+    runner->server = server;
+    concurrency::PlatformThreadFactory threadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+        concurrency::PlatformThreadFactory::OTHER,
+        concurrency::PlatformThreadFactory::NORMAL,
+        1,
+#endif
+        false);
+    thread = threadFactory.newThread(runner);
+    thread->start();
+
+    concurrency::Synchronized s(events->monitor);
+    while (!events->listening) {
+      events->monitor.wait();
+    }
+    BOOST_REQUIRE_NE(0, server->getListenPort());
+    return server->getListenPort();
+  }
+
+  void waitForClosed(int count) {
+    concurrency::Synchronized s(events->monitor);
+    while (events->closed < count) {
+      events->monitor.wait();
+    }
+  }
+
+  boost::shared_ptr<test::ParentServiceClient> connect(int port) {
+    boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    return boost::make_shared<test::ParentServiceClient>(
+        boost::make_shared<protocol::TBinaryProtocol>(
+            boost::make_shared<transport::TFramedTransport>(socket)));
+  }
+
+  bool canCommunicate(int port) {
+    boost::shared_ptr<test::ParentServiceClient> client = connect(port);
+    client->addString("foo");
+    std::vector<std::string> strings;
+    client->getStrings(strings);
+    return strings.size() == 1 && !(strings[0].compare("foo"));
+  }
+
+  boost::shared_ptr<server::TIoUringServer> server;
+  boost::shared_ptr<EventHandler> events;
+
+private:
+  boost::shared_ptr<test::ParentServiceProcessor> processor;
+  boost::shared_ptr<concurrency::Thread> thread;
+};
+
+BOOST_AUTO_TEST_SUITE(TIoUringServerTest)
+
+BOOST_FIXTURE_TEST_CASE(io_uring_or_fallback, Fixture) {
+  int port = startServer(true);
+  BOOST_CHECK(canCommunicate(port));
+  BOOST_CHECK_EQUAL(server::TIoUringServer::isAvailable(), server->isUsingIoUring());
+}
+
+BOOST_FIXTURE_TEST_CASE(forced_fallback, Fixture) {
+  int port = startServer(false);
+  BOOST_CHECK(canCommunicate(port));
+  BOOST_CHECK(!server->isUsingIoUring());
+  BOOST_CHECK_EQUAL(0u, server->getNumRequests());
+}
+
+BOOST_FIXTURE_TEST_CASE(large_frames_and_many_clients, Fixture) {
+  if (!server::TIoUringServer::isAvailable()) {
+    BOOST_TEST_MESSAGE("io_uring not available, skipping");
+    return;
+  }
+  int port = startServer(true);
+
+  // larger than all provided receive buffers together, so receives have to
+  // wait for buffers to be recycled and responses go out in partial sends
+  const std::string big(8 * 1024 * 1024, 'x');
+  std::vector<boost::shared_ptr<test::ParentServiceClient> > clients;
+  for (int i = 0; i < 8; ++i) {
+    clients.push_back(connect(port));
+  }
+  clients[0]->addString(big);
+  for (size_t i = 0; i < clients.size(); ++i) {
+    std::vector<std::string> strings;
+    clients[i]->getStrings(strings);
+    BOOST_REQUIRE_EQUAL(1u, strings.size());
+    BOOST_CHECK(strings[0] == big);
+  }
+  BOOST_CHECK_EQUAL(9u, server->getNumRequests());
+  BOOST_CHECK_EQUAL(8u, server->getNumConnections());
+
+  clients.clear();
+  waitForClosed(8);
+  BOOST_CHECK_EQUAL(0u, server->getNumConnections());
+}
+
+BOOST_FIXTURE_TEST_CASE(client_not_reading_responses, Fixture) {
+  if (!server::TIoUringServer::isAvailable()) {
+    BOOST_TEST_MESSAGE("io_uring not available, skipping");
+    return;
+  }
+  int port = startServer(true, 1024 * 1024);
+
+  boost::shared_ptr<test::ParentServiceClient> client = connect(port);
+  const std::string big(1024 * 1024, 'x');
+  client->addString(big);
+
+  // pipeline far more responses than the socket buffers hold, without
+  // reading any of them
+  const int calls = 64;
+  for (int i = 0; i < calls; ++i) {
+    client->send_getStrings();
+  }
+  THRIFT_SLEEP_USEC(300000);
+  BOOST_CHECK_LT(server->getNumRequests(), 1u + calls);
+
+  // receiving resumes as the responses are read
+  for (int i = 0; i < calls; ++i) {
+    std::vector<std::string> strings;
+    client->recv_getStrings(strings);
+    BOOST_REQUIRE_EQUAL(1u, strings.size());
+    BOOST_CHECK(strings[0] == big);
+  }
+  BOOST_CHECK_EQUAL(1u + calls, server->getNumRequests());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,308 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TLazyTest
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/TLazy.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TDenseProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/proc_types.h"
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::test::Profile;
+using apache::thrift::test::Request;
+using boost::shared_ptr;
+
+namespace {
+
+Profile makeProfile(const std::string& name, int tags) {
+  Profile profile;
+  profile.name = name;
+  for (int i = 0; i < tags; ++i) {
+    profile.tags.push_back(name + " tag");
+  }
+  profile.verified = tags % 2 == 1;
+  return profile;
+}
+
+Request makeRequest() {
+  Request request;
+  request.id = 1234567890123LL;
+  request.profile = makeProfile("alice", 3);
+  std::vector<Profile> friends;
+  for (int i = 0; i < 20; ++i) {
+    friends.push_back(makeProfile("friend", i));
+  }
+  request.friends = friends;
+  std::map<std::string, int64_t> counters;
+  counters["calls"] = 17;
+  counters["bytes"] = 1LL << 40;
+  request.counters = counters;
+  request.flags.getMutable().insert(99);
+  request.note = "note";
+  return request;
+}
+
+template <typename Protocol>
+std::string serialize(const Request& request) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol oprot(buffer);
+  request.write(static_cast<TProtocol*>(&oprot));
+  return buffer->getBufferAsString();
+}
+
+template <typename Protocol>
+Request deserialize(std::string& wire) {
+  shared_ptr<TMemoryBuffer> buffer(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(&wire[0]), static_cast<uint32_t>(wire.size())));
+  Protocol iprot(buffer);
+  Request request;
+  request.read(static_cast<TProtocol*>(&iprot));
+  return request;
+}
+
+// Reads a request without touching its lazy fields and writes it back
+template <typename Protocol>
+void checkRoundTrip() {
+  Request sent = makeRequest();
+  std::string wire = serialize<Protocol>(sent);
+
+  Request received = deserialize<Protocol>(wire);
+  BOOST_CHECK_EQUAL(sent.id, received.id);
+  BOOST_CHECK_EQUAL(sent.note, received.note);
+  BOOST_CHECK(received.profile.isPending());
+  BOOST_CHECK(received.friends.isPending());
+  BOOST_CHECK(received.counters.isPending());
+  BOOST_CHECK(received.flags.isPending());
+  BOOST_CHECK(!received.profile.getSerialized().empty());
+
+  // untouched fields are copied back byte for byte
+  BOOST_CHECK(serialize<Protocol>(received) == wire);
+  BOOST_CHECK(received.friends.isPending());
+
+  // and deserialized on first access
+  BOOST_CHECK(received.profile.get() == sent.profile.get());
+  BOOST_CHECK(!received.profile.isPending());
+  BOOST_CHECK_EQUAL(20u, received.friends.get().size());
+  BOOST_CHECK(received.friends.get() == sent.friends.get());
+  BOOST_CHECK(received.counters.get() == sent.counters.get());
+  BOOST_CHECK_EQUAL(3u, received.flags.get().size());
+  BOOST_CHECK(received == sent);
+  BOOST_CHECK(serialize<Protocol>(received) == wire);
+
+  // a changed field is serialized from scratch
+  received.profile.getMutable().name = "bob";
+  BOOST_CHECK(received.profile.getSerialized().empty());
+  Request changed = deserialize<Protocol>(wire = serialize<Protocol>(received));
+  BOOST_CHECK_EQUAL("bob", changed.profile.get().name);
+  BOOST_CHECK(changed.friends.get() == sent.friends.get());
+}
+
+// Reads the lazy fields of a shared request and copies of it
+struct Reader : public apache::thrift::concurrency::Runnable {
+  Reader(const Request& request, const Request& expected)
+    : request(request), expected(expected), matched(false) {}
+
+  virtual void run() {
+    Request copy = request;
+    matched = request.friends.get() == expected.friends.get()
+              && request.profile.get() == expected.profile.get() && copy == expected;
+  }
+
+  const Request& request;
+  const Request& expected;
+  bool matched;
+};
+}
+
+BOOST_AUTO_TEST_SUITE(TLazyTest)
+
+BOOST_AUTO_TEST_CASE(test_binary) {
+  checkRoundTrip<TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_compact) {
+  checkRoundTrip<TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_verbatim_copy) {
+  Request sent = makeRequest();
+  std::string wire = serialize<TBinaryProtocol>(sent);
+  // make profile.verified a true that is not encoded as 1
+  size_t verified = wire.find(std::string("\x02\x00\x03\x01", 4));
+  BOOST_REQUIRE(verified != std::string::npos);
+  wire[verified + 3] = 7;
+  std::string input = wire;
+
+  Request received = deserialize<TBinaryProtocol>(wire);
+  BOOST_CHECK(serialize<TBinaryProtocol>(received) == input);
+  BOOST_CHECK(received.profile.get().verified);
+}
+
+BOOST_AUTO_TEST_CASE(test_framed_slices) {
+  Request sent = makeRequest();
+  shared_ptr<TMemoryBuffer> pipe(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> out(new TFramedTransport(pipe));
+  TCompactProtocol oprot(out);
+  sent.write(static_cast<TProtocol*>(&oprot));
+  out->flush();
+
+  shared_ptr<TFramedTransport> in(new TFramedTransport(pipe));
+  TCompactProtocol iprot(in);
+  Request received;
+  received.read(static_cast<TProtocol*>(&iprot));
+  BOOST_CHECK(received.friends.isPending());
+  // the fields alias the frame
+  BOOST_CHECK(received.profile.getSerialized().owner().get()
+              == received.friends.getSerialized().owner().get());
+
+  // the kept bytes outlive the transport
+  in.reset();
+  pipe.reset();
+  BOOST_CHECK(received == sent);
+}
+
+BOOST_AUTO_TEST_CASE(test_other_encoding) {
+  Request sent = makeRequest();
+  std::string wire = serialize<TBinaryProtocol>(sent);
+  Request received = deserialize<TBinaryProtocol>(wire);
+
+  // written with another protocol, lazy fields are deserialized first
+  BOOST_CHECK(serialize<TCompactProtocol>(received) == serialize<TCompactProtocol>(sent));
+  BOOST_CHECK(!received.friends.isPending());
+
+  std::string json = serialize<TJSONProtocol>(sent);
+  Request fromJSON = deserialize<TJSONProtocol>(json);
+  BOOST_CHECK(!fromJSON.profile.isPending());
+  BOOST_CHECK(fromJSON == sent);
+}
+
+BOOST_AUTO_TEST_CASE(test_partially_buffered) {
+  // fields that do not fit into the read buffer are read eagerly
+  Request sent = makeRequest();
+  std::string wire = serialize<TBinaryProtocol>(sent);
+  shared_ptr<TMemoryBuffer> pipe(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(&wire[0]), static_cast<uint32_t>(wire.size())));
+  shared_ptr<TBufferedTransport> in(new TBufferedTransport(pipe, 64));
+  TBinaryProtocol iprot(in);
+  Request received;
+  received.read(static_cast<TProtocol*>(&iprot));
+  BOOST_CHECK(!received.friends.isPending());
+  BOOST_CHECK(received.friends.getSerialized().empty());
+  BOOST_CHECK(received == sent);
+}
+
+BOOST_AUTO_TEST_CASE(test_value_semantics) {
+  Request request;
+  BOOST_CHECK_EQUAL(2u, request.flags.get().size());
+  BOOST_CHECK(!request.flags.isPending());
+
+  Request sent = makeRequest();
+  std::string wire = serialize<TBinaryProtocol>(sent);
+  Request received = deserialize<TBinaryProtocol>(wire);
+
+  Request copy = received;
+  BOOST_CHECK(copy.friends.isPending());
+  BOOST_CHECK(copy == sent);
+
+  using std::swap;
+  swap(request, copy);
+  BOOST_CHECK(request == sent);
+  BOOST_CHECK_EQUAL(2u, copy.flags.get().size());
+
+  std::map<std::string, int64_t> counters;
+  counters["calls"] = 1;
+  received.__set_counters(counters);
+  BOOST_CHECK(!received.counters.isPending());
+  BOOST_CHECK(received.counters.get() == counters);
+  BOOST_CHECK(apache::thrift::to_string(received).find("calls: 1") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_shared_const) {
+  Request sent = makeRequest();
+  std::string wire = serialize<TBinaryProtocol>(sent);
+  const Request received = deserialize<TBinaryProtocol>(wire);
+
+  // the first get() on any of the threads decodes, the others wait for it
+  apache::thrift::concurrency::PlatformThreadFactory threadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+      apache::thrift::concurrency::PlatformThreadFactory::OTHER,
+      apache::thrift::concurrency::PlatformThreadFactory::NORMAL,
+      1,
+#endif
+      false);
+  std::vector<shared_ptr<Reader> > readers;
+  std::vector<shared_ptr<apache::thrift::concurrency::Thread> > threads;
+  for (int i = 0; i < 8; ++i) {
+    readers.push_back(shared_ptr<Reader>(new Reader(received, sent)));
+    threads.push_back(threadFactory.newThread(readers.back()));
+    threads.back()->start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+    BOOST_CHECK(readers[i]->matched);
+  }
+  BOOST_CHECK(!received.friends.isPending());
+}
+
+BOOST_AUTO_TEST_CASE(test_size_limits) {
+  Request sent = makeRequest();
+  std::string wire = serialize<TBinaryProtocol>(sent);
+  shared_ptr<TMemoryBuffer> buffer(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(&wire[0]), static_cast<uint32_t>(wire.size())));
+  TBinaryProtocol iprot(buffer);
+  // note still fits, the profile name does not
+  iprot.setStringSizeLimit(4);
+  Request received;
+  received.read(static_cast<TProtocol*>(&iprot));
+  BOOST_CHECK(received.profile.isPending());
+
+  // the limits of the reading protocol hold when the field is decoded
+  Request copy = received;
+  try {
+    copy.profile.get();
+    BOOST_ERROR("too long lazy string was decoded");
+  } catch (TProtocolException& x) {
+    BOOST_CHECK_EQUAL(TProtocolException::SIZE_LIMIT, x.getType());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_dense_protocol_reads_eagerly) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  apache::thrift::protocol::TDenseProtocol dense(buffer);
+  // TDenseProtocol derives from TBinaryProtocol but encodes values its own way
+  BOOST_CHECK_EQUAL(apache::thrift::protocol::T_ENCODING_UNKNOWN,
+                    static_cast<TProtocol&>(dense).getValueEncoding());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -20,30 +20,83 @@
 #define BOOST_TEST_MODULE TNonblockingServerTest
 #include <boost/test/unit_test.hpp>
 #include <boost/smart_ptr.hpp>
+#include <boost/atomic.hpp>
 
+#include "thrift/concurrency/Monitor.h"
 #include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/Util.h"
 #include "thrift/server/TNonblockingServer.h"
 
+#include "gen-cpp/InlineService.h"
 #include "gen-cpp/ParentService.h"
 
 #include <event.h>
 
 using namespace apache::thrift;
 
+// Holds back getDataWait() calls with a negative length until opened
+struct Gate {
+  Gate() : open_(false) {}
+
+  void close() {
+    concurrency::Synchronized s(monitor_);
+    open_ = false;
+  }
+
+  void wait() {
+    concurrency::Synchronized s(monitor_);
+    while (!open_) {
+      monitor_.wait();
+    }
+  }
+
+  void open() {
+    concurrency::Synchronized s(monitor_);
+    open_ = true;
+    monitor_.notifyAll();
+  }
+
+  concurrency::Monitor monitor_;
+  bool open_;
+};
+
+static Gate gate;
+
+// getGeneration() calls served so far, by any handler
+static boost::atomic<int> generationCalls(0);
+
 struct Handler : public test::ParentServiceIf {
   void addString(const std::string& s) { strings_.push_back(s); }
   void getStrings(std::vector<std::string>& _return) { _return = strings_; }
   std::vector<std::string> strings_;
 
+  // simulates a slow call, taking length milliseconds, or waiting for the
+  // gate if length is negative
+  void getDataWait(std::string&, int32_t length) {
+    if (length < 0) {
+      gate.wait();
+    } else {
+      THRIFT_SLEEP_USEC(length * 1000);
+    }
+  }
+
+  int32_t getGeneration() { return ++generationCalls; }
+
   // dummy overrides not used in this test
   int32_t incrementGeneration() { return 0; }
-  int32_t getGeneration() { return 0; }
-  void getDataWait(std::string&, int32_t) {}
   void onewayWait() {}
   void exceptionWait(const std::string&) {}
   void unexpectedExceptionWait(const std::string&) {}
 };
 
+struct InlineHandler : public test::InlineServiceIf {
+  void addString(const std::string& s) { strings_.push_back(s); }
+  void getStrings(std::vector<std::string>& _return) { _return = strings_; }
+  std::vector<std::string> strings_;
+
+  void getDataWait(std::string&, int32_t) { gate.wait(); }
+};
+
 class Fixture {
 private:
   struct Runner : public concurrency::Runnable {
@@ -66,7 +119,9 @@ private:
 protected:
   Fixture() : processor(new test::ParentServiceProcessor(boost::make_shared<Handler>())) {}
 
-  ~Fixture() {
+  explicit Fixture(const boost::shared_ptr<TProcessor>& p) : processor(p) {}
+
+  virtual ~Fixture() {
     if (server) {
       server->stop();
     }
@@ -75,6 +130,9 @@ protected:
     }
   }
 
+  // hook for test cases that need to tune the server before it starts
+  virtual void configureServer(server::TNonblockingServer&) {}
+
   void setEventBase(event_base* user_event_base) {
     userEventBase_.reset(user_event_base, EventDeleter());
   }
@@ -87,11 +145,12 @@ protected:
             concurrency::PlatformThreadFactory::NORMAL,
             1,
 #endif
-            true));
+            false)); // joinable, so that tearing down waits for serve() to return
 
     int retry_count = port ? 10 : 0;
     for (int p = port; p <= port + retry_count; p++) {
       server.reset(new server::TNonblockingServer(processor, p));
+      configureServer(*server);
       if (userEventBase_) {
         try {
           server->registerEvents(userEventBase_.get());
@@ -127,7 +186,7 @@ protected:
 
 private:
   boost::shared_ptr<event_base> userEventBase_;
-  boost::shared_ptr<test::ParentServiceProcessor> processor;
+  boost::shared_ptr<TProcessor> processor;
   boost::shared_ptr<concurrency::Thread> thread;
 
 protected:
@@ -170,4 +229,356 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+struct ReusePortFixture : public Fixture {
+  virtual void configureServer(server::TNonblockingServer& s) {
+    s.setNumIOThreads(4);
+    s.setUseReusePortListeners(true);
+  }
+};
+
+BOOST_FIXTURE_TEST_CASE(reuse_port_listeners, ReusePortFixture) {
+  startServer(0);
+  int port = server->getListenPort();
+  BOOST_REQUIRE_NE(port, 0);
+
+  BOOST_CHECK(canCommunicate(port));
+
+  // enough fresh connections that the kernel hands some to every listener
+  for (int i = 0; i < 16; ++i) {
+    boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+        boost::make_shared<transport::TFramedTransport>(socket)));
+    std::vector<std::string> strings;
+    client.getStrings(strings);
+    BOOST_CHECK_EQUAL(strings.size(), 1u);
+  }
+}
+
+struct PipelineFixture : public Fixture {
+  PipelineFixture() : threadManager(concurrency::ThreadManager::newSimpleThreadManager(4)) {
+    threadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+    threadManager->start();
+  }
+
+  virtual void configureServer(server::TNonblockingServer& s) {
+    s.setThreadManager(threadManager);
+    s.setPipelineDepth(8);
+  }
+
+  boost::shared_ptr<concurrency::ThreadManager> threadManager;
+};
+
+BOOST_FIXTURE_TEST_CASE(pipelined_requests, PipelineFixture) {
+  startServer(0);
+  int port = server->getListenPort();
+  BOOST_REQUIRE(canCommunicate(port));
+
+  boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->open();
+  test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+
+  // more calls in flight than the pipeline depth, answered in order
+  for (int i = 0; i < 20; ++i) {
+    client.send_getStrings();
+  }
+  for (int i = 0; i < 20; ++i) {
+    std::vector<std::string> strings;
+    client.recv_getStrings(strings);
+    BOOST_CHECK_EQUAL(strings.size(), 1u);
+  }
+  BOOST_CHECK_EQUAL(server->getNumActiveProcessors(), 0u);
+
+  // hold back the front of the pipeline until the calls behind it are done
+  int served = generationCalls;
+  gate.close();
+  client.send_getDataWait(-1);
+  for (int i = 0; i < 7; ++i) {
+    client.send_getGeneration();
+  }
+  while (generationCalls < served + 7 || server->getNumActiveProcessors() > 1) {
+    THRIFT_SLEEP_USEC(1000);
+  }
+  // the IO thread is done with earlier writes once it dispatched these calls
+  uint64_t syscalls = server->getNumWriteSyscalls();
+  uint64_t bytes = server->getNumBytesWritten();
+  gate.open();
+
+  std::string data;
+  client.recv_getDataWait(data);
+  for (int i = 0; i < 7; ++i) {
+    client.recv_getGeneration();
+  }
+
+  // then all eight responses are ready together and go out in one write
+  // (which the IO thread counts just after making it)
+  while (server->getNumWriteSyscalls() == syscalls) {
+    THRIFT_SLEEP_USEC(1000);
+  }
+  BOOST_CHECK_EQUAL(server->getNumWriteSyscalls() - syscalls, 1u);
+  BOOST_CHECK(server->getNumBytesWritten() - bytes > 8 * sizeof(int32_t));
+}
+
+struct QueueLatencyFixture : public Fixture {
+  QueueLatencyFixture() : threadManager(concurrency::ThreadManager::newSimpleThreadManager(1)) {
+    threadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+    threadManager->start();
+  }
+
+  virtual void configureServer(server::TNonblockingServer& s) {
+    s.setThreadManager(threadManager);
+    s.setPipelineDepth(64);
+    s.setQueueTargetLatency(1);
+    s.setQueueLatencyInterval(10);
+  }
+
+  boost::shared_ptr<concurrency::ThreadManager> threadManager;
+};
+
+BOOST_FIXTURE_TEST_CASE(queue_latency_shedding, QueueLatencyFixture) {
+  startServer(0);
+  int port = server->getListenPort();
+
+  boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->open();
+  test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+
+  // a single worker thread queues up 5ms calls faster than it runs them
+  const int calls = 40;
+  for (int i = 0; i < calls; ++i) {
+    client.send_getDataWait(5);
+  }
+  int served = 0, shed = 0;
+  for (int i = 0; i < calls; ++i) {
+    try {
+      std::string data;
+      client.recv_getDataWait(data);
+      ++served;
+    } catch (TApplicationException& x) {
+      BOOST_CHECK_EQUAL(x.getType(), TApplicationException::INTERNAL_ERROR);
+      ++shed;
+    }
+  }
+  BOOST_CHECK(served > 0);
+  BOOST_CHECK(shed > 0);
+  BOOST_CHECK_EQUAL(server->getNumRequestsShed(), static_cast<uint64_t>(shed));
+}
+
+BOOST_AUTO_TEST_CASE(inline_safe_annotation) {
+  test::InlineServiceProcessor processor(boost::make_shared<InlineHandler>());
+  BOOST_CHECK(processor.hasInlineSafeCalls());
+  BOOST_CHECK(processor.isInlineSafe("getStrings"));
+  BOOST_CHECK(!processor.isInlineSafe("addString"));
+
+  test::ParentServiceProcessor parentProcessor(boost::make_shared<Handler>());
+  BOOST_CHECK(!parentProcessor.hasInlineSafeCalls());
+}
+
+struct InlineFixture : public Fixture {
+  InlineFixture()
+    : Fixture(boost::make_shared<test::InlineServiceProcessor>(
+          boost::make_shared<InlineHandler>())),
+      threadManager(concurrency::ThreadManager::newSimpleThreadManager(1)) {
+    threadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+    threadManager->start();
+  }
+
+  virtual void configureServer(server::TNonblockingServer& s) { s.setThreadManager(threadManager); }
+
+  boost::shared_ptr<concurrency::ThreadManager> threadManager;
+};
+
+BOOST_FIXTURE_TEST_CASE(inline_calls, InlineFixture) {
+  startServer(0);
+  int port = server->getListenPort();
+
+  boost::shared_ptr<transport::TSocket> slowSocket(new transport::TSocket("localhost", port));
+  slowSocket->open();
+  test::InlineServiceClient slowClient(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(slowSocket)));
+  boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  // only reached if getStrings wrongly waits for the worker
+  socket->setRecvTimeout(10000);
+  socket->open();
+  test::InlineServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+
+  // keep the only worker thread busy until getStrings was answered
+  gate.close();
+  slowClient.send_getDataWait(0);
+  while (threadManager->pendingTaskCount() > 0 || threadManager->idleWorkerCount() > 0) {
+    THRIFT_SLEEP_USEC(1000);
+  }
+
+  // getStrings is inline safe, so it does not wait for the worker
+  std::vector<std::string> strings;
+  BOOST_CHECK_NO_THROW(client.getStrings(strings));
+  gate.open();
+
+  std::string data;
+  slowClient.recv_getDataWait(data);
+}
+
+struct NumaFixture : public Fixture {
+  NumaFixture()
+    : threadManager(concurrency::ThreadManager::newSimpleThreadManager(0)),
+      nodeThreadManager(concurrency::ThreadManager::newSimpleThreadManager(1)) {
+    threadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+    threadManager->start();
+    nodeThreadManager->threadFactory(boost::make_shared<concurrency::PlatformThreadFactory>());
+    nodeThreadManager->start();
+  }
+
+  virtual void configureServer(server::TNonblockingServer& s) {
+    s.setNumIOThreads(1);
+    s.setThreadManager(threadManager);
+    s.setUseNumaAffinity(true);
+    s.setNumaThreadManager(0, nodeThreadManager);
+  }
+
+  boost::shared_ptr<concurrency::ThreadManager> threadManager;
+  boost::shared_ptr<concurrency::ThreadManager> nodeThreadManager;
+};
+
+BOOST_FIXTURE_TEST_CASE(numa_thread_manager, NumaFixture) {
+  startServer(0);
+  BOOST_CHECK(server->getNumaThreadManager(0) == nodeThreadManager);
+  BOOST_CHECK(!server->getNumaThreadManager(1));
+
+  boost::shared_ptr<transport::TSocket> socket(
+      new transport::TSocket("localhost", server->getListenPort()));
+  socket->setRecvTimeout(5000);
+  socket->open();
+  test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+
+  // the default thread manager has no workers, only the node's one can answer
+  std::string data;
+  client.getDataWait(data, 0);
+  BOOST_CHECK_EQUAL(0u, threadManager->pendingTaskCount());
+}
+
+struct NumaDrainFixture : public NumaFixture {
+  virtual void configureServer(server::TNonblockingServer& s) {
+    NumaFixture::configureServer(s);
+    s.setMaxConnections(1);
+    s.setOverloadAction(server::T_OVERLOAD_DRAIN_TASK_QUEUE);
+  }
+};
+
+BOOST_FIXTURE_TEST_CASE(numa_drain_task_queue, NumaDrainFixture) {
+  startServer(0);
+  int port = server->getListenPort();
+
+  boost::shared_ptr<transport::TSocket> busySocket(new transport::TSocket("localhost", port));
+  busySocket->open();
+  test::ParentServiceClient busyClient(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(busySocket)));
+  boost::shared_ptr<transport::TSocket> queuedSocket(new transport::TSocket("localhost", port));
+  queuedSocket->setRecvTimeout(5000);
+  queuedSocket->open();
+  test::ParentServiceClient queuedClient(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(queuedSocket)));
+
+  // keep the node's only worker busy and queue a second call behind it
+  gate.close();
+  busyClient.send_getDataWait(-1);
+  while (nodeThreadManager->idleWorkerCount() > 0) {
+    THRIFT_SLEEP_USEC(1000);
+  }
+  queuedClient.send_getDataWait(-1);
+  while (nodeThreadManager->pendingTaskCount() == 0) {
+    THRIFT_SLEEP_USEC(1000);
+  }
+
+  // the overloaded server sheds the queued call to accept a new connection
+  boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->setRecvTimeout(5000);
+  socket->open();
+  test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+  std::string data;
+  BOOST_CHECK_THROW(queuedClient.recv_getDataWait(data), transport::TTransportException);
+  BOOST_CHECK_EQUAL(0u, nodeThreadManager->pendingTaskCount());
+
+  gate.open();
+  busyClient.recv_getDataWait(data);
+  BOOST_CHECK_NO_THROW(client.getDataWait(data, 0));
+}
+
+struct EpollFixture : public Fixture {
+  virtual void configureServer(server::TNonblockingServer& s) {
+    s.setEventLoopBackend(server::T_EVENT_LOOP_EPOLL_ET);
+  }
+};
+
+BOOST_FIXTURE_TEST_CASE(epoll_event_loop, EpollFixture) {
+  startServer(0);
+  int port = server->getListenPort();
+
+  boost::shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->open();
+  test::ParentServiceClient client(boost::make_shared<protocol::TBinaryProtocol>(
+      boost::make_shared<transport::TFramedTransport>(socket)));
+
+  // too big for a single read or write, so readiness has to be tracked
+  // across partial transfers
+  std::string big(1024 * 1024, 'x');
+  client.addString(big);
+  for (int i = 0; i < 20; ++i) {
+    std::vector<std::string> strings;
+    client.getStrings(strings);
+    BOOST_REQUIRE_EQUAL(strings.size(), 1u);
+    BOOST_CHECK(strings[0] == big);
+  }
+
+#ifdef HAVE_SYS_EPOLL_H
+  // registered once, however often the connection switched direction
+  BOOST_CHECK_EQUAL(server->getNumEventChanges(), 1u);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(buffer_pool) {
+  server::TBufferPool pool(8192);
+  uint32_t capacity;
+
+  // sizes are rounded up to the next size class
+  uint8_t* buf = pool.borrow(1500, &capacity);
+  BOOST_CHECK_EQUAL(capacity, 2048u);
+  BOOST_CHECK_EQUAL(pool.getBytesInUse(), 2048u);
+  pool.giveBack(buf, capacity);
+  BOOST_CHECK_EQUAL(pool.getBytesInUse(), 0u);
+  BOOST_CHECK_EQUAL(pool.getBytesCached(), 2048u);
+
+  // and reused
+  BOOST_CHECK(pool.borrow(2000, &capacity) == buf);
+  pool.giveBack(buf, capacity);
+
+  // buffers that would exceed the cache limit go back to the heap
+  buf = pool.borrow(8192, &capacity);
+  pool.giveBack(buf, capacity);
+  BOOST_CHECK_EQUAL(pool.getBytesCached(), 2048u);
+
+  // as do the ones too large to pool
+  buf = pool.borrow(server::TBufferPool::MAX_POOLED_SIZE + 1, &capacity);
+  BOOST_CHECK_EQUAL(capacity, server::TBufferPool::MAX_POOLED_SIZE + 1);
+  pool.giveBack(buf, capacity);
+  BOOST_CHECK_EQUAL(pool.getBytesInUse(), 0u);
+  BOOST_CHECK_EQUAL(pool.getBytesCached(), 2048u);
+
+  pool.setMaxCachedBytes(0);
+  BOOST_CHECK_EQUAL(pool.getBytesCached(), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(buffer_memory_returned, Fixture) {
+  startServer(0);
+  int port = server->getListenPort();
+  BOOST_REQUIRE(canCommunicate(port));
+  // read buffers are only borrowed while a frame is in flight
+  THRIFT_SLEEP_USEC(50000);
+  BOOST_CHECK_EQUAL(server->getBufferMemoryInUse(), 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
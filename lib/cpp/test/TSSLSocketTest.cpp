@@ -0,0 +1,240 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TSSLSocketTest
+#include <boost/test/unit_test.hpp>
+#include <boost/smart_ptr.hpp>
+
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "thrift/concurrency/PlatformThreadFactory.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/transport/TSSLSocket.h"
+
+using namespace apache::thrift;
+using apache::thrift::transport::TSSLSocket;
+using apache::thrift::transport::TSSLSocketFactory;
+
+namespace {
+
+// Anonymous key exchange keeps the test free of certificate files; the
+// record cipher is one the kernel can take over.
+const char* CIPHERS = "ADH-AES128-GCM-SHA256:@SECLEVEL=0";
+
+std::string pattern(uint32_t size, int seed) {
+  std::string str(size, '\0');
+  for (uint32_t i = 0; i < size; ++i) {
+    str[i] = static_cast<char>(i * 31 + seed);
+  }
+  return str;
+}
+
+class AnonymousSocketFactory : public TSSLSocketFactory {
+public:
+  AnonymousSocketFactory() : TSSLSocketFactory(transport::TLSv1_2) {
+    authenticate(false);
+    ciphers(CIPHERS);
+    // anonymous Diffie-Hellman needs parameters on the server
+    SSL_CTX_set_dh_auto(ctx_->get(), 1);
+  }
+};
+
+// Server side: echoes everything back until the client closes
+struct Echo : public concurrency::Runnable {
+  boost::shared_ptr<TSSLSocket> socket;
+  virtual void run() {
+    try {
+      uint8_t buf[4096];
+      while (uint32_t n = socket->read(buf, sizeof(buf))) {
+        socket->write(buf, n);
+        socket->flush();
+      }
+    } catch (const transport::TTransportException&) {
+    }
+    socket->close();
+  }
+};
+
+std::string ticketKey(char seed) {
+  return std::string(transport::SSLContext::TICKET_KEY_SIZE, seed);
+}
+
+// Listens on a loopback TCP port; kernel TLS does not work on unix sockets
+class Fixture {
+protected:
+  Fixture()
+    : serverFactory(new AnonymousSocketFactory), clientFactory(new AnonymousSocketFactory) {
+    serverFactory->server(true);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE(listener >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    BOOST_REQUIRE_EQUAL(0, bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    BOOST_REQUIRE_EQUAL(0, listen(listener, 1));
+    BOOST_REQUIRE_EQUAL(0, getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len));
+    port = ntohs(addr.sin_port);
+  }
+
+  ~Fixture() {
+    disconnect();
+    ::close(listener);
+  }
+
+  void connect() {
+    disconnect();
+    client = clientFactory->createSocket("127.0.0.1", port);
+    client->open();
+    int fd = accept(listener, NULL, NULL);
+    BOOST_REQUIRE(fd >= 0);
+    boost::shared_ptr<Echo> echo(new Echo);
+    echo->socket = server = serverFactory->createSocket(fd);
+    thread = concurrency::PlatformThreadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+                 concurrency::PlatformThreadFactory::OTHER,
+                 concurrency::PlatformThreadFactory::NORMAL,
+                 1,
+#endif
+                 false).newThread(echo);
+    thread->start();
+  }
+
+  void disconnect() {
+    if (client) {
+      client->close();
+      client.reset();
+    }
+    if (thread) {
+      thread->join();
+      thread.reset();
+    }
+  }
+
+  // Connects, exchanges a message and disconnects again; returns whether
+  // the session was resumed
+  bool handshake() {
+    uint64_t resumed = serverFactory->getResumedHandshakes();
+    connect();
+    BOOST_CHECK(roundTrip("ping") == "ping");
+    disconnect();
+    return serverFactory->getResumedHandshakes() > resumed;
+  }
+
+  std::string roundTrip(const std::string& data) {
+    client->write(reinterpret_cast<const uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+    client->flush();
+    std::string got(data.size(), '\0');
+    client->readAll(reinterpret_cast<uint8_t*>(&got[0]), static_cast<uint32_t>(got.size()));
+    return got;
+  }
+
+  boost::shared_ptr<TSSLSocketFactory> serverFactory;
+  boost::shared_ptr<TSSLSocketFactory> clientFactory;
+  boost::shared_ptr<TSSLSocket> client;
+  boost::shared_ptr<TSSLSocket> server;
+
+private:
+  int listener;
+  int port;
+  boost::shared_ptr<concurrency::Thread> thread;
+};
+}
+
+BOOST_AUTO_TEST_SUITE(TSSLSocketTest)
+
+BOOST_FIXTURE_TEST_CASE(user_space_tls, Fixture) {
+  connect();
+  std::string data = pattern(100000, 1);
+  BOOST_CHECK(roundTrip(data) == data);
+  BOOST_CHECK(!client->kernelTLS());
+  BOOST_CHECK(!client->kernelTLSSend());
+  BOOST_CHECK(!client->kernelTLSRecv());
+}
+
+BOOST_FIXTURE_TEST_CASE(kernel_tls, Fixture) {
+  serverFactory->kernelTLS(true);
+  clientFactory->kernelTLS(true);
+  connect();
+  BOOST_CHECK(client->kernelTLS());
+
+  // whether or not the kernel took over, the bytes arrive unchanged
+  std::string data = pattern(100000, 2);
+  BOOST_CHECK(roundTrip(data) == data);
+  BOOST_TEST_MESSAGE("kernel TLS send " << client->kernelTLSSend() << ", receive "
+                                        << client->kernelTLSRecv());
+
+  std::vector<TBufferSlice> slices;
+  std::string expected;
+  for (int i = 0; i < 20; ++i) {
+    slices.push_back(TBufferSlice(pattern(1000 + i, i)));
+    expected += slices.back().str();
+  }
+  client->writeSlices(&slices[0], static_cast<uint32_t>(slices.size()));
+  client->flush();
+  std::string got(expected.size(), '\0');
+  client->readAll(reinterpret_cast<uint8_t*>(&got[0]), static_cast<uint32_t>(got.size()));
+  BOOST_CHECK(expected == got);
+
+  // the session ends with an orderly close_notify in either mode
+  disconnect();
+}
+
+BOOST_FIXTURE_TEST_CASE(session_resumption, Fixture) {
+  BOOST_CHECK(clientFactory->sessionCache());
+  BOOST_CHECK(!handshake());
+  BOOST_CHECK(handshake());
+  BOOST_CHECK(handshake());
+  BOOST_CHECK_EQUAL(1u, serverFactory->getFullHandshakes());
+  BOOST_CHECK_EQUAL(2u, serverFactory->getResumedHandshakes());
+  BOOST_CHECK_EQUAL(1u, clientFactory->getFullHandshakes());
+  BOOST_CHECK_EQUAL(2u, clientFactory->getResumedHandshakes());
+
+  clientFactory->sessionCache(false);
+  BOOST_CHECK(!handshake());
+}
+
+BOOST_FIXTURE_TEST_CASE(ticket_key_rotation, Fixture) {
+  serverFactory->ticketKeys(std::vector<std::string>(1, ticketKey('a')));
+  BOOST_CHECK(!handshake());
+  BOOST_CHECK(handshake());
+
+  // tickets under the previous key still resume, and are reissued under
+  // the new one
+  serverFactory->rotateTicketKey(ticketKey('b'));
+  BOOST_CHECK(handshake());
+  serverFactory->rotateTicketKey(ticketKey('c'));
+  BOOST_CHECK(handshake());
+
+  // once the key is retired its tickets are rejected
+  serverFactory->ticketKeys(std::vector<std::string>(1, ticketKey('d')));
+  BOOST_CHECK(!handshake());
+  BOOST_CHECK(handshake());
+
+  BOOST_CHECK_THROW(serverFactory->ticketKeys(std::vector<std::string>(1, "short")),
+                    transport::TTransportException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <boost/test/auto_unit_test.hpp>
+#include <fcntl.h>
+#include <string>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocket.h>
+
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE(TServerSocketTest)
+
+#ifdef SO_REUSEPORT
+BOOST_AUTO_TEST_CASE(test_reuse_port) {
+  TServerSocket first(0);
+  first.setReusePort(true);
+  first.listen();
+
+  TServerSocket second(first.getPort());
+  second.setReusePort(true);
+  BOOST_CHECK_NO_THROW(second.listen());
+
+  // every socket on the port has to ask for it
+  TServerSocket third(first.getPort());
+  BOOST_CHECK_THROW(third.listen(), TTransportException);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(test_fast_open) {
+  TServerSocket server(0);
+  server.setTcpFastOpen(16);
+  server.listen();
+
+  // the second connection may carry its data in the SYN
+  for (int i = 0; i < 2; ++i) {
+    TSocket client("127.0.0.1", server.getPort());
+    client.setTcpFastOpen(true);
+    client.open();
+    client.write(reinterpret_cast<const uint8_t*>("ping"), 4);
+    client.flush();
+
+    shared_ptr<TTransport> accepted = server.accept();
+    uint8_t buf[4];
+    accepted->readAll(buf, sizeof(buf));
+    BOOST_CHECK_EQUAL("ping", std::string(reinterpret_cast<char*>(buf), sizeof(buf)));
+
+#ifdef HAVE_ACCEPT4
+    int fd = boost::dynamic_pointer_cast<TSocket>(accepted)->getSocketFD();
+    BOOST_CHECK(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+    BOOST_CHECK(!(fcntl(fd, F_GETFL) & O_NONBLOCK));
+#endif
+    accepted->close();
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,353 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TShmTransportTest
+#include <boost/test/unit_test.hpp>
+#include <boost/smart_ptr.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "thrift/concurrency/Mutex.h"
+#include "thrift/concurrency/PlatformThreadFactory.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadManager.h"
+#include "thrift/concurrency/Util.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/server/TSimpleServer.h"
+#include "thrift/server/TThreadPoolServer.h"
+#include "thrift/transport/TShmTransport.h"
+#include "thrift/transport/TSocket.h"
+
+#include "gen-cpp/ParentService.h"
+
+using namespace apache::thrift;
+using apache::thrift::transport::TShmServerTransport;
+using apache::thrift::transport::TShmTransport;
+
+struct Handler : public test::ParentServiceIf {
+  void addString(const std::string& s) {
+    concurrency::Guard g(mutex_);
+    strings_.push_back(s);
+  }
+  void getStrings(std::vector<std::string>& _return) {
+    concurrency::Guard g(mutex_);
+    _return = strings_;
+  }
+  int32_t incrementGeneration() { return 0; }
+  int32_t getGeneration() { return 0; }
+
+  // dummy overrides not used in this test
+  void getDataWait(std::string&, int32_t) {}
+  void onewayWait() {}
+  void exceptionWait(const std::string&) {}
+  void unexpectedExceptionWait(const std::string&) {}
+
+  concurrency::Mutex mutex_;
+  std::vector<std::string> strings_;
+};
+
+std::string socketPath(const char* name) {
+  std::ostringstream path;
+  path << "/tmp/TShmTransportTest." << getpid() << "." << name;
+  unlink(path.str().c_str());
+  return path.str();
+}
+
+/**
+ * A client that maps the region handed out by a TShmServerTransport without
+ * a TShmTransport, so it can scribble over the indices. The offsets mirror
+ * TShmTransport::Region: a 64 byte header, then two rings of three cache
+ * lines each with head and tail on the first two.
+ */
+class RawPeer {
+public:
+  enum Index { SERVER_HEAD = 64, SERVER_TAIL = 128, CLIENT_HEAD = 256, CLIENT_TAIL = 320 };
+
+  RawPeer(const std::string& path) : control_(path), region_(NULL), size_(0) {
+    control_.open();
+  }
+
+  ~RawPeer() {
+    if (region_ != NULL) {
+      munmap(region_, size_);
+    }
+  }
+
+  // must be called after the server accepted the connection
+  void map() {
+    uint32_t hello[2];
+    struct iovec iov;
+    iov.iov_base = hello;
+    iov.iov_len = sizeof(hello);
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    BOOST_REQUIRE_EQUAL(static_cast<ssize_t>(sizeof(hello)),
+                        recvmsg(control_.getSocketFD(), &msg, 0));
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    BOOST_REQUIRE(cmsg != NULL);
+    int fd;
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+    size_ = 64 + 2 * 192 + 2 * static_cast<size_t>(hello[1]);
+    region_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    BOOST_REQUIRE(region_ != MAP_FAILED);
+  }
+
+  void set(Index index, uint32_t value) {
+    *reinterpret_cast<volatile uint32_t*>(static_cast<char*>(region_) + index) = value;
+  }
+
+private:
+  transport::TSocket control_;
+  void* region_;
+  size_t size_;
+};
+
+class Fixture {
+private:
+  struct Runner : public concurrency::Runnable {
+    boost::shared_ptr<server::TServer> server;
+    virtual void run() { server->serve(); }
+  };
+
+protected:
+  Fixture() : processor(new test::ParentServiceProcessor(boost::make_shared<Handler>())) {}
+
+  ~Fixture() {
+    if (server) {
+      server->stop();
+    }
+    if (thread) {
+      thread->join();
+    }
+  }
+
+  void startServer(const boost::shared_ptr<server::TServer>& s) {
+    server = s;
+    boost::shared_ptr<Runner> runner(new Runner);
+    runner->server = server;
+    thread = threadFactory().newThread(runner);
+    thread->start();
+  }
+
+  static concurrency::PlatformThreadFactory threadFactory() {
+    return concurrency::PlatformThreadFactory(
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+        concurrency::PlatformThreadFactory::OTHER,
+        concurrency::PlatformThreadFactory::NORMAL,
+        1,
+#endif
+        false);
+  }
+
+  boost::shared_ptr<TShmTransport> connect(const std::string& path) {
+    boost::shared_ptr<TShmTransport> transport(new TShmTransport(path));
+    // the server may not have reached listen() yet
+    for (int i = 0;; ++i) {
+      try {
+        transport->open();
+        return transport;
+      } catch (const transport::TTransportException&) {
+        if (i == 100) {
+          throw;
+        }
+        THRIFT_SLEEP_USEC(10000);
+      }
+    }
+  }
+
+  boost::shared_ptr<test::ParentServiceClient> client(const boost::shared_ptr<TShmTransport>& t) {
+    return boost::make_shared<test::ParentServiceClient>(
+        boost::make_shared<protocol::TBinaryProtocol>(t));
+  }
+
+  boost::shared_ptr<test::ParentServiceProcessor> processor;
+  boost::shared_ptr<server::TServer> server;
+
+private:
+  boost::shared_ptr<concurrency::Thread> thread;
+};
+
+BOOST_AUTO_TEST_SUITE(TShmTransportTest)
+
+BOOST_FIXTURE_TEST_CASE(simple_server, Fixture) {
+  if (!TShmTransport::isSupported()) {
+    BOOST_TEST_MESSAGE("shared memory transport not supported, skipping");
+    return;
+  }
+  std::string path = socketPath("simple");
+  // rings much smaller than the messages, so both sides wrap around and
+  // wait for each other
+  boost::shared_ptr<TShmServerTransport> serverTransport(new TShmServerTransport(path, 4096));
+  startServer(boost::make_shared<server::TSimpleServer>(
+      processor,
+      serverTransport,
+      boost::make_shared<transport::TTransportFactory>(),
+      boost::make_shared<protocol::TBinaryProtocolFactory>()));
+
+  boost::shared_ptr<TShmTransport> transport = connect(path);
+  BOOST_CHECK_EQUAL(4096u, transport->getRingSize());
+  boost::shared_ptr<test::ParentServiceClient> c = client(transport);
+
+  const std::string big(1024 * 1024 + 17, 'x');
+  c->addString("foo");
+  c->addString(big);
+  std::vector<std::string> strings;
+  c->getStrings(strings);
+  BOOST_REQUIRE_EQUAL(2u, strings.size());
+  BOOST_CHECK_EQUAL("foo", strings[0]);
+  BOOST_CHECK(strings[1] == big);
+
+  transport->close();
+  BOOST_CHECK(!transport->isOpen());
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_pool_server, Fixture) {
+  if (!TShmTransport::isSupported()) {
+    BOOST_TEST_MESSAGE("shared memory transport not supported, skipping");
+    return;
+  }
+  std::string path = socketPath("pool");
+  boost::shared_ptr<concurrency::ThreadManager> threadManager
+      = concurrency::ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(
+      boost::make_shared<concurrency::PlatformThreadFactory>(threadFactory()));
+  threadManager->start();
+  startServer(boost::make_shared<server::TThreadPoolServer>(
+      processor,
+      boost::make_shared<TShmServerTransport>(path),
+      boost::make_shared<transport::TTransportFactory>(),
+      boost::make_shared<protocol::TBinaryProtocolFactory>(),
+      threadManager));
+
+  std::vector<boost::shared_ptr<TShmTransport> > transports;
+  for (int i = 0; i < 4; ++i) {
+    transports.push_back(connect(path));
+    transports.back()->setSpinCount(i % 2 ? 0 : TShmTransport::DEFAULT_SPIN_COUNT);
+  }
+  for (int round = 0; round < 50; ++round) {
+    for (size_t i = 0; i < transports.size(); ++i) {
+      client(transports[i])->addString("s");
+    }
+  }
+  std::vector<std::string> strings;
+  client(transports[0])->getStrings(strings);
+  BOOST_CHECK_EQUAL(200u, strings.size());
+
+  for (size_t i = 0; i < transports.size(); ++i) {
+    transports[i]->close();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(peer_in_another_process) {
+  if (!TShmTransport::isSupported()) {
+    BOOST_TEST_MESSAGE("shared memory transport not supported, skipping");
+    return;
+  }
+  std::string path = socketPath("fork");
+  TShmServerTransport serverTransport(path, 8192);
+  serverTransport.listen();
+
+  pid_t pid = fork();
+  BOOST_REQUIRE(pid >= 0);
+  if (pid == 0) {
+    // child: echo one message and exit without closing the transport
+    int status = 1;
+    try {
+      TShmTransport transport(path);
+      transport.open();
+      uint8_t buf[5];
+      transport.readAll(buf, sizeof(buf));
+      transport.write(buf, sizeof(buf));
+      transport.flush();
+      status = 0;
+    } catch (...) {
+    }
+    _exit(status);
+  }
+
+  boost::shared_ptr<transport::TTransport> accepted = serverTransport.accept();
+  accepted->write(reinterpret_cast<const uint8_t*>("hello"), 5);
+  accepted->flush();
+  uint8_t buf[5];
+  accepted->readAll(buf, sizeof(buf));
+  BOOST_CHECK_EQUAL("hello", std::string(reinterpret_cast<char*>(buf), sizeof(buf)));
+
+  // the child goes away without closing; reads then hit EOF
+  int status;
+  BOOST_REQUIRE_EQUAL(pid, waitpid(pid, &status, 0));
+  BOOST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  BOOST_CHECK(!accepted->peek());
+  BOOST_CHECK_EQUAL(0u, accepted->read(buf, sizeof(buf)));
+  accepted->close();
+  serverTransport.close();
+}
+
+BOOST_AUTO_TEST_CASE(corrupted_indices) {
+  if (!TShmTransport::isSupported()) {
+    BOOST_TEST_MESSAGE("shared memory transport not supported, skipping");
+    return;
+  }
+  std::string path = socketPath("corrupt");
+  TShmServerTransport serverTransport(path, 4096);
+  serverTransport.listen();
+
+  // a head more than a ring ahead of the tail must not be read from
+  RawPeer reader(path);
+  boost::shared_ptr<transport::TTransport> accepted = serverTransport.accept();
+  reader.map();
+  reader.set(RawPeer::SERVER_HEAD, 4096 + 1);
+  uint8_t buf[16];
+  try {
+    accepted->read(buf, sizeof(buf));
+    BOOST_ERROR("read() did not notice the corrupted head");
+  } catch (const transport::TTransportException& ttx) {
+    BOOST_CHECK_EQUAL(transport::TTransportException::CORRUPTED_DATA, ttx.getType());
+  }
+  BOOST_CHECK(!accepted->isOpen());
+
+  // nor may a tail that leaves more than a ring of room be written to
+  RawPeer writer(path);
+  accepted = serverTransport.accept();
+  writer.map();
+  writer.set(RawPeer::CLIENT_TAIL, 0x80000000u);
+  try {
+    accepted->write(buf, sizeof(buf));
+    BOOST_ERROR("write() did not notice the corrupted tail");
+  } catch (const transport::TTransportException& ttx) {
+    BOOST_CHECK_EQUAL(transport::TTransportException::CORRUPTED_DATA, ttx.getType());
+  }
+  BOOST_CHECK(!accepted->isOpen());
+
+  serverTransport.close();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
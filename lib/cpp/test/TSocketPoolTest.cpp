@@ -0,0 +1,196 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <string>
+#include <vector>
+#include <thrift/transport/TConnectionPool.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocketPool.h>
+
+using apache::thrift::transport::TConnectionLease;
+using apache::thrift::transport::TConnectionPool;
+using apache::thrift::transport::TLatencyPolicy;
+using apache::thrift::transport::TLeastOutstandingPolicy;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocketPool;
+using apache::thrift::transport::TSocketPoolServer;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TWeightedRoundRobinPolicy;
+using boost::shared_ptr;
+
+namespace {
+
+typedef std::vector<shared_ptr<TSocketPoolServer> > ServerList;
+
+ServerList makeServers(int count) {
+  ServerList servers;
+  for (int i = 0; i < count; ++i) {
+    servers.push_back(shared_ptr<TSocketPoolServer>(new TSocketPoolServer("127.0.0.1", 9000 + i)));
+  }
+  return servers;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TSocketPoolTest)
+
+BOOST_AUTO_TEST_CASE(test_record_latency) {
+  TSocketPoolServer server;
+  BOOST_CHECK_EQUAL(0, server.getLatency());
+  server.recordLatency(1000);
+  BOOST_CHECK_EQUAL(1000, server.getLatency());
+  for (int i = 0; i < 100; ++i) {
+    server.recordLatency(100);
+  }
+  BOOST_CHECK(server.getLatency() > 99 && server.getLatency() < 101);
+}
+
+BOOST_AUTO_TEST_CASE(test_weighted_round_robin) {
+  ServerList servers = makeServers(3);
+  servers[0]->weight_ = 5;
+  TWeightedRoundRobinPolicy policy;
+
+  std::string picks;
+  for (int i = 0; i < 7; ++i) {
+    ServerList order = servers;
+    policy.order(order);
+    BOOST_CHECK_EQUAL(3u, order.size());
+    picks += static_cast<char>('a' + (order[0]->port_ - 9000));
+  }
+  BOOST_CHECK_EQUAL("aabacaa", picks);
+
+  // a weight of 0 takes the server out of rotation
+  servers[0]->weight_ = 0;
+  picks.clear();
+  for (int i = 0; i < 4; ++i) {
+    ServerList order = servers;
+    policy.order(order);
+    BOOST_CHECK(order[2] == servers[0]);
+    picks += static_cast<char>('a' + (order[0]->port_ - 9000));
+  }
+  BOOST_CHECK_EQUAL("bcbc", picks);
+}
+
+BOOST_AUTO_TEST_CASE(test_least_outstanding) {
+  ServerList servers = makeServers(3);
+  servers[0]->outstanding_ = 3;
+  servers[1]->outstanding_ = 0;
+  servers[2]->outstanding_ = 2;
+  TLeastOutstandingPolicy policy;
+  for (int i = 0; i < 10; ++i) {
+    ServerList order = servers;
+    policy.order(order);
+    BOOST_CHECK(order[0] == servers[1]);
+    BOOST_CHECK(order[1] == servers[2]);
+    BOOST_CHECK(order[2] == servers[0]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_latency) {
+  ServerList servers = makeServers(2);
+  servers[0]->recordLatency(1000);
+  servers[1]->recordLatency(100);
+  TLatencyPolicy policy;
+  for (int i = 0; i < 10; ++i) {
+    ServerList order = servers;
+    policy.order(order);
+    BOOST_CHECK(order[0] == servers[1]);
+  }
+
+  // a fast server that is busy loses to an idle slow one
+  servers[1]->outstanding_ = 20;
+  for (int i = 0; i < 10; ++i) {
+    ServerList order = servers;
+    policy.order(order);
+    BOOST_CHECK(order[0] == servers[0]);
+  }
+
+  // of many servers the slowest one never comes first
+  servers = makeServers(5);
+  for (size_t i = 0; i < servers.size(); ++i) {
+    servers[i]->recordLatency(100 * (i + 1));
+  }
+  for (int i = 0; i < 50; ++i) {
+    ServerList order = servers;
+    policy.order(order);
+    BOOST_CHECK(order[0] != servers[4]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_socket_pool_stats) {
+  TServerSocket server(0);
+  server.listen();
+  TSocketPool pool("127.0.0.1", server.getPort());
+  pool.setPolicy(shared_ptr<TLatencyPolicy>(new TLatencyPolicy));
+  pool.open();
+  shared_ptr<TTransport> peer = server.accept();
+
+  ServerList servers;
+  pool.getServers(servers);
+  BOOST_CHECK(servers[0]->getLatency() > 0);
+  servers[0]->latency_ = 0;
+
+  uint8_t byte = 1;
+  pool.write(&byte, 1);
+  pool.write(&byte, 1);
+  BOOST_CHECK_EQUAL(1, servers[0]->outstanding_);
+  peer->readAll(&byte, 1);
+  peer->write(&byte, 1);
+  peer->flush();
+  BOOST_CHECK_EQUAL(1u, pool.read(&byte, 1));
+  BOOST_CHECK_EQUAL(0, servers[0]->outstanding_);
+  BOOST_CHECK(servers[0]->getLatency() > 0);
+
+  // a call cut short by close counts as no longer outstanding
+  pool.write(&byte, 1);
+  BOOST_CHECK_EQUAL(1, servers[0]->outstanding_);
+  pool.close();
+  BOOST_CHECK_EQUAL(0, servers[0]->outstanding_);
+  peer->close();
+  server.close();
+}
+
+BOOST_AUTO_TEST_CASE(test_connection_pool_stats) {
+  TServerSocket server(0);
+  server.listen();
+  shared_ptr<TSocketPoolServer> target(new TSocketPoolServer("127.0.0.1", server.getPort()));
+  TConnectionPool pool(ServerList(1, target));
+  pool.setPolicy(shared_ptr<TLeastOutstandingPolicy>(new TLeastOutstandingPolicy));
+
+  TConnectionLease first = pool.checkout();
+  shared_ptr<TTransport> peer1 = server.accept();
+  TConnectionLease second = pool.checkout();
+  shared_ptr<TTransport> peer2 = server.accept();
+  BOOST_CHECK_EQUAL(2, target->outstanding_);
+  BOOST_CHECK(target->getLatency() > 0);
+
+  first.recordLatency(5000000);
+  BOOST_CHECK(target->getLatency() > 1000000);
+  first.release();
+  BOOST_CHECK_EQUAL(1, target->outstanding_);
+  second.invalidate();
+  BOOST_CHECK_EQUAL(0, target->outstanding_);
+
+  pool.clear();
+  peer1->close();
+  peer2->close();
+  server.close();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
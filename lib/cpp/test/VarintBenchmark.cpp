@@ -0,0 +1,174 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Throughput of TCompactProtocol lists of ids written and read with the
+// array calls compared to one writeI64()/readI64() per element, as the
+// generated code did before.
+//
+// usage: VarintBenchmark [iterations]
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <time.h>
+
+#include "thrift/concurrency/Util.h"
+#include "thrift/protocol/TCompactProtocol.h"
+#include "thrift/transport/TBufferTransports.h"
+
+using namespace apache::thrift;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+namespace {
+
+const uint32_t LIST_SIZE = 1000;
+
+int64_t nowNsec() {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+  return concurrency::Util::currentTimeUsec() * 1000;
+#endif
+}
+
+// A simple generator so every run sees the same payloads
+struct Random {
+  Random() : state(88172645463325252ULL) {}
+  uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+  uint64_t state;
+};
+
+template <typename Int_>
+struct Calls {
+  uint32_t (TProtocol::*writeArray)(const Int_*, const uint32_t);
+  uint32_t (TProtocol::*readArray)(Int_*, const uint32_t);
+  uint32_t (TProtocol::*writeElement)(const Int_);
+  uint32_t (TProtocol::*readElement)(Int_&);
+};
+
+template <typename Int_>
+void run(const char* name, const std::vector<Int_>& values, const Calls<Int_>& calls, int iterations) {
+  boost::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(LIST_SIZE * 10 + 16));
+  // what TCompactProtocolFactoryT<TBufferBase> hands generated code
+  boost::shared_ptr<TProtocol> protocol(new TCompactProtocolT<TBufferBase>(buffer));
+  boost::shared_ptr<TMemoryBuffer> input(new TMemoryBuffer());
+  boost::shared_ptr<TProtocol> iprot(new TCompactProtocolT<TBufferBase>(input));
+  const uint32_t size = static_cast<uint32_t>(values.size());
+  std::vector<Int_> out(size);
+
+  double rates[4];
+  for (int bulk = 0; bulk < 2; ++bulk) {
+    int64_t start = nowNsec();
+    for (int i = 0; i < iterations; ++i) {
+      buffer->resetBuffer();
+      if (bulk) {
+        ((*protocol).*calls.writeArray)(&values[0], size);
+      } else {
+        for (uint32_t j = 0; j < size; ++j) {
+          ((*protocol).*calls.writeElement)(values[j]);
+        }
+      }
+    }
+    rates[bulk * 2] = static_cast<double>(size) * iterations * 1000 / (nowNsec() - start);
+
+    uint8_t* data;
+    uint32_t length;
+    buffer->getBuffer(&data, &length);
+    std::vector<uint8_t> wire(data, data + length);
+    start = nowNsec();
+    for (int i = 0; i < iterations; ++i) {
+      input->resetBuffer(&wire[0], length);
+      if (bulk) {
+        ((*iprot).*calls.readArray)(&out[0], size);
+      } else {
+        for (uint32_t j = 0; j < size; ++j) {
+          ((*iprot).*calls.readElement)(out[j]);
+        }
+      }
+    }
+    rates[bulk * 2 + 1] = static_cast<double>(size) * iterations * 1000 / (nowNsec() - start);
+    if (out != values) {
+      std::cerr << name << ": values read back differ" << std::endl;
+      std::exit(1);
+    }
+  }
+
+  std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+            << std::setprecision(1) << " write " << std::setw(7) << rates[0] << " -> "
+            << std::setw(7) << rates[2] << " M/s   read " << std::setw(7) << rates[1] << " -> "
+            << std::setw(7) << rates[3] << " M/s" << std::endl;
+}
+}
+
+int main(int argc, char** argv) {
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+  if (iterations <= 0) {
+    std::cerr << "usage: " << argv[0] << " [iterations]" << std::endl;
+    return 1;
+  }
+  std::cout << "per element -> array, millions of values per second" << std::endl;
+
+  Calls<int32_t> i32;
+  i32.writeArray = &TProtocol::writeI32Array;
+  i32.readArray = &TProtocol::readI32Array;
+  i32.writeElement = &TProtocol::writeI32;
+  i32.readElement = &TProtocol::readI32;
+  Calls<int64_t> i64;
+  i64.writeArray = &TProtocol::writeI64Array;
+  i64.readArray = &TProtocol::readI64Array;
+  i64.writeElement = &TProtocol::writeI64;
+  i64.readElement = &TProtocol::readI64;
+
+  Random random;
+  std::vector<int32_t> small(LIST_SIZE);
+  std::vector<int32_t> userIds(LIST_SIZE);
+  std::vector<int64_t> snowflakes(LIST_SIZE);
+  std::vector<int64_t> mixed(LIST_SIZE);
+  int64_t timestamp = static_cast<int64_t>(1400000000000LL);
+  for (uint32_t i = 0; i < LIST_SIZE; ++i) {
+    // counts and enum like values
+    small[i] = static_cast<int32_t>(random.next() % 60);
+    // dense 32 bit ids, 4 byte varints
+    userIds[i] = static_cast<int32_t>(random.next() % 100000000);
+    // time ordered 64 bit ids: millisecond timestamp, worker and sequence
+    timestamp += static_cast<int64_t>(random.next() % 1000);
+    snowflakes[i] = (timestamp << 22) | static_cast<int64_t>(random.next() % (1 << 22));
+    // mostly small with the odd large one
+    mixed[i] = random.next() % 8 == 0 ? static_cast<int64_t>(random.next() >> 20)
+                                      : static_cast<int64_t>(random.next() % 100);
+  }
+
+  run("list<i32> small", small, i32, iterations);
+  run("list<i32> user ids", userIds, i32, iterations);
+  run("list<i64> snowflake ids", snowflakes, i64, iterations);
+  run("list<i64> mixed", mixed, i64, iterations);
+  return 0;
+}
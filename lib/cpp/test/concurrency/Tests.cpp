@@ -64,6 +64,12 @@ int main(int argc, char** argv) {
     std::cout << "\t\tThreadFactory monitor timeout test" << std::endl;
 
     assert(threadFactoryTests.monitorTimeoutTest());
+
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+    std::cout << "\t\tThreadFactory affinity test" << std::endl;
+
+    assert(threadFactoryTests.affinityTest());
+#endif
   }
 
   if (runAll || args[0].compare("util") == 0) {
@@ -22,6 +22,7 @@
 #include <thrift/concurrency/PlatformThreadFactory.h>
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/Util.h>
+#include <thrift/concurrency/CpuAffinity.h>
 
 #include <assert.h>
 #include <iostream>
@@ -281,6 +282,76 @@ public:
     return success;
   }
 
+#if !USE_BOOST_THREAD && !USE_STD_THREAD
+  class AffinityTask : public Runnable {
+  public:
+    AffinityTask(Monitor& monitor, int& count) : _monitor(monitor), _count(count) {}
+
+    void run() {
+      Synchronized s(_monitor);
+      _count--;
+      _monitor.notify();
+    }
+
+    Monitor& _monitor;
+    int& _count;
+  };
+
+  /**
+   * Pins threads round-robin over the online CPUs and to NUMA node 0.
+   * Threads that cannot be pinned still run, so this only checks the policy
+   * bookkeeping and that every thread completes.
+   */
+  bool affinityTest(int count = 8) {
+
+    PosixThreadFactory threadFactory;
+    threadFactory.setDetached(false);
+
+    std::vector<int> online = CpuAffinity::getOnlineCpus();
+    threadFactory.setRoundRobinAffinity();
+    if (threadFactory.getAffinity() != PosixThreadFactory::ROUND_ROBIN_CPUS
+        || threadFactory.getAffinityCpus() != online) {
+      return false;
+    }
+
+    Monitor monitor;
+    int activeCount = count;
+    std::vector<shared_ptr<Thread> > threads;
+    for (int ix = 0; ix < count; ix++) {
+      if (ix == count / 2) {
+        threadFactory.setNumaNodeAffinity(0);
+        if (threadFactory.getAffinity() != PosixThreadFactory::NUMA_NODE
+            || threadFactory.getAffinityCpus() != CpuAffinity::getNumaNodeCpus(0)) {
+          return false;
+        }
+      }
+      threads.push_back(
+          threadFactory.newThread(shared_ptr<Runnable>(new AffinityTask(monitor, activeCount))));
+      threads.back()->start();
+    }
+
+    {
+      Synchronized s(monitor);
+      while (activeCount > 0) {
+        monitor.wait(1000);
+      }
+    }
+
+    for (size_t ix = 0; ix < threads.size(); ix++) {
+      threads[ix]->join();
+    }
+
+    threadFactory.clearAffinity();
+    bool success = threadFactory.getAffinity() == PosixThreadFactory::NO_AFFINITY
+                   && CpuAffinity::parseCpuList("0-2,5").size() == 4;
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! " << online.size()
+              << " online CPUs, " << CpuAffinity::getNumaNodeCount() << " NUMA nodes" << std::endl;
+
+    return success;
+  }
+#endif
+
   class FloodTask : public Runnable {
   public:
     FloodTask(const size_t id) : _id(id) {}
@@ -4,6 +4,26 @@ exception MyError {
   1: string message
 }
 
+struct Blob {
+  1: string name
+  2: binary (cpp.type = "apache::thrift::TBufferSlice") data
+}
+
+struct Profile {
+  1: string name
+  2: list<string> tags
+  3: bool verified
+}
+
+struct Request {
+  1: i64 id
+  2: Profile profile (cpp.lazy)
+  3: list<Profile> friends (cpp.lazy)
+  4: map<string, i64> counters (cpp.lazy)
+  5: optional set<i32> flags = [1, 2] (cpp.lazy)
+  6: string note
+}
+
 service ParentService {
   i32 incrementGeneration()
   i32 getGeneration()
@@ -20,3 +40,11 @@ service ChildService extends ParentService {
   i32 setValue(1: i32 value)
   i32 getValue()
 }
+
+// cpp.inline_safe calls for the TNonblockingServer tests, kept apart so that
+// ParentService calls still all go through the server's thread pool
+service InlineService {
+  void addString(1: string s)
+  list<string> getStrings() (cpp.inline_safe = "true")
+  binary getDataWait(1: i32 length)
+}
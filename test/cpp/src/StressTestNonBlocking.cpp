@@ -350,6 +350,9 @@ int main(int argc, char** argv) {
   // Dispatcher
   boost::shared_ptr<Server> serviceHandler(new Server());
 
+  boost::shared_ptr<TNonblockingServer> server;
+  boost::shared_ptr<TNonblockingServer> server2;
+
   if (replayRequests) {
     boost::shared_ptr<Server> serviceHandler(new Server());
     boost::shared_ptr<ServiceProcessor> serviceProcessor(new ServiceProcessor(serviceHandler));
@@ -394,10 +397,8 @@ int main(int argc, char** argv) {
 
     if (serverType == "simple") {
 
-      serverThread = threadFactory->newThread(boost::shared_ptr<TServer>(
-          new TNonblockingServer(serviceProcessor, protocolFactory, port)));
-      serverThread2 = threadFactory->newThread(boost::shared_ptr<TServer>(
-          new TNonblockingServer(serviceProcessor, protocolFactory, port + 1)));
+      server.reset(new TNonblockingServer(serviceProcessor, protocolFactory, port));
+      server2.reset(new TNonblockingServer(serviceProcessor, protocolFactory, port + 1));
 
     } else if (serverType == "thread-pool") {
 
@@ -406,11 +407,12 @@ int main(int argc, char** argv) {
 
       threadManager->threadFactory(threadFactory);
       threadManager->start();
-      serverThread = threadFactory->newThread(boost::shared_ptr<TServer>(
-          new TNonblockingServer(serviceProcessor, protocolFactory, port, threadManager)));
-      serverThread2 = threadFactory->newThread(boost::shared_ptr<TServer>(
-          new TNonblockingServer(serviceProcessor, protocolFactory, port + 1, threadManager)));
+      server.reset(new TNonblockingServer(serviceProcessor, protocolFactory, port, threadManager));
+      server2.reset(
+          new TNonblockingServer(serviceProcessor, protocolFactory, port + 1, threadManager));
     }
+    serverThread = threadFactory->newThread(server);
+    serverThread2 = threadFactory->newThread(server2);
 
     cerr << "Starting the server on port " << port << " and " << (port + 1) << endl;
     serverThread->start();
@@ -526,6 +528,21 @@ int main(int argc, char** argv) {
     cout << "workers :" << workerCount << ", client : " << clientCount << ", loops : " << loopCount
          << ", rate : " << (clientCount * loopCount * 1000) / ((double)(time01 - time00)) << endl;
 
+    if (server && server2) {
+      // Every completed task used to cost one write and one read on the
+      // notification pipe; batched wakeups amortize that over the queue.
+      uint64_t notifications = server->getNumNotifications() + server2->getNumNotifications();
+      uint64_t wakeups = server->getNumNotificationWakeups() + server2->getNumNotificationWakeups();
+      cout << "notifications : " << notifications << ", wakeups : " << wakeups
+           << ", notify syscalls/request : "
+           << (notifications ? (2.0 * wakeups) / notifications : 0.0) << " (pipe: 2)" << endl;
+
+      uint64_t writes = server->getNumWriteSyscalls() + server2->getNumWriteSyscalls();
+      uint64_t bytes = server->getNumBytesWritten() + server2->getNumBytesWritten();
+      cout << "response writes : " << writes << ", bytes : " << bytes
+           << ", bytes/write : " << (writes ? static_cast<double>(bytes) / writes : 0.0) << endl;
+    }
+
     count_map count = serviceHandler->getCount();
     count_map::iterator iter;
     for (iter = count.begin(); iter != count.end(); ++iter) {